@@ -0,0 +1,224 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Paul E. McKenney - What is RCU, Fundamentally? (https://lwn.net/Articles/262464/)
+
+3.3.2 Protecting rarely updated data structures (read-copy-update)
+
+	std::shared_mutex lets readers run concurrently, but every std::shared_lock still writes the reader count
+	inside the mutex, so all reader threads keep bouncing the same cache line between their cores.
+	With millions of reads and a handful of writes the readers end up waiting on each other anyway.
+
+	read-copy-update (RCU) removes the shared write from the read path
+		-> the data is an immutable snapshot published through an atomic pointer
+		-> a reader enters a read-side section (a store to its own cache line) and loads the pointer,
+		   it is wait-free and never blocks a writer or another reader
+		-> a writer copies the current snapshot, modifies the copy and publishes it with one atomic exchange
+		-> the old snapshot is deleted only after a grace period,
+		   i.e. once every reader that could have loaded the old pointer has left its read-side section
+
+	rcu_snapshot.hpp
+		rcu_domain			epoch based grace period detection, one padded slot per reader thread
+		rcu_read_guard		RAII read-side section
+		rcu_snapshot<T>		read() returns a read_ptr to the current snapshot,
+							update(f) / store(v) publish a new snapshot and reclaim the old one
+
+	The cost moves to the writer: a full copy of the data and a wait for the grace period per update.
+	That is a good trade for routing or DNS style tables which are read millions of times per second
+	and written a few times per minute, and a bad one for write heavy data.
+
+Usage
+    ./rcu_rare_update_data [max_threads] [milliseconds_per_run]
+
+**********/
+
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+
+#include "rcu_snapshot.hpp"
+
+using route_table_t = std::unordered_map<std::string, std::string>;
+
+// same data as rare_update_data.cpp, readers never block the writer
+rcu_snapshot<std::vector<std::string>>  vec;
+
+void writer(int num_elems) {
+    vec.update([&](std::vector<std::string> & data){
+        for(int i = 0; i < num_elems; ++i) {
+            data.push_back("val-" + std::to_string(i));
+        }
+    });
+}
+
+void reader(int thread_id) {
+    const auto l_data = vec.read();
+    std::string l_line = "Thread " + std::to_string(thread_id) + '\n';
+    for(auto & elem : *l_data) {
+        l_line += elem + ' ';
+    }
+    std::cout << l_line + '\n';
+}
+
+/*****
+    Benchmark
+        a routing table of 1024 entries, reader threads look up a route in a loop,
+        one writer replaces a route every 10 ms
+        reads per second are compared for std::shared_mutex and rcu_snapshot
+**********/
+
+struct shared_mutex_table_t {
+    route_table_t               m_routes;
+    mutable std::shared_mutex   m_mutex;
+
+    std::size_t lookup(const std::string & key) const {
+        std::shared_lock    l_lock(m_mutex);
+        const auto l_itr = m_routes.find(key);
+        return (l_itr == m_routes.end()) ? 0 : l_itr->second.size();
+    }
+
+    void set(const std::string & key, const std::string & val) {
+        std::lock_guard     l_lock(m_mutex);
+        m_routes[key] = val;
+    }
+};
+
+struct rcu_table_t {
+    rcu_snapshot<route_table_t> m_routes;
+
+    explicit rcu_table_t(route_table_t routes) : m_routes(std::move(routes)) { }
+
+    std::size_t lookup(const std::string & key) const {
+        const auto l_routes = m_routes.read();
+        const auto l_itr    = l_routes->find(key);
+        return (l_itr == l_routes->end()) ? 0 : l_itr->second.size();
+    }
+
+    void set(const std::string & key, const std::string & val) {
+        m_routes.update([&](route_table_t & routes){ routes[key] = val; });
+    }
+};
+
+template<typename Table>
+double reads_per_second(Table & table, const std::vector<std::string> & keys,
+        const std::size_t threads_count, const std::chrono::milliseconds duration) {
+    std::atomic<bool>           l_stop{false};
+    std::atomic<std::size_t>    l_total_reads{0};
+    std::vector<std::thread>    l_threads;
+
+    for(std::size_t t = 0; t < threads_count; ++t) {
+        l_threads.push_back(std::thread([&, t]{
+            std::size_t l_reads = 0, l_sum = 0, l_index = t * 7919;
+            while(not l_stop.load(std::memory_order_relaxed)) {
+                l_sum += table.lookup(keys[l_index++ % keys.size()]);
+                ++l_reads;
+            }
+            l_total_reads.fetch_add(l_reads);
+            if(0 == l_sum) {
+                std::cout << "no route found\n";
+            }
+        }));
+    }
+    std::thread l_writer([&]{
+        std::size_t l_version = 0;
+        while(not l_stop.load(std::memory_order_relaxed)) {
+            table.set(keys[l_version % keys.size()], "10.0.0." + std::to_string(l_version % 256));
+            ++l_version;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    const auto l_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    l_stop.store(true);
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    l_writer.join();
+    return static_cast<double>(l_total_reads.load()) / l_elapsed.count();
+}
+
+int main(int argc, char * argv[]) {
+    {
+        std::thread thr1{writer, 10};
+        thr1.join();
+
+        std::vector<std::thread>    thr_vec;
+        for(int i = 0; i < 4; ++i) {
+            thr_vec.push_back(std::thread(reader, i));
+        }
+        for(auto & th : thr_vec) {
+            th.join();
+        }
+    }
+
+    const std::size_t   max_threads = (argc > 1) ? std::stoul(argv[1]) : 64;
+    const auto          duration    = std::chrono::milliseconds((argc > 2) ? std::stoul(argv[2]) : 200);
+
+    route_table_t               l_routes;
+    std::vector<std::string>    l_keys;
+    for(std::size_t i = 0; i < 1024; ++i) {
+        l_keys.push_back("net-" + std::to_string(i) + ".example.com");
+        l_routes[l_keys.back()] = "10.0." + std::to_string(i / 256) + '.' + std::to_string(i % 256);
+    }
+
+    shared_mutex_table_t    l_mutex_table{l_routes, {}};
+    rcu_table_t             l_rcu_table(l_routes);
+
+    std::cout << std::setw(8) << "threads" << std::setw(20) << "shared_mutex r/s" << std::setw(20) << "rcu r/s" << std::setw(10) << "ratio" << '\n';
+    for(std::size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+        const double l_mutex_rate   = reads_per_second(l_mutex_table, l_keys, threads_count, duration);
+        const double l_rcu_rate     = reads_per_second(l_rcu_table, l_keys, threads_count, duration);
+        std::cout << std::setw(8) << threads_count
+                  << std::setw(20) << static_cast<std::size_t>(l_mutex_rate)
+                  << std::setw(20) << static_cast<std::size_t>(l_rcu_rate)
+                  << std::setw(10) << std::setprecision(3) << (l_rcu_rate / l_mutex_rate) << '\n';
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+rcu_domain gives every reader thread its own 64 byte slot, the read-side section stores the current epoch
+into that slot and clears it at the end, the only cache line written by a reader is its own.
+A writer publishes the new snapshot with an exchange, advances the epoch and waits until
+every slot is either empty or at least the new epoch, after which the old snapshot can be deleted.
+
+With std::shared_mutex every reader does an atomic read-modify-write on the mutex state twice per lookup,
+the reads per second flatten (and often drop) once more threads are added.
+With rcu_snapshot the reads scale with the number of cores until memory bandwidth is the limit.
+
+Readers may keep a read_ptr for longer, the snapshot they see never changes under them,
+but a writer waits for them, so a read_ptr must not be held across blocking calls.
+
+Output (g++ -O2, ./rcu_rare_update_data 64 200 on a single core machine,
+so this only shows the per read cost, the cache line bouncing needs several cores to show up)
+Thread 0
+val-0 val-1 val-2 val-3 val-4 val-5 val-6 val-7 val-8 val-9 
+...
+ threads    shared_mutex r/s             rcu r/s     ratio
+       1            16815527            21196858      1.26
+       2            18021329            21217558      1.18
+       4            17591788            20835871      1.18
+       8            17467302            26536337      1.52
+      16            20121010            24727017      1.23
+      32            27429048            39542054      1.44
+      64            25260422            31664055      1.25
+
+*****/
+
+/*****
+    END OF FILE
+**********/
@@ -0,0 +1,236 @@
+
+#ifndef RCU_SNAPSHOT
+#define RCU_SNAPSHOT
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+    Epoch based read-copy-update domain
+
+    Every reader thread owns one cache-line sized slot, the slot holds the epoch at which
+    the thread entered its read-side section, or 0 while the thread is outside any read-side section.
+    Readers only write their own slot, they never write a cache line shared with other threads.
+
+    synchronize() advances the global epoch and waits until every slot is either 0 or
+    at least the new epoch, after that no reader can still hold a pointer unpublished before the call.
+    retire() defers a delete until the end of the next grace period, without waiting.
+*/
+class rcu_domain {
+    static constexpr std::size_t    max_readers = 256;
+
+    struct alignas(64) reader_slot_t {
+        std::atomic<std::uint64_t>  m_epoch{0};
+        std::atomic<bool>           m_in_use{false};
+    };
+
+    std::array<reader_slot_t, max_readers>  m_slots;
+    alignas(64) std::atomic<std::uint64_t>  m_epoch{1};
+
+    std::mutex                                                      m_retired_mutex;
+    std::vector<std::pair<std::uint64_t, std::function<void()>>>   m_retired;
+
+    // a thread takes a free slot on its first read-side section and gives it back when it exits
+    struct registration_t {
+        reader_slot_t * m_slot      = nullptr;
+        std::size_t     m_depth     = 0;
+
+        ~registration_t() {
+            if(m_slot) {
+                m_slot->m_epoch.store(0);
+                m_slot->m_in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    registration_t & registration() {
+        thread_local registration_t l_reg;
+        if(not l_reg.m_slot) {
+            for(auto & slot : m_slots) {
+                bool l_expected = false;
+                if(slot.m_in_use.compare_exchange_strong(l_expected, true, std::memory_order_acquire)) {
+                    l_reg.m_slot    = &slot;
+                    break;
+                }
+            }
+            if(not l_reg.m_slot) {
+                throw std::runtime_error("rcu_domain: too many reader threads");
+            }
+        }
+        return l_reg;
+    }
+
+    rcu_domain() = default;
+
+    public:
+    rcu_domain(const rcu_domain &)              = delete;
+    rcu_domain & operator=(const rcu_domain &)  = delete;
+
+    ~rcu_domain() {
+        for(auto & retired : m_retired) {
+            retired.second();
+        }
+    }
+
+    // one domain for the whole program, like the rcu of an operating system kernel
+    static rcu_domain & instance() {
+        static rcu_domain   l_domain;
+        return l_domain;
+    }
+
+    // read-side sections may nest, only the outermost one publishes the epoch
+    void read_lock() {
+        registration_t & l_reg = registration();
+        if(0 == l_reg.m_depth++) {
+            // seq_cst store then seq_cst loads of the protected pointer:
+            // the writer either sees this slot or the reader sees the new pointer
+            l_reg.m_slot->m_epoch.store(m_epoch.load());
+        }
+    }
+
+    void read_unlock() {
+        registration_t & l_reg = registration();
+        if(0 == --l_reg.m_depth) {
+            l_reg.m_slot->m_epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    // wait for the end of a grace period, must not be called from a read-side section
+    void synchronize() {
+        const std::uint64_t l_epoch = m_epoch.fetch_add(1) + 1;
+        // every slot, in use or not: a free slot holds 0 and costs one load, while skipping on m_in_use
+        // could miss a reader that just took its slot and already loaded the old pointer
+        for(auto & slot : m_slots) {
+            std::size_t l_spins = 0;
+            for(std::uint64_t l_seen = slot.m_epoch.load(); (0 != l_seen) and (l_seen < l_epoch); l_seen = slot.m_epoch.load()) {
+                if(++l_spins > 64) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        reclaim(l_epoch);
+    }
+
+    // run deleter at the end of the next grace period, the caller does not wait,
+    // the deleter runs in the next synchronize() called by any thread
+    void retire(std::function<void()> deleter) {
+        const std::uint64_t l_epoch = m_epoch.load();
+        std::lock_guard     l_lock(m_retired_mutex);
+        m_retired.emplace_back(l_epoch, std::move(deleter));
+    }
+
+    // run the deleters retired before a grace period that already completed
+    void reclaim(const std::uint64_t completed_epoch) {
+        std::vector<std::function<void()>>  l_ready;
+        {
+            std::lock_guard l_lock(m_retired_mutex);
+            auto l_itr = m_retired.begin();
+            while(l_itr != m_retired.end()) {
+                if(l_itr->first < completed_epoch) {
+                    l_ready.push_back(std::move(l_itr->second));
+                    *l_itr = std::move(m_retired.back());
+                    m_retired.pop_back();
+                } else {
+                    ++l_itr;
+                }
+            }
+        }
+        for(auto & deleter : l_ready) {
+            deleter();
+        }
+    }
+};
+
+class rcu_read_guard {
+    rcu_domain &    m_domain;
+
+    public:
+    explicit rcu_read_guard(rcu_domain & domain = rcu_domain::instance()) : m_domain(domain) {
+        m_domain.read_lock();
+    }
+    ~rcu_read_guard() {
+        m_domain.read_unlock();
+    }
+
+    rcu_read_guard(const rcu_read_guard &)              = delete;
+    rcu_read_guard & operator=(const rcu_read_guard &)  = delete;
+};
+
+/*
+    An immutable snapshot of T published through an atomic pointer
+
+    Readers take a read_ptr, which is a read-side section plus the pointer to the current snapshot,
+    the snapshot stays valid as long as the read_ptr is alive.
+    Writers copy the current snapshot, modify the copy and publish it,
+    the previous snapshot is deleted after a grace period.
+    Writers are serialized with a mutex, readers never take it.
+*/
+template<typename T>
+class rcu_snapshot {
+    std::atomic<const T *>  m_current;
+    std::mutex              m_writer_mutex;
+    rcu_domain &            m_domain;
+
+    public:
+    class read_ptr {
+        rcu_read_guard  m_guard;
+        const T *       m_ptr;
+
+        public:
+        explicit read_ptr(const rcu_snapshot & snapshot)
+            : m_guard(snapshot.m_domain), m_ptr(snapshot.m_current.load()) { }
+
+        const T & operator*() const     { return *m_ptr; }
+        const T * operator->() const    { return m_ptr; }
+    };
+
+    explicit rcu_snapshot(T value = T{}, rcu_domain & domain = rcu_domain::instance())
+        : m_current(new T(std::move(value))), m_domain(domain) { }
+
+    ~rcu_snapshot() {
+        delete m_current.load();
+    }
+
+    rcu_snapshot(const rcu_snapshot &)              = delete;
+    rcu_snapshot & operator=(const rcu_snapshot &)  = delete;
+
+    read_ptr read() const {
+        return read_ptr(*this);
+    }
+
+    // publish a new snapshot, wait for the grace period and delete the old one
+    void store(T value) {
+        publish(std::make_unique<const T>(std::move(value)));
+    }
+
+    // copy the current snapshot, let update modify the copy and publish it
+    template<typename Function>
+    void update(Function update) {
+        std::lock_guard l_lock(m_writer_mutex);
+        auto l_copy = std::make_unique<T>(*m_current.load());
+        update(*l_copy);
+        replace(std::move(l_copy));
+    }
+
+    private:
+    void publish(std::unique_ptr<const T> value) {
+        std::lock_guard l_lock(m_writer_mutex);
+        replace(std::move(value));
+    }
+
+    void replace(std::unique_ptr<const T> value) {
+        std::unique_ptr<const T>    l_old(m_current.exchange(value.release()));
+        m_domain.synchronize();
+    }
+};
+
+#endif  // RCU_SNAPSHOT
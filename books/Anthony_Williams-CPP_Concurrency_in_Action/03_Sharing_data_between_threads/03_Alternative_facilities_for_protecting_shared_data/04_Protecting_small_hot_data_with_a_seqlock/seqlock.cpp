@@ -0,0 +1,305 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Hans-J. Boehm - Can Seqlocks Get Along With Programming Language Memory Models?
+    https://en.wikipedia.org/wiki/Seqlock
+
+3.3 Alternative facilities for protecting shared data
+
+Protecting small, hot data with a seqlock
+	rare_update_data.cpp protects the data with std::shared_mutex and SyncData (10_Parallel_algorithms)
+	uses one std::mutex per integer. For a small value which is written very often and read by many threads
+	(a 64 byte quote snapshot published at MHz rates) both have the same problem:
+	every reader writes the lock, so readers slow each other down and slow the writer down.
+
+	std::atomic<T> is no answer for a T of 64 bytes, it is not lock-free,
+	the implementation (libatomic) protects it with a lock taken by readers too.
+
+	A seqlock has a sequence counter next to the data
+		-> the writer makes the counter odd, writes the data, makes the counter even again
+		-> a reader reads the counter, copies the data, reads the counter again,
+		   if the counter was odd or changed the copy may be torn and the reader retries
+		-> readers do not store anything, the cache line of the data is only written by the writer
+
+	The copy must not be a data race in the C++ memory model, so the data is kept in
+	std::atomic words read and written with memory_order_relaxed, the ordering comes from fences:
+		writer		seq = s + 1 (relaxed), release fence, relaxed stores of the words, seq = s + 2 (release)
+		reader		s1 = seq (acquire), relaxed loads of the words, acquire fence, s2 = seq (relaxed)
+
+	seqlock<T>			single writer, multiple readers
+	mw_seqlock<T>		multiple writers, a writer takes the seqlock by a compare/exchange of an even sequence to odd,
+						readers are unchanged
+
+	The readers may starve if the writer writes continuously, the writer is never blocked by readers.
+
+Usage
+    g++ -std=c++20 -O2 -pthread seqlock.cpp -latomic     (std::atomic<quote_t> needs libatomic)
+    ./seqlock [max_readers] [milliseconds_per_run]
+
+**********/
+
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <type_traits>
+
+template<typename T>
+class seqlock {
+    static_assert(std::is_trivially_copyable_v<T>, "seqlock<T> copies T byte by byte");
+
+    protected:
+    static constexpr std::size_t    words_count = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+    using words_t = std::array<std::uint64_t, words_count>;
+
+    alignas(64) std::atomic<std::uint64_t>              m_seq{0};
+    std::array<std::atomic<std::uint64_t>, words_count> m_words;
+
+    void store_words(const T & val) {
+        words_t l_words{};
+        std::memcpy(l_words.data(), &val, sizeof(T));
+        for(std::size_t i = 0; i < words_count; ++i) {
+            m_words[i].store(l_words[i], std::memory_order_relaxed);
+        }
+    }
+
+    public:
+    explicit seqlock(const T & val = T{}) {
+        store_words(val);
+    }
+
+    seqlock(const seqlock &)                = delete;
+    seqlock & operator=(const seqlock &)    = delete;
+
+    // only one thread may call store() at a time
+    void store(const T & val) {
+        const std::uint64_t l_seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(l_seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(val);
+        m_seq.store(l_seq + 2, std::memory_order_release);
+    }
+
+    // returns false if a write was in progress, val is then unspecified
+    bool try_load(T & val) const {
+        const std::uint64_t l_seq1 = m_seq.load(std::memory_order_acquire);
+        if(l_seq1 & 1) {
+            return false;
+        }
+        words_t l_words;
+        for(std::size_t i = 0; i < words_count; ++i) {
+            l_words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const std::uint64_t l_seq2 = m_seq.load(std::memory_order_relaxed);
+        if(l_seq1 != l_seq2) {
+            return false;
+        }
+        std::memcpy(&val, l_words.data(), sizeof(T));
+        return true;
+    }
+
+    // spins while a write is in progress, yields after a while in case the writer was preempted
+    T load() const {
+        T           l_val;
+        std::size_t l_spins = 0;
+        while(not try_load(l_val)) {
+            if(++l_spins > 64) {
+                std::this_thread::yield();
+            }
+        }
+        return l_val;
+    }
+};
+
+// any number of writers, they exclude each other through the sequence itself
+template<typename T>
+class mw_seqlock : public seqlock<T> {
+    using seqlock<T>::m_seq;
+
+    public:
+    using seqlock<T>::seqlock;
+
+    void store(const T & val) {
+        std::uint64_t   l_seq   = m_seq.load(std::memory_order_relaxed);
+        std::size_t     l_spins = 0;
+        while(true) {
+            if((0 == (l_seq & 1)) and
+               m_seq.compare_exchange_weak(l_seq, l_seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                break;
+            }
+            if(++l_spins > 64) {
+                std::this_thread::yield();
+            }
+            l_seq = m_seq.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        this->store_words(val);
+        m_seq.store(l_seq + 2, std::memory_order_release);
+    }
+};
+
+/*****
+    Benchmark
+        a 64 byte quote, one writer publishes as fast as it can, readers load it in a loop
+        and check that the copy is not torn (every field comes from the same update)
+**********/
+
+struct quote_t {
+    std::uint64_t   m_sequence;
+    double          m_bid;
+    double          m_ask;
+    std::uint64_t   m_bid_size;
+    std::uint64_t   m_ask_size;
+    std::uint64_t   m_timestamp;
+    std::uint64_t   m_instrument;
+    std::uint64_t   m_check;            // m_sequence ^ m_timestamp, detects torn reads
+};
+static_assert(sizeof(quote_t) == 64);
+
+quote_t make_quote(const std::uint64_t seq) {
+    const std::uint64_t l_time = seq * 1000 + 7;
+    return quote_t{seq, 100.0 + static_cast<double>(seq % 100) / 100.0, 100.5 + static_cast<double>(seq % 100) / 100.0,
+                   seq % 1000, seq % 777, l_time, 42, seq ^ l_time};
+}
+
+bool is_consistent(const quote_t & q) {
+    return (q.m_check == (q.m_sequence ^ q.m_timestamp)) and (q.m_timestamp == q.m_sequence * 1000 + 7);
+}
+
+struct shared_mutex_quote_t {
+    quote_t                     m_quote{};
+    mutable std::shared_mutex   m_mutex;
+
+    void store(const quote_t & q)   { std::lock_guard l_lock(m_mutex); m_quote = q; }
+    quote_t load() const            { std::shared_lock l_lock(m_mutex); return m_quote; }
+};
+
+struct atomic_quote_t {
+    std::atomic<quote_t>    m_quote{quote_t{}};
+
+    void store(const quote_t & q)   { m_quote.store(q); }
+    quote_t load() const            { return m_quote.load(); }
+};
+
+struct bench_result_t {
+    double      m_reads;
+    double      m_writes;
+    std::size_t m_torn;
+};
+
+template<typename Holder>
+bench_result_t run_bench(Holder & holder, const std::size_t readers, const std::size_t writers, const std::chrono::milliseconds duration) {
+    std::atomic<bool>           l_stop{false};
+    std::atomic<std::size_t>    l_reads{0}, l_writes{0}, l_torn{0};
+    std::vector<std::thread>    l_threads;
+
+    for(std::size_t w = 0; w < writers; ++w) {
+        l_threads.push_back(std::thread([&]{
+            std::uint64_t l_seq = 1;
+            while(not l_stop.load(std::memory_order_relaxed)) {
+                holder.store(make_quote(l_seq++));
+            }
+            l_writes.fetch_add(l_seq - 1);
+        }));
+    }
+    for(std::size_t r = 0; r < readers; ++r) {
+        l_threads.push_back(std::thread([&]{
+            std::size_t l_count = 0, l_bad = 0;
+            while(not l_stop.load(std::memory_order_relaxed)) {
+                if(not is_consistent(holder.load())) {
+                    ++l_bad;
+                }
+                ++l_count;
+            }
+            l_reads.fetch_add(l_count);
+            l_torn.fetch_add(l_bad);
+        }));
+    }
+    const auto l_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    l_stop.store(true);
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    return { static_cast<double>(l_reads.load()) / l_elapsed.count(), static_cast<double>(l_writes.load()) / l_elapsed.count(), l_torn.load() };
+}
+
+template<typename Holder>
+void report(const char * name, const std::size_t readers, const std::size_t writers, const std::chrono::milliseconds duration) {
+    Holder  l_holder;
+    const auto l_res = run_bench(l_holder, readers, writers, duration);
+    std::cout << std::setw(16) << name << std::setw(8) << readers << std::setw(8) << writers
+              << std::setw(14) << static_cast<std::size_t>(l_res.m_reads)
+              << std::setw(14) << static_cast<std::size_t>(l_res.m_writes)
+              << std::setw(8) << l_res.m_torn << '\n';
+}
+
+int main(int argc, char * argv[]) {
+    const std::size_t   max_readers = (argc > 1) ? std::stoul(argv[1]) : 32;
+    const auto          duration    = std::chrono::milliseconds((argc > 2) ? std::stoul(argv[2]) : 200);
+
+    {
+        atomic_quote_t l_atomic;
+        std::cout << "std::atomic<quote_t> is lock free : " << std::boolalpha << l_atomic.m_quote.is_lock_free() << "\n\n";
+    }
+
+    std::cout << std::setw(16) << "" << std::setw(8) << "readers" << std::setw(8) << "writers"
+              << std::setw(14) << "reads/s" << std::setw(14) << "writes/s" << std::setw(8) << "torn" << '\n';
+    for(std::size_t readers = 1; readers <= max_readers; readers *= 4) {
+        report<seqlock<quote_t>>("seqlock", readers, 1, duration);
+        report<mw_seqlock<quote_t>>("mw_seqlock", readers, 2, duration);
+        report<shared_mutex_quote_t>("shared_mutex", readers, 1, duration);
+        report<atomic_quote_t>("std::atomic", readers, 1, duration);
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+try_load() reads the sequence twice, the acquire load of the first read synchronizes with the release store
+which ended the previous write, so the words read after it are at least that new.
+The acquire fence after the copy orders the copy before the second read of the sequence:
+if a writer had started in between, its first relaxed store of the sequence (ordered before its data stores
+by the release fence) would be visible to the second read, and the copy is discarded.
+
+The quote carries its own check field, the torn column counts loads where the fields come from different updates,
+it must be 0 for all four holders.
+
+On a single core a writer can be preempted in the middle of a write, the readers would then spin
+for their whole time slice, load() yields after a few failed attempts to let the writer finish.
+
+Output (g++ -O2 -latomic, ./seqlock 16 200 on a single core machine, readers and writers share the core)
+std::atomic<quote_t> is lock free : false
+
+                 readers writers       reads/s      writes/s    torn
+         seqlock       1       1      15133811      99082045       0
+      mw_seqlock       1       2       2225743      41180964       0
+    shared_mutex       1       1      21225132      15703127       0
+     std::atomic       1       1      21247419      19112876       0
+         seqlock       4       1      42321596      71056343       0
+      mw_seqlock       4       2      28766346      35957996       0
+    shared_mutex       4       1      43023466       1339743       0
+     std::atomic       4       1      33126115       8506754       0
+         seqlock      16       1      85284072      24965996       0
+      mw_seqlock      16       2      53393401      22359182       0
+    shared_mutex      16       1      41565574        471323       0
+     std::atomic      16       1      29780661       2931532       0
+
+*****/
+
+/*****
+    END OF FILE
+**********/
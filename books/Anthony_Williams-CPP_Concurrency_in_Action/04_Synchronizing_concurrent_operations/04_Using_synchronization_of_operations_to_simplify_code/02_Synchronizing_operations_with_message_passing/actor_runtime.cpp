@@ -0,0 +1,593 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Dmitry Vyukov - Non-intrusive MPSC node-based queue
+    https://www.erlang.org/doc/system/ref_man_processes
+
+4.4.2 Synchronizing operations with message passing
+
+An actor runtime
+	csp.cpp gives every actor its own thread, every message then costs a context switch
+	(the receiver sleeps on a condition variable, the sender wakes it up) and the number of actors
+	is limited by the number of threads the system can run.
+
+	Here many actors share a small pool of worker threads
+		-> every actor has a typed mailbox, a lock-free MPSC queue (mpsc_queue.hpp): any thread can send,
+		   only the worker running the actor pops
+		-> an actor is scheduled (put on a work queue) by the send which makes its mailbox non-empty,
+		   the count of pending messages decides it, an actor is never on two queues at the same time
+		-> an activation handles up to batch messages, then the actor goes back on the queue
+		   if more messages are pending, so one busy actor cannot starve the others
+		-> the workers use the work stealing queues of 9.1.5: a worker pushes the actors it wakes up
+		   on its own queue (the receiver runs next on the same core, the message is still in cache)
+		   and steals from the others when its own queue is empty
+		-> idle workers park with std::atomic::wait, they are woken by the next schedule
+
+	Backpressure
+		a mailbox has a capacity, try_send() fails when it is full, send() retries until it succeeds.
+		A worker blocked in send() runs other actors while it waits (the receiver among them),
+		a thread outside the pool yields.
+		send() from receive() can deadlock when actors send to each other in a cycle: A blocks in
+		send() to a full B while B blocks in send() to a full A, neither activation returns and
+		nobody empties the mailboxes (on one worker B runs nested in A's send() and spins for ever).
+		Inside a cycle use try_send() and keep what did not fit, or give the mailboxes a capacity
+		the cycle cannot fill; send() is for producers outside the cycle, like main() below.
+		The ping-pong pairs below are such a cycle, with one ball per pair a mailbox never fills.
+
+Usage
+    ./actor_runtime [threads] [pairs] [round_trips] [fan_out_messages]
+
+**********/
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <latch>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+
+#include "mpsc_queue.hpp"
+#include "thsafe_queue.hpp"
+
+class actor_system;
+
+class actor_base {
+    friend class actor_system;
+
+   protected:
+    actor_system& m_system;
+
+    explicit actor_base(actor_system& system) : m_system(system) {}
+
+    // one activation, handles a batch of messages
+    virtual void run() = 0;
+
+   public:
+    virtual ~actor_base() = default;
+
+    actor_base(const actor_base&) = delete;
+    actor_base& operator=(const actor_base&) = delete;
+};
+
+// 9.1.5, the owner works at the front, thieves take from the back
+class work_stealing_queue {
+    std::deque<actor_base*> m_queue;
+    mutable std::mutex m_mutex;
+
+   public:
+    void push(actor_base* actor) {
+        const std::lock_guard l_lock(m_mutex);
+        m_queue.push_front(actor);
+    }
+
+    bool try_pop(actor_base*& actor) {
+        const std::lock_guard l_lock(m_mutex);
+        if (m_queue.empty()) {
+            return false;
+        }
+        actor = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+
+    bool try_steal(actor_base*& actor) {
+        const std::lock_guard l_lock(m_mutex);
+        if (m_queue.empty()) {
+            return false;
+        }
+        actor = m_queue.back();
+        m_queue.pop_back();
+        return true;
+    }
+};
+
+class actor_system {
+    std::atomic_bool m_done;
+    std::vector<std::unique_ptr<work_stealing_queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<std::size_t> m_next_queue{0};
+
+    // bumped by every schedule, idle workers wait for it to change
+    alignas(64) std::atomic<std::uint32_t> m_signal{0};
+    alignas(64) std::atomic<int> m_sleepers{0};
+
+    static thread_local actor_system* m_owner;
+    static thread_local std::size_t m_index;
+
+    bool find_pending_task(actor_base*& actor) {
+        const bool l_worker = (this == m_owner);
+        bool l_found = l_worker and m_queues[m_index]->try_pop(actor);
+        for (std::size_t i = 1; (not l_found) and (i <= m_queues.size()); ++i) {
+            l_found = m_queues[(m_index + i) % m_queues.size()]->try_steal(actor);
+        }
+        return l_found;
+    }
+
+    bool run_pending_task() {
+        actor_base* l_actor = nullptr;
+        if (find_pending_task(l_actor)) {
+            l_actor->run();
+            return true;
+        }
+        return false;
+    }
+
+    void worker_thread(const std::size_t index) {
+        m_owner = this;
+        m_index = index;
+        while (not m_done.load(std::memory_order_acquire)) {
+            // loaded before the scan: a schedule() the scan misses bumps it afterwards, the wait returns
+            const std::uint32_t l_signal = m_signal.load();
+            if (run_pending_task()) {
+                continue;
+            }
+            // the increment of m_sleepers before the second load of m_signal, and the increment of m_signal
+            // before the load of m_sleepers in schedule(), form a Dekker pair:
+            // either the worker sees the new signal or schedule() sees the sleeper and notifies
+            m_sleepers.fetch_add(1);
+            actor_base* l_actor = nullptr;
+            if (find_pending_task(l_actor)) {
+                m_sleepers.fetch_sub(1);
+                l_actor->run();
+                continue;
+            }
+            if ((l_signal == m_signal.load()) and (not m_done.load())) {
+                m_signal.wait(l_signal);
+            }
+            m_sleepers.fetch_sub(1);
+        }
+    }
+
+   public:
+    explicit actor_system(const unsigned threads_count = std::thread::hardware_concurrency()) : m_done(false) {
+        const unsigned l_count = std::max(1u, threads_count);
+        for (unsigned i = 0; i < l_count; ++i) {
+            m_queues.push_back(std::make_unique<work_stealing_queue>());
+        }
+        try {
+            for (unsigned i = 0; i < l_count; ++i) {
+                m_threads.push_back(std::thread(&actor_system::worker_thread, this, i));
+            }
+        } catch (...) {
+            m_done = true;
+            m_signal.fetch_add(1);
+            m_signal.notify_all();
+            for (auto& th : m_threads) {
+                th.join();
+            }
+            throw;
+        }
+    }
+
+    // the actors must be idle (no pending messages) when the system is destroyed,
+    // and must outlive it: the activation which handled the last message may still be running
+    ~actor_system() {
+        m_done = true;
+        m_signal.fetch_add(1);
+        m_signal.notify_all();
+        for (auto& th : m_threads) {
+            th.join();
+        }
+    }
+
+    actor_system(const actor_system&) = delete;
+    actor_system& operator=(const actor_system&) = delete;
+
+    void schedule(actor_base* actor) {
+        if (this == m_owner) {
+            m_queues[m_index]->push(actor);
+        } else {
+            m_queues[m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size()]->push(actor);
+        }
+        m_signal.fetch_add(1);
+        if (m_sleepers.load() > 0) {
+            m_signal.notify_one();
+        }
+    }
+
+    // called by a sender waiting for room in a mailbox
+    void help_or_yield() {
+        if ((this != m_owner) or (not run_pending_task())) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+thread_local actor_system* actor_system::m_owner = nullptr;
+thread_local std::size_t actor_system::m_index = 0;
+
+template <typename Msg>
+class actor : public actor_base {
+    mpsc_queue<Msg> m_mailbox;
+    const std::size_t m_capacity;
+    const std::size_t m_batch;
+
+    alignas(64) std::atomic<std::size_t> m_reserved{0};    // room taken in the mailbox, bounded by m_capacity
+    alignas(64) std::atomic<std::size_t> m_pending{0};     // messages linked in the mailbox, the actor is scheduled while > 0
+    std::atomic<std::size_t> m_rejected{0};
+
+    // only touched by the running activation
+    std::size_t m_activations = 0;
+    std::size_t m_handled = 0;
+
+    void run() override {
+        const std::size_t l_count = std::min(m_pending.load(std::memory_order_acquire), m_batch);
+        Msg l_msg;
+        for (std::size_t i = 0; i < l_count; ++i) {
+            // the message is counted, an earlier sender may still be linking its node
+            while (not m_mailbox.try_pop(l_msg)) {
+                std::this_thread::yield();
+            }
+            m_reserved.fetch_sub(1, std::memory_order_relaxed);
+            receive(l_msg);
+        }
+        ++m_activations;
+        m_handled += l_count;
+        if (m_pending.fetch_sub(l_count, std::memory_order_acq_rel) > l_count) {
+            m_system.schedule(this);
+        }
+    }
+
+    bool try_push(Msg& msg) {
+        if (m_reserved.fetch_add(1, std::memory_order_relaxed) >= m_capacity) {
+            m_reserved.fetch_sub(1, std::memory_order_relaxed);
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_mailbox.push(std::move(msg));
+        if (0 == m_pending.fetch_add(1, std::memory_order_acq_rel)) {
+            m_system.schedule(this);
+        }
+        return true;
+    }
+
+   protected:
+    virtual void receive(Msg& msg) = 0;
+
+   public:
+    explicit actor(actor_system& system, const std::size_t capacity = 1024, const std::size_t batch = 64)
+        : actor_base(system), m_capacity(capacity), m_batch(std::max<std::size_t>(1, batch)) {}
+
+    bool try_send(Msg msg) { return try_push(msg); }
+
+    // blocks while the mailbox is full, must not be called in a cycle of actors (see Backpressure)
+    void send(Msg msg) {
+        while (not try_push(msg)) {
+            m_system.help_or_yield();
+        }
+    }
+
+    // read once the actor is idle
+    std::size_t rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+    double average_batch() const { return m_activations ? static_cast<double>(m_handled) / static_cast<double>(m_activations) : 0.0; }
+};
+
+/*****
+    Benchmarks
+**********/
+
+struct latency_t {
+    double m_p50;
+    double m_p99;
+    double m_max;
+};
+
+latency_t percentiles_us(std::vector<std::uint64_t>& samples_ns) {
+    if (samples_ns.empty()) {
+        return {0.0, 0.0, 0.0};
+    }
+    std::sort(samples_ns.begin(), samples_ns.end());
+    auto l_at = [&](const double q) {
+        return static_cast<double>(samples_ns[static_cast<std::size_t>(q * static_cast<double>(samples_ns.size() - 1))]) / 1000.0;
+    };
+    return {l_at(0.50), l_at(0.99), l_at(1.0)};
+}
+
+std::uint64_t elapsed_ns(const std::chrono::steady_clock::time_point since) {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+}
+
+void report(const char* name, const double messages, const double seconds, std::vector<std::uint64_t>& samples_ns,
+            const char* latency_name, const double batch, const std::size_t rejected) {
+    const latency_t l_lat = percentiles_us(samples_ns);
+    std::cout << std::setw(24) << name << std::fixed << std::setprecision(0) << std::setw(12) << messages / seconds << " msg/s"
+              << "   " << latency_name << " p50 " << std::setprecision(1) << l_lat.m_p50 << " us, p99 " << l_lat.m_p99
+              << " us, max " << l_lat.m_max << " us";
+    if (batch > 0.0) {
+        std::cout << ", batch " << batch << ", rejected " << rejected;
+    }
+    std::cout << '\n';
+}
+
+/*****
+    Ping-pong
+        pairs of actors pass a ball back and forth, the server records the round trip time
+**********/
+
+struct ball_t {
+    std::size_t m_hits_left = 0;
+    std::chrono::steady_clock::time_point m_sent;
+};
+
+class player_t : public actor<ball_t> {
+    player_t* m_peer = nullptr;
+    const bool m_server;
+    std::latch& m_done;
+
+   public:
+    std::vector<std::uint64_t> m_round_trips_ns;
+
+    player_t(actor_system& system, const bool server, std::latch& done) : actor(system), m_server(server), m_done(done) {}
+
+    void set_peer(player_t* peer) { m_peer = peer; }
+
+    void serve(const std::size_t hits) {
+        m_round_trips_ns.reserve(hits);
+        m_peer->send(ball_t{hits, std::chrono::steady_clock::now()});
+    }
+
+   protected:
+    void receive(ball_t& ball) override {
+        if (m_server) {
+            m_round_trips_ns.push_back(elapsed_ns(ball.m_sent));
+            if (0 == --ball.m_hits_left) {
+                m_done.count_down();
+                return;
+            }
+            ball.m_sent = std::chrono::steady_clock::now();
+        }
+        m_peer->send(ball);
+    }
+};
+
+void ping_pong_actors(const unsigned threads_count, const std::size_t pairs, const std::size_t round_trips) {
+    std::latch l_done(static_cast<std::ptrdiff_t>(pairs));
+    std::vector<std::unique_ptr<player_t>> l_players;   // outlives the system, a worker may still be in an activation
+    double l_seconds = 0.0;
+    {
+        actor_system l_system(threads_count);
+        for (std::size_t p = 0; p < pairs; ++p) {
+            l_players.push_back(std::make_unique<player_t>(l_system, true, l_done));
+            l_players.push_back(std::make_unique<player_t>(l_system, false, l_done));
+            l_players[2 * p]->set_peer(l_players[2 * p + 1].get());
+            l_players[2 * p + 1]->set_peer(l_players[2 * p].get());
+        }
+        const auto l_start = std::chrono::steady_clock::now();
+        for (std::size_t p = 0; p < pairs; ++p) {
+            l_players[2 * p]->serve(round_trips);
+        }
+        l_done.wait();
+        l_seconds = static_cast<double>(elapsed_ns(l_start)) / 1e9;
+    }
+    std::vector<std::uint64_t> l_samples;
+    for (std::size_t p = 0; p < pairs; ++p) {
+        l_samples.insert(l_samples.end(), l_players[2 * p]->m_round_trips_ns.begin(), l_players[2 * p]->m_round_trips_ns.end());
+    }
+    report("actors", static_cast<double>(2 * pairs * round_trips), l_seconds, l_samples, "round trip", 0.0, 0);
+}
+
+// csp.cpp style, one thread per actor, a blocking queue per thread
+void ping_pong_threads(const std::size_t pairs, const std::size_t round_trips) {
+    std::vector<std::unique_ptr<thsafe_queue<ball_t>>> l_queues;
+    std::vector<std::vector<std::uint64_t>> l_samples_per_pair(pairs);
+    std::vector<std::thread> l_threads;
+    for (std::size_t i = 0; i < 2 * pairs; ++i) {
+        l_queues.push_back(std::make_unique<thsafe_queue<ball_t>>());
+    }
+
+    const auto l_start = std::chrono::steady_clock::now();
+    for (std::size_t p = 0; p < pairs; ++p) {
+        thsafe_queue<ball_t>& l_server_queue = *l_queues[2 * p];
+        thsafe_queue<ball_t>& l_echo_queue = *l_queues[2 * p + 1];
+        std::vector<std::uint64_t>& l_samples = l_samples_per_pair[p];
+        l_threads.push_back(std::thread([&l_server_queue, &l_echo_queue, &l_samples, round_trips] {
+            l_samples.reserve(round_trips);
+            ball_t l_ball{round_trips, std::chrono::steady_clock::now()};
+            l_echo_queue.push(l_ball);
+            while (true) {
+                l_server_queue.wait_and_pop(l_ball);
+                l_samples.push_back(elapsed_ns(l_ball.m_sent));
+                if (0 == --l_ball.m_hits_left) {
+                    l_echo_queue.push(l_ball);      // tells the echo thread to stop
+                    return;
+                }
+                l_ball.m_sent = std::chrono::steady_clock::now();
+                l_echo_queue.push(l_ball);
+            }
+        }));
+        l_threads.push_back(std::thread([&l_server_queue, &l_echo_queue] {
+            ball_t l_ball;
+            while (true) {
+                l_echo_queue.wait_and_pop(l_ball);
+                if (0 == l_ball.m_hits_left) {
+                    return;
+                }
+                l_server_queue.push(l_ball);
+            }
+        }));
+    }
+    for (auto& th : l_threads) {
+        th.join();
+    }
+    const double l_seconds = static_cast<double>(elapsed_ns(l_start)) / 1e9;
+
+    std::vector<std::uint64_t> l_samples;
+    for (auto& s : l_samples_per_pair) {
+        l_samples.insert(l_samples.end(), s.begin(), s.end());
+    }
+    report("thread per actor", static_cast<double>(2 * pairs * round_trips), l_seconds, l_samples, "round trip", 0.0, 0);
+}
+
+/*****
+    Fan-out
+        the main thread sends jobs round robin to a set of worker actors, each worker hashes the value
+        and forwards the job to one sink actor, the latency is from the creation of the job to the sink,
+        it includes the time the main thread waited for room in a full mailbox
+**********/
+
+struct job_t {
+    std::uint64_t m_value = 0;
+    std::chrono::steady_clock::time_point m_created;
+};
+
+class sink_t : public actor<job_t> {
+    const std::size_t m_expected;
+    std::size_t m_count = 0;
+    std::latch& m_done;
+
+   public:
+    std::uint64_t m_checksum = 0;
+    std::vector<std::uint64_t> m_latencies_ns;
+
+    sink_t(actor_system& system, const std::size_t capacity, const std::size_t batch, const std::size_t expected, std::latch& done)
+        : actor(system, capacity, batch), m_expected(expected), m_done(done) {
+        m_latencies_ns.reserve(expected);
+    }
+
+   protected:
+    void receive(job_t& job) override {
+        m_checksum ^= job.m_value;
+        m_latencies_ns.push_back(elapsed_ns(job.m_created));
+        if (++m_count == m_expected) {
+            m_done.count_down();
+        }
+    }
+};
+
+class hasher_t : public actor<job_t> {
+    sink_t& m_sink;
+
+   public:
+    hasher_t(actor_system& system, const std::size_t capacity, const std::size_t batch, sink_t& sink)
+        : actor(system, capacity, batch), m_sink(sink) {}
+
+   protected:
+    void receive(job_t& job) override {
+        for (int i = 0; i < 8; ++i) {
+            job.m_value = (job.m_value ^ (job.m_value >> 31)) * 0x9E3779B97F4A7C15ull;
+        }
+        m_sink.send(job);
+    }
+};
+
+void fan_out(const unsigned threads_count, const std::size_t workers, const std::size_t messages, const std::size_t capacity,
+             const std::size_t batch) {
+    std::latch l_done(1);
+    std::unique_ptr<sink_t> l_sink;
+    std::vector<std::unique_ptr<hasher_t>> l_hashers;
+    double l_seconds = 0.0;
+    {
+        actor_system l_system(threads_count);
+        l_sink = std::make_unique<sink_t>(l_system, capacity, batch, messages, l_done);
+        for (std::size_t w = 0; w < workers; ++w) {
+            l_hashers.push_back(std::make_unique<hasher_t>(l_system, capacity, batch, *l_sink));
+        }
+
+        const auto l_start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < messages; ++i) {
+            l_hashers[i % workers]->send(job_t{i, std::chrono::steady_clock::now()});
+        }
+        l_done.wait();
+        l_seconds = static_cast<double>(elapsed_ns(l_start)) / 1e9;
+    }   // joins the workers, the last activation of the sink is over
+
+    std::size_t l_rejected = l_sink->rejected();
+    for (auto& h : l_hashers) {
+        l_rejected += h->rejected();
+    }
+    const std::string l_name = "capacity " + std::to_string(capacity) + " batch " + std::to_string(batch);
+    report(l_name.c_str(), static_cast<double>(2 * messages), l_seconds, l_sink->m_latencies_ns, "latency", l_sink->average_batch(),
+           l_rejected);
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned threads_count = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : std::thread::hardware_concurrency();
+    const std::size_t pairs = (argc > 2) ? std::stoul(argv[2]) : 64;
+    const std::size_t round_trips = (argc > 3) ? std::stoul(argv[3]) : 2000;
+    const std::size_t messages = (argc > 4) ? std::stoul(argv[4]) : 1000000;
+
+    std::cout << "worker threads " << threads_count << "\n\n";
+
+    std::cout << "ping-pong, " << pairs << " pairs, " << round_trips << " round trips each\n";
+    ping_pong_actors(threads_count, pairs, round_trips);
+    ping_pong_threads(pairs, round_trips);
+
+    std::cout << "\nfan-out, " << messages << " jobs to 16 workers and one sink\n";
+    fan_out(threads_count, 16, messages, 1024, 1);
+    fan_out(threads_count, 16, messages, 1024, 64);
+    fan_out(threads_count, 16, messages, 64, 64);
+
+    return 0;
+}
+
+/*****
+Explanation
+
+Scheduling
+	m_pending counts the messages linked in the mailbox and not handled yet.
+	The send which takes it from 0 to 1 schedules the actor, the activation subtracts what it handled
+	and puts the actor back on a queue if the count is still not 0. So an actor is on at most one queue
+	or running on at most one worker, its state needs no lock.
+	The acq_rel increment after the push and the acquire load in run() make the linked nodes visible
+	to the activation, a node can still be hidden by an earlier sender which did not link its own node yet,
+	the activation then yields until it is linked.
+
+Batching
+	With batch 1 every message costs a trip through a work queue (a mutex and often a wake up),
+	with batch 64 a busy sink handles its whole mailbox in one activation, the batch column
+	is the average number of messages per activation of the sink.
+
+Backpressure
+	The main thread produces much faster than the workers consume, with a capacity of 64 it is throttled
+	and the rejected column counts the failed attempts, the latency stays bounded by the capacity
+	instead of growing with the backlog.
+
+Thread per actor
+	Every message wakes up the receiving thread, on one core each hop is a context switch through the kernel.
+	The actors pass a message by a push on a queue and run the receiver on the same worker.
+
+Output (g++ -O2, ./actor_runtime on a single core machine)
+worker threads 1
+
+ping-pong, 64 pairs, 2000 round trips each
+                  actors     6264086 msg/s   round trip p50 0.2 us, p99 0.4 us, max 40280.3 us
+        thread per actor      285893 msg/s   round trip p50 389.3 us, p99 854.6 us, max 38071.9 us
+
+fan-out, 1000000 jobs to 16 workers and one sink
+   capacity 1024 batch 1     4603360 msg/s   latency p50 3505.2 us, p99 6891.0 us, max 13729.0 us, batch 1.0, rejected 82704
+  capacity 1024 batch 64     7305166 msg/s   latency p50 2234.8 us, p99 5404.0 us, max 10458.5 us, batch 63.9, rejected 95
+    capacity 64 batch 64     8162850 msg/s   latency p50 120.1 us, p99 244.5 us, max 1656.5 us, batch 64.0, rejected 976
+
+*****/
+
+/*****
+    END OF FILE
+**********/
@@ -0,0 +1,61 @@
+#ifndef MPSC_QUEUE
+#define MPSC_QUEUE
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+/*****
+    Unbounded multiple producers / single consumer queue (Dmitry Vyukov's node based queue)
+        -> push() is wait-free: one exchange of the head and one store
+        -> try_pop() may only be called by one thread at a time, it never blocks
+
+    A producer which exchanged the head but did not link its node yet hides the nodes pushed after it,
+    try_pop() returns false until the link is stored even if later pushes completed.
+**********/
+
+template <typename T>
+class mpsc_queue {
+    struct node_t {
+        std::atomic<node_t*>    m_next{nullptr};
+        std::optional<T>        m_data;
+    };
+
+    alignas(64) std::atomic<node_t*>    m_head;     // producers
+    alignas(64) node_t*                 m_tail;     // consumer, always a stub whose m_data is empty
+
+   public:
+    mpsc_queue() : m_head(new node_t), m_tail(m_head.load(std::memory_order_relaxed)) {}
+
+    ~mpsc_queue() {
+        while (m_tail) {
+            node_t* l_next = m_tail->m_next.load(std::memory_order_relaxed);
+            delete m_tail;
+            m_tail = l_next;
+        }
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    void push(T val) {
+        node_t* l_node = new node_t;
+        l_node->m_data.emplace(std::move(val));
+        node_t* l_prev = m_head.exchange(l_node, std::memory_order_acq_rel);
+        l_prev->m_next.store(l_node, std::memory_order_release);
+    }
+
+    bool try_pop(T& val) {
+        node_t* l_next = m_tail->m_next.load(std::memory_order_acquire);
+        if (nullptr == l_next) {
+            return false;
+        }
+        val = std::move(*(l_next->m_data));
+        l_next->m_data.reset();     // l_next becomes the stub
+        delete m_tail;
+        m_tail = l_next;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,309 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Mellor-Crummey, Scott - Algorithms for Scalable Synchronization on Shared-Memory Multiprocessors
+    https://en.cppreference.com/w/cpp/atomic/atomic/wait
+
+4.4 Using synchronization of operations to simplify code
+
+4.4.11 A combining tree barrier
+
+	std::barrier (and std::experimental::flex_barrier, see 4.4.9 and 4.4.10) keeps one counter for all the threads.
+	Every arriving thread does an atomic read-modify-write on that one cache line,
+	with many threads and many phases per second the counter is the bottleneck:
+	the arrivals are serialized and the line moves from core to core for each of them.
+
+	A combining tree barrier splits the counter
+		-> participants are grouped by fan_in (4 here), each group has its own counter (a leaf of the tree)
+		-> the last thread to arrive at a node goes on to the parent node, the others wait
+		-> the last thread to arrive at the root has seen every participant arrive,
+		   it runs the completion function and releases everybody by advancing the phase
+	Each counter only sees fan_in arrivals, the contended read-modify-writes are spread over n / fan_in cache lines.
+
+	Like flex_barrier the completion function can change the number of participants for the next phase,
+	it returns the new count, or -1 to keep the current one. The completion step runs while
+	every participant is blocked, so the tree is rebuilt there without any extra synchronization.
+
+	Waiting is spin-then-park
+		-> a waiting thread first spins on the phase for a while, a release is usually a few hundred nanoseconds away
+		-> then it parks with std::atomic::wait (a futex on Linux), the last arriver calls notify_all
+		-> when there are more participants than cores spinning only delays the threads that still have to arrive,
+		   the barrier parks immediately in that case
+
+	Every participant passes its id (0 .. count - 1) to arrive_and_wait, the id selects its leaf.
+
+Usage
+    ./combining_tree_barrier [max_threads] [phases]
+
+**********/
+
+#include <iostream>
+#include <thread>
+#include <barrier>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <iomanip>
+#include <syncstream>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+class combining_tree_barrier {
+    static constexpr int    fan_in = 4;
+
+    struct alignas(64) node_t {
+        std::atomic<int>    m_arrived{0};
+        int                 m_expected = 0;
+        int                 m_parent   = -1;
+    };
+
+    std::vector<node_t>                 m_nodes;        // leaves first, root last
+    int                                 m_count;
+    const int                           m_spin_budget;  // as passed to the constructor
+    int                                 m_spin_count;   // 0 while there are more participants than cores
+    std::function<std::ptrdiff_t()>     m_completion;
+    alignas(64) std::atomic<std::uint64_t>  m_phase{0};
+
+    // a tree of fan_in children per node, built level by level from the leaves
+    void build(const int count) {
+        std::size_t l_nodes_count = 0;
+        for(int l_size = count; l_size > 1; ) {
+            l_size = (l_size + fan_in - 1) / fan_in;
+            l_nodes_count += static_cast<std::size_t>(l_size);
+        }
+        m_nodes = std::vector<node_t>(std::max<std::size_t>(l_nodes_count, 1));
+
+        // l_children arrive at the level starting at l_begin, they are grouped by fan_in
+        int l_begin     = 0;
+        int l_children  = count;
+        while(true) {
+            const int l_size = std::max(1, (l_children + fan_in - 1) / fan_in);
+            for(int i = 0; i < l_size; ++i) {
+                node_t & l_node     = m_nodes[static_cast<std::size_t>(l_begin + i)];
+                l_node.m_expected   = std::min(fan_in, l_children - i * fan_in);
+                l_node.m_parent     = (1 == l_size) ? -1 : (l_begin + l_size + i / fan_in);
+            }
+            if(1 == l_size) {
+                break;
+            }
+            l_begin     += l_size;
+            l_children  = l_size;
+        }
+        m_count         = count;
+        m_spin_count    = (count > static_cast<int>(std::thread::hardware_concurrency())) ? 0 : m_spin_budget;
+    }
+
+    public:
+    template<typename Completion = std::function<std::ptrdiff_t()>>
+    explicit combining_tree_barrier(const int count, Completion completion = []{ return std::ptrdiff_t{-1}; },
+            const int spin_count = 4000)
+        : m_count(count), m_spin_budget(spin_count), m_spin_count(0),
+          m_completion(std::move(completion)) {
+        build(count);
+    }
+
+    combining_tree_barrier(const combining_tree_barrier &)              = delete;
+    combining_tree_barrier & operator=(const combining_tree_barrier &)  = delete;
+
+    int count() const { return m_count; }
+
+    void arrive_and_wait(const int id) {
+        const std::uint64_t l_phase = m_phase.load(std::memory_order_acquire);
+        // recomputed with the tree, so read before arriving like the nodes
+        const int l_spin_count = m_spin_count;
+        int l_index = id / fan_in;
+        while(true) {
+            node_t &    l_node      = m_nodes[static_cast<std::size_t>(l_index)];
+            // read before arriving, once arrived the tree may be rebuilt by the completion step
+            const int   l_expected  = l_node.m_expected;
+            // acq_rel: the last arriver sees everything the other children did before arriving
+            if((l_node.m_arrived.fetch_add(1, std::memory_order_acq_rel) + 1) < l_expected) {
+                break;
+            }
+            // every child arrived, nobody touches the node again in this phase
+            l_node.m_arrived.store(0, std::memory_order_relaxed);
+            if(l_node.m_parent < 0) {
+                const std::ptrdiff_t l_new_count = m_completion();
+                if((l_new_count > 0) and (l_new_count != m_count)) {
+                    build(static_cast<int>(l_new_count));
+                }
+                m_phase.store(l_phase + 1, std::memory_order_release);
+                m_phase.notify_all();
+                return;
+            }
+            l_index = l_node.m_parent;
+        }
+
+        for(int i = 0; i < l_spin_count; ++i) {
+            if(m_phase.load(std::memory_order_acquire) != l_phase) {
+                return;
+            }
+        }
+        while(m_phase.load(std::memory_order_acquire) == l_phase) {
+            m_phase.wait(l_phase, std::memory_order_acquire);
+        }
+    }
+};
+
+// one counter for everybody, same waiting strategy, to isolate the effect of the tree
+class central_barrier {
+    alignas(64) std::atomic<int>            m_arrived{0};
+    alignas(64) std::atomic<std::uint64_t>  m_phase{0};
+    const int                               m_count;
+    const int                               m_spin_count;
+
+    public:
+    explicit central_barrier(const int count, const int spin_count = 4000)
+        : m_count(count), m_spin_count((count > static_cast<int>(std::thread::hardware_concurrency())) ? 0 : spin_count) { }
+
+    void arrive_and_wait(int) {
+        const std::uint64_t l_phase = m_phase.load(std::memory_order_acquire);
+        if((m_arrived.fetch_add(1, std::memory_order_acq_rel) + 1) == m_count) {
+            m_arrived.store(0, std::memory_order_relaxed);
+            m_phase.store(l_phase + 1, std::memory_order_release);
+            m_phase.notify_all();
+            return;
+        }
+        for(int i = 0; i < m_spin_count; ++i) {
+            if(m_phase.load(std::memory_order_acquire) != l_phase) {
+                return;
+            }
+        }
+        while(m_phase.load(std::memory_order_acquire) == l_phase) {
+            m_phase.wait(l_phase, std::memory_order_acquire);
+        }
+    }
+};
+
+struct std_barrier {
+    std::barrier<>  m_barrier;
+
+    explicit std_barrier(const int count) : m_barrier(count) { }
+    void arrive_and_wait(int) { m_barrier.arrive_and_wait(); }
+};
+
+/*****
+    Benchmark
+        every thread runs the given number of phases with no work in between,
+        the time per phase is the latency of the barrier itself
+**********/
+
+template<typename Barrier>
+double ns_per_phase(const int threads_count, const int phases) {
+    Barrier                     l_barrier(threads_count);
+    std::vector<std::thread>    l_threads;
+
+    const auto l_start = std::chrono::steady_clock::now();
+    for(int t = 0; t < threads_count; ++t) {
+        l_threads.push_back(std::thread([&, t]{
+            for(int p = 0; p < phases; ++p) {
+                l_barrier.arrive_and_wait(t);
+            }
+        }));
+    }
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double, std::nano> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    return l_elapsed.count() / phases;
+}
+
+int main(int argc, char * argv[]) {
+    {
+        // bulk synchronous steps with a completion step, the group shrinks from 6 to 3 threads after phase 1
+        int     l_step  = 0;
+        combining_tree_barrier  l_barrier(6, [&]{
+            std::osyncstream(std::cout) << "completion of step " << l_step << '\n';
+            return (1 == l_step++) ? std::ptrdiff_t{3} : std::ptrdiff_t{-1};
+        });
+        std::vector<std::thread>    l_threads;
+        for(int t = 0; t < 6; ++t) {
+            l_threads.push_back(std::thread([&, t]{
+                for(int p = 0; p < 4; ++p) {
+                    if(t >= l_barrier.count()) {
+                        return;         // dropped out of the group
+                    }
+                    std::osyncstream(std::cout) << "thread " << t << " step " << p << '\n';
+                    l_barrier.arrive_and_wait(t);
+                }
+            }));
+        }
+        for(auto & th : l_threads) {
+            th.join();
+        }
+        std::cout << '\n';
+    }
+
+    const int   max_threads = (argc > 1) ? std::stoi(argv[1]) : 128;
+    const int   phases      = (argc > 2) ? std::stoi(argv[2]) : 2000;
+
+    std::cout << "ns per phase, " << phases << " phases\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "std::barrier" << std::setw(14) << "central" << std::setw(14) << "tree" << '\n';
+    for(int threads_count = 2; threads_count <= max_threads; threads_count *= 2) {
+        std::cout << std::setw(8) << threads_count << std::fixed << std::setprecision(0)
+                  << std::setw(14) << ns_per_phase<std_barrier>(threads_count, phases)
+                  << std::setw(14) << ns_per_phase<central_barrier>(threads_count, phases)
+                  << std::setw(14) << ns_per_phase<combining_tree_barrier>(threads_count, phases) << '\n';
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+A participant reads a node (its expected count and parent) and the spin count before its fetch_add, never after:
+as soon as it has arrived the last participant may reach the root and rebuild the tree in the completion step.
+The rebuild happens before the release store of the next phase, every participant loads the phase
+(acquire) before arriving again, so every participant of the next phase sees the rebuilt tree.
+The spin count is recomputed with the tree, a completion that grows the count beyond the cores
+turns the spinning off for the next phases, one that shrinks it turns it back on.
+A participant dropped by the completion function must not call arrive_and_wait again,
+in the example the threads check count() after each phase.
+
+The last arriver at a node resets its counter before going up, the other children of that node
+are already waiting for the phase, they cannot arrive at the node again before the release.
+
+Output (g++ -O2, single core machine, every barrier parks immediately because threads > cores,
+the tree cannot win here, the benefit shows with many cores and spinning waiters, ./combining_tree_barrier 128 2000)
+thread 0 step 0
+thread 1 step 0
+thread 2 step 0
+thread 3 step 0
+thread 4 step 0
+thread 5 step 0
+completion of step 0
+thread 5 step 1
+thread 0 step 1
+thread 1 step 1
+thread 2 step 1
+thread 3 step 1
+thread 4 step 1
+completion of step 1
+thread 0 step 2
+thread 1 step 2
+thread 2 step 2
+completion of step 2
+thread 2 step 3
+thread 0 step 3
+thread 1 step 3
+completion of step 3
+
+ns per phase, 2000 phases
+ threads  std::barrier       central          tree
+       2          1750          1799          1879
+       4          4805          4762          4905
+       8         10952         10434         10437
+      16         22623         22622         23447
+      32         50446         46556         45880
+      64        102468        100942         98816
+     128        195399        203031        200328
+
+*****/
+
+/*****
+    END OF FILE
+**********/
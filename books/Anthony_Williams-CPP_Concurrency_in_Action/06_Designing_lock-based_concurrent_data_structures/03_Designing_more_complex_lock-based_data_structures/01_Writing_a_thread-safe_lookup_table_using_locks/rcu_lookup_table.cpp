@@ -0,0 +1,251 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Paul E. McKenney - What is RCU, Fundamentally? (https://lwn.net/Articles/262464/)
+
+6.3.1 Writing a thread-safe lookup table using locks (read-copy-update read path)
+
+thsafe_lookup_table takes a std::shared_lock on the bucket for every get(),
+the reader count of the bucket's std::shared_mutex is written by every reader of that bucket,
+so the readers of a popular key bounce one cache line between their cores.
+
+rcu_lookup_table keeps the whole table in an rcu_snapshot (rcu_snapshot.hpp, see 3.3.2)
+	-> get() and visit() enter a read-side section, a store to the thread's own slot,
+	   and look the key up in the current immutable std::unordered_map, no lock and no shared write
+	-> add_or_update() and remove() copy the map, change the copy and publish it,
+	   then wait for a grace period before the old map is deleted
+	-> update(f) applies a batch of changes with one copy and one grace period
+
+The interface is the one of thsafe_lookup_table, including the heterogeneous lookup
+with a transparent hash and equality (thsafe_hash<std::string>, std::equal_to<>).
+A write costs a copy of the whole table, this is the table for routing or DNS style data
+read millions of times per second and written a few times per minute,
+for write heavy data thsafe_lookup_table stays the better choice.
+
+Usage
+    ./rcu_lookup_table [max_threads] [milliseconds_per_run]
+
+**********/
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <functional>
+#include <iomanip>
+#include <thread>
+
+#include "thsafe_lookup_table.hpp"
+#include "rcu_snapshot.hpp"
+
+template<typename key_t, typename val_t,
+         typename hash_t = thsafe_hash<key_t>, typename key_equal_t = std::equal_to<>>
+class rcu_lookup_table {
+    using map_t = std::unordered_map<key_t, val_t, hash_t, key_equal_t>;
+
+    // as for std::unordered_map, the template overloads taking a key other than key_t
+    // exist only when both hash_t and key_equal_t are transparent
+    template<typename lookup_key_t>
+    static constexpr bool is_lookup_key =
+        requires { typename hash_t::is_transparent; typename key_equal_t::is_transparent; } and
+        std::invocable<const hash_t &, const lookup_key_t &> and
+        std::predicate<const key_equal_t &, const lookup_key_t &, const key_t &>;
+
+    rcu_snapshot<map_t>     m_map;
+
+    template<typename lookup_key_t>
+    val_t get_impl(const lookup_key_t & key, const val_t & default_val) const {
+        const auto  l_map = m_map.read();
+        const auto  l_itr = l_map->find(key);
+        return (l_map->end() == l_itr) ? default_val : l_itr->second;
+    }
+
+    template<typename lookup_key_t, typename Function>
+    bool visit_impl(const lookup_key_t & key, Function & f) const {
+        const auto  l_map = m_map.read();
+        const auto  l_itr = l_map->find(key);
+        if(l_map->end() == l_itr) {
+            return false;
+        }
+        f(l_itr->second);
+        return true;
+    }
+
+    public:
+    rcu_lookup_table(const rcu_lookup_table &)              = delete;
+    rcu_lookup_table & operator=(const rcu_lookup_table &)  = delete;
+
+    explicit rcu_lookup_table(const std::size_t num_buckets = 17, const hash_t & hasher = hash_t())
+        : m_map(map_t(num_buckets, hasher)) { }
+
+    val_t get(const key_t & key, const val_t & default_val = val_t{}) const {
+        return get_impl(key, default_val);
+    }
+
+    template<typename lookup_key_t> requires is_lookup_key<lookup_key_t>
+    val_t get(const lookup_key_t & key, const val_t & default_val = val_t{}) const {
+        return get_impl(key, default_val);
+    }
+
+    // calls f(const val_t &) in a read-side section, returns false if the key is not present
+    // f may run while writers publish newer versions, it must not write to the table (the writer would wait for f)
+    template<typename Function>
+    bool visit(const key_t & key, Function f) const {
+        return visit_impl(key, f);
+    }
+
+    template<typename lookup_key_t, typename Function> requires is_lookup_key<lookup_key_t>
+    bool visit(const lookup_key_t & key, Function f) const {
+        return visit_impl(key, f);
+    }
+
+    void add_or_update(const key_t & key, const val_t & val) {
+        m_map.update([&](map_t & map){ map.insert_or_assign(key, val); });
+    }
+
+    void remove(const key_t & key) {
+        m_map.update([&](map_t & map){ map.erase(key); });
+    }
+
+    // f(std::unordered_map &) changes a copy of the table, published as a whole: one copy for a batch of writes
+    template<typename Function>
+    void update(Function f) {
+        m_map.update(f);
+    }
+};
+
+/*****
+    Benchmark
+        1024 host names, reader threads look a name up in a loop with a std::string_view key,
+        one writer changes an entry every 10 ms
+        reads per second are compared for thsafe_lookup_table (a shared_mutex per bucket) and rcu_lookup_table
+**********/
+
+template<typename Table>
+double reads_per_second(Table & table, const std::vector<std::string> & keys,
+        const std::size_t threads_count, const std::chrono::milliseconds duration) {
+    std::atomic<bool>           l_stop{false};
+    std::atomic<std::size_t>    l_total_reads{0};
+    std::vector<std::thread>    l_threads;
+
+    for(std::size_t t = 0; t < threads_count; ++t) {
+        l_threads.push_back(std::thread([&, t]{
+            std::size_t l_reads = 0, l_sum = 0, l_index = t * 7919;
+            while(not l_stop.load(std::memory_order_relaxed)) {
+                table.visit(std::string_view(keys[l_index++ % keys.size()]), [&](const std::string & val){ l_sum += val.size(); });
+                ++l_reads;
+            }
+            l_total_reads.fetch_add(l_reads);
+            if(0 == l_sum) {
+                std::cout << "no address found\n";
+            }
+        }));
+    }
+    std::thread l_writer([&]{
+        std::size_t l_version = 0;
+        while(not l_stop.load(std::memory_order_relaxed)) {
+            table.add_or_update(keys[l_version % keys.size()], "10.1.0." + std::to_string(l_version % 256));
+            ++l_version;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    const auto l_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    l_stop.store(true);
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    l_writer.join();
+    return static_cast<double>(l_total_reads.load()) / l_elapsed.count();
+}
+
+int main(int argc, char * argv[]) {
+    {
+        rcu_lookup_table<std::string, std::string>  ltable;
+        ltable.add_or_update("www.example.com", "93.184.216.34");
+        ltable.add_or_update("api.example.com", "93.184.216.35");
+        ltable.update([](auto & map){
+            map.erase("api.example.com");
+            map.insert_or_assign("cdn.example.com", "93.184.216.36");
+        });
+        std::cout << "www " << ltable.get("www.example.com") << ", api " << ltable.get(std::string_view("api.example.com"), "removed")
+                  << ", cdn " << ltable.get(std::string("cdn.example.com")) << "\n\n";
+
+        // a key which only converts to key_t still works, as with thsafe_lookup_table
+        rcu_lookup_table<long, int>     lnumbers;
+        lnumbers.add_or_update(1, 10);
+        lnumbers.remove(2);
+        std::cout << "1 => " << lnumbers.get(1) << ", 2 => " << lnumbers.get(2, -1) << "\n\n";
+    }
+
+    const std::size_t   max_threads = (argc > 1) ? std::stoul(argv[1]) : 64;
+    const auto          duration    = std::chrono::milliseconds((argc > 2) ? std::stoul(argv[2]) : 200);
+
+    std::vector<std::string>                        l_keys;
+    thsafe_lookup_table<std::string, std::string>   l_locked_table(1031);
+    rcu_lookup_table<std::string, std::string>      l_rcu_table(1031);
+    l_rcu_table.update([&](auto & map){
+        for(std::size_t i = 0; i < 1024; ++i) {
+            l_keys.push_back("host-" + std::to_string(i) + ".example.com");
+            const std::string l_address = "10.1." + std::to_string(i / 256) + '.' + std::to_string(i % 256);
+            map.insert_or_assign(l_keys.back(), l_address);
+            l_locked_table.add_or_update(l_keys.back(), l_address);
+        }
+    });
+
+    std::cout << std::setw(8) << "threads" << std::setw(20) << "shared_mutex r/s" << std::setw(20) << "rcu r/s" << std::setw(10) << "ratio" << '\n';
+    for(std::size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+        const double l_locked_rate  = reads_per_second(l_locked_table, l_keys, threads_count, duration);
+        const double l_rcu_rate     = reads_per_second(l_rcu_table, l_keys, threads_count, duration);
+        std::cout << std::setw(8) << threads_count
+                  << std::setw(20) << static_cast<std::size_t>(l_locked_rate)
+                  << std::setw(20) << static_cast<std::size_t>(l_rcu_rate)
+                  << std::setw(10) << std::setprecision(3) << (l_rcu_rate / l_locked_rate) << '\n';
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+The read path of rcu_lookup_table writes only the reader's own slot of rcu_domain,
+thsafe_lookup_table does two atomic read-modify-writes on the shared_mutex of the bucket per lookup,
+with several cores the readers of the same bucket contend on it, the RCU readers never do.
+A writer of rcu_lookup_table copies the 1024 entries and waits for the readers in their read-side
+sections, the writes are rare enough here for that not to show in the read rates.
+
+On one core nothing contends: the uncontended shared_lock of a bucket and the epoch store cost about
+the same, the hash of the key and the cache misses of the lookup are most of a read, and the two
+tables stay within 20% of each other from run to run, in both directions.
+
+A value returned by get() is a copy, visit() reads it in place: the snapshot it belongs to
+is not deleted before the read-side section of visit() ends, even if a writer replaced it.
+
+Output (g++ -O2 -std=c++20, ./rcu_lookup_table 64 200 on a single core machine,
+so this only shows the per read cost, the cache line bouncing needs several cores to show up)
+www 93.184.216.34, api removed, cdn 93.184.216.36
+
+1 => 10, 2 => -1
+
+ threads    shared_mutex r/s             rcu r/s     ratio
+       1            19086248            19624069      1.03
+       2            16738445            16589948     0.991
+       4            18147138            21395005      1.18
+       8            20119368            20076835     0.998
+      16            18414816            21686974      1.18
+      32            30032351            24387632     0.812
+      64            27118261            22267874     0.821
+*****/
+
+/*****
+    END OF FILE
+**********/
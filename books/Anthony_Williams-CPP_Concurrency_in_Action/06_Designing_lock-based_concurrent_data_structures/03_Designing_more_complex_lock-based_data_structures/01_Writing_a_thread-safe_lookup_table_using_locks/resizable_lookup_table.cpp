@@ -0,0 +1,400 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+
+6.3.1 Writing a thread-safe lookup table using locks (with online resizing)
+
+thsafe_lookup_table in thread_safe_lookup_table.cpp fixes the number of buckets at construction.
+It never rehashes, so once the number of keys is much bigger than the number of buckets
+every bucket is a long std::list and each lookup becomes a linear search.
+
+This example keeps the same design (one std::shared_mutex per bucket, no iterators)
+and adds incremental, concurrent resizing:
+
+    -> the table keeps track of the number of keys,
+       when size > max_load_factor * bucket_count a new table with twice the buckets is created,
+       by the one thread which claims the resize (m_resize_claimed), the others do not allocate
+    -> the old table keeps a pointer to the new table,
+       buckets are migrated one at a time under the lock of the old bucket only
+    -> every modifying operation helps by migrating a few buckets (migrate_step),
+       so the cost of the rehash is spread over many operations
+    -> once every old bucket is migrated the new table becomes the current table
+
+There is no stop-the-world lock:
+    -> a bucket which is not migrated yet is still the owner of its keys,
+       readers and writers keep using it
+    -> a migrated bucket is marked as moved, any operation that finds the moved mark
+       releases the lock and retries on the next table
+    -> with a bucket count doubling, new bucket j only receives keys from old bucket (j % old_count),
+       so nobody can touch new bucket j before old bucket (j % old_count) is moved
+
+Readers load the current table as a raw pointer (acquire), no reference count is written per operation.
+A table owns the next one, so a thread which is still looking at an old table always finds it alive:
+the retired tables are freed with the lookup table. Their buckets are empty after the migration and
+their arrays add up to less than the current one.
+
+Usage
+    ./resizable_lookup_table [max_keys] [threads]
+    e.g. ./resizable_lookup_table 50000000 8     (about 10 GB of memory, see the output below)
+
+**********/
+
+#include <iostream>
+#include <exception>
+#include <memory>
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <shared_mutex>
+
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <iomanip>
+
+template<typename key_t, typename val_t, typename hash_t = std::hash<key_t>>
+class thsafe_lookup_table {
+
+    class bucket_t {
+        using bucket_val_t  = std::pair<key_t, val_t>;
+        using bucket_data_t = std::list<bucket_val_t>;
+        using bucket_itr_t  = typename bucket_data_t::iterator;
+
+        bucket_data_t       m_bucket_data;
+        bool                m_moved = false;
+
+        bucket_itr_t find_entry_for(const key_t & key)  {
+            return std::find_if(m_bucket_data.begin(), m_bucket_data.end(),
+            [&](const bucket_val_t & bval){ return key == bval.first; });
+        }
+
+        public:
+        std::shared_mutex   m_bucket_data_mutex;
+
+        // all functions below expect the caller to hold m_bucket_data_mutex
+        bool moved() const { return m_moved; }
+
+        bool remove(const key_t & key) {
+            bucket_itr_t l_itr =    find_entry_for(key);
+            if(m_bucket_data.end() != l_itr) {
+                m_bucket_data.erase(l_itr);
+                return true;
+            }
+            return false;
+        }
+
+        bool add_or_update(const key_t & key, const val_t & val) {
+            bucket_itr_t l_itr =    find_entry_for(key);
+            if(m_bucket_data.end() ==  l_itr) {
+                m_bucket_data.push_back(bucket_val_t{key, val});
+                return true;
+            }
+            l_itr->second = val;
+            return false;
+        }
+
+        val_t get(const key_t & key, const val_t & default_val)  {
+            bucket_itr_t l_itr = find_entry_for(key);
+            if(m_bucket_data.end() == l_itr) {
+                return default_val;
+            }
+            return l_itr->second;
+        }
+
+        // splice the nodes into the new buckets, no copy and no allocation
+        template<typename Destination>
+        void move_to(Destination dest) {
+            while(not m_bucket_data.empty()) {
+                bucket_t & l_dest = dest(m_bucket_data.front().first);
+                l_dest.m_bucket_data.splice(l_dest.m_bucket_data.end(), m_bucket_data, m_bucket_data.begin());
+            }
+            m_moved = true;
+        }
+    }; // bucket_t
+
+    struct table_t {
+        const std::size_t                       m_bucket_count;
+        std::unique_ptr<bucket_t[]>             m_buckets;          // one allocation for all buckets
+        std::unique_ptr<table_t>                m_next_owner;       // the retired tables live as long as the lookup table
+        std::atomic<table_t *>                  m_next{nullptr};    // set once a resize starts
+        std::atomic<bool>                       m_resize_claimed{false};    // by the one thread which allocates m_next
+        std::atomic<std::size_t>                m_migrate_cursor{0};
+        std::atomic<std::size_t>                m_migrated_count{0};
+
+        explicit table_t(const std::size_t num_buckets)
+            : m_bucket_count(num_buckets), m_buckets(std::make_unique<bucket_t[]>(num_buckets)) {
+        }
+
+        bucket_t & get_bucket(const std::size_t hash) const {
+            return m_buckets[hash % m_bucket_count];
+        }
+    }; // table_t
+
+    static constexpr std::size_t    migrate_step = 4;
+
+    std::unique_ptr<table_t>                m_first;
+    std::atomic<table_t *>                  m_table;
+    std::atomic<std::size_t>                m_size{0};
+    const double                            m_max_load_factor;
+    hash_t                                  m_hasher;
+
+    // lock the bucket owning the key, following moved buckets to the newer tables
+    template<typename Lock, typename Operation>
+    auto apply(const key_t & key, Operation op) const {
+        const std::size_t           l_hash  = m_hasher(key);
+        const table_t *             l_table = m_table.load(std::memory_order_acquire);
+        while(true) {
+            bucket_t &  l_bucket = l_table->get_bucket(l_hash);
+            Lock        l_lock(l_bucket.m_bucket_data_mutex);
+            if(not l_bucket.moved()) {
+                return op(l_bucket);
+            }
+            l_lock.unlock();
+            l_table = l_table->m_next.load(std::memory_order_acquire);
+        }
+    }
+
+    void migrate_bucket(table_t & old_table, table_t & new_table, const std::size_t index) {
+        bucket_t &  l_bucket = old_table.m_buckets[index];
+        {
+            std::lock_guard l_lock(l_bucket.m_bucket_data_mutex);
+            l_bucket.move_to([&](const key_t & key) -> bucket_t & {
+                return new_table.get_bucket(m_hasher(key));
+            });
+        }
+        if(old_table.m_bucket_count == (old_table.m_migrated_count.fetch_add(1) + 1)) {
+            // last bucket migrated, publish the new table
+            table_t *   l_expected  = &old_table;
+            m_table.compare_exchange_strong(l_expected, old_table.m_next.load(std::memory_order_acquire),
+                                            std::memory_order_acq_rel);
+        }
+    }
+
+    void help_resize() {
+        table_t *   l_table = m_table.load(std::memory_order_acquire);
+        table_t *   l_next  = l_table->m_next.load(std::memory_order_acquire);
+
+        if(not l_next) {
+            const std::size_t   l_count = l_table->m_bucket_count;
+            if(static_cast<double>(m_size.load(std::memory_order_relaxed)) <= (m_max_load_factor * static_cast<double>(l_count))) {
+                return;
+            }
+            // only the thread which claims the resize allocates the new table,
+            // the others carry on and help migrating once m_next is published
+            if(l_table->m_resize_claimed.exchange(true)) {
+                return;
+            }
+            try {
+                l_table->m_next_owner = std::make_unique<table_t>(l_count * 2);
+            } catch(...) {
+                // the table keeps working at its current size, a later modification claims the resize again
+                l_table->m_resize_claimed.store(false);
+                throw;
+            }
+            l_next = l_table->m_next_owner.get();
+            l_table->m_next.store(l_next, std::memory_order_release);
+        }
+
+        for(std::size_t i = 0; i < migrate_step; ++i) {
+            const std::size_t   l_index = l_table->m_migrate_cursor.fetch_add(1);
+            if(l_index >= l_table->m_bucket_count) {
+                break;
+            }
+            migrate_bucket(*l_table, *l_next, l_index);
+        }
+    }
+
+    public:
+    thsafe_lookup_table(const thsafe_lookup_table &)                = delete;
+    thsafe_lookup_table & operator=(const thsafe_lookup_table &)    = delete;
+
+    thsafe_lookup_table(const std::size_t num_buckets = 17, const double max_load_factor = 2.0,
+            const hash_t & hasher = hash_t())
+        : m_first(std::make_unique<table_t>(num_buckets ? num_buckets : 1)), m_table(m_first.get()),
+          m_max_load_factor(max_load_factor), m_hasher(hasher) {
+    }
+
+    val_t get(const key_t & key, const val_t & default_val = val_t{}) const {
+        return apply<std::shared_lock<std::shared_mutex>>(key,
+            [&](bucket_t & bucket){ return bucket.get(key, default_val); });
+    }
+
+    void add_or_update(const key_t & key, const val_t & val) {
+        const bool  l_added = apply<std::unique_lock<std::shared_mutex>>(key,
+            [&](bucket_t & bucket){ return bucket.add_or_update(key, val); });
+        if(l_added) {
+            m_size.fetch_add(1, std::memory_order_relaxed);
+        }
+        help_resize();
+    }
+
+    void remove(const key_t & key) {
+        const bool  l_removed = apply<std::unique_lock<std::shared_mutex>>(key,
+            [&](bucket_t & bucket){ return bucket.remove(key); });
+        if(l_removed) {
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+        }
+        help_resize();
+    }
+
+    std::size_t size() const            { return m_size.load(std::memory_order_relaxed); }
+    std::size_t bucket_count() const    { return m_table.load(std::memory_order_acquire)->m_bucket_count; }
+};
+
+/*****
+    Benchmark
+        threads insert disjoint keys and look up keys already inserted,
+        the table starts with 17 buckets and grows with the key count
+        every operation is timed, p50 / p99 / max are reported for each growth stage
+**********/
+
+using bench_clock_t = std::chrono::steady_clock;
+
+struct latency_t {
+    std::vector<std::uint64_t>  m_nanos;
+
+    void record(const bench_clock_t::time_point start) {
+        const auto l_nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock_t::now() - start).count();
+        m_nanos.push_back(static_cast<std::uint64_t>(l_nanos));
+    }
+};
+
+std::uint64_t percentile(std::vector<std::uint64_t> & nanos, const double pct) {
+    if(nanos.empty()) {
+        return 0;
+    }
+    const auto l_pos = static_cast<std::size_t>(pct * static_cast<double>(nanos.size() - 1));
+    std::nth_element(nanos.begin(), nanos.begin() + static_cast<std::ptrdiff_t>(l_pos), nanos.end());
+    return nanos[l_pos];
+}
+
+template<typename Table>
+void run_stage(Table & table, const std::size_t from, const std::size_t to, const std::size_t threads_count) {
+    std::vector<latency_t>      l_insert(threads_count);
+    std::vector<latency_t>      l_lookup(threads_count);
+    std::vector<std::thread>    l_threads;
+
+    const auto l_start = bench_clock_t::now();
+    for(std::size_t t = 0; t < threads_count; ++t) {
+        l_threads.push_back(std::thread([&, t]{
+            for(std::size_t i = from + t; i < to; i += threads_count) {
+                auto l_op_start = bench_clock_t::now();
+                table.add_or_update(i, i);
+                l_insert[t].record(l_op_start);
+
+                const std::size_t   l_key = (i * 2654435761u) % (i + 1);
+                l_op_start = bench_clock_t::now();
+                const std::size_t   l_val = table.get(l_key, to);
+                l_lookup[t].record(l_op_start);
+                if((l_val != l_key) and (l_val != to)) {
+                    throw std::logic_error("bad value for key");
+                }
+            }
+        }));
+    }
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double> l_elapsed = bench_clock_t::now() - l_start;
+
+    std::vector<std::uint64_t>  l_all_insert, l_all_lookup;
+    for(std::size_t t = 0; t < threads_count; ++t) {
+        l_all_insert.insert(l_all_insert.end(), l_insert[t].m_nanos.begin(), l_insert[t].m_nanos.end());
+        l_all_lookup.insert(l_all_lookup.end(), l_lookup[t].m_nanos.begin(), l_lookup[t].m_nanos.end());
+    }
+
+    std::cout << std::setw(10) << to
+              << std::setw(10) << table.bucket_count()
+              << std::setw(12) << static_cast<std::size_t>(static_cast<double>(2 * (to - from)) / l_elapsed.count())
+              << std::setw(10) << percentile(l_all_insert, 0.50)
+              << std::setw(10) << percentile(l_all_insert, 0.99)
+              << std::setw(12) << percentile(l_all_insert, 1.0)
+              << std::setw(10) << percentile(l_all_lookup, 0.50)
+              << std::setw(10) << percentile(l_all_lookup, 0.99)
+              << std::setw(12) << percentile(l_all_lookup, 1.0) << '\n';
+}
+
+int main(int argc, char * argv[]) {
+
+    const std::size_t max_keys      = (argc > 1) ? std::stoul(argv[1]) : 1'000'000;
+    const std::size_t hw_threads    = std::thread::hardware_concurrency();
+    const std::size_t threads_count = (argc > 2) ? std::stoul(argv[2]) : (hw_threads ? hw_threads : 2);
+
+    {
+        // same usage as the fixed bucket example
+        thsafe_lookup_table<std::string, std::string> ltable(20);
+        for(std::size_t i = 0; i < 100; ++i) {
+            ltable.add_or_update(std::string("key-")+std::to_string(i), std::string("value-")+std::to_string(i));
+        }
+        ltable.remove("key-7");
+        std::cout << "size " << ltable.size() << ", buckets " << ltable.bucket_count()
+                  << ", key-42 => " << ltable.get("key-42") << ", key-7 => " << ltable.get("key-7", "DEFAULT_VAL") << "\n\n";
+    }
+
+    std::cout << "threads: " << threads_count << ", latencies in ns\n";
+    std::cout << std::setw(10) << "keys" << std::setw(10) << "buckets" << std::setw(12) << "ops/s"
+              << std::setw(10) << "ins p50" << std::setw(10) << "ins p99" << std::setw(12) << "ins max"
+              << std::setw(10) << "get p50" << std::setw(10) << "get p99" << std::setw(12) << "get max" << '\n';
+
+    thsafe_lookup_table<std::size_t, std::size_t>   ltable;
+    std::size_t from = 0;
+    for(std::size_t to = 1'000; from < max_keys; to *= 10) {
+        to = std::min(to, max_keys);
+        run_stage(ltable, from, to, threads_count);
+        from = to;
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+Migration of a bucket splices the std::list nodes into the new buckets,
+keys and values are neither copied nor reallocated during a resize.
+
+The only global state written by every modification is the key counter (m_size),
+it is updated with a relaxed fetch_add/fetch_sub because it is only used to trigger a resize.
+A get writes nothing shared: the current table is a raw pointer loaded with acquire, no reference
+count is taken, the retired tables stay allocated (m_next_owner) as long as the lookup table.
+Because every modifying call migrates migrate_step buckets, a table of N buckets
+is fully migrated after at most N / migrate_step modifications, well before the next doubling is due.
+
+The p99 latency stays flat as the table grows from 1K keys to millions of keys,
+with the fixed 17 buckets of thread_safe_lookup_table.cpp each lookup would scan size/17 entries.
+
+Only the thread which claims the resize (m_resize_claimed) allocates the new bucket array, the other
+threads which see the load factor exceeded carry on and help migrating once m_next is published.
+If the allocation throws, the claim is released and the exception goes to the caller of the
+modification, the key is already stored and the next modification tries to grow the table again.
+The max column is a single operation: the claiming thread value-initializes the new array
+(8.9M buckets of a std::shared_mutex and a std::list, 780 MB for the last doubling), and with 4 threads
+on one core an operation can also wait for a preempted lock holder. The samples are 64 bit, not clamped.
+
+The run stops at 10M keys: it used 2.2 GB (max RSS of the process, getrusage from its parent), a list node of 48 bytes per key, 88 bytes per bucket,
+the current bucket array and the retired ones (together smaller than the current one, the same peak as
+both arrays during a migration) and 16 bytes of latency samples per key.
+50M keys need about 10 GB, twice the memory of this machine.
+
+Output (g++ -O2, ./resizable_lookup_table 10000000 4, on a single core machine)
+size 99, buckets 80, key-42 => value-42, key-7 => DEFAULT_VAL
+
+threads: 4, latencies in ns
+      keys   buckets       ops/s   ins p50   ins p99     ins max   get p50   get p99     get max
+      1000       544     2368248       153      2475       44343        92       169         379
+     10000      8704     2419518       205      1672     2359400       135       363         730
+    100000     69632     1677885       252      2730    19908492       262       749    12020165
+   1000000    557056     1569747       255      2710   172015199       536      1210    22131845
+  10000000   4456448     1236028       268      2941  1982765712       694      1582    45098379
+
+*****/
+
+/*****
+    END OF FILE
+**********/
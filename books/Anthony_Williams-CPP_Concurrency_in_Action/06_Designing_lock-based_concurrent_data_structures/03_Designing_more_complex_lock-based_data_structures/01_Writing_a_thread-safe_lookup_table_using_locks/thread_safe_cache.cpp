@@ -0,0 +1,470 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    https://en.wikipedia.org/wiki/Page_replacement_algorithm#Clock
+    https://en.wikipedia.org/wiki/Zipf%27s_law
+
+6.3.1 Writing a thread-safe lookup table using locks (bounded cache)
+
+thsafe_lookup_table never evicts anything, a cache in front of a slow backing store
+keeps every key it ever loaded. thsafe_cache keeps the design of the lookup table
+(a fixed number of independently locked shards, the shard of a key is a property of its hash)
+and adds what a cache needs:
+
+	-> capacity
+		the total capacity is split across the shards (at most one shard per unit of capacity),
+		the cost of an entry is given by a weigher,
+		by default every entry costs 1 (entry based), a weigher returning the size in bytes makes it byte based
+	-> CLOCK eviction (an approximation of LRU)
+		a hit only sets the referenced flag of the entry, an atomic store under the shared lock of the shard,
+		there is no list to reorder and so no exclusive lock on hits.
+		When a shard is over capacity the clock hand sweeps its entries,
+		a referenced entry gets a second chance (the flag is cleared), the first unreferenced one is evicted
+	-> per entry TTL
+		an expired entry is a miss, it is removed by the next write or by the clock hand
+	-> counters
+		hits, misses, evictions, expirations and loads, relaxed atomics kept per shard to avoid a shared cache line
+	-> get_or_compute(key, loader)
+		single-flight: concurrent misses on the same key call the loader once,
+		the other threads wait on a std::shared_future for its result.
+		The loader runs without any lock held.
+
+Usage
+    ./thread_safe_cache [threads] [operations_per_thread] [capacity]
+
+**********/
+
+#include <iostream>
+#include <exception>
+#include <memory>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <shared_mutex>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
+
+#include "thsafe_lookup_table.hpp"
+
+struct cache_stats_t {
+    std::size_t hits        = 0;
+    std::size_t misses      = 0;
+    std::size_t evictions   = 0;
+    std::size_t expirations = 0;
+    std::size_t loads       = 0;
+    std::size_t size        = 0;
+    std::size_t cost        = 0;
+};
+
+template<typename val_t>
+struct unit_weigher {
+    std::size_t operator()(const val_t &) const { return 1; }
+};
+
+template<typename key_t, typename val_t, typename weigher_t = unit_weigher<val_t>,
+         typename hash_t = thsafe_hash<key_t>, typename key_equal_t = std::equal_to<>>
+class thsafe_cache {
+    public:
+    using clock_t       = std::chrono::steady_clock;
+    using value_ptr_t   = std::shared_ptr<const val_t>;
+
+    private:
+    struct entry_t {
+        key_t               m_key;
+        value_ptr_t         m_val;
+        std::size_t         m_cost;
+        clock_t::time_point m_expiry;
+        std::size_t         m_ring_pos;
+        std::atomic<bool>   m_referenced{false};
+
+        bool expired(const clock_t::time_point now) const {
+            return m_expiry <= now;
+        }
+    };
+
+    class alignas(64) shard_t {
+        std::unordered_map<key_t, std::unique_ptr<entry_t>, hash_t, key_equal_t>    m_entries;
+        std::vector<entry_t *>                                                      m_ring;     // clock order
+        std::size_t                                                                 m_hand = 0;
+        std::size_t                                                                 m_cost = 0;
+        const std::size_t                                                           m_capacity;
+        mutable std::shared_mutex                                                   m_mutex;
+
+        std::unordered_map<key_t, std::shared_future<value_ptr_t>, hash_t, key_equal_t>   m_in_flight;
+
+        mutable std::atomic<std::size_t>    m_hits{0};
+        mutable std::atomic<std::size_t>    m_misses{0};
+        std::atomic<std::size_t>            m_evictions{0};
+        std::atomic<std::size_t>            m_expirations{0};
+        std::atomic<std::size_t>            m_loads{0};
+
+        // all private functions expect the caller to hold the exclusive lock
+        void erase(entry_t & entry) {
+            entry_t * l_last = m_ring.back();
+            l_last->m_ring_pos = entry.m_ring_pos;
+            m_ring[entry.m_ring_pos] = l_last;
+            m_ring.pop_back();
+            m_cost -= entry.m_cost;
+            m_entries.erase(m_entries.find(entry.m_key));   // destroys entry
+        }
+
+        // second chance sweep, expired entries go first
+        void evict_over_capacity() {
+            const auto l_now = clock_t::now();
+            while((m_cost > m_capacity) and not m_ring.empty()) {
+                if(m_hand >= m_ring.size()) {
+                    m_hand = 0;
+                }
+                entry_t & l_entry = *m_ring[m_hand];
+                if(l_entry.expired(l_now)) {
+                    m_expirations.fetch_add(1, std::memory_order_relaxed);
+                    erase(l_entry);
+                } else if(l_entry.m_referenced.exchange(false, std::memory_order_relaxed)) {
+                    ++m_hand;
+                } else {
+                    m_evictions.fetch_add(1, std::memory_order_relaxed);
+                    erase(l_entry);
+                }
+            }
+        }
+
+        void insert(const key_t & key, value_ptr_t val, const std::size_t cost, const clock_t::time_point expiry) {
+            auto l_itr = m_entries.find(key);
+            if(m_entries.end() != l_itr) {
+                entry_t & l_entry = *(l_itr->second);
+                m_cost      = m_cost - l_entry.m_cost + cost;
+                l_entry.m_val       = std::move(val);
+                l_entry.m_cost      = cost;
+                l_entry.m_expiry    = expiry;
+                l_entry.m_referenced.store(true, std::memory_order_relaxed);
+            } else {
+                auto l_entry = std::make_unique<entry_t>(key, std::move(val), cost, expiry, m_ring.size());
+                m_ring.push_back(l_entry.get());
+                m_entries.emplace(key, std::move(l_entry));
+                m_cost += cost;
+            }
+            evict_over_capacity();
+        }
+
+        public:
+        explicit shard_t(const std::size_t capacity) : m_capacity(capacity) { }
+
+        template<typename lookup_key_t>
+        value_ptr_t get(const lookup_key_t & key) const {
+            std::shared_lock    l_lock(m_mutex);
+            const auto l_itr = m_entries.find(key);
+            if((m_entries.end() == l_itr) or l_itr->second->expired(clock_t::now())) {
+                m_misses.fetch_add(1, std::memory_order_relaxed);
+                return value_ptr_t();
+            }
+            entry_t & l_entry = *(l_itr->second);
+            // avoid writing the cache line when the flag is already set
+            if(not l_entry.m_referenced.load(std::memory_order_relaxed)) {
+                l_entry.m_referenced.store(true, std::memory_order_relaxed);
+            }
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return l_entry.m_val;
+        }
+
+        void put(const key_t & key, value_ptr_t val, const std::size_t cost, const clock_t::time_point expiry) {
+            std::lock_guard l_lock(m_mutex);
+            insert(key, std::move(val), cost, expiry);
+        }
+
+        template<typename lookup_key_t>
+        void remove(const lookup_key_t & key) {
+            std::lock_guard l_lock(m_mutex);
+            const auto l_itr = m_entries.find(key);
+            if(m_entries.end() != l_itr) {
+                erase(*(l_itr->second));
+            }
+        }
+
+        template<typename Loader, typename Weigher>
+        value_ptr_t get_or_compute(const key_t & key, Loader & loader, const Weigher & weigher, const clock_t::duration ttl) {
+            if(value_ptr_t l_val = get(key)) {
+                return l_val;
+            }
+
+            std::promise<value_ptr_t>   l_promise;
+            {
+                std::unique_lock    l_lock(m_mutex);
+                // another thread may have loaded it in the meantime
+                const auto l_itr = m_entries.find(key);
+                if((m_entries.end() != l_itr) and not l_itr->second->expired(clock_t::now())) {
+                    return l_itr->second->m_val;
+                }
+                const auto l_flight = m_in_flight.find(key);
+                if(m_in_flight.end() != l_flight) {
+                    std::shared_future<value_ptr_t> l_future = l_flight->second;
+                    l_lock.unlock();
+                    return l_future.get();
+                }
+                m_in_flight.emplace(key, l_promise.get_future().share());
+            }
+
+            try {
+                value_ptr_t l_val = std::make_shared<const val_t>(loader(key));
+                const std::size_t l_cost = weigher(*l_val);
+                m_loads.fetch_add(1, std::memory_order_relaxed);
+                {
+                    std::lock_guard l_lock(m_mutex);
+                    insert(key, l_val, l_cost, expiry_for(ttl));
+                    m_in_flight.erase(key);
+                }
+                l_promise.set_value(l_val);
+                return l_val;
+            } catch(...) {
+                {
+                    std::lock_guard l_lock(m_mutex);
+                    m_in_flight.erase(key);
+                }
+                l_promise.set_exception(std::current_exception());
+                throw;
+            }
+        }
+
+        void add_stats(cache_stats_t & stats) const {
+            stats.hits          += m_hits.load(std::memory_order_relaxed);
+            stats.misses        += m_misses.load(std::memory_order_relaxed);
+            stats.evictions     += m_evictions.load(std::memory_order_relaxed);
+            stats.expirations   += m_expirations.load(std::memory_order_relaxed);
+            stats.loads         += m_loads.load(std::memory_order_relaxed);
+            std::shared_lock    l_lock(m_mutex);
+            stats.size          += m_entries.size();
+            stats.cost          += m_cost;
+        }
+    }; // shard_t
+
+    std::vector<std::unique_ptr<shard_t>>   m_shards;
+    hash_t                                  m_hasher;
+    weigher_t                               m_weigher;
+
+    template<typename lookup_key_t>
+    shard_t & get_shard(const lookup_key_t & key) const {
+        const std::size_t   index = m_hasher(key)%m_shards.size();
+        return *(m_shards[index]);
+    }
+
+    static clock_t::time_point expiry_for(const clock_t::duration ttl) {
+        return (clock_t::duration::zero() == ttl) ? clock_t::time_point::max() : clock_t::now() + ttl;
+    }
+
+    public:
+    thsafe_cache(const thsafe_cache &)              = delete;
+    thsafe_cache & operator=(const thsafe_cache &)  = delete;
+
+    // capacity is in units of the weigher, i.e. entries by default
+    // the shard capacities add up to capacity, there are at most capacity shards so none is empty
+    explicit thsafe_cache(const std::size_t capacity, const std::size_t num_shards = 17,
+            const weigher_t & weigher = weigher_t(), const hash_t & hasher = hash_t())
+        : m_shards(std::max<std::size_t>(1, std::min(num_shards, capacity))), m_hasher(hasher), m_weigher(weigher) {
+            const std::size_t l_count = m_shards.size();
+            for(std::size_t i = 0; i < l_count; ++i) {
+                m_shards[i] = std::make_unique<shard_t>(capacity / l_count + ((i < capacity % l_count) ? 1 : 0));
+            }
+    }
+
+    // empty pointer on a miss or if the entry expired
+    template<typename lookup_key_t = key_t>
+    value_ptr_t get(const lookup_key_t & key) const {
+        return get_shard(key).get(key);
+    }
+
+    // ttl of zero means the entry never expires
+    void put(const key_t & key, val_t val, const clock_t::duration ttl = clock_t::duration::zero()) {
+        const std::size_t l_cost = m_weigher(val);
+        get_shard(key).put(key, std::make_shared<const val_t>(std::move(val)), l_cost, expiry_for(ttl));
+    }
+
+    template<typename lookup_key_t = key_t>
+    void remove(const lookup_key_t & key) {
+        get_shard(key).remove(key);
+    }
+
+    // on a miss loader(key) is called once for all concurrent callers with the same key,
+    // an exception from the loader is propagated to all of them and nothing is cached
+    template<typename Loader>
+    value_ptr_t get_or_compute(const key_t & key, Loader loader, const clock_t::duration ttl = clock_t::duration::zero()) {
+        return get_shard(key).get_or_compute(key, loader, m_weigher, ttl);
+    }
+
+    cache_stats_t stats() const {
+        cache_stats_t   l_stats;
+        for(const auto & shard : m_shards) {
+            shard->add_stats(l_stats);
+        }
+        return l_stats;
+    }
+};
+
+/*****
+    Benchmark
+        keys follow a Zipf distribution (s = 0.99) over 1M keys, the cache holds 10% of them,
+        a miss loads the value from a slow backing store (about 20 us)
+**********/
+
+class zipf_distribution {
+    std::vector<double> m_cdf;
+
+    public:
+    zipf_distribution(const std::size_t n, const double s) : m_cdf(n) {
+        double l_sum = 0;
+        for(std::size_t i = 0; i < n; ++i) {
+            l_sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            m_cdf[i] = l_sum;
+        }
+        for(auto & val : m_cdf) {
+            val /= l_sum;
+        }
+    }
+
+    template<typename Generator>
+    std::size_t operator()(Generator & gen) const {
+        const double l_u = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+        return static_cast<std::size_t>(std::lower_bound(m_cdf.begin(), m_cdf.end(), l_u) - m_cdf.begin());
+    }
+};
+
+std::string backing_store_load(const std::string & key) {
+    const auto l_until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+    while(std::chrono::steady_clock::now() < l_until) { }
+    return "value-of-" + key;
+}
+
+struct string_bytes_weigher {
+    std::size_t operator()(const std::string & val) const { return sizeof(std::string) + val.capacity(); }
+};
+
+void print_stats(const cache_stats_t & stats) {
+    const double l_lookups = static_cast<double>(stats.hits + stats.misses);
+    std::cout << "hits " << stats.hits << ", misses " << stats.misses
+              << ", hit ratio " << std::setprecision(3) << (l_lookups ? static_cast<double>(stats.hits) / l_lookups : 0.0)
+              << ", evictions " << stats.evictions << ", expirations " << stats.expirations
+              << ", loads " << stats.loads << ", size " << stats.size << ", cost " << stats.cost << '\n';
+}
+
+int main(int argc, char * argv[]) {
+    using namespace std::chrono_literals;
+
+    {
+        // TTL and single-flight
+        thsafe_cache<std::string, std::string>  lcache(100, 4);
+        lcache.put("short-lived", "gone soon", 20ms);
+        lcache.put("long-lived", "stays");
+        std::this_thread::sleep_for(30ms);
+        std::cout << "short-lived " << (lcache.get("short-lived") ? "found" : "expired")
+                  << ", long-lived " << *lcache.get(std::string_view("long-lived")) << '\n';
+
+        std::atomic<int>            l_loader_calls{0};
+        std::vector<std::thread>    l_threads;
+        for(int i = 0; i < 8; ++i) {
+            l_threads.push_back(std::thread([&]{
+                lcache.get_or_compute("slow-key", [&](const std::string & key){
+                    ++l_loader_calls;
+                    std::this_thread::sleep_for(50ms);
+                    return "computed-" + key;
+                });
+            }));
+        }
+        for(auto & th : l_threads) {
+            th.join();
+        }
+        std::cout << "8 concurrent misses, loader called " << l_loader_calls << " time(s), value " << *lcache.get("slow-key") << '\n';
+        print_stats(lcache.stats());
+        std::cout << '\n';
+    }
+
+    const std::size_t   threads_count   = (argc > 1) ? std::stoul(argv[1]) : 8;
+    const std::size_t   ops_per_thread  = (argc > 2) ? std::stoul(argv[2]) : 200'000;
+    const std::size_t   capacity        = (argc > 3) ? std::stoul(argv[3]) : 100'000;
+    const std::size_t   key_space       = 1'000'000;
+
+    const zipf_distribution         l_zipf(key_space, 0.99);
+    std::vector<std::string>        l_keys;
+    for(std::size_t i = 0; i < key_space; ++i) {
+        l_keys.push_back("user:" + std::to_string(i * 2654435761u % 1000000007u));
+    }
+
+    auto run = [&](auto & cache, const char * name) {
+        std::vector<std::thread>    l_threads;
+        const auto l_start = std::chrono::steady_clock::now();
+        for(std::size_t t = 0; t < threads_count; ++t) {
+            l_threads.push_back(std::thread([&, t]{
+                std::mt19937_64 l_gen(t);
+                std::size_t     l_bytes = 0;
+                for(std::size_t i = 0; i < ops_per_thread; ++i) {
+                    l_bytes += cache.get_or_compute(l_keys[l_zipf(l_gen)], backing_store_load)->size();
+                }
+                if(0 == l_bytes) {
+                    std::cout << "nothing loaded\n";
+                }
+            }));
+        }
+        for(auto & th : l_threads) {
+            th.join();
+        }
+        const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+        std::cout << name << ": " << static_cast<std::size_t>(static_cast<double>(threads_count * ops_per_thread) / l_elapsed.count()) << " ops/s\n";
+        print_stats(cache.stats());
+    };
+
+    std::cout << "zipf 0.99 over " << key_space << " keys, " << threads_count << " threads, "
+              << ops_per_thread << " operations per thread\n";
+
+    thsafe_cache<std::string, std::string>  l_entry_cache(capacity, 64);
+    run(l_entry_cache, "entry capacity");
+
+    thsafe_cache<std::string, std::string, string_bytes_weigher>    l_byte_cache(capacity * 64, 64);
+    run(l_byte_cache, "byte capacity ");
+
+    thsafe_cache<std::string, std::string>  l_unbounded(key_space * 2, 64);
+    run(l_unbounded, "unbounded     ");
+
+    return 0;
+}
+
+/*****
+Explanation
+
+get() takes the shared lock of one shard, readers of the same shard run concurrently,
+the referenced flag is only written when it is not already set, so hot entries do not keep dirtying their cache line.
+
+The clock hand gives every referenced entry a second chance, on a skewed (Zipf) workload
+the hot keys are referenced again before the hand comes back and stay, the cold tail is evicted.
+The hit ratio stays close to the unbounded table while holding a tenth of the entries.
+
+get_or_compute() registers a std::shared_future for the key before calling the loader,
+later misses on the same key find it and wait, so the backing store sees one load per key.
+The loader runs without the lock of the shard, so other keys of the shard are not blocked by a slow load.
+
+Output (g++ -O2, ./thread_safe_cache 8 100000 on a single core machine)
+short-lived expired, long-lived stays
+8 concurrent misses, loader called 1 time(s), value computed-slow-key
+hits 2, misses 9, hit ratio 0.182, evictions 0, expirations 0, loads 1, size 3, cost 3
+
+zipf 0.99 over 1000000 keys, 8 threads, 100000 operations per thread
+entry capacity: 127440 ops/s
+hits 590242, misses 209758, hit ratio 0.738, evictions 109750, expirations 0, loads 209750, size 100000, cost 100000
+byte capacity : 128338 ops/s
+hits 591527, misses 208473, hit ratio 0.739, evictions 105291, expirations 0, loads 208460, size 103169, cost 6396463
+unbounded     : 132285 ops/s
+hits 607102, misses 192898, hit ratio 0.759, evictions 0, expirations 0, loads 192891, size 192891, cost 192891
+
+*****/
+
+/*****
+    END OF FILE
+**********/
@@ -50,95 +50,16 @@ The downside is that you need a good hash function for the key. The C++ Standard
 #include <exception>
 #include <memory>
 
-#include <list>
+#include <array>
+#include <charconv>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <thread>
-#include <mutex>
 #include <syncstream>
-#include <shared_mutex>
 
-#include <algorithm>
-
-template<typename key_t, typename val_t, typename hash_t = std::hash<key_t>>
-class thsafe_lookup_table {
-
-    class bucket_t {
-        using bucket_val_t  = std::pair<key_t, val_t>;
-        using bucket_data_t = std::list<bucket_val_t>;
-        using bucket_itr_t  = bucket_data_t::iterator;
-
-        bucket_data_t       m_bucket_data;
-        std::shared_mutex   m_bucket_data_mutex;
-
-        bucket_itr_t find_entry_for(const key_t & key)  {
-            return std::find_if(m_bucket_data.begin(), m_bucket_data.end(),
-            [&](const bucket_val_t & bval){ return key == bval.first; });
-        }
-
-        public:
-
-        void remove(const key_t & key) {
-            std::lock_guard         l_lock(m_bucket_data_mutex);
-            bucket_itr_t l_itr =    find_entry_for(key);
-            if(m_bucket_data.end() != l_itr) {
-                m_bucket_data.erase(l_itr);
-            }
-        }
-
-        void add_or_update(const key_t & key, const val_t & val) {
-            std::lock_guard         l_lock(m_bucket_data_mutex);
-            bucket_itr_t l_itr =    find_entry_for(key);
-            if(m_bucket_data.end() ==  l_itr) {
-                m_bucket_data.push_back(bucket_val_t{key, val});
-            } else {
-                l_itr->second = val;
-            }
-        }
-
-        val_t get(const key_t & key, const val_t & default_val)  {
-            std::shared_lock        l_lock(m_bucket_data_mutex);
-            bucket_itr_t l_itr = find_entry_for(key);
-            if(m_bucket_data.end() == l_itr) {
-                return default_val;
-            }
-            return l_itr->second;
-        }
-    }; // bucket_t
-
-    std::vector<std::unique_ptr<bucket_t>>  m_buckets;
-    hash_t                                  m_hasher;
-
-    bucket_t & get_bucket(const key_t & key) const {
-        const std::size_t   index = m_hasher(key)%m_buckets.size();
-        return *(m_buckets[index]);
-    }
-
-    public:
-    thsafe_lookup_table(const thsafe_lookup_table &)                = delete;
-    thsafe_lookup_table & operator=(const thsafe_lookup_table &)    = delete;
-
-    thsafe_lookup_table(const std::size_t num_buckets = 17, const hash_t & hasher = hash_t()) 
-        : m_buckets(num_buckets), m_hasher(hasher) {
-            for(std::size_t i = 0; i < num_buckets; ++i) {
-                m_buckets[i] = std::make_unique<bucket_t>();
-            }
-    }
-
-    val_t get(const key_t & key, const val_t & default_val = val_t{}) const {
-        return get_bucket(key).get(key, default_val);
-    }
-
-    void add_or_update(const key_t & key, const val_t & val) {
-        get_bucket(key).add_or_update(key, val);
-    }
-
-    void remove(const key_t & key) {
-        get_bucket(key).remove(key);
-    }
-
-};
+#include "thsafe_lookup_table.hpp"
 
 const std::size_t count = 20;
 
@@ -159,12 +80,19 @@ void remove_keys(const std::size_t count) {
     }  
 }
 
+// lookup through a std::string_view into a stack buffer and visit the value in place,
+// no std::string is built for the key and the value is not copied
 void get(const std::size_t count) {
+    std::array<char, 32>    l_key_buf{'k', 'e', 'y', '-'};
     for(std::size_t i = 0; i < count; ++i) {
-        const std::string l_key = std::string("key-")+std::to_string(i);
-        std::string l_default_val = std::string("DEFAULT_VAL"); 
-        const auto val = gtable.get(l_key);
-        std::cout << "Value for " << l_key << " is " << val << '\n';
+        const auto              l_res = std::to_chars(l_key_buf.data() + 4, l_key_buf.data() + l_key_buf.size(), i);
+        const std::string_view  l_key(l_key_buf.data(), l_res.ptr);
+        const bool l_found = gtable.visit(l_key, [&](const std::string & val){
+            syn_cout << "Value for " << l_key << " is " << val << '\n';
+        });
+        if(not l_found) {
+            syn_cout << "Value for " << l_key << " is DEFAULT_VAL" << '\n';
+        }
     }
 }
 
@@ -203,6 +131,19 @@ if the assignment throws, you’re relying on it leaving the original unchanged.
 But this doesn’t affect the data structure as a whole and is entirely a property of the user-supplied type, 
 so you can safely leave it up to the user to handle this.
 
+Heterogeneous lookup (thsafe_lookup_table.hpp)
+get(), visit() and remove() take a const key_t & as before, so a key that converts to key_t still works,
+e.g. get(1) on a thsafe_lookup_table<long, int>.
+As for std::unordered_map, template overloads on the lookup key type are added
+only when the hash and the key equality are both transparent (they define is_transparent).
+The key can then be anything they accept, like std::string_view or const char * for a std::string key:
+	-> thsafe_hash<std::string> hashes a std::string_view, std::hash<std::string> gives the same value for the same characters
+	-> std::equal_to<> compares the lookup key and the stored key without a conversion
+
+get() returns a copy of the value, visit(key, f) calls f(const val_t &) under the shared lock of the bucket instead.
+f runs while the bucket is locked, so it should be short and must not call back into the table.
+See heterogeneous_lookup.cpp for the allocations saved per lookup.
+
 *****/
 
 /*****
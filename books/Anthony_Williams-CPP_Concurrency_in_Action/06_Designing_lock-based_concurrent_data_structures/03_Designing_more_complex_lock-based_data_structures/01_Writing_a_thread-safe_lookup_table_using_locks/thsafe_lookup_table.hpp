@@ -0,0 +1,161 @@
+
+#ifndef THSAFE_LOOKUP_TABLE
+#define THSAFE_LOOKUP_TABLE
+
+#include <exception>
+#include <memory>
+
+#include <list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mutex>
+#include <shared_mutex>
+
+#include <algorithm>
+#include <concepts>
+#include <functional>
+#include <utility>
+
+// std::hash<key_t>, except for std::string keys where the hash is computed on a std::string_view,
+// so a lookup with a std::string_view or a const char * does not have to build a std::string
+template<typename key_t>
+struct thsafe_hash : std::hash<key_t> { };
+
+template<>
+struct thsafe_hash<std::string> {
+    using is_transparent = void;
+
+    std::size_t operator()(const std::string_view key) const noexcept {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+template<typename key_t, typename val_t,
+         typename hash_t = thsafe_hash<key_t>, typename key_equal_t = std::equal_to<>>
+class thsafe_lookup_table {
+
+    // as for std::unordered_map, the template overloads taking a key other than key_t
+    // exist only when both hash_t and key_equal_t are transparent
+    template<typename lookup_key_t>
+    static constexpr bool is_lookup_key =
+        requires { typename hash_t::is_transparent; typename key_equal_t::is_transparent; } and
+        std::invocable<const hash_t &, const lookup_key_t &> and
+        std::predicate<const key_equal_t &, const lookup_key_t &, const key_t &>;
+
+    class bucket_t {
+        using bucket_val_t  = std::pair<key_t, val_t>;
+        using bucket_data_t = std::list<bucket_val_t>;
+        using bucket_itr_t  = typename bucket_data_t::iterator;
+
+        bucket_data_t       m_bucket_data;
+        std::shared_mutex   m_bucket_data_mutex;
+        key_equal_t         m_key_equal;
+
+        template<typename lookup_key_t>
+        bucket_itr_t find_entry_for(const lookup_key_t & key)  {
+            return std::find_if(m_bucket_data.begin(), m_bucket_data.end(),
+            [&](const bucket_val_t & bval){ return m_key_equal(key, bval.first); });
+        }
+
+        public:
+
+        template<typename lookup_key_t>
+        void remove(const lookup_key_t & key) {
+            std::lock_guard         l_lock(m_bucket_data_mutex);
+            bucket_itr_t l_itr =    find_entry_for(key);
+            if(m_bucket_data.end() != l_itr) {
+                m_bucket_data.erase(l_itr);
+            }
+        }
+
+        void add_or_update(const key_t & key, const val_t & val) {
+            std::lock_guard         l_lock(m_bucket_data_mutex);
+            bucket_itr_t l_itr =    find_entry_for(key);
+            if(m_bucket_data.end() ==  l_itr) {
+                m_bucket_data.push_back(bucket_val_t{key, val});
+            } else {
+                l_itr->second = val;
+            }
+        }
+
+        template<typename lookup_key_t>
+        val_t get(const lookup_key_t & key, const val_t & default_val)  {
+            std::shared_lock        l_lock(m_bucket_data_mutex);
+            bucket_itr_t l_itr = find_entry_for(key);
+            if(m_bucket_data.end() == l_itr) {
+                return default_val;
+            }
+            return l_itr->second;
+        }
+
+        template<typename lookup_key_t, typename Function>
+        bool visit(const lookup_key_t & key, Function & f)  {
+            std::shared_lock        l_lock(m_bucket_data_mutex);
+            bucket_itr_t l_itr = find_entry_for(key);
+            if(m_bucket_data.end() == l_itr) {
+                return false;
+            }
+            f(std::as_const(l_itr->second));
+            return true;
+        }
+    }; // bucket_t
+
+    std::vector<std::unique_ptr<bucket_t>>  m_buckets;
+    hash_t                                  m_hasher;
+
+    template<typename lookup_key_t>
+    bucket_t & get_bucket(const lookup_key_t & key) const {
+        const std::size_t   index = m_hasher(key)%m_buckets.size();
+        return *(m_buckets[index]);
+    }
+
+    public:
+    thsafe_lookup_table(const thsafe_lookup_table &)                = delete;
+    thsafe_lookup_table & operator=(const thsafe_lookup_table &)    = delete;
+
+    thsafe_lookup_table(const std::size_t num_buckets = 17, const hash_t & hasher = hash_t())
+        : m_buckets(num_buckets), m_hasher(hasher) {
+            for(std::size_t i = 0; i < num_buckets; ++i) {
+                m_buckets[i] = std::make_unique<bucket_t>();
+            }
+    }
+
+    val_t get(const key_t & key, const val_t & default_val = val_t{}) const {
+        return get_bucket(key).get(key, default_val);
+    }
+
+    template<typename lookup_key_t> requires is_lookup_key<lookup_key_t>
+    val_t get(const lookup_key_t & key, const val_t & default_val = val_t{}) const {
+        return get_bucket(key).get(key, default_val);
+    }
+
+    // calls f(const val_t &) under the shared lock of the bucket, returns false if the key is not present
+    // f must not call back into the table for a key of the same bucket
+    template<typename Function>
+    bool visit(const key_t & key, Function f) const {
+        return get_bucket(key).visit(key, f);
+    }
+
+    template<typename lookup_key_t, typename Function> requires is_lookup_key<lookup_key_t>
+    bool visit(const lookup_key_t & key, Function f) const {
+        return get_bucket(key).visit(key, f);
+    }
+
+    void add_or_update(const key_t & key, const val_t & val) {
+        get_bucket(key).add_or_update(key, val);
+    }
+
+    void remove(const key_t & key) {
+        get_bucket(key).remove(key);
+    }
+
+    template<typename lookup_key_t> requires is_lookup_key<lookup_key_t>
+    void remove(const lookup_key_t & key) {
+        get_bucket(key).remove(key);
+    }
+
+};
+
+#endif  // THSAFE_LOOKUP_TABLE
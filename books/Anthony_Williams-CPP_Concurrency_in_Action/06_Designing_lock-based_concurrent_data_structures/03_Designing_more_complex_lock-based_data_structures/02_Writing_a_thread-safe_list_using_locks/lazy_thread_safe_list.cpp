@@ -0,0 +1,442 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Heller, Herlihy, Luchangco, Moir, Scherer, Shavit - A Lazy Concurrent List-Based Set Algorithm
+
+6.3.2 Writing a thread-safe list using locks (lazy list with optimistic validation)
+
+	thsafe_list in thread_safe_list.cpp uses hand-over-hand locking,
+	for_each(), find_first_if() and remove_first_if() lock and unlock the mutex of every node they pass,
+	so a traversal costs two mutex operations per element, even when nobody modifies the list.
+
+	The lazy list keeps the nodes sorted and moves all locking to the modifications:
+		-> traversals (for_each, find_first_if, contains) take no lock at all,
+		   they follow the atomic next pointers and skip nodes marked as removed
+		-> insert and remove search without locks, then lock only the two nodes involved (pred, curr)
+		   and validate that both are still unmarked and still adjacent (pred->next == curr),
+		   if validation fails, the operation starts again
+		-> remove first marks the node (logical removal) and then unlinks it (physical removal),
+		   a traversal which already stands on the node can still follow its next pointer
+
+	A removed node may still be in use by a traversal, it is retired to the rcu_domain of rcu_snapshot.hpp
+	and deleted only after a grace period, every traversal runs inside an rcu read-side section.
+
+**********/
+
+#include <iostream>
+#include <exception>
+#include <memory>
+#include <string>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <syncstream>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <utility>
+
+#include "rcu_snapshot.hpp"
+
+template<typename T, typename Compare = std::less<T>>
+class thsafe_lazy_list {
+    struct Node {
+        std::shared_ptr<T>  m_data;
+        std::atomic<Node *> m_next{nullptr};
+        std::atomic<bool>   m_marked{false};
+        std::mutex          m_node_mutex;
+
+        Node()  { }
+        Node(T val) :   m_data(std::make_shared<T>(std::move(val)))  { }
+    };
+
+    // sentinels, m_head is before and m_tail after every element
+    Node            m_head;
+    Node            m_tail;
+    Compare         m_less;
+    rcu_domain &    m_domain = rcu_domain::instance();
+    std::atomic<std::size_t>    m_retired_count{0};
+
+    bool less(const Node * node, const T & val) const {
+        return (node != &m_tail) and m_less(*(node->m_data), val);
+    }
+
+    bool equal(const Node * node, const T & val) const {
+        return (node != &m_tail) and not m_less(*(node->m_data), val) and not m_less(val, *(node->m_data));
+    }
+
+    static bool validate(const Node * pred, const Node * curr) {
+        return not pred->m_marked.load(std::memory_order_relaxed) and
+               not curr->m_marked.load(std::memory_order_relaxed) and
+               (pred->m_next.load(std::memory_order_relaxed) == curr);
+    }
+
+    // caller holds the locks of pred and curr and has validated them
+    void unlink(Node * pred, Node * curr) {
+        curr->m_marked.store(true, std::memory_order_release);
+        pred->m_next.store(curr->m_next.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    // the nodes may still be read by traversals, delete them after a grace period
+    void retire(std::vector<Node *> & removed) {
+        for(Node * node : removed) {
+            m_domain.retire([node]{ delete node; });
+        }
+        if(not removed.empty() and ((m_retired_count.fetch_add(removed.size()) + removed.size()) % 64) < removed.size()) {
+            m_domain.synchronize();
+        }
+        removed.clear();
+    }
+
+    public:
+    thsafe_lazy_list(const Compare & less = Compare()) : m_less(less) {
+        m_head.m_next.store(&m_tail);
+    }
+
+    ~thsafe_lazy_list() {
+        Node * current = m_head.m_next.load();
+        while(current != &m_tail) {
+            Node * next = current->m_next.load();
+            delete current;
+            current = next;
+        }
+    }
+
+    thsafe_lazy_list(const thsafe_lazy_list & )             = delete;
+    thsafe_lazy_list& operator=(const thsafe_lazy_list & )  = delete;
+
+    // keeps the list sorted, returns false if an equal element is already present
+    bool insert(const T & val) {
+        auto new_node   = std::make_unique<Node>(val);
+        while(true) {
+            rcu_read_guard  l_guard(m_domain);
+            Node * pred = &m_head;
+            Node * curr = pred->m_next.load(std::memory_order_acquire);
+            while(less(curr, val)) {
+                pred = curr;
+                curr = curr->m_next.load(std::memory_order_acquire);
+            }
+
+            std::scoped_lock    l_lock(pred->m_node_mutex, curr->m_node_mutex);
+            if(not validate(pred, curr)) {
+                continue;
+            }
+            if(equal(curr, val)) {
+                return false;
+            }
+            new_node->m_next.store(curr, std::memory_order_relaxed);
+            pred->m_next.store(new_node.release(), std::memory_order_release);
+            return true;
+        }
+    }
+
+    bool remove(const T & val) {
+        std::vector<Node *> l_removed;
+        bool                l_found = false;
+        while(true) {
+            rcu_read_guard  l_guard(m_domain);
+            Node * pred = &m_head;
+            Node * curr = pred->m_next.load(std::memory_order_acquire);
+            while(less(curr, val)) {
+                pred = curr;
+                curr = curr->m_next.load(std::memory_order_acquire);
+            }
+
+            std::scoped_lock    l_lock(pred->m_node_mutex, curr->m_node_mutex);
+            if(not validate(pred, curr)) {
+                continue;
+            }
+            if(equal(curr, val)) {
+                unlink(pred, curr);
+                l_removed.push_back(curr);
+                l_found = true;
+            }
+            break;
+        }
+        retire(l_removed);
+        return l_found;
+    }
+
+    bool contains(const T & val) const {
+        rcu_read_guard  l_guard(m_domain);
+        const Node * curr = m_head.m_next.load(std::memory_order_acquire);
+        while(less(curr, val)) {
+            curr = curr->m_next.load(std::memory_order_acquire);
+        }
+        return equal(curr, val) and not curr->m_marked.load(std::memory_order_acquire);
+    }
+
+    template<typename Predicate>
+    std::shared_ptr<T>  find_first_if(Predicate p) const {
+        rcu_read_guard  l_guard(m_domain);
+        for(const Node * curr = m_head.m_next.load(std::memory_order_acquire); curr != &m_tail;
+                curr = curr->m_next.load(std::memory_order_acquire)) {
+            if(not curr->m_marked.load(std::memory_order_acquire) and p(*(curr->m_data))) {
+                return curr->m_data;
+            }
+        }
+        return std::shared_ptr<T>();
+    }
+
+    // removes every element for which p returns true
+    template<typename Predicate>
+    void  remove_if(Predicate p) {
+        std::vector<Node *> l_removed;
+        {
+            rcu_read_guard  l_guard(m_domain);
+            Node * pred = &m_head;
+            Node * curr = pred->m_next.load(std::memory_order_acquire);
+            while(curr != &m_tail) {
+                if(curr->m_marked.load(std::memory_order_acquire) or not p(*(curr->m_data))) {
+                    pred = curr;
+                    curr = curr->m_next.load(std::memory_order_acquire);
+                    continue;
+                }
+                std::scoped_lock    l_lock(pred->m_node_mutex, curr->m_node_mutex);
+                if(validate(pred, curr)) {
+                    unlink(pred, curr);
+                    l_removed.push_back(curr);
+                    curr = curr->m_next.load(std::memory_order_relaxed);
+                } else {
+                    // lost a race with another modification, start again from the head
+                    pred = &m_head;
+                    curr = pred->m_next.load(std::memory_order_acquire);
+                }
+            }
+        }
+        retire(l_removed);
+    }
+
+    template<typename Function>
+    void for_each(Function f) const {
+        rcu_read_guard  l_guard(m_domain);
+        for(const Node * curr = m_head.m_next.load(std::memory_order_acquire); curr != &m_tail;
+                curr = curr->m_next.load(std::memory_order_acquire)) {
+            if(not curr->m_marked.load(std::memory_order_acquire)) {
+                f(std::as_const(*(curr->m_data)));
+            }
+        }
+    }
+};
+
+// thsafe_list of thread_safe_list.cpp, hand-over-hand locking, kept for the benchmark
+template<typename T>
+class thsafe_list {
+    struct Node {
+        std::shared_ptr<T>      m_data;
+        std::unique_ptr<Node>   m_next;
+        std::mutex              m_node_mutex;
+
+        Node()  : m_next()  { }
+        Node(T val) :   m_data(std::make_shared<T>(val))    { }
+    };
+
+    Node    m_head;
+    public:
+    void push_front(const T & val) {
+        auto new_node   = std::make_unique<Node>(val);
+        std::unique_lock   l_head_lock(m_head.m_node_mutex);
+        new_node -> m_next  = std::move(m_head.m_next);
+        m_head.m_next = std::move(new_node);
+    }
+
+    template<typename Predicate>
+    void  remove_first_if(Predicate p) {
+        Node    * current = &m_head;
+        std::unique_lock    l_lock(current->m_node_mutex);
+        while(Node * next = current->m_next.get()) {
+            std::unique_lock    l_next_lock(next->m_node_mutex);
+            if(p(*(next->m_data))) {
+                auto l_node_to_remove = std::move(current->m_next);
+                current->m_next = std::move(next->m_next);
+                l_next_lock.unlock();
+            }
+            else {
+                l_lock.unlock();
+                current = next;
+                l_lock = std::move(l_next_lock);
+            }
+        }
+    }
+
+    template<typename Function>
+    void for_each(Function f) {
+        Node * current = &m_head;
+        std::unique_lock    l_lock(current->m_node_mutex);
+        while(Node * next = current->m_next.get()) {
+            std::unique_lock    l_next_lock(next->m_node_mutex);
+            l_lock.unlock();
+            f(*(next->m_data));
+            current = next;
+            l_lock = std::move(l_next_lock);
+        }
+    }
+};
+
+std::osyncstream syn_cout(std::cout);
+
+thsafe_lazy_list<std::string>   glist;
+
+void push_val(std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        glist.insert(std::string("sample string ") + std::to_string(i));
+    }
+}
+
+void remove_val(std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        glist.remove(std::string("sample string ") + std::to_string(i));
+    }
+}
+
+void find_val(std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        auto val = glist.find_first_if([i=i](const std::string & val){return not(val.compare(std::string("sample string ") + std::to_string(i)));});
+        if(val) {
+            syn_cout << "Value is : " << *val << '\n';
+        }
+    }
+}
+
+/*****
+    Benchmark
+        a subscriber registry of 1000 ids, reader threads call for_each constantly,
+        one writer thread adds and removes a subscriber in a loop
+        traversals per second and modifications per second are reported for both lists
+**********/
+
+struct bench_result_t {
+    double  m_traversals;
+    double  m_modifications;
+};
+
+template<typename List, typename Add, typename Remove>
+bench_result_t run_bench(List & list, Add add, Remove remove, const std::size_t readers, const std::chrono::milliseconds duration) {
+    std::atomic<bool>           l_stop{false};
+    std::atomic<std::size_t>    l_traversals{0};
+    std::size_t                 l_modifications = 0;
+    std::vector<std::thread>    l_threads;
+
+    for(std::size_t t = 0; t < readers; ++t) {
+        l_threads.push_back(std::thread([&]{
+            std::size_t l_count = 0, l_sum = 0;
+            while(not l_stop.load(std::memory_order_relaxed)) {
+                list.for_each([&](const int & id){ l_sum += static_cast<std::size_t>(id); });
+                ++l_count;
+            }
+            l_traversals.fetch_add(l_count);
+            if(0 == l_sum) {
+                std::cout << "empty registry\n";
+            }
+        }));
+    }
+    std::thread l_writer([&]{
+        for(int id = 1'000'000; not l_stop.load(std::memory_order_relaxed); ++id) {
+            add(id);
+            remove(id);
+            l_modifications += 2;
+        }
+    });
+
+    const auto l_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    l_stop.store(true);
+    l_writer.join();
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    return { static_cast<double>(l_traversals.load()) / l_elapsed.count(), static_cast<double>(l_modifications) / l_elapsed.count() };
+}
+
+int main(int argc, char * argv[]) {
+    {
+        std::vector<std::thread>    vecth;
+        const std::size_t count = 20;
+
+        vecth.push_back(std::thread(push_val, count));
+        vecth.push_back(std::thread(find_val, count));
+        vecth.push_back(std::thread(remove_val, count/2));
+        vecth.push_back(std::thread([]{
+            glist.for_each([](const std::string & val){ syn_cout << val << " called for it" << '\n'; });
+        }));
+        vecth.push_back(std::thread(find_val, count));
+
+        for(auto & th : vecth) {
+            th.join();
+        }
+        glist.remove_if([](const std::string & val){ return val.ends_with('7'); });
+        syn_cout << "contains sample string 17 : " << glist.contains("sample string 17") << '\n';
+        syn_cout.emit();
+    }
+
+    const std::size_t   max_readers = (argc > 1) ? std::stoul(argv[1]) : 8;
+    const auto          duration    = std::chrono::milliseconds((argc > 2) ? std::stoul(argv[2]) : 300);
+
+    thsafe_lazy_list<int>   l_lazy;
+    thsafe_list<int>        l_hoh;
+    for(int id = 0; id < 1000; ++id) {
+        l_lazy.insert(id);
+        l_hoh.push_front(id);
+    }
+
+    std::cout << std::setw(8) << "readers"
+              << std::setw(18) << "hoh traversal/s" << std::setw(18) << "lazy traversal/s"
+              << std::setw(16) << "hoh modify/s" << std::setw(16) << "lazy modify/s" << '\n';
+    for(std::size_t readers = 1; readers <= max_readers; readers *= 2) {
+        const auto l_hoh_res = run_bench(l_hoh,
+            [&](int id){ l_hoh.push_front(id); },
+            [&](int id){ l_hoh.remove_first_if([id](const int & val){ return val == id; }); },
+            readers, duration);
+        const auto l_lazy_res = run_bench(l_lazy,
+            [&](int id){ l_lazy.insert(id); },
+            [&](int id){ l_lazy.remove(id); },
+            readers, duration);
+        std::cout << std::setw(8) << readers
+                  << std::setw(18) << static_cast<std::size_t>(l_hoh_res.m_traversals)
+                  << std::setw(18) << static_cast<std::size_t>(l_lazy_res.m_traversals)
+                  << std::setw(16) << static_cast<std::size_t>(l_hoh_res.m_modifications)
+                  << std::setw(16) << static_cast<std::size_t>(l_lazy_res.m_modifications) << '\n';
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+A traversal of the lazy list is a chain of acquire loads, it writes nothing shared,
+the only store is the rcu read-side section entry and exit on the cache line owned by the thread.
+The hand-over-hand list writes two mutexes per element, and every reader writes the same mutexes.
+
+insert() and remove() lock two adjacent nodes with std::scoped_lock, always pred and curr,
+and validate after locking. A node is never unlinked without being marked first,
+so a successful validation means no other thread changed the link between pred and curr.
+
+contains() and find_first_if() may return an element which is being removed at the same time,
+they linearize at the point the marked flag is read, which is the usual guarantee of the lazy list.
+
+The list is a sorted set, an element equal to one already present is not inserted again.
+
+Traversals get an order of magnitude faster. Modifications get slower as readers are added:
+every 64th removal waits for a grace period, i.e. for the running traversals to finish,
+which is the right trade for a registry that is iterated constantly and modified rarely.
+
+Output (g++ -O2, ./lazy_thread_safe_list 8 300 on a single core machine, first part omitted)
+contains sample string 17 : 0
+ readers   hoh traversal/s  lazy traversal/s    hoh modify/s   lazy modify/s
+       1             19454            292818           37660           32789
+       2             23080            316960           27458           15775
+       4             30435            327384           13976            7560
+       8             29453            334858            6183            3622
+
+*****/
+
+/*****
+    END OF FILE
+**********/
@@ -0,0 +1,462 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    Herlihy, Shavit - The Art of Multiprocessor Programming, 14.4 A Lock-Free Concurrent Skiplist
+    Keir Fraser - Practical lock-freedom
+
+7.2 Examples of lock-free data structures
+
+Writing a lock-free skip list (an ordered map)
+==========================================
+thread_safe_lookup_table.cpp explains why a tree or a sorted array needs a single lock:
+every operation starts at the root, or cannot know in advance where in the array its key lives.
+The hash table avoids that but loses the order of the keys, there is no range scan.
+
+A skip list keeps the keys sorted in a linked list (level 0) and adds express lanes above it,
+a node is linked at level i with probability 1/2^i, so a search skips about half of the remaining nodes per level,
+O(log n) on average, like a balanced tree, but every change is a local pointer swap:
+
+	-> insert links the new node at level 0 with a compare/exchange (this is when it becomes visible),
+	   then links the upper levels one at a time, upper levels are only hints for the search
+	-> erase marks the next pointers of the node, top level first,
+	   the thread which marks level 0 owns the removal (logical deletion),
+	   then a search unlinks the marked node at every level (physical deletion)
+	-> the mark is the lowest bit of the next pointer, so marking a node and changing
+	   where it points can never both succeed, a compare/exchange on the pointer sees either
+	-> a search which finds a marked node on its way helps by unlinking it
+
+Readers (get, range, for_each) never write anything shared, they skip marked nodes.
+
+Reclamation
+	A node unlinked by one thread may still be under the feet of a concurrent search,
+	every operation runs in a read-side section of the rcu_domain of rcu_snapshot.hpp,
+	an unlinked node (or a replaced value) is retired and deleted after a grace period.
+	A node is retired once both its inserter has stopped linking upper levels and its remover has unlinked it,
+	m_owners counts these two.
+
+Usage
+    ./lock_free_skip_list [max_threads] [milliseconds_per_run]
+
+**********/
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <shared_mutex>
+
+#include <vector>
+#include <map>
+#include <optional>
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <random>
+
+#include "rcu_snapshot.hpp"
+
+template<typename key_t, typename val_t, typename Compare = std::less<key_t>>
+class lock_free_skip_list {
+    static constexpr int        max_height  = 24;
+    static constexpr std::size_t retire_batch = 256;
+
+    struct node {
+        key_t                                           m_key;
+        std::atomic<const val_t *>                      m_val;
+        const int                                       m_height;
+        std::unique_ptr<std::atomic<std::uintptr_t>[]>  m_next;
+        std::atomic<int>                                m_owners{2};     // inserter and remover
+
+        node(key_t key, const val_t * val, const int height)
+            : m_key(std::move(key)), m_val(val), m_height(height),
+              m_next(std::make_unique<std::atomic<std::uintptr_t>[]>(static_cast<std::size_t>(height))) { }
+
+        ~node() {
+            delete m_val.load();
+        }
+    };
+
+    static node * get_ptr(const std::uintptr_t word)   { return reinterpret_cast<node *>(word & ~std::uintptr_t{1}); }
+    static bool is_marked(const std::uintptr_t word)   { return word & 1; }
+    static std::uintptr_t to_word(const node * ptr)    { return reinterpret_cast<std::uintptr_t>(ptr); }
+
+    node                        m_head;
+    Compare                     m_less;
+    rcu_domain &                m_domain = rcu_domain::instance();
+    std::atomic<std::size_t>    m_retired_count{0};
+
+    bool less(const node * curr, const key_t & key) const {
+        return (nullptr != curr) and m_less(curr->m_key, key);
+    }
+
+    static int random_height() {
+        thread_local std::minstd_rand   l_gen(static_cast<unsigned>(std::hash<std::thread::id>{}(std::this_thread::get_id())));
+        return std::min(max_height, 1 + std::countr_one(static_cast<std::uint32_t>(l_gen())));
+    }
+
+    // fills preds/succs at every level, unlinks the marked nodes met on the way
+    // returns true if an unmarked node with the key is linked at level 0, it is succs[0]
+    bool find(const key_t & key, node ** preds, node ** succs) {
+        retry:
+        node * pred = &m_head;
+        for(int level = max_height - 1; level >= 0; --level) {
+            node * curr = get_ptr(pred->m_next[level].load());
+            while(nullptr != curr) {
+                std::uintptr_t l_succ = curr->m_next[level].load();
+                if(is_marked(l_succ)) {
+                    std::uintptr_t l_expected = to_word(curr);
+                    if(not pred->m_next[level].compare_exchange_strong(l_expected, to_word(get_ptr(l_succ)))) {
+                        goto retry;
+                    }
+                    curr = get_ptr(l_succ);
+                } else if(less(curr, key)) {
+                    pred = curr;
+                    curr = get_ptr(l_succ);
+                } else {
+                    break;
+                }
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return (nullptr != succs[0]) and not m_less(key, succs[0]->m_key);
+    }
+
+    // read only search, returns the first unmarked node with a key not less than key
+    const node * lower_bound_node(const key_t & key) const {
+        const node * pred = &m_head;
+        const node * curr = nullptr;
+        for(int level = max_height - 1; level >= 0; --level) {
+            curr = get_ptr(pred->m_next[level].load());
+            while(nullptr != curr) {
+                const std::uintptr_t l_succ = curr->m_next[level].load();
+                if(is_marked(l_succ)) {
+                    curr = get_ptr(l_succ);
+                } else if(less(curr, key)) {
+                    pred = curr;
+                    curr = get_ptr(l_succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        return curr;
+    }
+
+    void release_owner(node * n) {
+        if(1 == n->m_owners.fetch_sub(1)) {
+            m_domain.retire([n]{ delete n; });
+            m_retired_count.fetch_add(1);
+        }
+    }
+
+    // must be called outside of a read-side section
+    void reclaim_if_needed() {
+        std::size_t l_count = m_retired_count.load();
+        while((l_count >= retire_batch) and not m_retired_count.compare_exchange_weak(l_count, 0)) {
+        }
+        if(l_count >= retire_batch) {
+            m_domain.synchronize();
+        }
+    }
+
+    bool insert_or_assign_impl(const key_t & key, std::unique_ptr<const val_t> val) {
+        node * preds[max_height];
+        node * succs[max_height];
+        rcu_read_guard  l_guard(m_domain);
+        while(true) {
+            if(find(key, preds, succs)) {
+                const val_t * l_old = succs[0]->m_val.exchange(val.release());
+                m_domain.retire([l_old]{ delete l_old; });
+                m_retired_count.fetch_add(1);
+                return false;
+            }
+
+            const int   l_height = random_height();
+            auto        l_node   = std::make_unique<node>(key, val.get(), l_height);
+            for(int level = 0; level < l_height; ++level) {
+                l_node->m_next[level].store(to_word(succs[level]), std::memory_order_relaxed);
+            }
+            std::uintptr_t l_expected = to_word(succs[0]);
+            if(not preds[0]->m_next[0].compare_exchange_strong(l_expected, to_word(l_node.get()))) {
+                l_node->m_val.store(nullptr);       // val is still owned by the unique_ptr
+                continue;
+            }
+            val.release();
+            node * n = l_node.release();
+
+            // upper levels, stop as soon as a remover has marked the node
+            for(int level = 1; level < l_height; ++level) {
+                while(true) {
+                    std::uintptr_t l_next = n->m_next[level].load();
+                    if(is_marked(l_next)) {
+                        goto linked;
+                    }
+                    if((get_ptr(l_next) != succs[level]) and
+                       not n->m_next[level].compare_exchange_strong(l_next, to_word(succs[level]))) {
+                        goto linked;                // only a remover changes it before it is linked
+                    }
+                    l_expected = to_word(succs[level]);
+                    if(preds[level]->m_next[level].compare_exchange_strong(l_expected, to_word(n))) {
+                        break;
+                    }
+                    find(key, preds, succs);
+                    if(is_marked(n->m_next[0].load())) {
+                        goto linked;
+                    }
+                }
+            }
+            linked:
+            // a remover which ran its find before a level was linked left the node there, unlink it
+            if(is_marked(n->m_next[0].load())) {
+                find(key, preds, succs);
+            }
+            release_owner(n);
+            return true;
+        }
+    }
+
+    public:
+    lock_free_skip_list(const Compare & less = Compare())
+        : m_head(key_t{}, nullptr, max_height), m_less(less) {
+        for(int level = 0; level < max_height; ++level) {
+            m_head.m_next[level].store(0);
+        }
+    }
+
+    ~lock_free_skip_list() {
+        node * curr = get_ptr(m_head.m_next[0].load());
+        while(nullptr != curr) {
+            node * next = get_ptr(curr->m_next[0].load());
+            delete curr;
+            curr = next;
+        }
+    }
+
+    lock_free_skip_list(const lock_free_skip_list &)                = delete;
+    lock_free_skip_list & operator=(const lock_free_skip_list &)    = delete;
+
+    // returns true if the key was inserted, false if the value of an existing key was replaced
+    bool insert_or_assign(const key_t & key, const val_t & val) {
+        const bool l_inserted = insert_or_assign_impl(key, std::make_unique<const val_t>(val));
+        reclaim_if_needed();
+        return l_inserted;
+    }
+
+    bool erase(const key_t & key) {
+        node *  preds[max_height];
+        node *  succs[max_height];
+        bool    l_erased = false;
+        {
+            rcu_read_guard  l_guard(m_domain);
+            if(find(key, preds, succs)) {
+                node * n = succs[0];
+                for(int level = n->m_height - 1; level > 0; --level) {
+                    std::uintptr_t l_next = n->m_next[level].load();
+                    while(not is_marked(l_next) and not n->m_next[level].compare_exchange_weak(l_next, l_next | 1)) {
+                    }
+                }
+                std::uintptr_t l_next = n->m_next[0].load();
+                while(not is_marked(l_next)) {
+                    if(n->m_next[0].compare_exchange_strong(l_next, l_next | 1)) {
+                        l_erased = true;
+                        find(key, preds, succs);
+                        release_owner(n);
+                        break;
+                    }
+                }
+            }
+        }
+        reclaim_if_needed();
+        return l_erased;
+    }
+
+    std::optional<val_t> get(const key_t & key) const {
+        rcu_read_guard  l_guard(m_domain);
+        const node * curr = lower_bound_node(key);
+        if((nullptr == curr) or m_less(key, curr->m_key)) {
+            return std::nullopt;
+        }
+        return *(curr->m_val.load());
+    }
+
+    bool contains(const key_t & key) const {
+        rcu_read_guard  l_guard(m_domain);
+        const node * curr = lower_bound_node(key);
+        return (nullptr != curr) and not m_less(key, curr->m_key);
+    }
+
+    // calls f(key, value) in key order for every key in [first, last)
+    template<typename Function>
+    void range(const key_t & first, const key_t & last, Function f) const {
+        rcu_read_guard  l_guard(m_domain);
+        for(const node * curr = lower_bound_node(first); less(curr, last); curr = get_ptr(curr->m_next[0].load())) {
+            if(not is_marked(curr->m_next[0].load())) {
+                f(curr->m_key, *(curr->m_val.load()));
+            }
+        }
+    }
+
+    // calls f(key, value) in key order for every key
+    template<typename Function>
+    void for_each(Function f) const {
+        rcu_read_guard  l_guard(m_domain);
+        for(const node * curr = get_ptr(m_head.m_next[0].load()); nullptr != curr; curr = get_ptr(curr->m_next[0].load())) {
+            if(not is_marked(curr->m_next[0].load())) {
+                f(curr->m_key, *(curr->m_val.load()));
+            }
+        }
+    }
+};
+
+/*****
+    Benchmark
+        500K keys out of 1M, every thread runs 70% get, 10% insert, 10% erase and 10% range scans of 64 keys
+        lock_free_skip_list against a std::map guarded by a std::shared_mutex
+**********/
+
+struct locked_map_t {
+    std::map<int, int>          m_map;
+    mutable std::shared_mutex   m_mutex;
+
+    std::optional<int> get(const int key) const {
+        std::shared_lock    l_lock(m_mutex);
+        const auto l_itr = m_map.find(key);
+        return (l_itr == m_map.end()) ? std::nullopt : std::optional<int>(l_itr->second);
+    }
+    bool insert_or_assign(const int key, const int val) {
+        std::lock_guard     l_lock(m_mutex);
+        return m_map.insert_or_assign(key, val).second;
+    }
+    bool erase(const int key) {
+        std::lock_guard     l_lock(m_mutex);
+        return m_map.erase(key) > 0;
+    }
+    template<typename Function>
+    void range(const int first, const int last, Function f) const {
+        std::shared_lock    l_lock(m_mutex);
+        for(auto l_itr = m_map.lower_bound(first); (l_itr != m_map.end()) and (l_itr->first < last); ++l_itr) {
+            f(l_itr->first, l_itr->second);
+        }
+    }
+};
+
+template<typename Map>
+double ops_per_second(Map & map, const std::size_t threads_count, const std::chrono::milliseconds duration) {
+    std::atomic<bool>           l_stop{false};
+    std::atomic<std::size_t>    l_total_ops{0};
+    std::vector<std::thread>    l_threads;
+
+    for(std::size_t t = 0; t < threads_count; ++t) {
+        l_threads.push_back(std::thread([&, t]{
+            std::mt19937                        l_gen(static_cast<unsigned>(t));
+            std::uniform_int_distribution<int>  l_key(0, 999'999);
+            std::uniform_int_distribution<int>  l_op(0, 9);
+            std::size_t l_ops = 0;
+            long long   l_sum = 0;
+            while(not l_stop.load(std::memory_order_relaxed)) {
+                const int l_k = l_key(l_gen);
+                switch(l_op(l_gen)) {
+                    case 0:     map.insert_or_assign(l_k, l_k);   break;
+                    case 1:     map.erase(l_k);                     break;
+                    case 2:     map.range(l_k, l_k + 128, [&](const int, const int val){ l_sum += val; }); break;
+                    default:    l_sum += map.get(l_k).value_or(0);  break;
+                }
+                ++l_ops;
+            }
+            l_total_ops.fetch_add(l_ops);
+            if(l_sum < 0) {
+                std::cout << "overflow\n";
+            }
+        }));
+    }
+    const auto l_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    l_stop.store(true);
+    for(auto & th : l_threads) {
+        th.join();
+    }
+    const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    return static_cast<double>(l_total_ops.load()) / l_elapsed.count();
+}
+
+int main(int argc, char * argv[]) {
+    {
+        lock_free_skip_list<std::string, int>   l_prices;
+        std::vector<std::thread>                l_threads;
+        for(int t = 0; t < 4; ++t) {
+            l_threads.push_back(std::thread([&, t]{
+                for(int i = t; i < 40; i += 4) {
+                    l_prices.insert_or_assign("order-" + std::to_string(100 + i), i);
+                }
+            }));
+        }
+        for(auto & th : l_threads) {
+            th.join();
+        }
+        l_prices.erase("order-105");
+        l_prices.insert_or_assign("order-110", 1000);
+
+        std::cout << "range [order-104, order-112): ";
+        l_prices.range("order-104", "order-112", [](const std::string & key, const int val){ std::cout << key << '=' << val << ' '; });
+        std::cout << "\norder-105 " << (l_prices.contains("order-105") ? "present" : "erased")
+                  << ", order-139 = " << l_prices.get("order-139").value_or(-1) << "\n\n";
+    }
+
+    const std::size_t   max_threads = (argc > 1) ? std::stoul(argv[1]) : 8;
+    const auto          duration    = std::chrono::milliseconds((argc > 2) ? std::stoul(argv[2]) : 300);
+
+    lock_free_skip_list<int, int>   l_skip_list;
+    locked_map_t                    l_locked_map;
+    for(int key = 0; key < 1'000'000; key += 2) {
+        l_skip_list.insert_or_assign(key, key);
+        l_locked_map.insert_or_assign(key, key);
+    }
+
+    std::cout << std::setw(8) << "threads" << std::setw(22) << "map+shared_mutex op/s" << std::setw(18) << "skip list op/s" << '\n';
+    for(std::size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+        std::cout << std::setw(8) << threads_count
+                  << std::setw(22) << static_cast<std::size_t>(ops_per_second(l_locked_map, threads_count, duration))
+                  << std::setw(18) << static_cast<std::size_t>(ops_per_second(l_skip_list, threads_count, duration)) << '\n';
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+All atomic operations use the default std::memory_order_seq_cst, the algorithm relies on a node
+being fully built before the compare/exchange which publishes it, and on a remover's mark being
+visible to an inserter which checks for it after linking a level.
+
+A range scan walks level 0 from the lower bound, it sees every key which was present for the whole scan
+and may or may not see keys inserted or erased during the scan, like any other lock-free iteration.
+
+With std::map every writer excludes all readers for the duration of a rebalancing insert or erase,
+and every reader writes the shared_mutex state. The skip list lets readers, writers and
+range scans run on different parts of the key space at the same time.
+
+Output (g++ -O2, ./lock_free_skip_list 8 300 on a single core machine,
+there is no parallelism to win here, std::map is faster per operation on one core)
+range [order-104, order-112): order-104=4 order-106=6 order-107=7 order-108=8 order-109=9 order-110=1000 order-111=11 
+order-105 erased, order-139 = 39
+
+ threads map+shared_mutex op/s    skip list op/s
+       1                648463            523390
+       2                619210            465623
+       4                589332            520489
+       8                654046            530113
+
+*****/
+
+/*****
+    END OF FILE
+**********/
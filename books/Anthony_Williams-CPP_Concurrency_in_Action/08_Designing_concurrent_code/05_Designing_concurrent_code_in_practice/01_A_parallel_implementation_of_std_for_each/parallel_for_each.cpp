@@ -20,47 +20,35 @@ use std::thread::hardware_concurrency() to determine the number of threads
 the elements can be processed entirely independently, so you can use contiguous blocks to avoid false sharing
 use the std::packaged_task and std::future mechanisms to transfer the exception between threads
 
+Creating threads_count - 1 threads on every call (or a std::async per half in the recursive version)
+costs tens of microseconds per thread, for small inputs far more than the work itself.
+The blocks are now tasks of an executor (executor.hpp): by default a thread pool shared by the program
+and created once, any other executor can be passed as the last argument.
+task_group replaces the packaged_task / future pairs, it transfers the first exception to the caller.
+
+Usage
+    ./parallel_for_each [concurrency]
+
 
 **********/
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <future>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <thread>
 #include <vector>
 
-namespace nonstd {
-class jthread {
-    std::thread m_thread;
-
-   public:
-    ~jthread() { 
-        if(m_thread.joinable()) m_thread.join();
-    }
-    jthread() { }
-    jthread(std::thread athread) : m_thread(std::move(athread)) {}
-
-    jthread(const jthread &)    = delete;
-    jthread & operator=(const jthread &)    = delete;
-
-    jthread(jthread && other)
-        : m_thread(std::move(other.m_thread)) { }
-
-    jthread& operator=(jthread && other) {
-        if(this != &other) {
-            m_thread = std::move(other.m_thread);
-        }
-        return *this;
-    }
-};
-}  // namespace nonstd
-
+#include "executor.hpp"
 
 void fun(std::string arg) { std::cout << arg << '\n'; }
 
-template <typename It, typename Callable>
-void parallel_for_each(It begin, It end, Callable callable) {
+// the blocks run as tasks of the executor, the calling thread processes the last one
+template <typename It, typename Callable, typename Executor = thread_pool>
+void parallel_for_each(It begin, It end, Callable callable, Executor& executor = default_executor()) {
     const auto length = std::distance(begin, end);
     if (not length) {
         return;
@@ -69,36 +57,55 @@ void parallel_for_each(It begin, It end, Callable callable) {
     const size_t per_thread_count = 25;
     const size_t max_threads =
         (length + per_thread_count - 1) / per_thread_count;
-    const size_t hardware_threads_count = std::thread::hardware_concurrency();
-    const size_t threads_count = std::min(
-        hardware_threads_count ? hardware_threads_count : 2, max_threads);
+    const size_t threads_count = std::min(executor.concurrency(), max_threads);
 
     const size_t block_size = length / threads_count;
 
-    std::vector<nonstd::jthread>    tvec(threads_count - 1);
-    std::vector<std::future<void>>  fvec(threads_count - 1);
-    //join_threads joiner(tvec);
+    task_group group(executor);
 
     It block_start = begin;
     It block_end = block_start;
 
     for (size_t i = 0; i < (threads_count - 1); ++i) {
         std::advance(block_end, block_size);
-        std::packaged_task<void(void)> task(
-            [=]() { std::for_each(block_start, block_end, callable); });
-
-        fvec[i] = task.get_future();
-        tvec[i] = nonstd::jthread(std::thread(std::move(task)));
-
+        group.run([=]() { std::for_each(block_start, block_end, callable); });
         block_start = block_end;
     }
     std::for_each(block_start, end, callable);
 
-    for (size_t i = 0; i < (threads_count - 1); ++i) {
-        fvec[i].get();
+    group.wait();
+}
+
+// the recursive split of parallel_for_each_using_async, the first half is a task of the executor
+template <typename It, typename Callable, typename Executor>
+void parallel_for_each_split(It begin, It end, Callable callable, Executor& executor, const long grain) {
+    const auto length = std::distance(begin, end);
+
+    if (length < (2 * grain)) {
+        std::for_each(begin, end, callable);
+    } else {
+        const It mid_point = begin + length / 2;
+
+        task_group group(executor);
+        group.run([=, &executor] { parallel_for_each_split(begin, mid_point, callable, executor, grain); });
+
+        parallel_for_each_split(mid_point, end, callable, executor, grain);
+
+        group.wait();
     }
 }
 
+// the grain of the book (25 elements) makes length / 25 tasks, 40000 for one million elements:
+// the leaves are at least 4096 elements, and about 8 per thread of the executor for larger inputs
+template <typename It, typename Callable, typename Executor = thread_pool>
+void parallel_for_each_recursive(It begin, It end, Callable callable, Executor& executor = default_executor()) {
+    const auto length = std::distance(begin, end);
+    if (not length) return;
+
+    const long grain = std::max<long>(4096, static_cast<long>(length / static_cast<long>(8 * executor.concurrency())));
+    parallel_for_each_split(begin, end, callable, executor, grain);
+}
+
 template <typename It, typename Callable>
 void parallel_for_each_using_async(It begin, It end, Callable callable) {
     const auto length = std::distance(begin, end);
@@ -121,7 +128,47 @@ void parallel_for_each_using_async(It begin, It end, Callable callable) {
     }
 }
 
-int main() {
+/*****
+    Benchmark
+        microseconds per call for inputs of 1K to 1M integers, the work per element is a multiply-add,
+        the executors have the same concurrency
+**********/
+
+template <typename Func>
+double us_per_call(Func func) {
+    using namespace std::chrono;
+    std::size_t l_calls = 0;
+    const auto l_start = steady_clock::now();
+    auto l_now = l_start;
+    while ((l_calls < 3) or (l_now - l_start < milliseconds(200))) {
+        func();
+        ++l_calls;
+        l_now = steady_clock::now();
+    }
+    return duration<double, std::micro>(l_now - l_start).count() / static_cast<double>(l_calls);
+}
+
+void benchmark(const std::size_t concurrency) {
+    thread_pool l_pool(static_cast<unsigned>(concurrency - 1));
+    new_thread_executor l_new_threads(concurrency);
+    const auto l_work = [](std::uint32_t& x) { x = x * 2654435761u + 1; };
+
+    std::cout << "microseconds per call, concurrency " << concurrency << '\n';
+    std::cout << std::setw(10) << "elements" << std::setw(14) << "std::for_each" << std::setw(14) << "new threads"
+              << std::setw(14) << "std::async" << std::setw(14) << "pool" << std::setw(16) << "pool recursive" << '\n';
+    for (std::size_t size = 1000; size <= 1000000; size *= 10) {
+        std::vector<std::uint32_t> l_data(size, 1);
+        std::cout << std::setw(10) << size << std::fixed << std::setprecision(1)
+                  << std::setw(14) << us_per_call([&] { std::for_each(l_data.begin(), l_data.end(), l_work); })
+                  << std::setw(14) << us_per_call([&] { parallel_for_each(l_data.begin(), l_data.end(), l_work, l_new_threads); })
+                  << std::setw(14) << us_per_call([&] { parallel_for_each_using_async(l_data.begin(), l_data.end(), l_work); })
+                  << std::setw(14) << us_per_call([&] { parallel_for_each(l_data.begin(), l_data.end(), l_work, l_pool); })
+                  << std::setw(16) << us_per_call([&] { parallel_for_each_recursive(l_data.begin(), l_data.end(), l_work, l_pool); })
+                  << '\n';
+    }
+}
+
+int main(int argc, char* argv[]) {
     constexpr size_t count = 1000;
     std::vector<std::string> svec;
     for (size_t i = 0; i < count; ++i) {
@@ -132,9 +179,40 @@ int main() {
     // parallel_for_each_using_async(svec.begin(), svec.end(), fun);
     parallel_for_each(svec.begin(), svec.end(), fun);
 
+    const std::size_t concurrency = (argc > 1) ? std::stoul(argv[1]) : 4;
+    benchmark(std::max<std::size_t>(2, concurrency));
+
     return 0;
 }
 
+/*****
+Explanation
+
+std::async with the default policy starts a thread for every half in libstdc++, the recursive version
+creates length / 25 threads per call, 40000 for one million elements.
+
+With the pool a call costs a few pushes on the queue and the wake up of the workers,
+the time per element is the same as std::for_each as soon as the blocks are a few thousand elements long.
+
+The recursive pool version splits down to a grain of max(4096, length / (8 * concurrency)) elements.
+Every split is a task_group, a push, a pop and a wait, the grain of the book (25 elements) would make
+40000 of them for one million elements, far more than the work of their leaves.
+Below 8192 elements the call is a plain std::for_each (0.8 us for 1000 elements, the flat pool version
+still pays the wake up of the workers); one million elements with a concurrency of 4 make 32 leaves,
+8 per thread so that a thread which finishes early finds more, and the cost of the tasks disappears in the work.
+On one core the parallel versions cannot beat std::for_each, they can only stop losing to it;
+the columns of 1M elements vary by +-30 % from run to run on this machine.
+
+Output (g++ -O2, ./parallel_for_each on a single core machine, benchmark part)
+microseconds per call, concurrency 4
+  elements std::for_each   new threads    std::async          pool  pool recursive
+      1000           1.0          50.8        1128.0           4.5             0.8
+     10000          12.1          66.5       12078.3          17.7             9.8
+    100000         114.9         136.9      105979.6          87.8           114.1
+   1000000         622.7         652.7     2280127.9         757.9           815.7
+
+*****/
+
 /*****
     END OF FILE
 **********/
@@ -39,90 +39,183 @@ the other hand, if you want to allow the other workers to keep searching, you
 can use std::packaged_task, store all the exceptions, and then rethrow one of
 them if a match isn’t found.
 
+Starting threads_count - 1 threads on every call costs more than searching a few thousand elements.
+The blocks are now tasks of an executor (executor.hpp): by default a thread pool shared by the program
+and created once, any other executor can be passed as the last argument.
+The result is written by the block which sets the flag first (exchange), two blocks finding a match
+no longer both set the value of the same promise.
+
+parallel_find_first
+    parallel_find splits the range in threads_count fixed blocks: a match at the end of the first block
+    is only found when its thread reaches it, and the caller waits for every block, the match found
+    is not necessarily the first one.
+    parallel_find_first cuts the range in small chunks (64 KiB) claimed in order by a shared counter
+        -> every thread of the executor claims the next chunk when it is done with the previous one
+        -> the position of the best match is an atomic, lowered with compare/exchange,
+           a thread stops as soon as the chunk it claims starts after it:
+           every chunk before the best match was claimed and is searched entirely,
+           so the result is the first match by position, like std::find
+        -> the shared state is touched once per chunk, not once per element
+        -> for arithmetic types in a contiguous range the chunk is searched with
+           std::experimental::simd, several elements compared per instruction (4 uint32_t with SSE2,
+           8 with AVX2 when built with -march=native), and one test for four vectors
+
+Usage
+    g++ -O2 -std=c++20 -pthread [-march=native] parallel_find.cpp
+    ./parallel_find [concurrency] [elements]
+
 **********/
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <experimental/simd>
 #include <future>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
-namespace nonstd {
-class jthread {
-    std::thread m_thread;
-
-   public:
-    ~jthread() {
-        if (m_thread.joinable()) m_thread.join();
-    }
-    jthread() {}
-    jthread(std::thread athread) : m_thread(std::move(athread)) {}
-
-    jthread(const jthread &) = delete;
-    jthread &operator=(const jthread &) = delete;
-
-    jthread(jthread &&other) : m_thread(std::move(other.m_thread)) {}
-
-    jthread &operator=(jthread &&other) {
-        if (this != &other) {
-            m_thread = std::move(other.m_thread);
-        }
-        return *this;
-    }
-};
-}  // namespace nonstd
+#include "executor.hpp"
 
-template <typename It, typename Value>
-It parallel_find(It begin, It end, Value val) {
+// the blocks run as tasks of the executor, the calling thread searches the last one
+template <typename It, typename Value, typename Executor = thread_pool>
+It parallel_find(It begin, It end, Value val, Executor& executor = default_executor()) {
 
     const auto length = std::distance(begin, end);
     if(! length)
         return begin;
 
-    const size_t hardware_threads_count = std::thread::hardware_concurrency();
     const size_t per_thread_count = 100;
     const size_t max_threads = (length + per_thread_count - 1)/per_thread_count;
-    const size_t threads_count = std::min(hardware_threads_count?hardware_threads_count:2, max_threads);
+    const size_t threads_count = std::min(executor.concurrency(), max_threads);
     const size_t block_size = length/threads_count;
 
-    
-    std::promise<It>                result;
     std::atomic_bool                done{false};
+    It                              result = end;   // written by the block which sets done
 
     It block_start  = begin;
     It block_end    = block_start;
 
-    auto find_h = [&](It begin, It end, Value val) {
+    auto find_h = [&](It begin, It end) {
         if(done.load()) {
             
         } else {
             auto it = std::find(begin, end, val);
             if(it == end) {
 
-            } else {
-                done = true;
-                result.set_value(it);
+            } else if(! done.exchange(true)) {
+                result = it;
             }
         }
 
     };
 
     {
-        std::vector<nonstd::jthread>    tvec(threads_count-1);
+        task_group group(executor);
         for(size_t i = 0; i < (threads_count - 1); ++i) {
             std::advance(block_end, block_size);
-            tvec[i] = std::thread(find_h, block_start, block_end, val);
+            group.run([=, &find_h] { find_h(block_start, block_end); });
             block_start = block_end;
         }
-        find_h(block_start, end, val);
+        find_h(block_start, end);
+        group.wait();
     }
 
-    if(done.load()) {
-        return result.get_future().get();
+    return result;
+}
+
+namespace stdx = std::experimental;
+
+template <typename T>
+concept simd_searchable = std::is_arithmetic_v<T> and (not std::is_same_v<T, bool>);
+
+// first element equal to value in [first, last), one branch per four vectors
+template <simd_searchable T>
+const T* simd_find(const T* first, const T* last, const T value) {
+    using simd_t = stdx::native_simd<T>;
+    constexpr std::ptrdiff_t width = simd_t::size();
+    const simd_t l_value(value);
+
+    for (; last - first >= 4 * width; first += 4 * width) {
+        const simd_t a(first, stdx::element_aligned);
+        const simd_t b(first + width, stdx::element_aligned);
+        const simd_t c(first + 2 * width, stdx::element_aligned);
+        const simd_t d(first + 3 * width, stdx::element_aligned);
+        if (stdx::any_of((a == l_value) || (b == l_value) || (c == l_value) || (d == l_value))) {
+            break;
+        }
+    }
+    for (; last - first >= width; first += width) {
+        const auto l_mask = (simd_t(first, stdx::element_aligned) == l_value);
+        if (stdx::any_of(l_mask)) {
+            return first + stdx::find_first_set(l_mask);
+        }
     }
-    return end;
+    return std::find(first, last, value);
+}
+
+template <typename It, typename Value>
+It find_in_chunk(It begin, It end, const Value& val) {
+    using value_t = std::iter_value_t<It>;
+    if constexpr (std::contiguous_iterator<It> and simd_searchable<value_t> and std::is_same_v<value_t, Value>) {
+        const value_t* l_first = std::to_address(begin);
+        return begin + (simd_find(l_first, l_first + (end - begin), val) - l_first);
+    } else {
+        return std::find(begin, end, val);
+    }
+}
+
+template <typename It, typename Value, typename Executor = thread_pool>
+It parallel_find_first(It begin, It end, Value val, Executor& executor = default_executor()) {
+    const std::size_t length = static_cast<std::size_t>(std::distance(begin, end));
+    if (! length)
+        return end;
+
+    const std::size_t chunk_size = std::max<std::size_t>(1, (64 * 1024) / sizeof(std::iter_value_t<It>));
+    const std::size_t chunks_count = (length + chunk_size - 1) / chunk_size;
+    const std::size_t threads_count = std::min(executor.concurrency(), chunks_count);
+
+    alignas(64) std::atomic<std::size_t> next_chunk{0};
+    alignas(64) std::atomic<std::size_t> best{length};     // position of the first match found so far
+
+    auto search = [&] {
+        while (true) {
+            const std::size_t l_start = next_chunk.fetch_add(1, std::memory_order_relaxed) * chunk_size;
+            // chunks are claimed in order, every later chunk starts after the best match as well
+            if ((l_start >= length) or (l_start >= best.load(std::memory_order_relaxed))) {
+                return;
+            }
+            const It l_begin = std::next(begin, static_cast<std::ptrdiff_t>(l_start));
+            const It l_end = std::next(l_begin, static_cast<std::ptrdiff_t>(std::min(chunk_size, length - l_start)));
+            const It l_found = find_in_chunk(l_begin, l_end, val);
+            if (l_found != l_end) {
+                const std::size_t l_pos = static_cast<std::size_t>(std::distance(begin, l_found));
+                std::size_t l_best = best.load(std::memory_order_relaxed);
+                while ((l_pos < l_best) and
+                       (not best.compare_exchange_weak(l_best, l_pos, std::memory_order_relaxed))) {
+                }
+                return;
+            }
+        }
+    };
+
+    {
+        task_group group(executor);
+        for (std::size_t i = 0; i < (threads_count - 1); ++i) {
+            group.run(search);
+        }
+        search();
+        group.wait();
+    }
+
+    return std::next(begin, static_cast<std::ptrdiff_t>(best.load(std::memory_order_relaxed)));
 }
 
 template <typename It, typename Value>
@@ -157,7 +250,99 @@ It parallel_find_using_async(It begin, It end, Value val) {
 }
 
 
-int main() {
+/*****
+    Benchmark
+        microseconds per call for inputs of 1K to 1M integers, the value is at 5/8 of the range (inside a block of a task),
+        the executors have the same concurrency
+**********/
+
+std::size_t g_found_index = 0;    // keeps the searches from being optimized away
+
+template <typename Func>
+double us_per_call(Func func) {
+    using namespace std::chrono;
+    std::size_t l_calls = 0;
+    const auto l_start = steady_clock::now();
+    auto l_now = l_start;
+    while ((l_calls < 3) or (l_now - l_start < milliseconds(200))) {
+        g_found_index += static_cast<std::size_t>(func());
+        ++l_calls;
+        l_now = steady_clock::now();
+    }
+    return duration<double, std::micro>(l_now - l_start).count() / static_cast<double>(l_calls);
+}
+
+void benchmark(const std::size_t concurrency) {
+    thread_pool l_pool(static_cast<unsigned>(concurrency - 1));
+    new_thread_executor l_new_threads(concurrency);
+
+    std::cout << "microseconds per call, concurrency " << concurrency << '\n';
+    std::cout << std::setw(10) << "elements" << std::setw(14) << "std::find" << std::setw(14) << "new threads"
+              << std::setw(14) << "pool" << '\n';
+    for (std::size_t size = 1000; size <= 1000000; size *= 10) {
+        std::vector<std::uint32_t> l_data(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            l_data[i] = static_cast<std::uint32_t>(i);
+        }
+        const std::uint32_t l_value = static_cast<std::uint32_t>(size * 5 / 8);
+        std::cout << std::setw(10) << size << std::fixed << std::setprecision(1)
+                  << std::setw(14) << us_per_call([&] { return std::find(l_data.begin(), l_data.end(), l_value) - l_data.begin(); })
+                  << std::setw(14) << us_per_call([&] { return parallel_find(l_data.begin(), l_data.end(), l_value, l_new_threads) - l_data.begin(); })
+                  << std::setw(14) << us_per_call([&] { return parallel_find(l_data.begin(), l_data.end(), l_value, l_pool) - l_data.begin(); })
+                  << '\n';
+    }
+}
+
+/*****
+    Benchmark of parallel_find_first
+        a large array of distinct uint32_t, the value is near the start (hit early), near the end (hit late)
+        or absent (miss), GB/s is the size of the elements before the match over the time
+**********/
+
+void benchmark_first(const std::size_t concurrency, const std::size_t elements) {
+    thread_pool l_pool(static_cast<unsigned>(concurrency - 1));
+    inline_executor l_inline;
+
+    std::vector<std::uint32_t> l_data(elements);
+    for (std::size_t i = 0; i < elements; ++i) {
+        l_data[i] = static_cast<std::uint32_t>(i);
+    }
+
+    struct case_t {
+        const char* m_name;
+        std::size_t m_index;
+    };
+    const case_t l_cases[] = {{"hit early", 1000}, {"hit late", elements - 1000}, {"miss", elements}};
+
+    std::cout << "\n" << elements << " uint32_t, simd width " << stdx::native_simd<std::uint32_t>::size()
+              << ", microseconds per call (GB/s)\n";
+    std::cout << std::setw(10) << "" << std::setw(20) << "std::find" << std::setw(20) << "parallel_find"
+              << std::setw(20) << "first, 1 thread" << std::setw(20) << "first, pool" << '\n';
+    for (const auto& c : l_cases) {
+        const std::uint32_t l_value = static_cast<std::uint32_t>(c.m_index);
+        const double l_gb = static_cast<double>(std::min(c.m_index + 1, elements) * sizeof(std::uint32_t)) / 1e9;
+        auto l_column = [&](auto find) {
+            std::ostringstream l_out;
+            const double l_us = us_per_call([&] {
+                const auto l_pos = static_cast<std::size_t>(find() - l_data.begin());
+                if (l_pos != c.m_index) {
+                    std::cout << "wrong position " << l_pos << " instead of " << c.m_index << '\n';
+                }
+                return l_pos;
+            });
+            l_out << std::fixed << std::setprecision(1) << l_us << " (" << std::setprecision(1) << l_gb / (l_us / 1e6) << ")";
+            return l_out.str();
+        };
+        std::cout << std::setw(10) << c.m_name
+                  << std::setw(20) << l_column([&] { return std::find(l_data.begin(), l_data.end(), l_value); })
+                  << std::setw(20) << l_column([&] { return parallel_find(l_data.begin(), l_data.end(), l_value, l_pool); })
+                  << std::setw(20) << l_column([&] { return parallel_find_first(l_data.begin(), l_data.end(), l_value, l_inline); })
+                  << std::setw(20) << l_column([&] { return parallel_find_first(l_data.begin(), l_data.end(), l_value, l_pool); })
+                  << '\n';
+    }
+}
+
+int main(int argc, char* argv[]) {
     constexpr size_t count = 1000;
     std::vector<std::string> svec;
     for (size_t i = 0; i < count; ++i) {
@@ -196,10 +381,60 @@ int main() {
         }
     }
 
+    {
+        std::cout << "=== using parallel_find_first\n";
+        auto it = parallel_find_first(svec.begin(), svec.end(), elem);
+        if (it == svec.end()) {
+            std::cout << elem << " not found\n";
+        } else {
+            std::cout << elem << " found, index " << it - svec.begin() << '\n';
+        }
+    }
+
+    const std::size_t concurrency = (argc > 1) ? std::stoul(argv[1]) : 4;
+    const std::size_t elements = (argc > 2) ? std::stoul(argv[2]) : (64u << 20);
+    benchmark(std::max<std::size_t>(2, concurrency));
+    benchmark_first(std::max<std::size_t>(2, concurrency), std::max<std::size_t>(elements, 2000));
 
     return 0;
 }
 
+/*****
+Explanation
+
+The pool removes the cost of the threads, a call costs a few pushes on the queue and the wake up of the workers.
+The search still only stops between blocks (done is checked before a block, not inside it),
+a match in the last block does not shorten the search of the others.
+
+parallel_find_first reads memory as fast as one core can: with a single core the pool adds nothing,
+the gain over std::find comes from the simd kernel, which compares a whole vector per instruction
+where std::find tests and branches on every element. On a machine with more cores the claimed chunks
+spread the scan over the memory channels. On a hit early only the first chunks are read, the cost
+is the wake up of the pool, parallel_find waits for every block it started.
+
+Output (g++ -O2, ./parallel_find on a single core machine)
+microseconds per call, concurrency 4
+  elements     std::find   new threads          pool
+      1000           0.2          52.8           2.5
+     10000           1.7          41.3           7.8
+    100000          19.0          65.6          33.4
+   1000000         222.6         355.2         232.8
+
+67108864 uint32_t, simd width 4, microseconds per call (GB/s)
+                     std::find       parallel_find     first, 1 thread         first, pool
+ hit early          0.4 (10.5)          24.1 (0.2)          0.2 (19.6)           3.1 (1.3)
+  hit late       55721.7 (4.8)       56491.6 (4.8)       39540.3 (6.8)       39193.3 (6.8)
+      miss       53728.2 (5.0)       54830.4 (4.9)       40664.0 (6.6)       43033.0 (6.2)
+
+Output (g++ -O2 -march=native, same machine with AVX-512, second table)
+67108864 uint32_t, simd width 16, microseconds per call (GB/s)
+                     std::find       parallel_find     first, 1 thread         first, pool
+ hit early           0.5 (8.1)          31.9 (0.1)          0.1 (29.0)           2.4 (1.6)
+  hit late       57052.2 (4.7)       53158.2 (5.0)       28295.3 (9.5)       30788.6 (8.7)
+      miss       64950.7 (4.1)       64281.2 (4.2)       32195.9 (8.3)       30677.8 (8.8)
+
+*****/
+
 /*****
     END OF FILE
 **********/
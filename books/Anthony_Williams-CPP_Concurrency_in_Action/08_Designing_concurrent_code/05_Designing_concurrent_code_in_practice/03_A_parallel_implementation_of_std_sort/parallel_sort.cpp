@@ -0,0 +1,438 @@
+/*****
+
+References
+    Anthony Williams - C++ Concurrency in Action
+    https://en.cppreference.com/w/cpp/algorithm/sort
+    https://en.cppreference.com/w/cpp/algorithm/stable_sort
+
+8. Designing concurrent code
+
+8.5 Designing concurrent code in practice
+
+A parallel implementation of std::sort
+
+parallel_quick_sort of 9.1.3 sorts a std::list by splicing: one node allocation per element,
+a pointer chase per comparison, and the first element as the only pivot, so the two halves
+are as unbalanced as the input lets them be.
+
+parallel_sort and parallel_stable_sort sort a contiguous range (vector, array) on an executor (executor.hpp):
+
+    small ranges        less than sequential_threshold elements, std::sort / std::stable_sort
+
+    samplesort          any type and comparator
+        -> a sample of the range (oversampling elements per bucket) is sorted, the splitters
+           are taken at regular steps in it, the buckets have about the same size whatever the input
+        -> every block (one per thread) finds the bucket of its elements (binary search in the splitters)
+           and counts them, the counts of all the blocks, bucket by bucket, give where
+           every block writes every bucket (exclusive prefix sum)
+        -> the blocks move their elements to the buckets in a buffer, in parallel, without synchronization,
+           every block owns its ranges of the buffer
+        -> every bucket is sorted by a task and moved back
+        the elements are moved in order, block by block: with std::stable_sort for the buckets
+        the whole sort is stable (parallel_stable_sort)
+
+    LSD radix sort      integers and floating-point values with std::less
+        -> one pass per byte of the key, starting with the least significant one,
+           each pass is a counting sort: block histograms, prefix sum, scatter to the buffer
+        -> a pass is skipped when all the keys have the same byte (small values, ...)
+        -> signed integers have their sign bit flipped, floating-point values have all their bits flipped
+           when negative and the sign bit set when positive, the unsigned keys then sort like the values;
+           -0.0 and +0.0 are equal for std::less, both get the key of +0.0 so they keep their order
+        -> a counting sort is stable, the radix sort is used by both parallel_sort and parallel_stable_sort
+        -> n + (number of passes) * 2n memory accesses, no comparison, whatever the order of the input
+
+    Both need a buffer as large as the range, the elements have to be default constructible.
+    Many equal keys make a large bucket in samplesort, it is sorted by one task.
+
+Usage
+    g++ -O2 -std=c++20 -pthread parallel_sort.cpp -ltbb      (-ltbb for std::execution::par of libstdc++)
+    ./parallel_sort [concurrency] [ints] [strings]
+
+**********/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "executor.hpp"
+
+constexpr std::size_t sequential_threshold = 1 << 16;
+constexpr std::size_t oversampling = 64;
+constexpr std::size_t buckets_per_block = 4;
+
+// func(b, begin, end) for the blocks of [0, length), the calling thread runs the first one
+template <typename Executor, typename Func>
+void run_blocks(Executor& executor, const std::size_t blocks_count, const std::size_t length, Func func) {
+    const std::size_t l_block_size = (length + blocks_count - 1) / blocks_count;
+    task_group group(executor);
+    for (std::size_t b = 1; b < blocks_count; ++b) {
+        group.run([&func, b, l_block_size, length] {
+            func(b, std::min(b * l_block_size, length), std::min((b + 1) * l_block_size, length));
+        });
+    }
+    func(0, 0, std::min(l_block_size, length));
+    group.wait();
+}
+
+template <typename Executor>
+std::size_t blocks_for(const std::size_t length, Executor& executor) {
+    return std::clamp<std::size_t>(length / sequential_threshold, 1, executor.concurrency());
+}
+
+template <typename T>
+concept radix_sortable = (std::is_integral_v<T> and (not std::is_same_v<T, bool>)) or
+                         std::is_same_v<T, float> or std::is_same_v<T, double>;
+
+template <typename T, typename Compare>
+constexpr bool ascending_order = std::is_same_v<Compare, std::less<>> or std::is_same_v<Compare, std::less<T>>;
+
+// unsigned key in the order of the values
+template <radix_sortable T>
+auto radix_key(const T value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        using key_t = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+        constexpr key_t l_sign = key_t{1} << (sizeof(key_t) * 8 - 1);
+        const key_t l_bits = std::bit_cast<key_t>((value == T{}) ? T{} : value);
+        return static_cast<key_t>((l_bits & l_sign) ? ~l_bits : (l_bits | l_sign));
+    } else {
+        using key_t = std::make_unsigned_t<T>;
+        if constexpr (std::is_signed_v<T>) {
+            return static_cast<key_t>(static_cast<key_t>(value) ^ (key_t{1} << (sizeof(key_t) * 8 - 1)));
+        } else {
+            return static_cast<key_t>(value);
+        }
+    }
+}
+
+template <radix_sortable T, typename Executor>
+void radix_sort(T* data, const std::size_t length, Executor& executor) {
+    std::unique_ptr<T[]> l_buffer(new T[length]);
+    const std::size_t l_blocks = blocks_for(length, executor);
+    std::vector<std::array<std::size_t, 256>> l_counts(l_blocks);
+
+    T* l_from = data;
+    T* l_to = l_buffer.get();
+    for (unsigned l_shift = 0; l_shift < sizeof(T) * 8; l_shift += 8) {
+        const auto digit = [l_shift](const T value) { return static_cast<std::size_t>((radix_key(value) >> l_shift) & 0xff); };
+
+        run_blocks(executor, l_blocks, length, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            l_counts[b].fill(0);
+            for (std::size_t i = begin; i < end; ++i) {
+                ++l_counts[b][digit(l_from[i])];
+            }
+        });
+
+        // offsets digit by digit, block by block: the scatter keeps the order of equal digits
+        std::size_t l_offset = 0;
+        bool l_single_digit = false;
+        for (std::size_t d = 0; d < 256; ++d) {
+            const std::size_t l_digit_begin = l_offset;
+            for (auto& l_block_counts : l_counts) {
+                l_offset += std::exchange(l_block_counts[d], l_offset);
+            }
+            l_single_digit = l_single_digit or (l_offset - l_digit_begin == length);
+        }
+        if (l_single_digit) {
+            continue;
+        }
+
+        run_blocks(executor, l_blocks, length, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            auto& l_offsets = l_counts[b];
+            for (std::size_t i = begin; i < end; ++i) {
+                l_to[l_offsets[digit(l_from[i])]++] = l_from[i];
+            }
+        });
+        std::swap(l_from, l_to);
+    }
+
+    if (l_from != data) {
+        run_blocks(executor, l_blocks, length, [&](std::size_t, std::size_t begin, std::size_t end) {
+            std::copy(l_from + begin, l_from + end, data + begin);
+        });
+    }
+}
+
+template <typename T, typename Compare, typename Executor>
+void sample_sort(T* data, const std::size_t length, Compare comp, const bool stable, Executor& executor) {
+    const std::size_t l_blocks = blocks_for(length, executor);
+    const std::size_t l_buckets = std::min<std::size_t>(l_blocks * buckets_per_block, 256);
+
+    // splitters from a sorted random sample, l_buckets - 1 of them
+    std::vector<T> l_sample;
+    l_sample.reserve(l_buckets * oversampling);
+    std::minstd_rand l_random(static_cast<std::minstd_rand::result_type>(length));
+    std::uniform_int_distribution<std::size_t> l_position(0, length - 1);
+    for (std::size_t i = 0; i < l_buckets * oversampling; ++i) {
+        l_sample.push_back(data[l_position(l_random)]);
+    }
+    std::sort(l_sample.begin(), l_sample.end(), comp);
+    std::vector<T> l_splitters;
+    for (std::size_t k = 1; k < l_buckets; ++k) {
+        l_splitters.push_back(std::move(l_sample[k * oversampling]));
+    }
+
+    // the bucket of every element, found once, used to count and to move
+    std::unique_ptr<std::uint8_t[]> l_bucket_of(new std::uint8_t[length]);
+    std::vector<std::vector<std::size_t>> l_counts(l_blocks, std::vector<std::size_t>(l_buckets));
+    run_blocks(executor, l_blocks, length, [&](std::size_t b, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            const auto l_bucket = std::upper_bound(l_splitters.begin(), l_splitters.end(), data[i], comp) - l_splitters.begin();
+            l_bucket_of[i] = static_cast<std::uint8_t>(l_bucket);
+            ++l_counts[b][l_bucket];
+        }
+    });
+
+    std::vector<std::size_t> l_bucket_begin(l_buckets + 1);
+    std::size_t l_offset = 0;
+    for (std::size_t k = 0; k < l_buckets; ++k) {
+        l_bucket_begin[k] = l_offset;
+        for (auto& l_block_counts : l_counts) {
+            l_offset += std::exchange(l_block_counts[k], l_offset);
+        }
+    }
+    l_bucket_begin[l_buckets] = length;
+
+    std::unique_ptr<T[]> l_buffer(new T[length]);
+    run_blocks(executor, l_blocks, length, [&](std::size_t b, std::size_t begin, std::size_t end) {
+        auto& l_offsets = l_counts[b];
+        for (std::size_t i = begin; i < end; ++i) {
+            l_buffer[l_offsets[l_bucket_of[i]]++] = std::move(data[i]);
+        }
+    });
+
+    // the largest buckets first, the small ones fill the gaps at the end
+    std::vector<std::size_t> l_order(l_buckets);
+    std::iota(l_order.begin(), l_order.end(), 0);
+    std::sort(l_order.begin(), l_order.end(), [&](std::size_t a, std::size_t b) {
+        return (l_bucket_begin[a + 1] - l_bucket_begin[a]) > (l_bucket_begin[b + 1] - l_bucket_begin[b]);
+    });
+    auto sort_bucket = [&](const std::size_t k) {
+        T* const l_begin = l_buffer.get() + l_bucket_begin[k];
+        T* const l_end = l_buffer.get() + l_bucket_begin[k + 1];
+        if (stable) {
+            std::stable_sort(l_begin, l_end, comp);
+        } else {
+            std::sort(l_begin, l_end, comp);
+        }
+        std::move(l_begin, l_end, data + l_bucket_begin[k]);
+    };
+    task_group group(executor);
+    for (std::size_t i = 1; i < l_buckets; ++i) {
+        group.run([&sort_bucket, k = l_order[i]] { sort_bucket(k); });
+    }
+    sort_bucket(l_order[0]);
+    group.wait();
+}
+
+template <typename It, typename Compare, typename Executor>
+void parallel_sort_impl(It first, It last, Compare comp, const bool stable, Executor& executor) {
+    static_assert(std::contiguous_iterator<It>, "parallel_sort needs a contiguous range");
+    using value_t = std::iter_value_t<It>;
+
+    const std::size_t length = static_cast<std::size_t>(last - first);
+    if constexpr (radix_sortable<value_t> and ascending_order<value_t, Compare>) {
+        if (length >= sequential_threshold) {
+            radix_sort(std::to_address(first), length, executor);
+            return;
+        }
+    }
+    if ((length < 2 * sequential_threshold) or (executor.concurrency() == 1)) {
+        if (stable) {
+            std::stable_sort(first, last, comp);
+        } else {
+            std::sort(first, last, comp);
+        }
+        return;
+    }
+    sample_sort(std::to_address(first), length, comp, stable, executor);
+}
+
+template <typename It, typename Compare = std::less<>, typename Executor = thread_pool>
+void parallel_sort(It first, It last, Compare comp = {}, Executor& executor = default_executor()) {
+    parallel_sort_impl(first, last, comp, false, executor);
+}
+
+template <typename It, typename Compare = std::less<>, typename Executor = thread_pool>
+void parallel_stable_sort(It first, It last, Compare comp = {}, Executor& executor = default_executor()) {
+    parallel_sort_impl(first, last, comp, true, executor);
+}
+
+// the result is compared with the one of std::sort, the first run
+template <typename T, typename Sort>
+void run(const std::string& name, const std::vector<T>& input, std::vector<T>& work, std::vector<T>& expected, Sort sort) {
+    work = input;
+    const auto l_start = std::chrono::steady_clock::now();
+    sort(work);
+    const std::chrono::duration<double, std::milli> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    if (expected.empty()) {
+        expected = work;
+    }
+    std::cout << std::setw(34) << name << std::fixed << std::setprecision(1) << std::setw(12) << l_elapsed.count()
+              << ((work == expected) ? "  ok" : "  WRONG") << '\n';
+}
+
+// a comparator which is not std::less, the radix sort is not used
+constexpr auto less_than = [](const auto& a, const auto& b) { return a < b; };
+
+template <typename T, typename Executor>
+void benchmark(const std::string& title, const std::vector<T>& input, Executor& pool) {
+    std::cout << title << ", milliseconds\n";
+    std::vector<T> l_work;
+    std::vector<T> l_expected;
+    run("std::sort", input, l_work, l_expected, [](auto& v) { std::sort(v.begin(), v.end()); });
+    run("std::sort(par)", input, l_work, l_expected, [](auto& v) { std::sort(std::execution::par, v.begin(), v.end()); });
+    run("std::stable_sort", input, l_work, l_expected, [](auto& v) { std::stable_sort(v.begin(), v.end()); });
+    run("parallel_sort", input, l_work, l_expected, [&](auto& v) { parallel_sort(v.begin(), v.end(), std::less<>{}, pool); });
+    run("parallel_stable_sort", input, l_work, l_expected, [&](auto& v) { parallel_stable_sort(v.begin(), v.end(), std::less<>{}, pool); });
+    if constexpr (radix_sortable<T>) {
+        run("parallel_sort, samplesort", input, l_work, l_expected, [&](auto& v) { parallel_sort(v.begin(), v.end(), less_than, pool); });
+        run("parallel_stable_sort, samplesort", input, l_work, l_expected, [&](auto& v) { parallel_stable_sort(v.begin(), v.end(), less_than, pool); });
+    }
+    std::cout << '\n';
+}
+
+// equal keys keep the order they had, compared with std::stable_sort
+template <typename Executor>
+void check_stability(Executor& pool) {
+    std::vector<std::pair<int, int>> l_input(1 << 20);
+    std::mt19937 l_random(7);
+    for (std::size_t i = 0; i < l_input.size(); ++i) {
+        l_input[i] = {static_cast<int>(l_random() % 1000), static_cast<int>(i)};
+    }
+    const auto by_key = [](const auto& a, const auto& b) { return a.first < b.first; };
+    auto l_expected = l_input;
+    std::stable_sort(l_expected.begin(), l_expected.end(), by_key);
+    auto l_result = l_input;
+    parallel_stable_sort(l_result.begin(), l_result.end(), by_key, pool);
+    std::cout << "parallel_stable_sort of " << l_input.size() << " pairs by key "
+              << ((l_result == l_expected) ? "same" : "different") << " as std::stable_sort\n";
+
+    // -0.0f == +0.0f: the radix sort has to keep them in the order of the input
+    std::vector<float> l_zeros(1 << 17);
+    for (std::size_t i = 0; i < l_zeros.size(); ++i) {
+        l_zeros[i] = (i % 2) ? -0.0f : 0.0f;
+    }
+    auto l_expected_zeros = l_zeros;
+    std::stable_sort(l_expected_zeros.begin(), l_expected_zeros.end());
+    parallel_stable_sort(l_zeros.begin(), l_zeros.end(), std::less<>{}, pool);
+    const bool l_same_signs = std::equal(l_zeros.begin(), l_zeros.end(), l_expected_zeros.begin(),
+                                         [](const float a, const float b) { return std::signbit(a) == std::signbit(b); });
+    std::cout << "parallel_stable_sort of " << l_zeros.size() << " signed zeros "
+              << (l_same_signs ? "same" : "different") << " as std::stable_sort\n";
+}
+
+template <typename Executor>
+void benchmarks(Executor& l_pool, const std::size_t ints, const std::size_t strings) {
+    std::mt19937_64 l_random(42);
+
+    std::cout << "concurrency " << l_pool.concurrency() << "\n\n";
+    {
+        std::vector<int> l_input(ints);
+        std::generate(l_input.begin(), l_input.end(), [&] { return static_cast<int>(l_random()); });
+        benchmark(std::to_string(ints) + " random int", l_input, l_pool);
+    }
+    {
+        std::vector<float> l_input(ints / 10);
+        std::normal_distribution<float> l_normal(0.0f, 1000.0f);
+        std::generate(l_input.begin(), l_input.end(), [&] { return l_normal(l_random); });
+        benchmark(std::to_string(l_input.size()) + " normal float", l_input, l_pool);
+    }
+    {
+        // the strings of 22.2 (execution_policies.cpp) in random order
+        const std::string l_symbol[] = {"+", "-", "*", "#"};
+        std::vector<std::string> l_input;
+        l_input.reserve(strings);
+        for (std::size_t i = 0; i < strings; ++i) {
+            l_input.push_back("string-" + l_symbol[i % 4] + std::to_string(i));
+        }
+        std::shuffle(l_input.begin(), l_input.end(), l_random);
+        benchmark(std::to_string(strings) + " strings", l_input, l_pool);
+    }
+    check_stability(l_pool);
+}
+
+int main(int argc, char* argv[]) {
+    const std::size_t concurrency = (argc > 1) ? std::stoul(argv[1]) : 4;
+    const std::size_t ints = (argc > 2) ? std::stoul(argv[2]) : 100'000'000;
+    const std::size_t strings = (argc > 3) ? std::stoul(argv[3]) : 10'000'000;
+
+    // the calling thread is one of them, a thread_pool has at least one worker
+    if (concurrency <= 1) {
+        inline_executor l_caller;
+        benchmarks(l_caller, ints, strings);
+    } else {
+        thread_pool l_pool(static_cast<unsigned>(concurrency - 1));
+        benchmarks(l_pool, ints, strings);
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+On a single core the tasks run one after the other, what is left is the work done by every version.
+
+The radix sort does 4 passes over the ints, 4 to 5 times faster than std::sort: every pass reads the keys in order
+and writes to 256 places which stay in the cache, std::sort makes log2(n) passes of comparisons and
+mispredicted branches. The floats are sorted the same way, the sign handling and the test for -0.0
+cost nothing.
+
+samplesort does what std::sort does on the buckets plus the classification (a binary search in the splitters)
+and two moves of every element, 3 to 15% more than std::sort from run to run here, the buckets sorted in parallel
+are what makes it faster with more cores. The strings use it, their comparisons are the cost,
+the moves only move pointers for the long strings.
+
+std::sort(par) goes through TBB, on one core its parallel quick sort is slower than std::sort.
+
+Output (g++ -O2 -std=c++20 -pthread parallel_sort.cpp -ltbb, ./parallel_sort on a single core machine)
+concurrency 4
+
+100000000 random int, milliseconds
+                         std::sort     14307.8  ok
+                    std::sort(par)     18705.7  ok
+                  std::stable_sort     16392.6  ok
+                     parallel_sort      2964.1  ok
+              parallel_stable_sort      3151.1  ok
+         parallel_sort, samplesort     14781.9  ok
+  parallel_stable_sort, samplesort     18514.4  ok
+
+10000000 normal float, milliseconds
+                         std::sort      1260.2  ok
+                    std::sort(par)      1770.2  ok
+                  std::stable_sort      1588.0  ok
+                     parallel_sort       253.6  ok
+              parallel_stable_sort       269.7  ok
+         parallel_sort, samplesort      1533.8  ok
+  parallel_stable_sort, samplesort      1821.6  ok
+
+10000000 strings, milliseconds
+                         std::sort      4837.7  ok
+                    std::sort(par)      6404.1  ok
+                  std::stable_sort      5255.9  ok
+                     parallel_sort      5276.3  ok
+              parallel_stable_sort      5390.2  ok
+
+parallel_stable_sort of 1048576 pairs by key same as std::stable_sort
+parallel_stable_sort of 131072 signed zeros same as std::stable_sort
+
+*****/
+
+/*****
+    END OF FILE
+**********/
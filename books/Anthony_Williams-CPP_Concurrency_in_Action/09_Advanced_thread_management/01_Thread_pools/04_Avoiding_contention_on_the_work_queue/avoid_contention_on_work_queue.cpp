@@ -42,6 +42,7 @@ Each thread then posts new items to its own queue and takes work from the global
 #include <functional>
 #include <future>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <numeric>
@@ -49,8 +50,10 @@ Each thread then posts new items to its own queue and takes work from the global
 #include <string>
 #include <syncstream>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "simd_kernels.hpp"
 #include "thsafe_queue.hpp"
 
 class function_wrapper {
@@ -150,10 +153,17 @@ thread_local std::unique_ptr<thread_pool::local_queue_t> thread_pool::m_local_qu
 
 std::osyncstream sync_cout(std::cout);
 
+// contiguous int32_t, float or double blocks are summed by the vector kernels (simd_kernels.hpp),
+// the instruction set is selected once at run time, the other blocks by std::accumulate
 template <typename Iterator, typename T>
 struct accumulate_block {
     T operator()(Iterator first, Iterator last) {
-        return std::accumulate(first, last, T());
+        if constexpr (std::contiguous_iterator<Iterator> and
+                      std::is_same_v<std::iter_value_t<Iterator>, T> and simd_kernels::kernel_type<T>) {
+            return simd_kernels::sum(std::to_address(first), static_cast<std::size_t>(last - first));
+        } else {
+            return std::accumulate(first, last, T());
+        }
     }
 };
 
@@ -0,0 +1,466 @@
+/*****
+
+References
+    https://gcc.gnu.org/onlinedocs/gcc/Vector-Extensions.html
+    https://gcc.gnu.org/onlinedocs/gcc/x86-Function-Attributes.html
+    Intel 64 and IA-32 Architectures Software Developer's Manual, CPUID and XGETBV
+    Nicholas J. Higham - The accuracy of floating point summation
+
+simd_kernels.hpp
+
+    sum, dot, minmax and axpy for std::int32_t, float and double, written once with the GCC vector
+    extensions and compiled four times with the target attribute:
+        scalar      1 lane          any x86-64 or other processor
+        sse4_2      16 bytes        pminsd, pmulld (SSE4.1) are needed for int32 min/max and multiply
+        avx2        32 bytes        with fma
+        avx512      64 bytes        avx512f
+    detected_isa() reads CPUID once (and XGETBV, the OS must save the ymm/zmm registers),
+    every call dispatches on the isa argument, by default the detected one, a larger one is lowered to it.
+
+    Floating point sums (sum, dot) take a summation:
+        plain       4 vector accumulators, 4 x lanes partial sums, error grows with n / lanes
+        pairwise    blocks of pairwise_block elements summed plain, the blocks added as a binary tree,
+                    error grows with log2(n), as fast as plain
+        kahan       compensated summation in every lane, error independent of n, about 4 additions per element
+    Kahan needs strict floating point, do not build with -ffast-math (it removes the compensation).
+    int32_t ignores the summation, sums and products wrap modulo 2^32 like the scalar loops do in practice.
+
+    minmax requires n > 0, NaN values are not ordered and give an unspecified result.
+
+Usage
+    #include "simd_kernels.hpp"
+    const float l_score = simd_kernels::dot(features.data(), weights.data(), features.size());
+    const double l_total = simd_kernels::sum(values.data(), values.size(), simd_kernels::summation::kahan);
+
+**********/
+
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_KERNELS_X86 1
+#include <cpuid.h>
+#endif
+
+namespace simd_kernels {
+
+enum class isa { scalar, sse4_2, avx2, avx512 };
+
+enum class summation { plain, pairwise, kahan };
+
+template <typename T>
+concept kernel_type = std::same_as<T, std::int32_t> or std::same_as<T, float> or std::same_as<T, double>;
+
+constexpr const char *to_string(const isa i) {
+    switch (i) {
+        case isa::sse4_2: return "sse4.2";
+        case isa::avx2: return "avx2";
+        case isa::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+namespace detail {
+
+#ifdef SIMD_KERNELS_X86
+inline std::uint64_t xgetbv0() {
+    std::uint32_t l_lo, l_hi;
+    asm volatile("xgetbv" : "=a"(l_lo), "=d"(l_hi) : "c"(0));
+    return (static_cast<std::uint64_t>(l_hi) << 32) | l_lo;
+}
+#endif
+
+inline isa detect_isa() {
+#ifdef SIMD_KERNELS_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (not __get_cpuid(1, &eax, &ebx, &ecx, &edx) or not (ecx & bit_SSE4_2)) {
+        return isa::scalar;
+    }
+    const bool l_fma = ecx & bit_FMA;
+    if (not (ecx & bit_OSXSAVE) or not (ecx & bit_AVX)) {
+        return isa::sse4_2;
+    }
+    // XCR0: bits 1, 2 the OS saves xmm and ymm, bits 5, 6, 7 the opmask and zmm registers
+    const std::uint64_t l_xcr0 = xgetbv0();
+    if ((l_xcr0 & 0x06) != 0x06 or not __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return isa::sse4_2;
+    }
+    if ((ebx & bit_AVX512F) and (l_xcr0 & 0xe6) == 0xe6) {
+        return isa::avx512;
+    }
+    if ((ebx & bit_AVX2) and l_fma) {
+        return isa::avx2;
+    }
+    return isa::sse4_2;
+#else
+    return isa::scalar;
+#endif
+}
+
+// the int32_t lanes compute in uint32_t, overflow wraps instead of being undefined
+template <typename T>
+struct lane {
+    using type = T;
+};
+
+template <>
+struct lane<std::int32_t> {
+    using type = std::uint32_t;
+};
+
+template <typename T>
+using lane_t = typename lane<T>::type;
+
+template <typename E, std::size_t Bytes>
+struct simd_vector {
+    typedef E type __attribute__((vector_size(Bytes)));
+};
+
+// Bytes == sizeof(E) is the scalar build: a plain value, a vector of one lane is kept in memory by GCC
+template <typename E, std::size_t Bytes>
+using vector_t = typename std::conditional_t<Bytes == sizeof(E), std::type_identity<E>, simd_vector<E, Bytes>>::type;
+
+// the vectors are passed by reference only, returning them from a function compiled
+// without the target would change the ABI, everything is inlined into the target entry points
+template <typename T, std::size_t Bytes>
+struct kernels {
+    using L = lane_t<T>;
+    using V = vector_t<L, Bytes>;
+    static constexpr std::size_t lanes = Bytes / sizeof(T);
+
+    template <typename E>
+    [[gnu::always_inline]] static auto lane_at(const E &v, const std::size_t l) {
+        if constexpr (lanes == 1) {
+            return v;
+        } else {
+            return v[l];
+        }
+    }
+
+    [[gnu::always_inline]] static void load(V &v, const T *p) { std::memcpy(&v, p, sizeof(V)); }
+    [[gnu::always_inline]] static void store(T *p, const V &v) { std::memcpy(p, &v, sizeof(V)); }
+    [[gnu::always_inline]] static L lane_sum(const V &v) {
+        L l_sum{};
+        for (std::size_t l = 0; l < lanes; ++l) {
+            l_sum += lane_at(v, l);
+        }
+        return l_sum;
+    }
+
+    // the terms of sum and dot
+    struct values {
+        const T *x;
+        [[gnu::always_inline]] void load(V &v, const std::size_t i) const { kernels::load(v, x + i); }
+        [[gnu::always_inline]] L at(const std::size_t i) const { return static_cast<L>(x[i]); }
+    };
+
+    struct products {
+        const T *x;
+        const T *y;
+        [[gnu::always_inline]] void load(V &v, const std::size_t i) const {
+            V l_y;
+            kernels::load(v, x + i);
+            kernels::load(l_y, y + i);
+            v *= l_y;
+        }
+        [[gnu::always_inline]] L at(const std::size_t i) const { return static_cast<L>(x[i]) * static_cast<L>(y[i]); }
+    };
+
+    template <typename Terms>
+    [[gnu::always_inline]] static L reduce_plain(const Terms &terms, std::size_t i, const std::size_t last) {
+        V l_acc0{}, l_acc1{}, l_acc2{}, l_acc3{}, l_term;
+        for (; i + 4 * lanes <= last; i += 4 * lanes) {
+            terms.load(l_term, i);
+            l_acc0 += l_term;
+            terms.load(l_term, i + lanes);
+            l_acc1 += l_term;
+            terms.load(l_term, i + 2 * lanes);
+            l_acc2 += l_term;
+            terms.load(l_term, i + 3 * lanes);
+            l_acc3 += l_term;
+        }
+        for (; i + lanes <= last; i += lanes) {
+            terms.load(l_term, i);
+            l_acc0 += l_term;
+        }
+        l_acc0 += l_acc1;
+        l_acc2 += l_acc3;
+        l_acc0 += l_acc2;
+        L l_sum = lane_sum(l_acc0);
+        for (; i < last; ++i) {
+            l_sum += terms.at(i);
+        }
+        return l_sum;
+    }
+
+    // a multiple of 4 x lanes for every isa, the blocks are reduced without a tail
+    static constexpr std::size_t pairwise_block = 1024;
+
+    template <typename Terms>
+    [[gnu::always_inline]] static L reduce_pairwise(const Terms &terms, const std::size_t first, const std::size_t last) {
+        // an explicit stack of partial sums: the sum of 2^k blocks is added to the one of the
+        // previous 2^k blocks before going on, the tree of a recursion without the calls
+        L l_stack[64];
+        std::size_t l_depth = 0;
+        std::size_t l_blocks = 0;
+        std::size_t i = first;
+        for (; i + pairwise_block <= last; i += pairwise_block) {
+            l_stack[l_depth++] = reduce_plain(terms, i, i + pairwise_block);
+            for (std::size_t l_done = ++l_blocks; (l_done & 1) == 0; l_done >>= 1) {
+                --l_depth;
+                l_stack[l_depth - 1] += l_stack[l_depth];
+            }
+        }
+        L l_sum = reduce_plain(terms, i, last);
+        while (l_depth > 0) {
+            l_sum += l_stack[--l_depth];
+        }
+        return l_sum;
+    }
+
+    // E is V in the loop, L for the lanes and the tail
+    template <typename E>
+    [[gnu::always_inline]] static void kahan_add(E &sum, E &compensation, const E &term) {
+        const E l_y = term - compensation;
+        const E l_t = sum + l_y;
+        compensation = (l_t - sum) - l_y;
+        sum = l_t;
+    }
+
+    // TwoSum (Knuth): the rounding error of sum + term is exact, it is accumulated apart from the sums
+    [[gnu::always_inline]] static void two_sum_add(L &sum, L &error, const L term) {
+        const L l_sum = sum + term;
+        const L l_term = l_sum - sum;
+        error += (sum - (l_sum - l_term)) + (term - l_term);
+        sum = l_sum;
+    }
+
+    template <typename Terms>
+    [[gnu::always_inline]] static L reduce_kahan(const Terms &terms, std::size_t i, const std::size_t last) {
+        // 4 independent (sum, compensation) pairs hide the latency of the 4 dependent operations
+        V l_sum0{}, l_comp0{}, l_sum1{}, l_comp1{}, l_sum2{}, l_comp2{}, l_sum3{}, l_comp3{}, l_term;
+        for (; i + 4 * lanes <= last; i += 4 * lanes) {
+            terms.load(l_term, i);
+            kahan_add(l_sum0, l_comp0, l_term);
+            terms.load(l_term, i + lanes);
+            kahan_add(l_sum1, l_comp1, l_term);
+            terms.load(l_term, i + 2 * lanes);
+            kahan_add(l_sum2, l_comp2, l_term);
+            terms.load(l_term, i + 3 * lanes);
+            kahan_add(l_sum3, l_comp3, l_term);
+        }
+        for (; i + lanes <= last; i += lanes) {
+            terms.load(l_term, i);
+            kahan_add(l_sum0, l_comp0, l_term);
+        }
+        // every lane holds sum - compensation: the 4 pairs are merged into the first one, then its lanes
+        // are added with TwoSum, a chain of one addition per lane instead of the 4 of kahan_add
+        kahan_add(l_sum0, l_comp0, l_sum1);
+        kahan_add(l_sum0, l_comp0, l_sum2);
+        kahan_add(l_sum0, l_comp0, l_sum3);
+        l_comp0 += l_comp1;
+        l_comp0 += l_comp2;
+        l_comp0 += l_comp3;
+        L l_total{}, l_error{};
+        for (std::size_t l = 0; l < lanes; ++l) {
+            two_sum_add(l_total, l_error, lane_at(l_sum0, l));
+            l_error -= lane_at(l_comp0, l);
+        }
+        for (; i < last; ++i) {
+            two_sum_add(l_total, l_error, terms.at(i));
+        }
+        l_total += l_error;
+        return l_total;
+    }
+
+    template <typename Terms>
+    [[gnu::always_inline]] static T reduce(const Terms &terms, const std::size_t n, const summation s) {
+        if constexpr (std::floating_point<T>) {
+            if (s == summation::kahan) {
+                return reduce_kahan(terms, 0, n);
+            }
+            if (s == summation::pairwise) {
+                return reduce_pairwise(terms, 0, n);
+            }
+        }
+        return static_cast<T>(reduce_plain(terms, 0, n));
+    }
+
+    [[gnu::always_inline]] static T sum(const T *x, const std::size_t n, const summation s) {
+        return reduce(values{x}, n, s);
+    }
+
+    [[gnu::always_inline]] static T dot(const T *x, const T *y, const std::size_t n, const summation s) {
+        return reduce(products{x, y}, n, s);
+    }
+
+    [[gnu::always_inline]] static std::pair<T, T> minmax(const T *x, const std::size_t n) {
+        std::size_t i = 0;
+        T l_min = x[0];
+        T l_max = x[0];
+        if (n >= 2 * lanes) {
+            // the values are compared as T, the int32_t lanes are reinterpreted as signed
+            using C = vector_t<T, Bytes>;
+            C l_min0, l_max0, l_min1, l_max1, l_v;
+            std::memcpy(&l_min0, x, sizeof(C));
+            std::memcpy(&l_min1, x + lanes, sizeof(C));
+            l_max0 = l_min0;
+            l_max1 = l_min1;
+            for (i = 2 * lanes; i + 2 * lanes <= n; i += 2 * lanes) {
+                std::memcpy(&l_v, x + i, sizeof(C));
+                l_min0 = l_v < l_min0 ? l_v : l_min0;
+                l_max0 = l_v > l_max0 ? l_v : l_max0;
+                std::memcpy(&l_v, x + i + lanes, sizeof(C));
+                l_min1 = l_v < l_min1 ? l_v : l_min1;
+                l_max1 = l_v > l_max1 ? l_v : l_max1;
+            }
+            l_min0 = l_min1 < l_min0 ? l_min1 : l_min0;
+            l_max0 = l_max1 > l_max0 ? l_max1 : l_max0;
+            l_min = lane_at(l_min0, 0);
+            l_max = lane_at(l_max0, 0);
+            for (std::size_t l = 1; l < lanes; ++l) {
+                l_min = lane_at(l_min0, l) < l_min ? lane_at(l_min0, l) : l_min;
+                l_max = lane_at(l_max0, l) > l_max ? lane_at(l_max0, l) : l_max;
+            }
+        }
+        for (; i < n; ++i) {
+            l_min = x[i] < l_min ? x[i] : l_min;
+            l_max = x[i] > l_max ? x[i] : l_max;
+        }
+        return {l_min, l_max};
+    }
+
+    [[gnu::always_inline]] static void axpy(const T a, const T *x, T *y, const std::size_t n) {
+        const V l_a = V{} + static_cast<L>(a);
+        V l_x0, l_y0, l_x1, l_y1;
+        std::size_t i = 0;
+        for (; i + 2 * lanes <= n; i += 2 * lanes) {
+            load(l_x0, x + i);
+            load(l_y0, y + i);
+            load(l_x1, x + i + lanes);
+            load(l_y1, y + i + lanes);
+            l_y0 += l_a * l_x0;
+            l_y1 += l_a * l_x1;
+            store(y + i, l_y0);
+            store(y + i + lanes, l_y1);
+        }
+        for (; i < n; ++i) {
+            y[i] = static_cast<T>(static_cast<L>(y[i]) + static_cast<L>(a) * static_cast<L>(x[i]));
+        }
+    }
+};
+
+// the entry points, one per isa and operation, the kernels are inlined into them with the target's instructions
+template <typename T>
+T sum_scalar(const T *x, const std::size_t n, const summation s) { return kernels<T, sizeof(T)>::sum(x, n, s); }
+template <typename T>
+T dot_scalar(const T *x, const T *y, const std::size_t n, const summation s) { return kernels<T, sizeof(T)>::dot(x, y, n, s); }
+template <typename T>
+std::pair<T, T> minmax_scalar(const T *x, const std::size_t n) { return kernels<T, sizeof(T)>::minmax(x, n); }
+template <typename T>
+void axpy_scalar(const T a, const T *x, T *y, const std::size_t n) { kernels<T, sizeof(T)>::axpy(a, x, y, n); }
+
+#ifdef SIMD_KERNELS_X86
+template <typename T>
+[[gnu::target("sse4.2")]] T sum_sse4_2(const T *x, const std::size_t n, const summation s) { return kernels<T, 16>::sum(x, n, s); }
+template <typename T>
+[[gnu::target("sse4.2")]] T dot_sse4_2(const T *x, const T *y, const std::size_t n, const summation s) { return kernels<T, 16>::dot(x, y, n, s); }
+template <typename T>
+[[gnu::target("sse4.2")]] std::pair<T, T> minmax_sse4_2(const T *x, const std::size_t n) { return kernels<T, 16>::minmax(x, n); }
+template <typename T>
+[[gnu::target("sse4.2")]] void axpy_sse4_2(const T a, const T *x, T *y, const std::size_t n) { kernels<T, 16>::axpy(a, x, y, n); }
+
+template <typename T>
+[[gnu::target("avx2,fma")]] T sum_avx2(const T *x, const std::size_t n, const summation s) { return kernels<T, 32>::sum(x, n, s); }
+template <typename T>
+[[gnu::target("avx2,fma")]] T dot_avx2(const T *x, const T *y, const std::size_t n, const summation s) { return kernels<T, 32>::dot(x, y, n, s); }
+template <typename T>
+[[gnu::target("avx2,fma")]] std::pair<T, T> minmax_avx2(const T *x, const std::size_t n) { return kernels<T, 32>::minmax(x, n); }
+template <typename T>
+[[gnu::target("avx2,fma")]] void axpy_avx2(const T a, const T *x, T *y, const std::size_t n) { kernels<T, 32>::axpy(a, x, y, n); }
+
+template <typename T>
+[[gnu::target("avx512f")]] T sum_avx512(const T *x, const std::size_t n, const summation s) { return kernels<T, 64>::sum(x, n, s); }
+template <typename T>
+[[gnu::target("avx512f")]] T dot_avx512(const T *x, const T *y, const std::size_t n, const summation s) { return kernels<T, 64>::dot(x, y, n, s); }
+template <typename T>
+[[gnu::target("avx512f")]] std::pair<T, T> minmax_avx512(const T *x, const std::size_t n) { return kernels<T, 64>::minmax(x, n); }
+template <typename T>
+[[gnu::target("avx512f")]] void axpy_avx512(const T a, const T *x, T *y, const std::size_t n) { kernels<T, 64>::axpy(a, x, y, n); }
+#endif
+
+}  // namespace detail
+
+// CPUID is read by the first call only
+inline isa detected_isa() {
+    static const isa l_isa = detail::detect_isa();
+    return l_isa;
+}
+
+// sum of x[0, n)
+template <kernel_type T>
+T sum(const T *x, const std::size_t n, const summation s = summation::plain, const isa i = detected_isa()) {
+    switch (std::min(i, detected_isa())) {
+#ifdef SIMD_KERNELS_X86
+        case isa::avx512: return detail::sum_avx512(x, n, s);
+        case isa::avx2: return detail::sum_avx2(x, n, s);
+        case isa::sse4_2: return detail::sum_sse4_2(x, n, s);
+#endif
+        default: return detail::sum_scalar(x, n, s);
+    }
+}
+
+// sum of x[k] * y[k], k in [0, n)
+template <kernel_type T>
+T dot(const T *x, const T *y, const std::size_t n, const summation s = summation::plain, const isa i = detected_isa()) {
+    switch (std::min(i, detected_isa())) {
+#ifdef SIMD_KERNELS_X86
+        case isa::avx512: return detail::dot_avx512(x, y, n, s);
+        case isa::avx2: return detail::dot_avx2(x, y, n, s);
+        case isa::sse4_2: return detail::dot_sse4_2(x, y, n, s);
+#endif
+        default: return detail::dot_scalar(x, y, n, s);
+    }
+}
+
+// {min, max} of x[0, n), n > 0
+template <kernel_type T>
+std::pair<T, T> minmax(const T *x, const std::size_t n, const isa i = detected_isa()) {
+    switch (std::min(i, detected_isa())) {
+#ifdef SIMD_KERNELS_X86
+        case isa::avx512: return detail::minmax_avx512(x, n);
+        case isa::avx2: return detail::minmax_avx2(x, n);
+        case isa::sse4_2: return detail::minmax_sse4_2(x, n);
+#endif
+        default: return detail::minmax_scalar(x, n);
+    }
+}
+
+// y[k] += a * x[k], k in [0, n)
+template <kernel_type T>
+void axpy(const T a, const T *x, T *y, const std::size_t n, const isa i = detected_isa()) {
+    switch (std::min(i, detected_isa())) {
+#ifdef SIMD_KERNELS_X86
+        case isa::avx512: return detail::axpy_avx512(a, x, y, n);
+        case isa::avx2: return detail::axpy_avx2(a, x, y, n);
+        case isa::sse4_2: return detail::axpy_sse4_2(a, x, y, n);
+#endif
+        default: return detail::axpy_scalar(a, x, y, n);
+    }
+}
+
+}  // namespace simd_kernels
+
+#endif
+
+/*****
+    END OF FILE
+**********/
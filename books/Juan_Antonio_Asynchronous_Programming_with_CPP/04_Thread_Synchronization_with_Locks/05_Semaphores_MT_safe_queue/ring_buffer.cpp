@@ -17,10 +17,11 @@ Thread Safe Ring Buffer:
 #include <thread>
 
 #include "ring_buffer.hpp"
+#include "sharded_counter.hpp"
 
 RingBuffer<std::string, 1024> rbuffer;
-std::atomic_uint32_t    consumed_count{0};
-std::atomic_uint32_t    produced_count{0};
+sharded_counter         consumed_count;
+sharded_counter         produced_count;
 
 void producer(const std::size_t data_size)
 {
@@ -59,7 +60,7 @@ int main()
     pth.join();
     cth.join();
 
-    std::cout << "Producer count: " << produced_count << ", Consumer count: " << consumed_count << '\n';
+    std::cout << "Producer count: " << produced_count.sum() << ", Consumer count: " << consumed_count.sum() << '\n';
 
     return 0;
 }
@@ -0,0 +1,230 @@
+/*******
+
+References
+    Asynchronous Programming with C++ | Javier Reguera-Salgado & Juan Antonio Rufes
+    https://en.cppreference.com/w/cpp/language/storage_duration.html
+
+
+Sharded counters and gauges:
+    A counter shared by all the threads (std::atomic with fetch_add) makes every increment
+    a read-modify-write of the same cache line, the line moves from core to core at each increment.
+
+    Here every thread has its own slot in each counter, on its own cache line
+        -> add() is a relaxed load and a relaxed store of the thread's own slot, no read-modify-write
+        -> sum() and snapshot() read all the slots with relaxed loads, they never block the writers
+        -> a slot is registered the first time a thread uses the counter, and released
+           when the thread exits, the next new thread takes it over with its value,
+           so the sum keeps the counts of the threads which are gone
+        -> the state of a counter is shared by the counter and the threads which used it,
+           it lives until the last of them is gone or until the thread uses the next counter
+           which took the id of the destroyed one
+        -> the ids of destroyed counters are reused: the table of slots of a thread is as large
+           as the largest number of counters alive at the same time, not as the number of counters
+           ever created
+
+    sharded_counter     unsigned, only grows (events, bytes, ...)
+    sharded_gauge       signed, goes up and down (items in flight, open connections, ...)
+
+    sum() is not a snapshot of one instant: an add() may happen while the slots are read,
+    the result is a value the counter had at some point during the call.
+
+***********/
+
+#ifndef SHARDED_COUNTER_HPP
+#define SHARDED_COUNTER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// a fixed size: std::hardware_destructive_interference_size warns (-Winterference-size) with gcc
+constexpr std::size_t cache_line = 64;
+
+template <typename T>
+class basic_sharded_counter
+{
+    struct alignas(cache_line) slot_t
+    {
+        std::atomic<T> m_value{0};
+        std::atomic<bool> m_owned{true};
+        slot_t *m_next{nullptr};
+    };
+
+    struct state_t
+    {
+        std::atomic<slot_t *> m_slots{nullptr};     // only grows, slots are reused, never removed
+
+        ~state_t()
+        {
+            slot_t *l_slot = m_slots.load(std::memory_order_relaxed);
+            while (l_slot)
+            {
+                slot_t *l_next = l_slot->m_next;
+                delete l_slot;
+                l_slot = l_next;
+            }
+        }
+
+        slot_t *acquire_slot()
+        {
+            for (slot_t *l_slot = m_slots.load(std::memory_order_acquire); l_slot; l_slot = l_slot->m_next)
+            {
+                bool l_owned = false;
+                // acquire: sees the last value stored by the previous owner
+                if (l_slot->m_owned.compare_exchange_strong(l_owned, true, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    return l_slot;
+                }
+            }
+            slot_t *l_slot = new slot_t;
+            l_slot->m_next = m_slots.load(std::memory_order_relaxed);
+            while (not m_slots.compare_exchange_weak(l_slot->m_next, l_slot, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+            return l_slot;
+        }
+    };
+
+    struct thread_slot_t
+    {
+        std::shared_ptr<state_t> m_state;
+        slot_t *m_slot{nullptr};
+
+        void release()
+        {
+            if (m_slot)
+            {
+                m_slot->m_owned.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    // the slots of the current thread, indexed by counter id, released when the thread exits
+    struct thread_slots_t
+    {
+        std::vector<thread_slot_t> m_slots;
+
+        ~thread_slots_t()
+        {
+            for (thread_slot_t &l_slot : m_slots)
+            {
+                l_slot.release();
+            }
+        }
+    };
+
+    // the ids of the destroyed counters, taken first by the new ones
+    static inline std::mutex s_ids_mutex;
+    static inline std::vector<std::size_t> s_free_ids;
+    static inline std::size_t s_next_id{0};
+
+    static std::size_t acquire_id()
+    {
+        std::lock_guard<std::mutex> l_lock(s_ids_mutex);
+        if (s_free_ids.empty())
+        {
+            return s_next_id++;
+        }
+        const std::size_t l_id = s_free_ids.back();
+        s_free_ids.pop_back();
+        return l_id;
+    }
+
+    static void release_id(const std::size_t id)
+    {
+        std::lock_guard<std::mutex> l_lock(s_ids_mutex);
+        s_free_ids.push_back(id);
+    }
+
+    const std::size_t m_id;
+    const std::shared_ptr<state_t> m_state;
+
+    // first use by the thread, or the entry still holds the state of the destroyed counter which had the id
+    slot_t *register_thread(thread_slots_t &slots)
+    {
+        if (slots.m_slots.size() <= m_id)
+        {
+            slots.m_slots.resize(m_id + 1);
+        }
+        thread_slot_t &l_entry = slots.m_slots[m_id];
+        l_entry.release();
+        l_entry = {m_state, m_state->acquire_slot()};
+        return l_entry.m_slot;
+    }
+
+    slot_t *local_slot()
+    {
+        static thread_local thread_slots_t l_slots;
+        // the entry holds its state: a state of a previous counter cannot have the address of m_state
+        if ((m_id < l_slots.m_slots.size()) and (l_slots.m_slots[m_id].m_state == m_state))
+        {
+            return l_slots.m_slots[m_id].m_slot;
+        }
+        return register_thread(l_slots);
+    }
+
+public:
+    basic_sharded_counter() : m_id{acquire_id()},
+                              m_state{std::make_shared<state_t>()} {}
+
+    ~basic_sharded_counter() { release_id(m_id); }
+
+    basic_sharded_counter(const basic_sharded_counter &) = delete;
+    basic_sharded_counter &operator=(const basic_sharded_counter &) = delete;
+
+    void add(const T value)
+    {
+        // only the owner thread writes the slot, no read-modify-write is needed
+        std::atomic<T> &l_value = local_slot()->m_value;
+        l_value.store(l_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    basic_sharded_counter &operator++()
+    {
+        add(1);
+        return *this;
+    }
+
+    T sum() const
+    {
+        T l_sum{0};
+        for (slot_t *l_slot = m_state->m_slots.load(std::memory_order_acquire); l_slot; l_slot = l_slot->m_next)
+        {
+            l_sum += l_slot->m_value.load(std::memory_order_relaxed);
+        }
+        return l_sum;
+    }
+
+    // the value of every slot, a slot is shared over time by the threads which reused it
+    std::vector<T> snapshot() const
+    {
+        std::vector<T> l_values;
+        for (slot_t *l_slot = m_state->m_slots.load(std::memory_order_acquire); l_slot; l_slot = l_slot->m_next)
+        {
+            l_values.push_back(l_slot->m_value.load(std::memory_order_relaxed));
+        }
+        return l_values;
+    }
+};
+
+using sharded_counter = basic_sharded_counter<std::uint64_t>;
+
+class sharded_gauge : public basic_sharded_counter<std::int64_t>
+{
+public:
+    void sub(const std::int64_t value) { add(-value); }
+
+    sharded_gauge &operator--()
+    {
+        add(-1);
+        return *this;
+    }
+};
+
+#endif
+
+/*******
+	END OF FILE
+***********/
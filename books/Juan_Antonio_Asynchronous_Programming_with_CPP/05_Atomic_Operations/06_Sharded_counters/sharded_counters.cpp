@@ -0,0 +1,211 @@
+/*******
+
+References
+    Asynchronous Programming with C++ | Javier Reguera-Salgado & Juan Antonio Rufes
+    https://en.cppreference.com/w/cpp/language/storage_duration.html
+
+Sharded counters:
+    Counting events from many threads with one std::atomic and fetch_add against
+    sharded_counter.hpp (one padded slot per thread, sum() over the slots).
+
+    Every thread increments its counter the given number of times, a reader thread calls sum() in a loop
+    meanwhile, the total must be exact once all the writers are done.
+
+        std::atomic             one shared counter, fetch_add (relaxed)
+        unpadded slots          one std::atomic per thread in a plain array, 8 threads share a cache line (false sharing)
+        sharded_counter         one slot per thread, each on its own cache line
+
+Usage
+    ./sharded_counters [threads] [increments_per_thread]
+
+***********/
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "sharded_counter.hpp"
+
+struct shared_atomic
+{
+    std::atomic<std::uint64_t> m_value{0};
+
+    void add(const std::size_t, const std::uint64_t value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+    std::uint64_t sum() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+struct unpadded_slots
+{
+    std::unique_ptr<std::atomic<std::uint64_t>[]> m_values;
+    const std::size_t m_count;
+
+    explicit unpadded_slots(const std::size_t count) : m_values{new std::atomic<std::uint64_t>[count]}, m_count{count}
+    {
+        for (std::size_t i = 0; i < m_count; ++i)
+        {
+            m_values[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add(const std::size_t index, const std::uint64_t value)
+    {
+        m_values[index].store(m_values[index].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::uint64_t sum() const
+    {
+        std::uint64_t l_sum{0};
+        for (std::size_t i = 0; i < m_count; ++i)
+        {
+            l_sum += m_values[i].load(std::memory_order_relaxed);
+        }
+        return l_sum;
+    }
+};
+
+struct sharded
+{
+    sharded_counter m_counter;
+
+    void add(const std::size_t, const std::uint64_t value) { m_counter.add(value); }
+    std::uint64_t sum() const { return m_counter.sum(); }
+};
+
+template <typename Counter>
+void run(const std::string &name, Counter &counter, const std::size_t threads_count, const std::size_t increments)
+{
+    std::atomic<bool> l_stop{false};
+    std::size_t l_sums{0};
+    std::thread l_reader([&]
+                         {
+        while (not l_stop.load(std::memory_order_relaxed))
+        {
+            counter.sum();
+            ++l_sums;
+        } });
+
+    std::vector<std::thread> l_writers;
+    const auto l_start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threads_count; ++t)
+    {
+        l_writers.emplace_back([&counter, t, increments]
+                               {
+            for (std::size_t i = 0; i < increments; ++i)
+            {
+                counter.add(t, 1);
+            } });
+    }
+    for (auto &th : l_writers)
+    {
+        th.join();
+    }
+    const std::chrono::duration<double, std::nano> l_elapsed = std::chrono::steady_clock::now() - l_start;
+    l_stop = true;
+    l_reader.join();
+
+    const double l_total = static_cast<double>(threads_count * increments);
+    std::cout << std::setw(18) << name << std::setw(10) << threads_count
+              << std::fixed << std::setprecision(2) << std::setw(14) << l_elapsed.count() / l_total
+              << std::setprecision(0) << std::setw(14) << l_total / l_elapsed.count() * 1e3
+              << std::setw(12) << l_sums
+              << std::setw(14) << counter.sum() << (counter.sum() == threads_count * increments ? "  ok" : "  WRONG") << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t max_threads = (argc > 1) ? std::stoul(argv[1]) : 64;
+    const std::size_t increments = (argc > 2) ? std::stoul(argv[2]) : 2000000;
+
+    std::cout << std::setw(18) << "" << std::setw(10) << "threads" << std::setw(14) << "ns/increment"
+              << std::setw(14) << "increments/ms" << std::setw(12) << "sum() calls" << std::setw(14) << "total" << '\n';
+    for (std::size_t threads_count = 1; threads_count <= max_threads; threads_count *= 4)
+    {
+        shared_atomic l_atomic;
+        run("std::atomic", l_atomic, threads_count, increments);
+        unpadded_slots l_unpadded(threads_count);
+        run("unpadded slots", l_unpadded, threads_count, increments);
+        sharded l_sharded;
+        run("sharded_counter", l_sharded, threads_count, increments);
+    }
+
+    // a gauge goes up and down, the threads which exit leave their value in the slots
+    sharded_gauge l_in_flight;
+    {
+        std::vector<std::jthread> l_threads;
+        for (int t = 0; t < 8; ++t)
+        {
+            l_threads.emplace_back([&l_in_flight, t]
+                                   {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    ++l_in_flight;
+                    if (i % 4 != t % 4)
+                    {
+                        --l_in_flight;
+                    }
+                } });
+        }
+    }
+    std::cout << "\nin flight after 8 threads: " << l_in_flight.sum() << " (expected 2000), slots "
+              << l_in_flight.snapshot().size() << '\n';
+
+    // counters created and destroyed in a loop: the ids are reused, the thread keeps one entry
+    const std::size_t l_churn{1000000};
+    std::size_t l_wrong{0};
+    for (std::size_t i = 0; i < l_churn; ++i)
+    {
+        sharded_counter l_counter;
+        ++l_counter;
+        l_wrong += (l_counter.sum() != 1);
+    }
+    rusage l_usage{};
+    getrusage(RUSAGE_SELF, &l_usage);
+    std::cout << l_churn << " counters created and destroyed: " << (l_wrong == 0 ? "ok" : "WRONG")
+              << ", max RSS " << l_usage.ru_maxrss / 1024 << " MB\n";
+
+    return 0;
+}
+
+/*******
+
+The sharded counter trades a more expensive sum() for a cheap add(), use it when writes are far more frequent than reads
+(statistics, metrics), not when the value decides something on the hot path (a reference count).
+
+The slots of exited threads are reused: the 8 threads of the gauge example run one after the other
+on a single core and usually end up sharing one or two slots, at most 8 are created.
+
+The ids of destroyed counters are reused: a thread which uses a million short-lived counters one
+after the other keeps one entry for all of them, the loop of the example runs in 4 MB of max RSS.
+
+Output (g++ -O2, ./sharded_counters on a single core machine, without cache line transfers between cores
+the shared atomic only pays for the locked instruction)
+                     threads  ns/increment increments/ms sum() calls         total
+       std::atomic         1         17.19            58    12618979       2000000  ok
+    unpadded slots         1          3.31           302     1607932       2000000  ok
+   sharded_counter         1         13.06            77     5707707       2000000  ok
+       std::atomic         4         11.00            91    14724223       8000000  ok
+    unpadded slots         4          2.08           481      772702       8000000  ok
+   sharded_counter         4          6.51           154     4354369       8000000  ok
+       std::atomic        16          9.48           105    16890407      32000000  ok
+    unpadded slots        16          1.73           577      209457      32000000  ok
+   sharded_counter        16          6.87           145     2535942      32000000  ok
+       std::atomic        64          9.02           111    21212617     128000000  ok
+    unpadded slots        64          1.80           555      190102     128000000  ok
+   sharded_counter        64          5.69           176     1528423     128000000  ok
+
+in flight after 8 threads: 2000 (expected 2000), slots 1
+1000000 counters created and destroyed: ok, max RSS 4 MB
+
+*******/
+
+/*******
+	END OF FILE
+***********/
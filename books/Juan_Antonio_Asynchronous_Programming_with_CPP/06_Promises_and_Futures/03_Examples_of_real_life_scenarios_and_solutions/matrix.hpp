@@ -0,0 +1,395 @@
+/*******
+
+References
+    Asynchronous Programming with C++ | Javier Reguera-Salgado & Juan Antonio Rufes
+    Goto, van de Geijn - Anatomy of High-Performance Matrix Multiplication
+    https://en.cppreference.com/w/cpp/experimental/simd
+
+Contiguous matrix and cache-blocked multiplication:
+
+    Matrix<T>           row-major, all the elements in one allocation, element (i, j) at i * stride + j
+    matrix_view<T>      rows, columns and stride over elements owned by someone else,
+                        a block of a matrix is a view with the stride of the matrix (no copy)
+
+    gemm(a, b, c)       c += a * b, blocked as in GotoBLAS:
+        -> the columns of b are cut in panels of nc columns, the inner dimension in slices of kc,
+           a kc x nc block of b is packed (copied in the order the kernel reads it) once and stays in the L3 cache
+        -> the rows of a are cut in mc rows, a mc x kc block of a is packed and stays in the L2 cache
+        -> the micro-kernel computes a mr x nr tile of c in registers: for every k,
+           nr / simd width vectors of b, mr broadcasts of a, mr * nr / simd width multiply-adds,
+           the tile is added to c once, after kc steps
+        -> packing pads the edges with zeros, the kernel always computes full tiles,
+           the tiles crossing the edge of c are computed in a buffer and only the valid part is added
+
+        the kernel uses std::experimental::simd, native_simd<T> is 4 floats with SSE2,
+        16 with AVX-512 (-march=native)
+
+    parallel_gemm(a, b, c, executor)
+        the loops of gemm, the two inner ones in parallel as in BLIS, on the executor (executor.hpp,
+        a thread pool by default):
+        -> every kc x nc block of b is packed once, in one buffer shared by all the tasks,
+           its panels of nr columns are packed in parallel
+        -> then every mc rows of a (ic loop) is a task which packs its block of a in the buffer
+           of its thread and runs the macro-kernel on the packed b; with too few blocks of rows
+           for the threads, the panels of b (jr loop) are cut in ranges, a task per block and range
+        -> the tasks of a step write disjoint tiles of c, the group is waited for before
+           the next block of b is packed over the buffer
+
+***********/
+
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <experimental/simd>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "executor.hpp"
+
+template <typename T>
+class matrix_view
+{
+    T *m_data{nullptr};
+    std::size_t m_rows{0};
+    std::size_t m_cols{0};
+    std::size_t m_stride{0};
+
+public:
+    matrix_view() = default;
+    matrix_view(T *data, const std::size_t rows, const std::size_t cols, const std::size_t stride)
+        : m_data{data}, m_rows{rows}, m_cols{cols}, m_stride{stride} {}
+
+    // a view of T converts to a view of const T
+    template <typename U>
+        requires std::is_same_v<T, const U>
+    matrix_view(const matrix_view<U> &other)
+        : m_data{other.data()}, m_rows{other.rows()}, m_cols{other.cols()}, m_stride{other.stride()} {}
+
+    std::size_t rows() const { return m_rows; }
+    std::size_t cols() const { return m_cols; }
+    std::size_t stride() const { return m_stride; }
+    T *data() const { return m_data; }
+    T *row(const std::size_t i) const { return m_data + i * m_stride; }
+
+    T &operator()(const std::size_t i, const std::size_t j) const { return m_data[i * m_stride + j]; }
+
+    matrix_view block(const std::size_t row, const std::size_t col, const std::size_t rows, const std::size_t cols) const
+    {
+        return matrix_view(m_data + row * m_stride + col, rows, cols, m_stride);
+    }
+};
+
+template <typename T>
+class Matrix
+{
+    std::size_t m_rows{0};
+    std::size_t m_cols{0};
+    std::vector<T> m_data;
+
+public:
+    Matrix() = default;
+    Matrix(const std::size_t rows, const std::size_t cols, const T value = T{})
+        : m_rows{rows}, m_cols{cols}, m_data(rows * cols, value) {}
+
+    Matrix(std::initializer_list<std::initializer_list<T>> rows)
+        : m_rows{rows.size()}, m_cols{rows.size() ? rows.begin()->size() : 0}
+    {
+        m_data.reserve(m_rows * m_cols);
+        for (const auto &l_row : rows)
+        {
+            if (l_row.size() != m_cols)
+            {
+                throw std::invalid_argument("Matrix: rows of different sizes");
+            }
+            m_data.insert(m_data.end(), l_row.begin(), l_row.end());
+        }
+    }
+
+    std::size_t rows() const { return m_rows; }
+    std::size_t cols() const { return m_cols; }
+    std::size_t stride() const { return m_cols; }
+    T *data() { return m_data.data(); }
+    const T *data() const { return m_data.data(); }
+    T *row(const std::size_t i) { return m_data.data() + i * m_cols; }
+    const T *row(const std::size_t i) const { return m_data.data() + i * m_cols; }
+
+    T &operator()(const std::size_t i, const std::size_t j) { return m_data[i * m_cols + j]; }
+    const T &operator()(const std::size_t i, const std::size_t j) const { return m_data[i * m_cols + j]; }
+
+    matrix_view<T> view() { return matrix_view<T>(m_data.data(), m_rows, m_cols, m_cols); }
+    matrix_view<const T> view() const { return matrix_view<const T>(m_data.data(), m_rows, m_cols, m_cols); }
+
+    void fill(const T value) { std::fill(m_data.begin(), m_data.end(), value); }
+
+    bool operator==(const Matrix &) const = default;
+};
+
+namespace gemm_detail
+{
+    namespace stdx = std::experimental;
+
+    template <typename T>
+    struct kernel_shape
+    {
+        using simd_t = stdx::native_simd<T>;
+        static constexpr std::size_t width = simd_t::size();
+        static constexpr std::size_t mr = 6;
+        static constexpr std::size_t nr = 2 * width;
+        // a mc x kc block of a in the L2 cache, a kc x nr panel of b in the L1 cache
+        static constexpr std::size_t kc = 256;
+        static constexpr std::size_t mc = mr * (128 * 1024 / (kc * sizeof(T)) / mr);
+        static constexpr std::size_t nc = nr * 256;
+    };
+
+    // the buffers of the packed blocks, aligned for the simd loads
+    template <typename T>
+    struct aligned_buffer
+    {
+        struct deleter
+        {
+            void operator()(T *ptr) const { ::operator delete[](ptr, std::align_val_t{64}); }
+        };
+        std::unique_ptr<T[], deleter> m_data;
+
+        explicit aligned_buffer(const std::size_t size)
+            : m_data{static_cast<T *>(::operator new[](size * sizeof(T), std::align_val_t{64}))} {}
+        T *get() const { return m_data.get(); }
+    };
+
+    // the packed block of a of the current thread, gemm and the tasks of parallel_gemm do not allocate
+    template <typename T>
+    T *thread_packed_a()
+    {
+        static thread_local aligned_buffer<T> l_packed_a(kernel_shape<T>::mc * kernel_shape<T>::kc);
+        return l_packed_a.get();
+    }
+
+    // mc x kc block of a, in panels of mr rows, every k the mr elements of a column of the panel
+    template <typename T>
+    void pack_a(const matrix_view<const T> a, T *buffer)
+    {
+        constexpr std::size_t mr = kernel_shape<T>::mr;
+        for (std::size_t i0 = 0; i0 < a.rows(); i0 += mr)
+        {
+            const std::size_t l_rows = std::min(mr, a.rows() - i0);
+            for (std::size_t k = 0; k < a.cols(); ++k)
+            {
+                for (std::size_t i = 0; i < mr; ++i)
+                {
+                    *buffer++ = (i < l_rows) ? a(i0 + i, k) : T{};
+                }
+            }
+        }
+    }
+
+    // kc x nc block of b, in panels of nr columns, every k the nr elements of a row of the panel
+    template <typename T>
+    void pack_b(const matrix_view<const T> b, T *buffer)
+    {
+        constexpr std::size_t nr = kernel_shape<T>::nr;
+        for (std::size_t j0 = 0; j0 < b.cols(); j0 += nr)
+        {
+            const std::size_t l_cols = std::min(nr, b.cols() - j0);
+            for (std::size_t k = 0; k < b.rows(); ++k)
+            {
+                const T *l_row = b.row(k) + j0;
+                std::size_t j = 0;
+                for (; j < l_cols; ++j)
+                {
+                    *buffer++ = l_row[j];
+                }
+                for (; j < nr; ++j)
+                {
+                    *buffer++ = T{};
+                }
+            }
+        }
+    }
+
+    // c(mr x nr) += a panel * b panel, rows x cols of the tile are inside c
+    template <typename T>
+    void micro_kernel(const std::size_t kc, const T *a, const T *b, T *c, const std::size_t ldc,
+                      const std::size_t rows, const std::size_t cols)
+    {
+        using shape = kernel_shape<T>;
+        using simd_t = typename shape::simd_t;
+        constexpr std::size_t mr = shape::mr;
+        constexpr std::size_t w = shape::width;
+
+        simd_t l_c[mr][2] = {};
+        for (std::size_t k = 0; k < kc; ++k, a += mr, b += 2 * w)
+        {
+            const simd_t l_b0(b, stdx::vector_aligned);
+            const simd_t l_b1(b + w, stdx::vector_aligned);
+            for (std::size_t i = 0; i < mr; ++i)
+            {
+                const simd_t l_a(a[i]);
+                l_c[i][0] += l_a * l_b0;
+                l_c[i][1] += l_a * l_b1;
+            }
+        }
+
+        if ((rows == mr) and (cols == 2 * w))
+        {
+            for (std::size_t i = 0; i < mr; ++i, c += ldc)
+            {
+                (simd_t(c, stdx::element_aligned) + l_c[i][0]).copy_to(c, stdx::element_aligned);
+                (simd_t(c + w, stdx::element_aligned) + l_c[i][1]).copy_to(c + w, stdx::element_aligned);
+            }
+            return;
+        }
+        alignas(64) T l_tile[mr][2 * w];
+        for (std::size_t i = 0; i < mr; ++i)
+        {
+            l_c[i][0].copy_to(l_tile[i], stdx::vector_aligned);
+            l_c[i][1].copy_to(l_tile[i] + w, stdx::vector_aligned);
+        }
+        for (std::size_t i = 0; i < rows; ++i, c += ldc)
+        {
+            for (std::size_t j = 0; j < cols; ++j)
+            {
+                c[j] += l_tile[i][j];
+            }
+        }
+    }
+
+    // c += a * b for a packed mc x kc block of a and a packed kc x nc block of b
+    template <typename T>
+    void macro_kernel(const std::size_t kc, const T *packed_a, const T *packed_b, const matrix_view<T> c)
+    {
+        using shape = kernel_shape<T>;
+        for (std::size_t j0 = 0; j0 < c.cols(); j0 += shape::nr)
+        {
+            const T *l_b = packed_b + (j0 / shape::nr) * kc * shape::nr;
+            for (std::size_t i0 = 0; i0 < c.rows(); i0 += shape::mr)
+            {
+                micro_kernel(kc, packed_a + (i0 / shape::mr) * kc * shape::mr, l_b, c.row(i0) + j0, c.stride(),
+                             std::min(shape::mr, c.rows() - i0), std::min(shape::nr, c.cols() - j0));
+            }
+        }
+    }
+}
+
+// c += a * b
+template <typename T>
+void gemm(const matrix_view<const T> a, const matrix_view<const T> b, const matrix_view<T> c)
+{
+    using shape = gemm_detail::kernel_shape<T>;
+    if ((a.cols() != b.rows()) or (a.rows() != c.rows()) or (b.cols() != c.cols()))
+    {
+        throw std::invalid_argument("gemm: sizes do not match");
+    }
+
+    // one pair of buffers per thread
+    T *const l_packed_a = gemm_detail::thread_packed_a<T>();
+    static thread_local gemm_detail::aligned_buffer<T> l_packed_b(shape::kc * shape::nc);
+    for (std::size_t jc = 0; jc < b.cols(); jc += shape::nc)
+    {
+        const std::size_t l_nc = std::min(shape::nc, b.cols() - jc);
+        for (std::size_t pc = 0; pc < a.cols(); pc += shape::kc)
+        {
+            const std::size_t l_kc = std::min(shape::kc, a.cols() - pc);
+            gemm_detail::pack_b(b.block(pc, jc, l_kc, l_nc), l_packed_b.get());
+            for (std::size_t ic = 0; ic < a.rows(); ic += shape::mc)
+            {
+                const std::size_t l_mc = std::min(shape::mc, a.rows() - ic);
+                gemm_detail::pack_a(a.block(ic, pc, l_mc, l_kc), l_packed_a);
+                gemm_detail::macro_kernel(l_kc, l_packed_a, l_packed_b.get(), c.block(ic, jc, l_mc, l_nc));
+            }
+        }
+    }
+}
+
+template <typename T>
+Matrix<T> multiply(const Matrix<T> &a, const Matrix<T> &b)
+{
+    Matrix<T> l_c(a.rows(), b.cols());
+    gemm(a.view(), b.view(), l_c.view());
+    return l_c;
+}
+
+// c += a * b, the loops of gemm: every block of b is packed once in parallel, then the blocks of rows of a
+// (cut in ranges of panels of b when they are too few) are tasks sharing the packed block of b
+template <typename T, typename Executor>
+void parallel_gemm(const matrix_view<const T> a, const matrix_view<const T> b, const matrix_view<T> c, Executor &executor)
+{
+    using shape = gemm_detail::kernel_shape<T>;
+    if ((a.cols() != b.rows()) or (a.rows() != c.rows()) or (b.cols() != c.cols()))
+    {
+        throw std::invalid_argument("parallel_gemm: sizes do not match");
+    }
+    if ((c.rows() == 0) or (c.cols() == 0) or (a.cols() == 0))
+    {
+        return;
+    }
+
+    const std::size_t l_threads = executor.concurrency();
+    const std::size_t l_row_blocks = (a.rows() + shape::mc - 1) / shape::mc;
+    // at least 4 tasks per thread when the columns allow it, a range is at least one panel of nr columns
+    const std::size_t l_ranges = (4 * l_threads + l_row_blocks - 1) / l_row_blocks;
+
+    gemm_detail::aligned_buffer<T> l_packed_b(shape::kc * std::min(shape::nc, (b.cols() + shape::nr - 1) / shape::nr * shape::nr));
+    for (std::size_t jc = 0; jc < b.cols(); jc += shape::nc)
+    {
+        const std::size_t l_nc = std::min(shape::nc, b.cols() - jc);
+        const std::size_t l_panels = (l_nc + shape::nr - 1) / shape::nr;
+        for (std::size_t pc = 0; pc < a.cols(); pc += shape::kc)
+        {
+            const std::size_t l_kc = std::min(shape::kc, a.cols() - pc);
+
+            // the panels of b in parallel, a panel is kc x nr at (panel * kc * nr) in the buffer
+            {
+                task_group l_group(executor);
+                const std::size_t l_step = (l_panels + l_threads - 1) / l_threads;
+                for (std::size_t p0 = 0; p0 < l_panels; p0 += l_step)
+                {
+                    const std::size_t l_j0 = p0 * shape::nr;
+                    const std::size_t l_cols = std::min(l_step * shape::nr, l_nc - l_j0);
+                    l_group.run([=, &l_packed_b] { gemm_detail::pack_b(b.block(pc, jc + l_j0, l_kc, l_cols), l_packed_b.get() + p0 * l_kc * shape::nr); });
+                }
+                l_group.wait();
+            }
+
+            // the blocks of rows, every task packs its block of a and reads the shared packed b
+            task_group l_group(executor);
+            const std::size_t l_range = (l_panels + std::min(l_ranges, l_panels) - 1) / std::min(l_ranges, l_panels);
+            for (std::size_t ic = 0; ic < a.rows(); ic += shape::mc)
+            {
+                const std::size_t l_mc = std::min(shape::mc, a.rows() - ic);
+                for (std::size_t p0 = 0; p0 < l_panels; p0 += l_range)
+                {
+                    const std::size_t l_j0 = p0 * shape::nr;
+                    const std::size_t l_cols = std::min(l_range * shape::nr, l_nc - l_j0);
+                    const T *const l_b = l_packed_b.get() + p0 * l_kc * shape::nr;
+                    l_group.run([=] {
+                        T *const l_packed_a = gemm_detail::thread_packed_a<T>();
+                        gemm_detail::pack_a(a.block(ic, pc, l_mc, l_kc), l_packed_a);
+                        gemm_detail::macro_kernel(l_kc, l_packed_a, l_b, c.block(ic, jc + l_j0, l_mc, l_cols));
+                    });
+                }
+            }
+            // the calling thread runs tasks too while it waits
+            l_group.wait();
+        }
+    }
+}
+
+template <typename T, typename Executor = thread_pool>
+Matrix<T> parallel_multiply(const Matrix<T> &a, const Matrix<T> &b, Executor &executor = default_executor())
+{
+    Matrix<T> l_c(a.rows(), b.cols());
+    parallel_gemm(a.view(), b.view(), l_c.view(), executor);
+    return l_c;
+}
+
+#endif
+
+/*******
+	END OF FILE
+***********/
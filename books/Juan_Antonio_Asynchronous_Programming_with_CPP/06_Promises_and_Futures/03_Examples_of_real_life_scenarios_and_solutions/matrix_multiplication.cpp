@@ -2,6 +2,24 @@
 
 References
     Asynchronous Programming with C++ | Javier Reguera-Salgado & Juan Antonio Rufes
+    https://en.cppreference.com/w/cpp/thread/packaged_task
+
+Matrix multiplication with packaged tasks
+
+    The first asynchronous version ran a std::packaged_task on a new detached thread for every element
+    of the result, with a copy of a row and of a column (std::vector<std::vector<int>>):
+    a million threads and two million allocations for 1000 x 1000, far slower than the serial loops.
+    It is kept as per_element_matrix_mutiplication for the comparison, on small matrices only.
+
+    async_matrix_mutiplication runs parallel_gemm (matrix.hpp) on a thread pool (executor.hpp) created once:
+        -> every block of m2 is packed once, then every block of rows of m1 is a task which multiplies it
+           by the packed block, a 1000 x 1000 int result makes 8 tasks per block of m2, not a million
+        -> the tasks write disjoint tiles of the result, the task_group of parallel_gemm takes the place
+           of the futures: it waits for the tasks and transfers the first exception to the caller
+
+Usage
+    g++ -O2 -std=c++20 -pthread matrix_multiplication.cpp
+    ./matrix_multiplication [size] [max_threads]
 
 **********/
 
@@ -10,23 +28,27 @@ References
 #include <chrono>
 #include <vector>
 #include <future>
+#include <iomanip>
+#include <random>
+#include <string>
+
+#include "matrix.hpp"
 
 using matrix_t = std::vector<std::vector<int>>;
 
-auto display_matrix(const matrix_t &mt)
+template <typename T>
+auto display_matrix(const Matrix<T> &mt)
 {
-    const size_t l_rows = mt.size();
-    if (l_rows)
+    if (mt.rows())
     {
-        const size_t l_cols = mt[0].size();
-        std::cout << "Matrix rows: " << mt.size() << ", columns: " << mt[0].size() << ":\n";
+        std::cout << "Matrix rows: " << mt.rows() << ", columns: " << mt.cols() << ":\n";
 
-        for (size_t i = 0; i < l_rows; ++i)
+        for (size_t i = 0; i < mt.rows(); ++i)
         {
 
-            for (size_t j = 0; j < l_cols; ++j)
+            for (size_t j = 0; j < mt.cols(); ++j)
             {
-                std::cout << mt[i][j] << ' ';
+                std::cout << mt(i, j) << ' ';
             }
             std::cout << '\n';
         }
@@ -35,25 +57,9 @@ auto display_matrix(const matrix_t &mt)
     }
 }
 
-auto display_vec(const std::vector<int> &vec)
-{
-    for (const auto &elem : vec)
-    {
-        std::cout << elem << ' ';
-    }
-}
-
 auto dot_product(const std::vector<int> &row,
                  const std::vector<int> &col)
 {
-    //std::cout << "Row: ";
-    //display_vec(row);
-    // std::cout << '\n';
-
-    //std::cout << " Col: ";
-    //display_vec(col);
-    //std::cout << '\n';
-
     int res{0};
     for(size_t i = 0; i < row.size(); ++i) {
         res += (row[i] * col[i]);
@@ -62,20 +68,17 @@ auto dot_product(const std::vector<int> &row,
     return res;
 }
 
-auto matrix_mutiplication(const matrix_t &m1,
-                          const matrix_t &m2,
-                          matrix_t &outm)
+// the first asynchronous version, a thread and a future per element
+auto per_element_matrix_mutiplication(const matrix_t &m1,
+                                      const matrix_t &m2,
+                                      matrix_t &outm)
 {
     const size_t l_m1_r = m1.size();
-    //const size_t l_m1_c = m1[0].size();
-    //std::cout << "M1 Rows: " << l_m1_r << ", column: " << l_m1_c << '\n';
-
     const size_t l_m2_r = m2.size();
     const size_t l_m2_c = m2[0].size();
-    //std::cout << "M2 Rows: " << l_m2_r << ", column: " << l_m2_c << '\n';
 
+    std::vector<std::future<int>>   l_futs;
     outm.resize(l_m1_r);
-
     for (size_t i = 0; i < l_m1_r; ++i)
     {
         outm[i].resize(l_m2_c);
@@ -90,106 +93,230 @@ auto matrix_mutiplication(const matrix_t &m1,
                 l_col[k] = m2[k][j];
             }
 
-            outm[i][j] = dot_product(l_row, l_col);
+            std::packaged_task  l_task(dot_product);
+            l_futs.push_back(l_task.get_future());
+
+            std::thread l_th(std::move(l_task), l_row, l_col);
+            l_th.detach();
+        }
+    }
+
+    for(size_t i = 0; i < l_m1_r; ++i) {
+        for(size_t j = 0; j < l_m2_c; ++j) {
+            outm[i][j] = l_futs[(i * l_m2_c) + j].get();
         }
     }
 }
 
-auto async_matrix_mutiplication(const matrix_t &m1,
-                          const matrix_t &m2,
-                          matrix_t &outm)
+template <typename T>
+auto matrix_mutiplication(const Matrix<T> &m1,
+                          const Matrix<T> &m2,
+                          Matrix<T> &outm)
 {
-    const size_t l_m1_r = m1.size();
-    //const size_t l_m1_c = m1[0].size();
-    //std::cout << "M1 Rows: " << l_m1_r << ", column: " << l_m1_c << '\n';
+    outm = multiply(m1, m2);
+}
 
-    const size_t l_m2_r = m2.size();
-    const size_t l_m2_c = m2[0].size();
-    //std::cout << "M2 Rows: " << l_m2_r << ", column: " << l_m2_c << '\n';
+// the tasks of parallel_gemm on the pool, the calling thread runs tasks too while it waits
+template <typename T, typename Executor>
+auto async_matrix_mutiplication(const Matrix<T> &m1,
+                                const Matrix<T> &m2,
+                                Matrix<T> &outm,
+                                Executor &executor)
+{
+    outm = Matrix<T>(m1.rows(), m2.cols());
+    parallel_gemm(m1.view(), m2.view(), outm.view(), executor);
+}
 
-    std::vector<std::future<int>>   l_futs;
-    outm.resize(l_m1_r);
-    for (size_t i = 0; i < l_m1_r; ++i)
+// the best of 3 runs
+template <typename Func>
+double milliseconds(Func func)
+{
+    double l_best{0};
+    for (int r = 0; r < 3; ++r)
     {
-        outm[i].resize(l_m2_c);
-
-        const auto l_row = m1[i];
+        const auto l_start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double, std::milli> l_elapsed = std::chrono::steady_clock::now() - l_start;
+        l_best = (r == 0) ? l_elapsed.count() : std::min(l_best, l_elapsed.count());
+    }
+    return l_best;
+}
 
-        for (size_t j = 0; j < l_m2_c; ++j)
+Matrix<int> random_matrix(const size_t n, std::mt19937 &gen)
+{
+    Matrix<int> l_m(n, n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < n; ++j)
         {
-            std::vector<int> l_col(l_m2_r);
-            for (size_t k = 0; k < l_m2_r; ++k)
-            {
-                l_col[k] = m2[k][j];
-            }
-
-            //outm[i][j] = dot_product(l_row, l_col);
-            std::packaged_task  l_task(dot_product);
-            l_futs.push_back(l_task.get_future());
-
-            std::thread l_th(std::move(l_task), l_row, l_col);
-            l_th.detach();            
+            l_m(i, j) = static_cast<int>(gen() % 21) - 10;
         }
     }
+    return l_m;
+}
 
-    for(size_t i = 0; i < l_m1_r; ++i) {
-        for(size_t j = 0; j < l_m2_c; ++j) {
-            outm[i][j] = l_futs[(i * l_m2_c) + j].get();
+matrix_t to_vectors(const Matrix<int> &m)
+{
+    matrix_t l_v(m.rows(), std::vector<int>(m.cols()));
+    for (size_t i = 0; i < m.rows(); ++i)
+    {
+        for (size_t j = 0; j < m.cols(); ++j)
+        {
+            l_v[i][j] = m(i, j);
         }
     }
+    return l_v;
+}
+
+// a thread per element against a task per tile, small matrices
+void benchmark_per_element(thread_pool &pool, const size_t pool_threads)
+{
+    std::mt19937 l_gen(1);
+    std::cout << "milliseconds, tiles on a pool of " << pool_threads << " threads\n"
+              << std::setw(6) << "n" << std::setw(14) << "per element" << std::setw(12) << "serial" << std::setw(12) << "tiles" << '\n';
+    for (size_t n = 32; n <= 128; n *= 2)
+    {
+        const Matrix<int> l_m1 = random_matrix(n, l_gen);
+        const Matrix<int> l_m2 = random_matrix(n, l_gen);
+        const matrix_t l_v1 = to_vectors(l_m1);
+        const matrix_t l_v2 = to_vectors(l_m2);
+        matrix_t l_vout;
+        Matrix<int> l_serial;
+        Matrix<int> l_tiles;
+        std::cout << std::setw(6) << n << std::fixed << std::setprecision(3)
+                  << std::setw(14) << milliseconds([&] { per_element_matrix_mutiplication(l_v1, l_v2, l_vout); })
+                  << std::setw(12) << milliseconds([&] { matrix_mutiplication(l_m1, l_m2, l_serial); })
+                  << std::setw(12) << milliseconds([&] { async_matrix_mutiplication(l_m1, l_m2, l_tiles, pool); })
+                  << ((l_tiles == l_serial and to_vectors(l_serial) == l_vout) ? "  same" : "  DIFFERENT") << '\n';
+    }
+    std::cout << '\n';
+}
+
+// serial gemm against the tiles on pools of 1 to max_threads threads
+void benchmark_speedup(const size_t n, const size_t max_threads)
+{
+    std::mt19937 l_gen(2);
+    const Matrix<int> l_m1 = random_matrix(n, l_gen);
+    const Matrix<int> l_m2 = random_matrix(n, l_gen);
+    Matrix<int> l_serial;
+    const double l_serial_ms = milliseconds([&] { matrix_mutiplication(l_m1, l_m2, l_serial); });
+    std::cout << n << " x " << n << " int, serial " << std::fixed << std::setprecision(1) << l_serial_ms << " ms\n"
+              << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup" << '\n';
+
+    auto run = [&](const size_t threads, auto &executor)
+    {
+        Matrix<int> l_tiles;
+        const double l_ms = milliseconds([&] { async_matrix_mutiplication(l_m1, l_m2, l_tiles, executor); });
+        std::cout << std::setw(8) << threads << std::setw(12) << l_ms << std::setw(10) << std::setprecision(2)
+                  << l_serial_ms / l_ms << std::setprecision(1) << ((l_tiles == l_serial) ? "" : "  DIFFERENT") << '\n';
+    };
+    inline_executor l_inline;
+    run(1, l_inline);
+    for (size_t l_threads = 2; l_threads <= max_threads; l_threads *= 2)
+    {
+        // the calling thread is one of them
+        thread_pool l_pool(static_cast<unsigned>(l_threads - 1));
+        run(l_threads, l_pool);
+    }
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    matrix_t l_m1{
+    Matrix<int> l_m1{
         {11, 12, 13},
         {14, 15, 16},
         {17, 18, 19},
         {21, 22, 23}};
-    //std::cout << "Rows: " << l_m1.size() << ", column: " << l_m1[0].size() << '\n';
 
-    matrix_t l_m2{
+    Matrix<int> l_m2{
         {21, 22, 23},
         {24, 25, 26},
         {27, 28, 29}};
-    //std::cout << "Rows: " << l_m2.size() << ", column: " << l_m2[0].size() << '\n';
 
     display_matrix(l_m1);
     std::cout << '\n';
-    
+
     display_matrix(l_m2);
     std::cout << '\n';
 
     {
-        matrix_t l_m;
-        //const auto l_start_time = std::chrono::high_resolution_clock::now();
+        Matrix<int> l_m;
         matrix_mutiplication(l_m1, l_m2, l_m);
-        //const auto l_end_time = std::chrono::high_resolution_clock::now();
-
-        //const auto l_dur = std::chrono::duration_cast<std::chrono::nanoseconds>(l_end_time - l_start_time);
-        //std::cout << "Time taken " << l_dur.count() << " nanoseconds\n";
-
         display_matrix(l_m);
         std::cout << '\n';
     }
 
+    const unsigned pool_threads = 4;
+    thread_pool l_pool(pool_threads);
     {
-        matrix_t l_m;
-        //const auto l_start_time = std::chrono::high_resolution_clock::now();
-        async_matrix_mutiplication(l_m1, l_m2, l_m);
-        //const auto l_end_time = std::chrono::high_resolution_clock::now();
-
-        //const auto l_dur = std::chrono::duration_cast<std::chrono::nanoseconds>(l_end_time - l_start_time);
-        //std::cout << "Time taken " << l_dur.count() << " nanoseconds\n";
-
-        
+        Matrix<int> l_m;
+        async_matrix_mutiplication(l_m1, l_m2, l_m, l_pool);
         display_matrix(l_m);
         std::cout << '\n';
     }
 
+    benchmark_per_element(l_pool, pool_threads);
+
+    const size_t size = (argc > 1) ? static_cast<size_t>(std::stoul(argv[1])) : 1000;
+    const size_t max_threads = (argc > 2) ? static_cast<size_t>(std::stoul(argv[2])) : 8;
+    benchmark_speedup(size, max_threads);
+
     return 0;
 }
 
+/*****
+Explanation
+
+A thread per element costs about 40 microseconds of thread creation for a few hundred nanoseconds of work,
+the 128 x 128 product takes 0.7 s instead of less than a millisecond, a 1000 x 1000 one would not finish.
+
+The asynchronous version is parallel_gemm: each block of m2 is packed once, as in the serial gemm,
+whatever the number of tiles, and shared by the tasks; the cost of the tasks is a push on the queue
+and a wake up per block of rows. On a single core the pool cannot run the tasks at the same time,
+the speedup can only be 1: the table varies by +-10 % from run to run on this machine (the same code timed alternately with gemm
+gives the same time within 1 %). With N cores the 8 blocks of rows of a 1000 x 1000 product are cut
+in ranges of columns too, 4 tasks per thread, until the memory bandwidth runs out.
+At 32 x 32 to 128 x 128 the tiles column pays the tasks and the wake up of the pool, tens of microseconds.
+
+Output (g++ -O2 -std=c++20 -pthread, ./matrix_multiplication on a single core machine)
+Matrix rows: 4, columns: 3:
+11 12 13 
+14 15 16 
+17 18 19 
+21 22 23 
+
+Matrix rows: 3, columns: 3:
+21 22 23 
+24 25 26 
+27 28 29 
+
+Matrix rows: 4, columns: 3:
+870 906 942 
+1086 1131 1176 
+1302 1356 1410 
+1590 1656 1722 
+
+Matrix rows: 4, columns: 3:
+870 906 942 
+1086 1131 1176 
+1302 1356 1410 
+1590 1656 1722 
+
+milliseconds, tiles on a pool of 4 threads
+     n   per element      serial       tiles
+    32        33.040       0.016       0.049  same
+    64       156.771       0.121       0.238  same
+   128       649.103       0.907       1.156  same
+
+1000 x 1000 int, serial 387.5 ms
+ threads          ms   speedup
+       1       404.8      0.96
+       2       345.9      1.12
+       4       421.0      0.92
+       8       351.6      1.10
+
+*****/
+
 /*****
     END OF FILE
 **********/
@@ -0,0 +1,231 @@
+#ifndef EXECUTOR
+#define EXECUTOR
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+    Executors for the parallel algorithms of 8.5
+
+    An executor runs the tasks given to execute(), concurrency() is the number of tasks
+    it can run at the same time, the calling thread included (the algorithms process one block themselves).
+
+        thread_pool             persistent workers (9.1), created once, idle workers sleep on a condition variable
+        new_thread_executor     a new thread per task, what the first versions of 8.5 did on every call
+        inline_executor         runs the task in the calling thread, for tests and tiny inputs
+
+    default_executor() is a thread_pool shared by the whole program.
+
+    task_group waits for the tasks it started, while waiting it runs pending tasks of the executor
+    if the executor can (try_run_pending_task()), so an algorithm called from a task of the pool
+    cannot deadlock the pool by waiting for tasks queued behind it.
+*/
+
+class function_wrapper {
+    struct impl_base {
+        virtual void call() = 0;
+        virtual ~impl_base() {}
+    };
+
+    std::unique_ptr<impl_base> impl{nullptr};
+
+    template <typename F>
+    struct impl_type : impl_base {
+        F f;
+        impl_type(F&& f_) : f(std::move(f_)) {}
+        void call() { f(); }
+    };
+
+   public:
+    function_wrapper() = default;
+    function_wrapper(function_wrapper&& other) : impl(std::move(other.impl)) {}
+    function_wrapper& operator=(function_wrapper&& other) {
+        impl = std::move(other.impl);
+        return *this;
+    }
+
+    function_wrapper(const function_wrapper&) = delete;
+    function_wrapper(function_wrapper&) = delete;
+    function_wrapper& operator=(const function_wrapper&) = delete;
+
+    template <typename F>
+    function_wrapper(F&& f) : impl(std::make_unique<impl_type<F>>(std::move(f))) {}
+
+    void operator()() { impl->call(); }
+};
+
+class thread_pool {
+    std::mutex m_mutex;
+    std::condition_variable m_condv;
+    std::deque<function_wrapper> m_queue;
+    bool m_done{false};
+    std::vector<std::thread> m_threads;
+
+    void worker_thread() {
+        while (true) {
+            function_wrapper task;
+            {
+                std::unique_lock l_lock(m_mutex);
+                m_condv.wait(l_lock, [&] { return m_done or (not m_queue.empty()); });
+                if (m_queue.empty()) {
+                    return;
+                }
+                task = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            task();
+        }
+    }
+
+    void stop() {
+        {
+            const std::lock_guard l_lock(m_mutex);
+            m_done = true;
+        }
+        m_condv.notify_all();
+        for (auto& th : m_threads) {
+            th.join();
+        }
+    }
+
+   public:
+    explicit thread_pool(const unsigned threads_count) {
+        try {
+            for (unsigned i = 0; i < std::max(1u, threads_count); ++i) {
+                m_threads.push_back(std::thread(&thread_pool::worker_thread, this));
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    // runs the tasks still queued, then joins the workers
+    ~thread_pool() { stop(); }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    std::size_t concurrency() const { return m_threads.size() + 1; }
+
+    template <typename Func>
+    void execute(Func callable) {
+        {
+            const std::lock_guard l_lock(m_mutex);
+            m_queue.push_back(function_wrapper(std::move(callable)));
+        }
+        m_condv.notify_one();
+    }
+
+    bool try_run_pending_task() {
+        function_wrapper task;
+        {
+            const std::lock_guard l_lock(m_mutex);
+            if (m_queue.empty()) {
+                return false;
+            }
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        task();
+        return true;
+    }
+};
+
+inline thread_pool& default_executor() {
+    const unsigned l_hardware = std::thread::hardware_concurrency();
+    static thread_pool s_pool((l_hardware > 1) ? (l_hardware - 1) : 1);
+    return s_pool;
+}
+
+class new_thread_executor {
+    const std::size_t m_concurrency;
+
+   public:
+    explicit new_thread_executor(const std::size_t concurrency) : m_concurrency(std::max<std::size_t>(1, concurrency)) {}
+
+    std::size_t concurrency() const { return m_concurrency; }
+
+    // detached, the task_group waiting for it is the join
+    template <typename Func>
+    void execute(Func callable) {
+        std::thread(std::move(callable)).detach();
+    }
+};
+
+class inline_executor {
+   public:
+    std::size_t concurrency() const { return 1; }
+
+    template <typename Func>
+    void execute(Func callable) {
+        callable();
+    }
+};
+
+template <typename Executor>
+class task_group {
+    Executor& m_executor;
+    std::atomic<std::size_t> m_pending{0};
+    std::atomic<bool> m_failed{false};
+    std::exception_ptr m_exception;
+
+    void wait_for_tasks() {
+        while (m_pending.load(std::memory_order_acquire)) {
+            if constexpr (requires { m_executor.try_run_pending_task(); }) {
+                if (m_executor.try_run_pending_task()) {
+                    continue;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+   public:
+    explicit task_group(Executor& executor) : m_executor(executor) {}
+
+    // the tasks refer to the group, it cannot go away before they are done
+    ~task_group() { wait_for_tasks(); }
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+    template <typename Func>
+    void run(Func callable) {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        try {
+            m_executor.execute([this, callable = std::move(callable)]() mutable {
+                try {
+                    callable();
+                } catch (...) {
+                    if (not m_failed.exchange(true)) {
+                        m_exception = std::current_exception();
+                    }
+                }
+                // last access to the group, the waiting thread may destroy it right after
+                m_pending.fetch_sub(1, std::memory_order_release);
+            });
+        } catch (...) {
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+    }
+
+    // rethrows the first exception thrown by a task
+    void wait() {
+        wait_for_tasks();
+        if (m_exception) {
+            std::rethrow_exception(std::exchange(m_exception, nullptr));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,338 @@
+/*******
+
+References
+    Asynchronous Programming with C++ | Javier Reguera-Salgado & Juan Antonio Rufes
+    Strassen - Gaussian elimination is not optimal (1969)
+    Winograd's variant: 7 multiplications and 15 additions, https://en.wikipedia.org/wiki/Strassen_algorithm
+    Huss-Lederman, Jacobson, Johnson, Tsao, Turnbull - Implementation of Strassen's algorithm for matrix multiplication
+        (dynamic peeling of the odd rows and columns)
+
+Strassen-Winograd multiplication on top of gemm (matrix.hpp):
+
+    strassen_gemm(a, b, c, executor, threshold)     c = a * b (c is overwritten, gemm adds to c)
+        -> while the three sizes are above threshold, a, b and c are cut in 2 x 2 quadrants,
+           the product costs 7 half size products instead of 8 and 15 additions of quadrants:
+               S1 = A21 + A22   S2 = S1 - A11    S3 = A11 - A21   S4 = A12 - S2
+               T1 = B12 - B11   T2 = B22 - T1    T3 = B22 - B12   T4 = T2 - B21
+               P1 = A11 B11     P2 = A12 B21     P3 = S4 B22      P4 = A22 T4
+               P5 = S1 T1       P6 = S2 T2       P7 = S3 T3
+               C11 = P1 + P2            C12 = P1 + P6 + P5 + P3
+               C21 = P1 + P6 + P7 - P4  C22 = P1 + P6 + P7 + P5
+           P2, P3, P4 and P7 are computed in their quadrant of c, the additions reuse them in place
+        -> at threshold or below, the blocked gemm (about n^3 / 4 multiply-adds per level saved above it)
+        -> an odd size is peeled: the even part goes down the recursion, the last row, column or
+           inner index is a thin gemm, any m x k times k x n works
+        -> the temporaries (4 S, 4 T, P1, P5, P6) of every level come from one scratch arena
+           allocated before the recursion: a stack, a level takes its quadrants and gives them back,
+           the recursion itself never allocates
+        -> the first levels run their 7 products as tasks of the executor, as many levels as needed
+           to have at least executor.concurrency() tasks; each task gets its own part of the arena
+           for the levels below it, which run on its thread
+
+    The additions are memory bound and the error grows with the number of levels (S and T mix
+    quadrants of different magnitude), the threshold is the size where 1/8 of the multiply-adds
+    saved pays for them, a few hundred to a few thousand depending on the machine.
+
+    Memory of the arena for n x n: 11/4 n^2 elements at the first level, 1/4 of that at every
+    level below, 7 times the part below a level running in parallel
+
+***********/
+
+#ifndef STRASSEN_HPP
+#define STRASSEN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <experimental/simd>
+#include <functional>
+#include <stdexcept>
+
+#include "executor.hpp"
+#include "matrix.hpp"
+
+// below or at this size (of the smallest of the three dimensions) the blocked gemm is used;
+// not the crossover (Strassen wins down to 128 here, see strassen_multiplication.cpp) but the
+// threshold within a few % of the best time from 4096 up with half the error of 128
+inline constexpr std::size_t strassen_threshold = 256;
+
+namespace strassen_detail
+{
+    namespace stdx = std::experimental;
+
+    // the rows of the temporaries start on a 64 byte boundary
+    template <typename T>
+    constexpr std::size_t padded(const std::size_t cols)
+    {
+        constexpr std::size_t l_align = 64 / sizeof(T);
+        return (cols + l_align - 1) / l_align * l_align;
+    }
+
+    template <typename T>
+    constexpr std::size_t footprint(const std::size_t rows, const std::size_t cols)
+    {
+        return rows * padded<T>(cols);
+    }
+
+    // a stack of matrices in a buffer allocated once, the levels take their temporaries and release them
+    template <typename T>
+    class scratch_arena
+    {
+        T *m_data{nullptr};
+        std::size_t m_size{0};
+        std::size_t m_used{0};
+
+    public:
+        scratch_arena(T *data, const std::size_t size) : m_data{data}, m_size{size} {}
+
+        std::size_t used() const { return m_used; }
+        void release(const std::size_t mark) { m_used = mark; }
+
+        matrix_view<T> take(const std::size_t rows, const std::size_t cols)
+        {
+            const std::size_t l_size = footprint<T>(rows, cols);
+            if (m_used + l_size > m_size)
+            {
+                throw std::logic_error("scratch_arena: the scratch size does not match the recursion");
+            }
+            const matrix_view<T> l_view(m_data + m_used, rows, cols, padded<T>(cols));
+            m_used += l_size;
+            return l_view;
+        }
+
+        // the part of the arena of a task running in parallel
+        scratch_arena split(const std::size_t size)
+        {
+            if (m_used + size > m_size)
+            {
+                throw std::logic_error("scratch_arena: the scratch size does not match the recursion");
+            }
+            scratch_arena l_child(m_data + m_used, size);
+            m_used += size;
+            return l_child;
+        }
+    };
+
+    inline bool use_strassen(const std::size_t m, const std::size_t k, const std::size_t n, const std::size_t threshold)
+    {
+        return std::min({m, k, n}) > threshold;
+    }
+
+    // the arena needed by multiply for m x k times k x n, mirrors multiply and strassen_level
+    template <typename T>
+    std::size_t scratch_size(const std::size_t m, const std::size_t k, const std::size_t n,
+                             const std::size_t threshold, const std::size_t parallel_levels)
+    {
+        if (not use_strassen(m, k, n, threshold))
+        {
+            return 0;
+        }
+        const std::size_t hm = m / 2;
+        const std::size_t hk = k / 2;
+        const std::size_t hn = n / 2;
+        const std::size_t l_level = 4 * footprint<T>(hm, hk) + 4 * footprint<T>(hk, hn) + 3 * footprint<T>(hm, hn);
+        const std::size_t l_below = scratch_size<T>(hm, hk, hn, threshold, (parallel_levels > 0) ? parallel_levels - 1 : 0);
+        return l_level + ((parallel_levels > 0) ? 7 * l_below : l_below);
+    }
+
+    // the number of parallel levels, 7^levels tasks at least as many as the executor runs at once
+    inline std::size_t parallel_levels(const std::size_t concurrency)
+    {
+        std::size_t l_levels = 0;
+        for (std::size_t l_tasks = 1; l_tasks < concurrency; l_tasks *= 7)
+        {
+            ++l_levels;
+        }
+        return l_levels;
+    }
+
+    // out = op(x, y), out may be x or y
+    template <typename T, typename Op>
+    void elementwise(const matrix_view<T> out, const matrix_view<const T> x, const matrix_view<const T> y, Op op)
+    {
+        using simd_t = stdx::native_simd<T>;
+        constexpr std::size_t w = simd_t::size();
+        for (std::size_t i = 0; i < out.rows(); ++i)
+        {
+            T *l_out = out.row(i);
+            const T *l_x = x.row(i);
+            const T *l_y = y.row(i);
+            std::size_t j = 0;
+            for (; j + w <= out.cols(); j += w)
+            {
+                op(simd_t(l_x + j, stdx::element_aligned), simd_t(l_y + j, stdx::element_aligned)).copy_to(l_out + j, stdx::element_aligned);
+            }
+            for (; j < out.cols(); ++j)
+            {
+                l_out[j] = op(l_x[j], l_y[j]);
+            }
+        }
+    }
+
+    template <typename T>
+    void add(const matrix_view<T> out, const matrix_view<const T> x, const matrix_view<const T> y)
+    {
+        elementwise(out, x, y, std::plus<>{});
+    }
+
+    template <typename T>
+    void sub(const matrix_view<T> out, const matrix_view<const T> x, const matrix_view<const T> y)
+    {
+        elementwise(out, x, y, std::minus<>{});
+    }
+
+    template <typename T>
+    void set_zero(const matrix_view<T> c)
+    {
+        for (std::size_t i = 0; i < c.rows(); ++i)
+        {
+            std::fill(c.row(i), c.row(i) + c.cols(), T{});
+        }
+    }
+
+    template <typename T, typename Executor>
+    void multiply(matrix_view<const T> a, matrix_view<const T> b, matrix_view<T> c, scratch_arena<T> &arena,
+                  std::size_t threshold, std::size_t parallel_levels, Executor &executor);
+
+    // one level for even sizes, c = a * b
+    template <typename T, typename Executor>
+    void strassen_level(const matrix_view<const T> a, const matrix_view<const T> b, const matrix_view<T> c,
+                        scratch_arena<T> &arena, const std::size_t threshold, const std::size_t parallel_levels,
+                        Executor &executor)
+    {
+        const std::size_t hm = a.rows() / 2;
+        const std::size_t hk = a.cols() / 2;
+        const std::size_t hn = b.cols() / 2;
+        const auto a11 = a.block(0, 0, hm, hk), a12 = a.block(0, hk, hm, hk);
+        const auto a21 = a.block(hm, 0, hm, hk), a22 = a.block(hm, hk, hm, hk);
+        const auto b11 = b.block(0, 0, hk, hn), b12 = b.block(0, hn, hk, hn);
+        const auto b21 = b.block(hk, 0, hk, hn), b22 = b.block(hk, hn, hk, hn);
+        const auto c11 = c.block(0, 0, hm, hn), c12 = c.block(0, hn, hm, hn);
+        const auto c21 = c.block(hm, 0, hm, hn), c22 = c.block(hm, hn, hm, hn);
+
+        const std::size_t l_mark = arena.used();
+        const auto s1 = arena.take(hm, hk), s2 = arena.take(hm, hk), s3 = arena.take(hm, hk), s4 = arena.take(hm, hk);
+        const auto t1 = arena.take(hk, hn), t2 = arena.take(hk, hn), t3 = arena.take(hk, hn), t4 = arena.take(hk, hn);
+        const auto p1 = arena.take(hm, hn), p5 = arena.take(hm, hn), p6 = arena.take(hm, hn);
+
+        add<T>(s1, a21, a22);
+        sub<T>(s2, s1, a11);
+        sub<T>(s3, a11, a21);
+        sub<T>(s4, a12, s2);
+        sub<T>(t1, b12, b11);
+        sub<T>(t2, b22, t1);
+        sub<T>(t3, b22, b12);
+        sub<T>(t4, t2, b21);
+
+        struct product
+        {
+            matrix_view<const T> a;
+            matrix_view<const T> b;
+            matrix_view<T> c;
+        };
+        const product l_products[7] = {
+            {a11, b11, p1}, {a12, b21, c11}, {s4, b22, c12}, {a22, t4, c21},
+            {s1, t1, p5}, {s2, t2, p6}, {s3, t3, c22}};
+
+        if (parallel_levels > 0)
+        {
+            const std::size_t l_below = scratch_size<T>(hm, hk, hn, threshold, parallel_levels - 1);
+            task_group l_group(executor);
+            for (const product &l_product : l_products)
+            {
+                l_group.run([=, &executor, l_arena = arena.split(l_below)]() mutable {
+                    multiply(l_product.a, l_product.b, l_product.c, l_arena, threshold, parallel_levels - 1, executor);
+                });
+            }
+            l_group.wait();
+        }
+        else
+        {
+            for (const product &l_product : l_products)
+            {
+                multiply(l_product.a, l_product.b, l_product.c, arena, threshold, std::size_t{0}, executor);
+            }
+        }
+
+        // c11 = P1 + P2, P6 = U2 = P1 + P6, c12 = P3 + U2 + P5, c22 = U3 = P7 + U2, c21 = U3 - P4, c22 = U3 + P5
+        add<T>(c11, c11, p1);
+        add<T>(p6, p6, p1);
+        add<T>(c12, c12, p6);
+        add<T>(c12, c12, p5);
+        add<T>(c22, c22, p6);
+        sub<T>(c21, c22, c21);
+        add<T>(c22, c22, p5);
+
+        arena.release(l_mark);
+    }
+
+    // c = a * b
+    template <typename T, typename Executor>
+    void multiply(const matrix_view<const T> a, const matrix_view<const T> b, const matrix_view<T> c, scratch_arena<T> &arena,
+                  const std::size_t threshold, const std::size_t parallel_levels, Executor &executor)
+    {
+        const std::size_t m = a.rows();
+        const std::size_t k = a.cols();
+        const std::size_t n = b.cols();
+        if (not use_strassen(m, k, n, threshold))
+        {
+            set_zero(c);
+            gemm(a, b, c);
+            return;
+        }
+
+        // dynamic peeling, the odd last row, column or inner index are thin products for gemm
+        const std::size_t me = m & ~std::size_t{1};
+        const std::size_t ke = k & ~std::size_t{1};
+        const std::size_t ne = n & ~std::size_t{1};
+        strassen_level(a.block(0, 0, me, ke), b.block(0, 0, ke, ne), c.block(0, 0, me, ne), arena, threshold,
+                       parallel_levels, executor);
+        if (ke < k)
+        {
+            gemm(a.block(0, ke, me, 1), b.block(ke, 0, 1, ne), c.block(0, 0, me, ne));
+        }
+        if (ne < n)
+        {
+            set_zero(c.block(0, ne, m, 1));
+            gemm(a, b.block(0, ne, k, 1), c.block(0, ne, m, 1));
+        }
+        if (me < m)
+        {
+            set_zero(c.block(me, 0, 1, ne));
+            gemm(a.block(me, 0, 1, k), b.block(0, 0, k, ne), c.block(me, 0, 1, ne));
+        }
+    }
+}
+
+// c = a * b with Strassen-Winograd above threshold, the first levels in parallel on the executor
+template <typename T, typename Executor>
+void strassen_gemm(const matrix_view<const T> a, const matrix_view<const T> b, const matrix_view<T> c, Executor &executor,
+                   const std::size_t threshold = strassen_threshold)
+{
+    if ((a.cols() != b.rows()) or (a.rows() != c.rows()) or (b.cols() != c.cols()))
+    {
+        throw std::invalid_argument("strassen_gemm: sizes do not match");
+    }
+    // below 16 the additions cost more than the multiplications saved
+    const std::size_t l_threshold = std::max<std::size_t>(threshold, 16);
+    const std::size_t l_levels = strassen_detail::parallel_levels(executor.concurrency());
+    const std::size_t l_size = strassen_detail::scratch_size<T>(a.rows(), a.cols(), b.cols(), l_threshold, l_levels);
+
+    gemm_detail::aligned_buffer<T> l_buffer(l_size);
+    strassen_detail::scratch_arena<T> l_arena(l_buffer.get(), l_size);
+    strassen_detail::multiply(a, b, c, l_arena, l_threshold, l_levels, executor);
+}
+
+template <typename T, typename Executor = thread_pool>
+Matrix<T> strassen_multiply(const Matrix<T> &a, const Matrix<T> &b, Executor &executor = default_executor(),
+                            const std::size_t threshold = strassen_threshold)
+{
+    Matrix<T> l_c(a.rows(), b.cols());
+    strassen_gemm(a.view(), b.view(), l_c.view(), executor, threshold);
+    return l_c;
+}
+
+#endif
+
+/*******
+	END OF FILE
+***********/
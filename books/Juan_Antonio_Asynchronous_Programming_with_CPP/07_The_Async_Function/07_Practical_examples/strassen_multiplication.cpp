@@ -0,0 +1,267 @@
+/*****
+
+References
+    Asynchronous Programming with C++ | Javier Reguera-Salgado & Juan Antonio Rufes
+    https://en.wikipedia.org/wiki/Strassen_algorithm
+
+Strassen-Winograd against the blocked gemm
+
+    strassen_multiply (strassen.hpp) cuts the matrices in quadrants while they are larger than a threshold,
+    7 half size products instead of 8, and multiplies the quadrants at or below the threshold with gemm (matrix.hpp).
+    The first levels run their 7 products as tasks of a thread pool (executor.hpp).
+
+    This program
+        -> checks strassen_multiply against multiply on int matrices (exact) of odd sizes, small thresholds
+        -> looks for the crossover: gemm against Strassen with thresholds from 128 to 2048,
+           n from 2048 to max_size, in seconds and effective GFLOP/s (2 n^3 / time, the multiply-adds
+           of the classical product), with the largest difference to gemm relative to the largest element
+        -> runs the parallel levels on pools of 1 to max_threads threads (n = 2048, threshold 512)
+
+Usage
+    g++ -O2 -std=c++20 -pthread [-march=native] strassen_multiplication.cpp
+    ./strassen_multiplication [max_size] [max_threads]
+    max_size 4096 by default (8192: 1 GiB of matrices, 1 GiB of scratch), max_threads 8
+
+**********/
+
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "executor.hpp"
+#include "matrix.hpp"
+#include "strassen.hpp"
+
+template <typename T>
+Matrix<T> random_matrix(const std::size_t rows, const std::size_t cols, std::mt19937 &gen)
+{
+    Matrix<T> l_m(rows, cols);
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+        for (std::size_t j = 0; j < cols; ++j)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                l_m(i, j) = static_cast<T>(gen() % 21) - 10;
+            }
+            else
+            {
+                l_m(i, j) = std::uniform_real_distribution<T>(-1, 1)(gen);
+            }
+        }
+    }
+    return l_m;
+}
+
+// the largest difference relative to the largest element of expected
+template <typename T>
+double difference(const Matrix<T> &result, const Matrix<T> &expected)
+{
+    double l_diff{0};
+    double l_max{0};
+    for (std::size_t i = 0; i < expected.rows(); ++i)
+    {
+        for (std::size_t j = 0; j < expected.cols(); ++j)
+        {
+            l_diff = std::max(l_diff, std::abs(static_cast<double>(result(i, j)) - expected(i, j)));
+            l_max = std::max(l_max, std::abs(static_cast<double>(expected(i, j))));
+        }
+    }
+    return (l_max > 0) ? l_diff / l_max : l_diff;
+}
+
+// the best of runs
+template <typename Func>
+double seconds(Func func, const int runs)
+{
+    double l_best{0};
+    for (int r = 0; r < runs; ++r)
+    {
+        const auto l_start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+        l_best = (r == 0) ? l_elapsed.count() : std::min(l_best, l_elapsed.count());
+    }
+    return l_best;
+}
+
+// odd sizes go through the peeling at every level
+void check()
+{
+    std::mt19937 l_gen(5);
+    inline_executor l_inline;
+    thread_pool l_pool(3);
+    bool l_same = true;
+    for (const auto [m, k, n] : {std::array<std::size_t, 3>{37, 53, 41}, {64, 64, 64}, {100, 99, 101}, {257, 130, 199}})
+    {
+        const Matrix<int> l_a = random_matrix<int>(m, k, l_gen);
+        const Matrix<int> l_b = random_matrix<int>(k, n, l_gen);
+        const Matrix<int> l_expected = multiply(l_a, l_b);
+        for (const std::size_t l_threshold : {16, 24, 40})
+        {
+            l_same &= (strassen_multiply(l_a, l_b, l_inline, l_threshold) == l_expected);
+            l_same &= (strassen_multiply(l_a, l_b, l_pool, l_threshold) == l_expected);
+        }
+    }
+    std::cout << "strassen_multiply against multiply, int, odd sizes: " << (l_same ? "same" : "DIFFERENT") << "\n\n";
+}
+
+void crossover(const std::size_t max_size)
+{
+    const std::size_t l_thresholds[] = {2048, 1024, 512, 256, 128};
+    inline_executor l_inline;
+    std::mt19937 l_gen(7);
+
+    std::cout << "float, seconds (effective GFLOP/s), difference to gemm\n" << std::setw(6) << "n" << std::setw(16) << "gemm";
+    for (const std::size_t l_threshold : l_thresholds)
+    {
+        std::cout << std::setw(16) << ("t = " + std::to_string(l_threshold));
+    }
+    std::cout << '\n';
+
+    for (std::size_t n = 2048; n <= max_size; n *= 2)
+    {
+        const Matrix<float> l_a = random_matrix<float>(n, n, l_gen);
+        const Matrix<float> l_b = random_matrix<float>(n, n, l_gen);
+        const int l_runs = (n <= 4096) ? 3 : 1;
+        const double l_n = static_cast<double>(n);
+        const double l_flop = 2.0 * l_n * l_n * l_n;
+        auto cell = [&](const double s)
+        {
+            std::ostringstream l_cell;
+            l_cell << std::fixed << std::setprecision(2) << s << " (" << std::setprecision(1) << l_flop / s * 1e-9 << ')';
+            return l_cell.str();
+        };
+
+        Matrix<float> l_expected;
+        const double l_gemm = seconds([&] { l_expected = multiply(l_a, l_b); }, l_runs);
+        std::cout << std::setw(6) << n << std::setw(16) << cell(l_gemm);
+        std::vector<double> l_differences;
+        for (const std::size_t l_threshold : l_thresholds)
+        {
+            if (l_threshold >= n)
+            {
+                std::cout << std::setw(16) << "-";
+                l_differences.push_back(-1);
+                continue;
+            }
+            Matrix<float> l_c;
+            std::cout << std::setw(16) << cell(seconds([&] { l_c = strassen_multiply(l_a, l_b, l_inline, l_threshold); }, l_runs)) << std::flush;
+            l_differences.push_back(difference(l_c, l_expected));
+        }
+        std::cout << '\n' << std::setw(22) << "";
+        for (const double l_difference : l_differences)
+        {
+            std::ostringstream l_cell;
+            if (l_difference >= 0)
+            {
+                l_cell << std::scientific << std::setprecision(1) << l_difference;
+            }
+            else
+            {
+                l_cell << "-";
+            }
+            std::cout << std::setw(16) << l_cell.str();
+        }
+        std::cout << '\n';
+    }
+    std::cout << '\n';
+}
+
+void speedup(const std::size_t n, const std::size_t threshold, const std::size_t max_threads)
+{
+    std::mt19937 l_gen(9);
+    const Matrix<float> l_a = random_matrix<float>(n, n, l_gen);
+    const Matrix<float> l_b = random_matrix<float>(n, n, l_gen);
+
+    inline_executor l_inline;
+    Matrix<float> l_expected;
+    const double l_serial = seconds([&] { l_expected = strassen_multiply(l_a, l_b, l_inline, threshold); }, 3);
+    std::cout << n << " x " << n << " float, threshold " << threshold << ", parallel levels of the recursion\n"
+              << std::setw(8) << "threads" << std::setw(8) << "levels" << std::setw(10) << "seconds" << std::setw(10) << "speedup" << '\n'
+              << std::setw(8) << 1 << std::setw(8) << 0 << std::fixed << std::setprecision(3) << std::setw(10) << l_serial
+              << std::setprecision(2) << std::setw(10) << 1.0 << '\n';
+    for (std::size_t l_threads = 2; l_threads <= max_threads; l_threads *= 2)
+    {
+        // the calling thread works while it waits, the pool has threads - 1 workers
+        thread_pool l_pool(static_cast<unsigned>(l_threads - 1));
+        Matrix<float> l_c;
+        const double l_seconds = seconds([&] { l_c = strassen_multiply(l_a, l_b, l_pool, threshold); }, 3);
+        std::cout << std::setw(8) << l_threads << std::setw(8) << strassen_detail::parallel_levels(l_pool.concurrency())
+                  << std::setprecision(3) << std::setw(10) << l_seconds << std::setprecision(2) << std::setw(10)
+                  << l_serial / l_seconds << ((l_c == l_expected) ? "" : "  DIFFERENT") << '\n';
+    }
+    std::cout << std::defaultfloat;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t max_size = (argc > 1) ? static_cast<std::size_t>(std::stoul(argv[1])) : 4096;
+    const std::size_t max_threads = (argc > 2) ? static_cast<std::size_t>(std::stoul(argv[2])) : 8;
+
+    check();
+    crossover(max_size);
+    const std::size_t l_size = std::min<std::size_t>(max_size, 2048);
+    speedup(l_size, l_size / 4, max_threads);
+
+    return 0;
+}
+
+/*****
+Explanation
+
+    check: with thresholds of 16 to 40 every level peels odd rows, columns and inner indices, the
+    int products are exactly the ones of multiply, serial and with 3 threads.
+
+    crossover: gemm stays at about 10 GFLOP/s from 2048 to 8192, it is compute bound, so every level of
+    Strassen saves 1/8 of its time minus the 15 additions of quadrants. Every threshold measured wins
+    against gemm at every size, the crossover is below 128. At 8192 each smaller threshold wins,
+    65.9 s at t = 128 against 114.1 s for gemm (16.7 effective GFLOP/s, 6 levels, (7/8)^6 = 0.45 of
+    the multiply-adds). At 4096 (best of 3 runs) 512, 256 and 128 are within 4% of each other, the last
+    level saves less than its additions cost. At 2048 t = 128 is the fastest and t = 256 the slowest
+    of the three, the differences at this size change from run to run.
+    strassen_threshold is 256: within 2% of the best time at 8192 and 3% at 4096, with half the error of 128.
+
+    The difference to gemm grows 2 to 3 times per level: 1e-6 of the largest element with one level,
+    2e-4 with 6 levels (8192, t = 128).
+    Float results that have to match gemm closely want a larger threshold.
+
+    Memory: for 8192 the arena is 11/4 * 8192^2 * 4 bytes * (1 + 1/4 + ...) = about 980 MB,
+    allocated once; the recursion does not allocate.
+
+    speedup: 1 hardware thread, the parallel levels add tasks and 7 arenas instead of 1 but no
+    compute, the speedup of 1.02 to 1.23 is noise: the serial run took 1.56 s, the same product
+    took 1.32 s in the crossover table. On a machine with 8 cores the 49 tasks
+    of 2 levels would keep them busy.
+
+Output (g++ -O2 -std=c++20 -pthread, ./strassen_multiplication 8192 on a single core machine)
+
+strassen_multiply against multiply, int, odd sizes: same
+
+float, seconds (effective GFLOP/s), difference to gemm
+     n            gemm        t = 2048        t = 1024         t = 512         t = 256         t = 128
+  2048      1.83 (9.4)               -     1.40 (12.3)     1.32 (13.0)     1.42 (12.1)     1.13 (15.3)
+                                     -         1.2e-06         3.5e-06         1.1e-05         1.9e-05
+  4096    13.29 (10.3)    11.38 (12.1)     9.15 (15.0)     8.32 (16.5)     8.54 (16.1)     8.69 (15.8)
+                               1.1e-06         3.1e-06         1.1e-05         2.9e-05         6.0e-05
+  8192    114.12 (9.6)   100.75 (10.9)    84.61 (13.0)    73.76 (14.9)    67.20 (16.4)    65.93 (16.7)
+                               3.0e-06         1.1e-05         3.0e-05         8.4e-05         1.7e-04
+
+2048 x 2048 float, threshold 512, parallel levels of the recursion
+ threads  levels   seconds   speedup
+       1       0     1.558      1.00
+       2       1     1.520      1.02
+       4       1     1.479      1.05
+       8       2     1.264      1.23
+*****/
+
+/*****
+    END OF FILE
+**********/
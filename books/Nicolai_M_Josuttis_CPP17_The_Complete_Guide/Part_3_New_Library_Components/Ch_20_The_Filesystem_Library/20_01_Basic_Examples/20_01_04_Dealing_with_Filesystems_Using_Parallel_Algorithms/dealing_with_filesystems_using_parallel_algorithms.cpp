@@ -7,18 +7,39 @@ References:
 
 20. The Filesystem Library
 	With C++17 the Boost.filesystem library was finally adopted as a C++ standard library.
-	
+
 20.1 Basic Examples
 
 20.1.4 Dealing with Filesystems Using Parallel Algorithms
-	
+
     Recursive Directory Iteration
 
-		recursive_directory_iterator()		
+		recursive_directory_iterator()
         recursive_directory_iterator is a LegacyInputIterator that iterates over the directory_entry elements of a directory, and, recursively, over the entries of all subdirectories.
         The iteration order is unspecified, except that each directory entry is visited only once.
         By default, symlinks are not followed, but this can be enabled by specifying the directory option follow_directory_symlink at construction time.
 
+    Only the reduction runs in parallel here: the paths are collected by one thread first, then every
+    symlink_status(path) and file_size(path) of transform_reduce(par) stats the file by its whole path,
+    twice per regular file.
+
+    The same sum three ways, the sizes of the regular files below the directory. Like du, none of
+    them follows a symbolic link: a link to a file is not a regular file and its target is not counted
+    (is_regular_file(path) follows links, the book's version would add the size of every target).
+        list + par          the book's version: recursive_directory_iterator into a vector<path>,
+                            transform_reduce(std::execution::par) with symlink_status and file_size
+        entries             recursive_directory_iterator alone, directory_entry::symlink_status() uses
+                            the type read with the directory (no stat), file_size() one stat
+        parallel_walker     parallel_walker.hpp: getdents64 per directory on threads that steal
+                            directories from each other, one statx per entry relative to the open
+                            directory, the sizes summed while the directories are read
+
+    Usage:
+        g++ -O2 -std=c++20 dealing_with_filesystems_using_parallel_algorithms.cpp -ltbb
+        ./a.out <dir_name> [max_threads]                    sums the sizes below dir_name
+        ./a.out --create <dir_name> <files>                 creates a test tree of files (100 per directory,
+                                                            and a symbolic link to one of them)
+
 ******************/
 
 #include <iostream>
@@ -26,20 +47,36 @@ References:
 #include <vector>
 #include <numeric>
 #include <execution>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <thread>
+
+#include "parallel_walker.hpp"
+
+struct usage {
+    std::uintmax_t entries;
+    std::uintmax_t bytes;
+};
+
+double seconds_since(const std::chrono::steady_clock::time_point fp_start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - fp_start).count();
+}
 
+void print(const std::string & fp_name, const double fp_seconds, const usage fp_usage) {
+    std::clog << std::setw(24) << std::left << fp_name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(8) << fp_seconds << " s" << std::setw(12) << fp_usage.entries << " entries"
+              << std::setw(14) << fp_usage.bytes << " bytes" << std::setw(12) << std::setprecision(0)
+              << static_cast<double>(fp_usage.entries) / fp_seconds << " entries/s\n" << std::defaultfloat;
+}
 
-int main(const int argc, const char * const argv[]) {
-
-    if(2 != argc) {
-        std::clog << "Usage: " << argv[0] << " <dir_name>\n";
-        return 1;
-    }
-
-    std::filesystem::path l_dir     = argv[1];
+usage list_then_par(const std::filesystem::path & fp_dir) {
     std::vector<std::filesystem::path> l_paths_vec;
 
     try {
-        std::filesystem::recursive_directory_iterator l_itr{l_dir};
+        std::filesystem::recursive_directory_iterator l_itr{fp_dir};
         std::copy(std::filesystem::begin(l_itr), std::filesystem::end(l_itr), std::back_inserter(l_paths_vec));
 
     } catch(const std::filesystem::filesystem_error & fexp) {
@@ -57,16 +94,148 @@ int main(const int argc, const char * const argv[]) {
         std::uintmax_t {0},
         std::plus<>(),
         [](const std::filesystem::path & fp_path) {
-            return std::filesystem::is_regular_file(fp_path) ? std::filesystem::file_size(fp_path) : std::uintmax_t {0};
+            return std::filesystem::is_regular_file(std::filesystem::symlink_status(fp_path))
+                ? std::filesystem::file_size(fp_path) : std::uintmax_t {0};
         });
 
-    std::clog << "Size of all " << l_paths_vec.size() << " regular files is " << l_size << '\n';
+    return {l_paths_vec.size(), l_size};
+}
+
+usage entries(const std::filesystem::path & fp_dir) {
+    usage l_usage{0, 0};
+    for(const auto & elem : std::filesystem::recursive_directory_iterator(fp_dir)) {
+        ++l_usage.entries;
+        if(std::filesystem::is_regular_file(elem.symlink_status())) {
+            l_usage.bytes += elem.file_size();
+        }
+    }
+    return l_usage;
+}
+
+usage walk(walker::parallel_walker & fp_walker, const std::filesystem::path & fp_dir) {
+    return fp_walker.transform_reduce(
+        fp_dir, STATX_SIZE,
+        usage{0, 0},
+        [](const usage a, const usage b) { return usage{a.entries + b.entries, a.bytes + b.bytes}; },
+        [](const walker::entry & fp_entry) {
+            return usage{1, fp_entry.type == std::filesystem::file_type::regular ? fp_entry.stat->stx_size : 0};
+        });
+}
+
+// files / 100 directories, 10 subdirectories per directory: the directory k is the path of the digits of k,
+// the link l of each directory points to its file f1 (never empty), a sum that follows links differs
+void create_tree(const std::filesystem::path & fp_dir, const std::uintmax_t fp_files) {
+    for(std::uintmax_t l_file = 0; l_file < fp_files; ++l_file) {
+        const std::string l_digits = std::to_string(l_file / 100);
+        std::filesystem::path l_path = fp_dir;
+        for(const char l_digit : l_digits) {
+            l_path /= std::string(1, l_digit);
+        }
+        if(l_file % 100 == 0) {
+            std::filesystem::create_directories(l_path);
+        }
+        l_path /= "f" + std::to_string(l_file % 100);
+        std::ofstream{l_path} << std::string(l_file % 64, 'x');
+        if(l_file % 100 == 1) {
+            std::filesystem::create_symlink(l_path.filename(), l_path.parent_path() / "l");
+        }
+    }
+}
+
+int main(const int argc, const char * const argv[]) {
+
+    if(4 == argc && std::string(argv[1]) == "--create") {
+        const auto l_start = std::chrono::steady_clock::now();
+        create_tree(argv[2], std::stoull(argv[3]));
+        std::clog << "created " << argv[3] << " files in " << seconds_since(l_start) << " s\n";
+        return 0;
+    }
+    if(2 != argc && 3 != argc) {
+        std::clog << "Usage: " << argv[0] << " <dir_name> [max_threads]\n"
+                  << "       " << argv[0] << " --create <dir_name> <files>\n";
+        return 1;
+    }
+
+    std::filesystem::path l_dir     = argv[1];
+    const unsigned l_max_threads    = (3 == argc) ? static_cast<unsigned>(std::stoul(argv[2])) : std::max(1u, std::thread::hardware_concurrency());
+
+    try {
+        // the first walk reads the tree into the page cache, the others find it there
+        auto l_start = std::chrono::steady_clock::now();
+        usage l_usage = entries(l_dir);
+        print("entries, first walk", seconds_since(l_start), l_usage);
+
+        l_start = std::chrono::steady_clock::now();
+        l_usage = list_then_par(l_dir);
+        print("list + par", seconds_since(l_start), l_usage);
+
+        l_start = std::chrono::steady_clock::now();
+        l_usage = entries(l_dir);
+        print("entries", seconds_since(l_start), l_usage);
+
+        for(unsigned l_threads = 1; l_threads <= l_max_threads; l_threads *= 2) {
+            walker::parallel_walker l_walker(l_threads);
+            l_start = std::chrono::steady_clock::now();
+            l_usage = walk(l_walker, l_dir);
+            print("parallel_walker, " + std::to_string(l_threads) + " thr", seconds_since(l_start), l_usage);
+            if(l_walker.errors() != 0) {
+                std::clog << "    " << l_walker.errors() << " directories or entries could not be read, partial sum\n";
+            }
+        }
+
+        // the types of getdents64 alone, no statx: counting the entries
+        walker::parallel_walker l_walker(l_max_threads);
+        l_start = std::chrono::steady_clock::now();
+        std::atomic<std::uintmax_t> l_count{0};
+        l_walker.for_each(l_dir, 0, [&l_count](const walker::entry &) { l_count.fetch_add(1, std::memory_order_relaxed); });
+        print("for_each, no statx", seconds_since(l_start), usage{l_count.load(), 0});
+    } catch(const std::filesystem::filesystem_error & fexp) {
+        std::clog << "File operation exception " << fexp.what() << '\n';
+        std::clog << "  path1 " << fexp.path1() << '\n';
+        std::clog << "  Code message " << fexp.code().message() << '\n';
+        return 1;
+    }
 
     return 0;
 }
 
+/*****
+    Explanation
+
+    A tree of 2 million files (--create /tmp/tree 2000000: 20000 directories, 0 to 63 bytes per file,
+    a link per directory), not the 10 million of a large disk-usage scan, it takes 94 s to create;
+    the rates do not depend on the size of the tree. The 20000 links are counted as entries, their
+    targets are not counted again: the three sums agree, 63000000 bytes, the sizes of the files.
+
+    The first walk finds nothing in the page cache (echo 3 > /proc/sys/vm/drop_caches before the run).
+    The others run on a warm cache and measure the system calls:
+        list + par          2 million path objects, then symlink_status and file_size resolve
+                            every path from the root again: 2 stats per file, 10 s
+        entries             the type comes with the directory, one stat per file by its path, 9.7 s
+        parallel_walker     one statx per entry relative to the open directory, no path resolution,
+                            no list of paths: 4.1 s, 2.4 times entries and list + par
+        for_each, no statx  getdents64 alone, the types come from d_type: 0.7 s, the stats are 85%
+                            of the walk, a scan that needs names or types only should not ask for them
+
+    One hardware thread: 1 to 8 threads walk at the same rate, no gain and no loss from the queues.
+    With a cold cache (drop_caches before each walk, separate runs) the walker took 16.6 s with 1
+    thread, 15.7 s with 8 and 16.1 s with 32 (26.1 s for entries above): the disk of this virtual
+    machine answers one request at a time for a single vCPU. On a machine with several cores and
+    an SSD or a network filesystem, the threads keep several directory reads and stats in flight,
+    which is where a scan of hours is spent.
+
+    Output (g++ -O2 -std=c++20 ... -ltbb, ./a.out /tmp/tree 8 on a single core machine)
+
+entries, first walk       26.142 s     2040000 entries      63000000 bytes       78037 entries/s
+list + par                 9.952 s     2040000 entries      63000000 bytes      204993 entries/s
+entries                    9.660 s     2040000 entries      63000000 bytes      211170 entries/s
+parallel_walker, 1 thr     4.099 s     2040000 entries      63000000 bytes      497711 entries/s
+parallel_walker, 2 thr     3.852 s     2040000 entries      63000000 bytes      529651 entries/s
+parallel_walker, 4 thr     4.526 s     2040000 entries      63000000 bytes      450772 entries/s
+parallel_walker, 8 thr     4.461 s     2040000 entries      63000000 bytes      457276 entries/s
+for_each, no statx         0.696 s     2040000 entries             0 bytes     2929669 entries/s
+********/
+
 /*****
     END OF FILE
 *********/
-
-
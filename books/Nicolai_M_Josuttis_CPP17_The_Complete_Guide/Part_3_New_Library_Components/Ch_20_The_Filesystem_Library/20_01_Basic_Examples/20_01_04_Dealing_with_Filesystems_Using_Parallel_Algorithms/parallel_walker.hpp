@@ -0,0 +1,382 @@
+/**********
+
+References:
+    C++17 - The Complete Guide | Nicolai M. Josuttis
+    Anthony Williams - C++ Concurrency in Action, 9.1.5 Stealing work from other threads' queues
+    https://man7.org/linux/man-pages/man2/getdents.2.html
+    https://man7.org/linux/man-pages/man2/statx.2.html
+
+parallel_walker, a concurrent recursive directory walk for Linux
+
+    recursive_directory_iterator is an input iterator: one thread reads the directories one after
+    the other, and every is_regular_file(path), file_size(path) resolves the whole path again and
+    calls stat once more.
+
+    parallel_walker
+        -> every directory is opened once, openat() relative to the root, and read with getdents64()
+           in blocks of 64 KiB; d_type gives the type of an entry without a stat
+        -> statx() is called relative to the open directory (no path resolution), only when the
+           caller asks for attributes (statx_mask, e.g. STATX_SIZE) or when the filesystem does not
+           fill d_type (DT_UNKNOWN), at most once per entry; the entry carries the result
+        -> the subdirectories found are pushed to the queue of the thread that found them, each
+           thread takes its own newest directory first (depth first, few queued paths) and steals
+           the oldest one of another thread when its queue is empty (big subtrees move)
+        -> the entries are not collected: for_each calls the visitor while the directory is read,
+           transform_reduce keeps one accumulator per thread and combines them at the end
+        -> symbolic links are not followed (like recursive_directory_iterator by default), a link
+           is an entry of type symlink and its statx describes the link, not its target
+        -> directories that cannot be opened or read and entries whose statx fails are skipped and
+           counted in errors() (skip_permission_denied), a root that cannot be opened throws
+           filesystem_error
+
+    An entry (its directory and name) is valid during the call of the visitor only.
+    The visitor of for_each and the transform of transform_reduce run on several threads at once.
+    A visitor that throws stops the walk: the other threads leave after their current block of
+    entries, the first exception is rethrown by for_each / transform_reduce once they are joined.
+
+***********/
+
+#ifndef PARALLEL_WALKER_HPP
+#define PARALLEL_WALKER_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace walker {
+
+struct entry {
+    std::string_view directory;     // relative to the root, empty for the root itself
+    std::string_view name;
+    std::filesystem::file_type type;
+    const struct statx *stat;       // nullptr when no statx was needed
+};
+
+namespace detail {
+
+    inline std::filesystem::file_type from_d_type(const unsigned char d_type) {
+        using std::filesystem::file_type;
+        switch (d_type) {
+            case DT_REG:  return file_type::regular;
+            case DT_DIR:  return file_type::directory;
+            case DT_LNK:  return file_type::symlink;
+            case DT_BLK:  return file_type::block;
+            case DT_CHR:  return file_type::character;
+            case DT_FIFO: return file_type::fifo;
+            case DT_SOCK: return file_type::socket;
+            default:      return file_type::unknown;
+        }
+    }
+
+    inline std::filesystem::file_type from_mode(const unsigned mode) {
+        using std::filesystem::file_type;
+        switch (mode & S_IFMT) {
+            case S_IFREG:  return file_type::regular;
+            case S_IFDIR:  return file_type::directory;
+            case S_IFLNK:  return file_type::symlink;
+            case S_IFBLK:  return file_type::block;
+            case S_IFCHR:  return file_type::character;
+            case S_IFIFO:  return file_type::fifo;
+            case S_IFSOCK: return file_type::socket;
+            default:       return file_type::unknown;
+        }
+    }
+
+    // closes the descriptor at the end of the scope
+    class file_descriptor {
+        int m_fd;
+
+    public:
+        explicit file_descriptor(const int fd) : m_fd{fd} {}
+        ~file_descriptor() {
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+        }
+        file_descriptor(const file_descriptor &) = delete;
+        file_descriptor &operator=(const file_descriptor &) = delete;
+        int get() const { return m_fd; }
+    };
+
+    // the directories a thread found and has not scanned yet, a lock per queue: the owner and a
+    // thief only meet when the owner runs out of work
+    struct alignas(64) work_queue {
+        std::mutex mutex;
+        std::deque<std::string> directories;
+    };
+
+    // the partial result of one thread, updated for every entry: a cache line of its own
+    template <typename T>
+    struct alignas(64) partial {
+        std::optional<T> value;
+    };
+
+}  // namespace detail
+
+class parallel_walker {
+    static constexpr std::size_t buffer_size = 64 * 1024;
+
+    unsigned m_threads;
+    std::size_t m_directories{0};
+    std::size_t m_errors{0};
+
+    // the state of one walk
+    struct walk {
+        int root_fd;
+        unsigned statx_mask;
+        std::vector<detail::work_queue> queues;
+        std::atomic<std::size_t> pending{0};    // queued or being scanned
+        std::atomic<std::size_t> queued{0};     // in a queue
+        std::atomic<std::size_t> idle{0};
+        std::atomic<std::size_t> directories{0};
+        std::atomic<std::size_t> errors{0};
+        std::atomic<bool> stopped{false};       // a visitor threw
+        std::exception_ptr exception;           // the first one, under idle_mutex
+        std::mutex idle_mutex;
+        std::condition_variable idle_cv;
+
+        walk(const int fd, const unsigned mask, const unsigned threads) : root_fd{fd}, statx_mask{mask}, queues(threads) {}
+
+        void push(const unsigned self, std::string directory) {
+            pending.fetch_add(1);
+            std::lock_guard l_lock(queues[self].mutex);
+            queues[self].directories.push_back(std::move(directory));
+            // under the lock: a thief decrements it only after this increment
+            queued.fetch_add(1);
+        }
+
+        // the newest directory of its own queue, else the oldest one of another queue
+        std::optional<std::string> pop(const unsigned self) {
+            if (queued.load() == 0) {
+                return std::nullopt;
+            }
+            for (unsigned i = 0; i < queues.size(); ++i) {
+                detail::work_queue &l_queue = queues[(self + i) % queues.size()];
+                std::lock_guard l_lock(l_queue.mutex);
+                if (not l_queue.directories.empty()) {
+                    std::string l_directory;
+                    if (i == 0) {
+                        l_directory = std::move(l_queue.directories.back());
+                        l_queue.directories.pop_back();
+                    } else {
+                        l_directory = std::move(l_queue.directories.front());
+                        l_queue.directories.pop_front();
+                    }
+                    queued.fetch_sub(1);
+                    return l_directory;
+                }
+            }
+            return std::nullopt;
+        }
+
+        void wake_idle() {
+            if (idle.load() > 0) {
+                std::lock_guard l_lock(idle_mutex);
+                idle_cv.notify_all();
+            }
+        }
+
+        // the thread has no work: sleeps until there is a queued directory or the walk is over
+        void wait_for_work() {
+            std::unique_lock l_lock(idle_mutex);
+            idle.fetch_add(1);
+            idle_cv.wait(l_lock, [this] { return queued.load() > 0 or pending.load() == 0 or stopped.load(); });
+            idle.fetch_sub(1);
+        }
+
+        // keeps the first exception, the directories left in the queues are never scanned:
+        // pending does not reach 0, every thread leaves on stopped
+        void stop(std::exception_ptr e) {
+            std::lock_guard l_lock(idle_mutex);
+            if (not exception) {
+                exception = std::move(e);
+            }
+            stopped.store(true);
+            idle_cv.notify_all();
+        }
+    };
+
+    template <typename Visitor>
+    static void scan(walk &w, const unsigned self, const std::string &directory, char *buffer, Visitor &visit) {
+        const int l_fd = ::openat(w.root_fd, directory.empty() ? "." : directory.c_str(),
+                                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (l_fd < 0) {
+            w.errors.fetch_add(1);
+            return;
+        }
+        const detail::file_descriptor l_dir(l_fd);
+        w.directories.fetch_add(1);
+
+        bool l_pushed = false;
+        struct statx l_stat;
+        while (not w.stopped.load(std::memory_order_relaxed)) {
+            const ssize_t l_bytes = ::getdents64(l_fd, buffer, buffer_size);
+            if (l_bytes <= 0) {
+                if (l_bytes < 0) {
+                    w.errors.fetch_add(1);
+                }
+                break;
+            }
+            for (ssize_t l_offset = 0; l_offset < l_bytes;) {
+                const auto *l_record = reinterpret_cast<const struct dirent64 *>(buffer + l_offset);
+                l_offset += l_record->d_reclen;
+                const std::string_view l_name(l_record->d_name);
+                if (l_name == "." or l_name == "..") {
+                    continue;
+                }
+
+                entry l_entry{directory, l_name, detail::from_d_type(l_record->d_type), nullptr};
+                const bool l_unknown = (l_entry.type == std::filesystem::file_type::unknown);
+                if (w.statx_mask != 0 or l_unknown) {
+                    const unsigned l_mask = w.statx_mask | (l_unknown ? STATX_TYPE : 0u);
+                    if (::statx(l_fd, l_record->d_name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, l_mask, &l_stat) != 0) {
+                        // removed since the directory was read, or no permission: a subdirectory
+                        // of unknown type is not scanned, the caller sees a partial walk in errors()
+                        w.errors.fetch_add(1);
+                        continue;
+                    }
+                    l_entry.stat = &l_stat;
+                    if (l_unknown) {
+                        l_entry.type = detail::from_mode(l_stat.stx_mode);
+                    }
+                }
+
+                if (l_entry.type == std::filesystem::file_type::directory) {
+                    std::string l_path;
+                    l_path.reserve(directory.size() + 1 + l_name.size());
+                    if (not directory.empty()) {
+                        l_path.append(directory).push_back('/');
+                    }
+                    l_path.append(l_name);
+                    w.push(self, std::move(l_path));
+                    l_pushed = true;
+                }
+                visit(l_entry);
+            }
+            // after every block, a large directory does not keep the others waiting to its end
+            if (l_pushed) {
+                w.wake_idle();
+                l_pushed = false;
+            }
+        }
+    }
+
+    template <typename Visitor>
+    static void work(walk &w, const unsigned self, Visitor &visit) {
+        const std::unique_ptr<char[]> l_buffer(new char[buffer_size]);
+        while (not w.stopped.load()) {
+            if (std::optional<std::string> l_directory = w.pop(self)) {
+                try {
+                    scan(w, self, *l_directory, l_buffer.get(), visit);
+                } catch (...) {
+                    w.stop(std::current_exception());
+                    return;
+                }
+                if (w.pending.fetch_sub(1) == 1) {
+                    // the last directory: wake everybody to leave
+                    std::lock_guard l_lock(w.idle_mutex);
+                    w.idle_cv.notify_all();
+                }
+                continue;
+            }
+            if (w.pending.load() == 0) {
+                return;
+            }
+            w.wait_for_work();
+        }
+    }
+
+    // calls make_visitor(thread index) once per thread, runs the walk with the visitors
+    template <typename MakeVisitor>
+    void run(const std::filesystem::path &root, const unsigned statx_mask, MakeVisitor make_visitor) {
+        const int l_fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (l_fd < 0) {
+            throw std::filesystem::filesystem_error("parallel_walker: cannot open the root", root,
+                                                    std::error_code(errno, std::generic_category()));
+        }
+        const detail::file_descriptor l_root(l_fd);
+
+        walk l_walk(l_fd, statx_mask, m_threads);
+        l_walk.push(0, std::string{});
+        {
+            std::vector<std::jthread> l_threads;
+            for (unsigned t = 1; t < m_threads; ++t) {
+                l_threads.emplace_back([&l_walk, t, l_visit = make_visitor(t)]() mutable { work(l_walk, t, l_visit); });
+            }
+            auto l_visit = make_visitor(0);
+            work(l_walk, 0, l_visit);
+        }
+        m_directories = l_walk.directories.load();
+        m_errors = l_walk.errors.load();
+        if (l_walk.exception) {
+            std::rethrow_exception(l_walk.exception);
+        }
+    }
+
+public:
+    explicit parallel_walker(const unsigned threads = std::thread::hardware_concurrency())
+        : m_threads{threads == 0 ? 1 : threads} {}
+
+    // visit(const entry &) for every entry below root, on several threads at once
+    template <typename Visitor>
+    void for_each(const std::filesystem::path &root, const unsigned statx_mask, Visitor visit) {
+        run(root, statx_mask, [&visit](unsigned) { return std::ref(visit); });
+    }
+
+    // reduce(init, transform(e)...) over the entries, reduce associative and commutative like the
+    // reduce of std::transform_reduce(std::execution::par, ...)
+    template <typename T, typename Reduce, typename Transform>
+    T transform_reduce(const std::filesystem::path &root, const unsigned statx_mask, T init, Reduce reduce,
+                       Transform transform) {
+        std::vector<detail::partial<T>> l_partials(m_threads);
+        run(root, statx_mask, [&](const unsigned t) {
+            return [&l_partial = l_partials[t].value, &reduce, &transform](const entry &e) {
+                if (l_partial) {
+                    *l_partial = reduce(std::move(*l_partial), transform(e));
+                } else {
+                    l_partial.emplace(transform(e));
+                }
+            };
+        });
+        for (detail::partial<T> &l_partial : l_partials) {
+            if (l_partial.value) {
+                init = reduce(std::move(init), std::move(*l_partial.value));
+            }
+        }
+        return init;
+    }
+
+    unsigned threads() const { return m_threads; }
+    // of the last walk: the directories read (the root included), the directories that could not be
+    // read and the entries whose statx failed, not 0 means the walk visited a part of the tree only
+    std::size_t directories() const { return m_directories; }
+    std::size_t errors() const { return m_errors; }
+};
+
+}  // namespace walker
+
+#endif
+
+/*****
+    END OF FILE
+*********/
@@ -0,0 +1,395 @@
+/**********
+
+References:
+    C++17 - The Complete Guide | Nicolai M. Josuttis
+    https://en.cppreference.com/w/cpp/filesystem/recursive_directory_iterator
+    https://man7.org/linux/man-pages/man7/inotify.7.html
+
+20.5 Iterating Over Directories
+
+    A recursive_directory_iterator answers "how big is this subtree" by reading it: every directory,
+    one stat per file, each time the question is asked. A disk-usage tool over millions of files asks
+    it for many subtrees, again and again, while the tree changes little between two questions.
+
+    size_index.hpp keeps the answer instead:
+        -> the first run reads the tree once (getdents64, one statx per file) and saves an index file:
+           per directory its mtime and inode, per file its size, allocated bytes and mtime
+        -> inotify events update the index while it runs: a changed file adds the difference of its
+           size to its directory and every ancestor, the total of a subtree is a lookup
+        -> a restart loads the index and checks one statx per directory: the directories whose
+           mtime changed are read again, reconcile(true) stats the files of the others too
+           (their in-place writes do not change the directory mtime)
+
+    The benchmark creates a tree of files below <work_dir>/tree (100 files per directory), then measures
+        build               no index file: the whole tree read
+        save / load         the index file written, read back and reconciled with the unchanged tree
+        events              appends, new files, removals, new directories and renames, the events
+                            applied after every 1000 operations; a burst of writes to one file;
+                            an overflow of the event queue
+        query               the totals of random directories
+        recovery            the index saved and closed, the tree changed, the index opened again:
+                            reconcile(false), reconcile(true), compared with a full build
+    and checks the totals against a recursive_directory_iterator sum after each step.
+
+    Usage:
+        g++ -O2 -std=c++20 directory_size_index.cpp
+        ./a.out <work_dir> [files]                  (200000 files by default, work_dir is removed at the end)
+
+******************/
+
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "size_index.hpp"
+
+double seconds_since(const std::chrono::steady_clock::time_point fp_start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - fp_start).count();
+}
+
+// the directory of file k: the digits of k / 100 as a path
+std::filesystem::path directory_of(const std::filesystem::path & fp_tree, const std::uintmax_t fp_file) {
+    std::filesystem::path l_path = fp_tree;
+    for(const char l_digit : std::to_string(fp_file / 100)) {
+        l_path /= std::string(1, l_digit);
+    }
+    return l_path;
+}
+
+void create_tree(const std::filesystem::path & fp_tree, const std::uintmax_t fp_files) {
+    for(std::uintmax_t l_file = 0; l_file < fp_files; ++l_file) {
+        const std::filesystem::path l_directory = directory_of(fp_tree, l_file);
+        if(l_file % 100 == 0) {
+            std::filesystem::create_directories(l_directory);
+        }
+        std::ofstream{l_directory / ("f" + std::to_string(l_file % 100))} << std::string(l_file % 64, 'x');
+    }
+}
+
+// what the index should say, read the slow way
+sizeindex::totals reference(const std::filesystem::path & fp_tree) {
+    sizeindex::totals l_totals{0, 0, 0, 1};
+    struct stat l_stat;
+    for(const auto & elem : std::filesystem::recursive_directory_iterator(fp_tree)) {
+        if(elem.is_directory()) {
+            ++l_totals.directories;
+        } else if(elem.is_regular_file() and ::lstat(elem.path().c_str(), &l_stat) == 0) {
+            ++l_totals.files;
+            l_totals.bytes += l_stat.st_size;
+            l_totals.allocated += l_stat.st_blocks * 512;
+        }
+    }
+    return l_totals;
+}
+
+std::ostream & operator<<(std::ostream & os, const sizeindex::totals & fp_totals) {
+    return os << fp_totals.directories << " dirs " << fp_totals.files << " files " << fp_totals.bytes << " bytes "
+              << fp_totals.allocated << " allocated";
+}
+
+std::ostream & operator<<(std::ostream & os, const sizeindex::sync_stats & fp_stats) {
+    return os << fp_stats.events << " events, " << fp_stats.directories_checked << " dir statx, "
+              << fp_stats.directories_read << " dir reads, " << fp_stats.files_stated << " file statx";
+}
+
+void check(const std::string & fp_step, const sizeindex::size_index & fp_index) {
+    const sizeindex::totals l_expected = reference(fp_index.root_path());
+    const sizeindex::totals l_indexed = fp_index.query("").value();
+    std::clog << "    " << std::setw(22) << std::left << fp_step << std::right;
+    if(l_indexed == l_expected) {
+        std::clog << "same as the tree: " << l_indexed << '\n';
+    } else {
+        std::clog << "DIFFERS: index " << l_indexed << "\n" << std::string(26, ' ') << "tree  " << l_expected << '\n';
+    }
+}
+
+void print(const std::string & fp_step, const double fp_seconds, const std::string & fp_what = {}) {
+    std::clog << std::setw(26) << std::left << fp_step << std::right << std::fixed << std::setprecision(3)
+              << std::setw(9) << fp_seconds * 1e3 << " ms  " << std::defaultfloat << fp_what << '\n';
+}
+
+// everything the index received until the queue stays empty
+sizeindex::sync_stats drain(sizeindex::size_index & fp_index) {
+    sizeindex::sync_stats l_stats;
+    for(;;) {
+        const sizeindex::sync_stats l_batch = fp_index.process_events(0);
+        if(l_batch.events == 0) {
+            return l_stats;
+        }
+        l_stats += l_batch;
+    }
+}
+
+void append(const std::filesystem::path & fp_file, const std::size_t fp_bytes) {
+    std::ofstream{fp_file, std::ios::app} << std::string(fp_bytes, 'a');
+}
+
+// operation i of the mix on the tree of fp_files files
+void change(const std::filesystem::path & fp_tree, const std::uintmax_t fp_files, std::mt19937_64 & fp_random, const std::size_t i) {
+    const std::uintmax_t l_file = fp_random() % fp_files;
+    const std::filesystem::path l_directory = directory_of(fp_tree, l_file);
+    switch(i % 5) {
+        case 0:
+            append(l_directory / ("f" + std::to_string(l_file % 100)), 10);
+            break;
+        case 1:
+            std::ofstream{l_directory / ("n" + std::to_string(i))} << std::string(100, 'n');
+            break;
+        case 2:
+            std::filesystem::remove(l_directory / ("f" + std::to_string(l_file % 100)));
+            break;
+        case 3:
+            std::filesystem::create_directory(l_directory / ("d" + std::to_string(i)));
+            std::ofstream{l_directory / ("d" + std::to_string(i)) / "g"} << std::string(1000, 'g');
+            break;
+        default: {
+            // to another directory: a move out of one watched directory into another
+            const std::uintmax_t l_target = fp_random() % fp_files;
+            const std::filesystem::path l_from = l_directory / ("f" + std::to_string(l_file % 100));
+            if(std::filesystem::exists(l_from)) {
+                std::filesystem::rename(l_from, directory_of(fp_tree, l_target) / ("r" + std::to_string(i)));
+            }
+            break;
+        }
+    }
+}
+
+int main(const int argc, const char * const argv[]) {
+
+    if(2 != argc && 3 != argc) {
+        std::clog << "Usage: " << argv[0] << " <work_dir> [files]\n";
+        return 1;
+    }
+
+    const std::filesystem::path l_work      = std::filesystem::absolute(argv[1]);
+    const std::filesystem::path l_tree      = l_work / "tree";
+    const std::filesystem::path l_index_file = l_work / "sizes.index";
+    const std::uintmax_t l_files            = (3 == argc) ? std::stoull(argv[2]) : 200'000;
+
+    try {
+        std::filesystem::create_directories(l_work);
+        auto l_start = std::chrono::steady_clock::now();
+        create_tree(l_tree, l_files);
+        print("create tree", seconds_since(l_start), std::to_string(l_files) + " files");
+
+        l_start = std::chrono::steady_clock::now();
+        const sizeindex::totals l_expected = reference(l_tree);
+        std::ostringstream l_sum;
+        l_sum << l_expected;
+        print("recursive_directory_iter.", seconds_since(l_start), l_sum.str());
+
+        {
+            l_start = std::chrono::steady_clock::now();
+            sizeindex::size_index l_index(l_tree, l_index_file);
+            const double l_build = seconds_since(l_start);
+            std::ostringstream l_what;
+            l_what << l_index.startup() << (l_index.watching() ? ", watching" : ", NOT watching");
+            print("build (no index file)", l_build, l_what.str());
+            check("build", l_index);
+
+            l_start = std::chrono::steady_clock::now();
+            l_index.save();
+            print("save", seconds_since(l_start), std::to_string(std::filesystem::file_size(l_index_file)) + " bytes");
+        }
+        {
+            l_start = std::chrono::steady_clock::now();
+            sizeindex::size_index l_index(l_tree, l_index_file);
+            std::ostringstream l_what;
+            l_what << l_index.startup();
+            print("load + reconcile", seconds_since(l_start), l_what.str());
+            check("load", l_index);
+
+            l_start = std::chrono::steady_clock::now();
+            const sizeindex::sync_stats l_poll = l_index.reconcile(false);
+            l_what.str({});
+            l_what << l_poll;
+            print("reconcile(false)", seconds_since(l_start), l_what.str());
+
+            l_start = std::chrono::steady_clock::now();
+            const sizeindex::sync_stats l_verify = l_index.reconcile(true);
+            l_what.str({});
+            l_what << l_verify;
+            print("reconcile(true)", seconds_since(l_start), l_what.str());
+
+            // steady state: the file operations are not timed, the processing of their events is
+            std::mt19937_64 l_random{42};
+            const std::size_t l_operations = 20'000;
+            sizeindex::sync_stats l_stats;
+            double l_processing = 0;
+            for(std::size_t i = 0; i < l_operations; ++i) {
+                change(l_tree, l_files, l_random, i);
+                if(i % 1000 == 999) {
+                    l_start = std::chrono::steady_clock::now();
+                    l_stats += drain(l_index);
+                    l_processing += seconds_since(l_start);
+                }
+            }
+            l_what.str({});
+            l_what << l_operations << " operations, " << l_stats << ", "
+                   << static_cast<std::uint64_t>(static_cast<double>(l_stats.events) / l_processing) << " events/s";
+            print("events", l_processing, l_what.str());
+            check("events", l_index);
+
+            // a burst: many writes to one file are one statx
+            const std::filesystem::path l_log = l_tree / "log";
+            {
+                std::ofstream l_out{l_log};
+                for(int i = 0; i < 10'000; ++i) {
+                    l_out << std::string(100, 'l') << std::flush;
+                }
+            }
+            l_start = std::chrono::steady_clock::now();
+            l_stats = drain(l_index);
+            l_what.str({});
+            l_what << "10000 writes of 100 bytes, " << l_stats;
+            print("burst", seconds_since(l_start), l_what.str());
+            check("burst", l_index);
+
+            // an overflow: more events than max_queued_events before the index reads them
+            for(std::size_t i = l_operations; i < l_operations + 20'000; ++i) {
+                append(l_log, 1);
+            }
+            l_start = std::chrono::steady_clock::now();
+            l_stats = drain(l_index);
+            l_what.str({});
+            l_what << "20000 appends, " << l_stats;
+            print("overflow", seconds_since(l_start), l_what.str());
+            check("overflow", l_index);
+
+            // query latency: the totals of random directories
+            std::vector<std::string> l_paths;
+            for(const auto & elem : std::filesystem::recursive_directory_iterator(l_tree)) {
+                if(elem.is_directory()) {
+                    l_paths.push_back(elem.path().lexically_relative(l_tree).string());
+                }
+            }
+            std::vector<std::size_t> l_order(1'000'000);
+            for(std::size_t & l_pick : l_order) {
+                l_pick = l_random() % l_paths.size();
+            }
+            std::int64_t l_sum = 0;
+            l_start = std::chrono::steady_clock::now();
+            for(const std::size_t l_pick : l_order) {
+                l_sum += l_index.query(l_paths[l_pick])->bytes;
+            }
+            const double l_query = seconds_since(l_start);
+            print("query", l_query, std::to_string(static_cast<std::uint64_t>(l_query * 1e9 / static_cast<double>(l_order.size()))) +
+                                        " ns per query (1000000 of " + std::to_string(l_paths.size()) +
+                                        " directories, checksum " + std::to_string(l_sum % 1000) + ")");
+
+            l_index.save();
+        }
+
+        // recovery: changed while no index was running
+        std::mt19937_64 l_random{7};
+        for(int i = 0; i < 100; ++i) {
+            // in place: the directory mtime does not change
+            const std::uintmax_t l_file = l_random() % l_files;
+            const std::filesystem::path l_path = directory_of(l_tree, l_file) / ("f" + std::to_string(l_file % 100));
+            if(std::filesystem::exists(l_path)) {
+                append(l_path, 1000);
+            }
+            // new files: the directory mtime changes
+            std::ofstream{directory_of(l_tree, l_random() % l_files) / ("c" + std::to_string(i))} << "crash";
+        }
+        {
+            l_start = std::chrono::steady_clock::now();
+            sizeindex::size_index l_index(l_tree, l_index_file);
+            std::ostringstream l_what;
+            l_what << l_index.startup();
+            print("recovery, reconcile(false)", seconds_since(l_start), l_what.str());
+            check("reconcile(false)", l_index);
+
+            l_start = std::chrono::steady_clock::now();
+            const sizeindex::sync_stats l_verify = l_index.reconcile(true);
+            l_what.str({});
+            l_what << l_verify;
+            print("recovery, reconcile(true)", seconds_since(l_start), l_what.str());
+            check("reconcile(true)", l_index);
+        }
+        {
+            std::filesystem::remove(l_index_file);
+            l_start = std::chrono::steady_clock::now();
+            sizeindex::size_index l_index(l_tree, l_index_file);
+            print("full build again", seconds_since(l_start));
+        }
+    } catch(const std::filesystem::filesystem_error & fexp) {
+        std::clog << "File operation exception " << fexp.what() << '\n';
+        std::clog << "  path1 " << fexp.path1() << '\n';
+        std::clog << "  Code message " << fexp.code().message() << '\n';
+        std::filesystem::remove_all(l_work);
+        return 1;
+    }
+
+    std::filesystem::remove_all(l_work);
+    return 0;
+}
+
+/*****
+    Explanation
+
+    1 million files in 10000 directories (0 to 63 bytes each, 4 KiB allocated), the page cache warm.
+
+    build       3.8 s for getdents64 and one statx per file relative to the directory: half of the
+                7.9 s of the recursive_directory_iterator sum (a stat by the whole path per file),
+                then every later question is answered without reading the tree
+    save/load   31 MB of index (31 bytes a file) written and fsync'ed in 0.18 s; a restart takes 0.42 s
+                instead of a rebuild of 3.5 s: 0.39 s to parse the file, 30 ms for the 10000 directory statx
+    events      20000 operations (appends, new files, removals, new directories with a file,
+                renames between directories) sent 36000 events; applying them took 0.37 s,
+                97000 events/s: the 4000 new directories are read (and watched) with their file.
+                Afterwards the index equals the tree.
+    burst       10000 writes to one file: the kernel merges identical consecutive events (3 arrived)
+                and the index stats the file once
+    overflow    20000 appends without reading overflow the queue (max_queued_events 16384):
+                IN_Q_OVERFLOW, then reconcile(true), 3.3 s. The 8600 directories whose entries
+                changed since the load are marked unknown and read again, the others cost a statx
+                per file. Reading the events often enough keeps this from happening.
+    query       132 ns: one hash of the path string and one lookup, whatever the size of the subtree
+    recovery    the index saved and closed, 100 files appended in place and 100 files created in
+                other directories: reconcile(false) reads the 100 changed directories (0.55 s with
+                the load) and misses 99000 bytes of the in-place appends (their directory mtimes did
+                not change), reconcile(true) finds them with a statx per file, 2.3 s, still faster
+                than the full build
+
+    So a service restarts with reconcile(false) and runs reconcile(true) when it has time, or after
+    an unclean shutdown. A watch per directory: 14001 here of the 48542 of max_user_watches.
+
+    Output (g++ -O2 -std=c++20 directory_size_index.cpp, ./a.out /tmp/dsiw 1000000 on a single core machine)
+
+create tree               67363.531 ms  1000000 files
+recursive_directory_iter.  7936.270 ms  10001 dirs 1000000 files 31500000 bytes 4032000000 allocated
+build (no index file)      3757.870 ms  0 events, 10001 dir statx, 10001 dir reads, 1000000 file statx, watching
+    build                 same as the tree: 10001 dirs 1000000 files 31500000 bytes 4032000000 allocated
+save                        182.931 ms  31247842 bytes
+load + reconcile            423.889 ms  0 events, 10001 dir statx, 0 dir reads, 0 file statx
+    load                  same as the tree: 10001 dirs 1000000 files 31500000 bytes 4032000000 allocated
+reconcile(false)             30.218 ms  0 events, 10001 dir statx, 0 dir reads, 0 file statx
+reconcile(true)            2554.482 ms  0 events, 10001 dir statx, 0 dir reads, 1000000 file statx
+events                      369.060 ms  20000 operations, 35973 events, 4000 dir statx, 4000 dir reads, 27957 file statx, 97471 events/s
+    events                same as the tree: 14001 dirs 1004027 files 35815922 bytes 4049035264 allocated
+burst                         0.044 ms  10000 writes of 100 bytes, 3 events, 0 dir statx, 0 dir reads, 1 file statx
+    burst                 same as the tree: 14001 dirs 1004028 files 36815922 bytes 4050038784 allocated
+overflow                   3280.440 ms  20000 appends, 16385 events, 14001 dir statx, 8613 dir reads, 1004029 file statx
+    overflow              same as the tree: 14001 dirs 1004028 files 36835922 bytes 4050059264 allocated
+query                       132.219 ms  132 ns per query (1000000 of 14000 directories, checksum 637)
+recovery, reconcile(false)  551.496 ms  0 events, 14001 dir statx, 100 dir reads, 10103 file statx
+    reconcile(false)      DIFFERS: index 14001 dirs 1004128 files 36837422 bytes 4050468864 allocated
+                          tree  14001 dirs 1004128 files 36936422 bytes 4050477056 allocated
+recovery, reconcile(true)  2344.130 ms  0 events, 14001 dir statx, 0 dir reads, 1004128 file statx
+    reconcile(true)       same as the tree: 14001 dirs 1004128 files 36936422 bytes 4050477056 allocated
+full build again           3526.812 ms
+********/
+
+/*****
+    END OF FILE
+*********/
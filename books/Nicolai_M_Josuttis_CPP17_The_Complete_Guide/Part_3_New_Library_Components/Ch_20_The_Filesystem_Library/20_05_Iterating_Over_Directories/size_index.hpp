@@ -0,0 +1,713 @@
+/**********
+
+References:
+    C++17 - The Complete Guide | Nicolai M. Josuttis
+    https://man7.org/linux/man-pages/man7/inotify.7.html
+    https://man7.org/linux/man-pages/man2/getdents.2.html
+    https://man7.org/linux/man-pages/man2/statx.2.html
+
+size_index, the sizes of a directory tree kept up to date instead of recomputed (Linux)
+
+    size_index l_index(root, index_file);
+    l_index.query("a/b")            -> totals of the subtree a/b: bytes, allocated bytes, files, directories
+    l_index.process_events(ms)      applies the inotify events that arrived (waits up to ms for the first)
+    l_index.save()                  writes the index file (a temporary file, fsync'ed, renamed over the old one)
+    l_index.reconcile(verify_files) compares the index with the tree, see below
+
+    -> every directory is a node: its mtime and inode, its files (name -> size, allocated, mtime),
+       its subdirectories, the totals of the files directly inside and the totals of its subtree;
+       a change of a file adds the difference to its directory and to every ancestor (depth steps),
+       a query is one hash lookup
+    -> the constructor loads index_file when it exists and belongs to root, then reconciles; without
+       it the reconcile starts from an empty root and reads the whole tree
+    -> reconcile walks the directories of the index: one statx per directory; a directory whose mtime
+       (or inode) differs from the recorded one is read again (getdents64) and its files stat'ed,
+       new subdirectories are read, vanished ones removed with their subtree; a directory with the
+       same mtime has the same entries, only verify_files stats its files again
+    -> an inotify watch per directory, added before the directory is read (nothing is lost between
+       the read and the watch): create, delete, moves, close after write, modify, attribute changes.
+       The events of one read are merged per (directory, name), then the entry is stat'ed once:
+       a thousand writes to one file cost one statx. An event that changes the entries of a
+       directory marks it unknown (mtime 0) until the next reconcile reads it: the saved index never
+       claims a directory listing newer than the one it holds. An overflow of the event queue
+       reconciles with verify_files.
+
+    Limits
+        -> the directory mtime changes when entries are created, removed or renamed, not when a
+           file is written: changes made while nothing watched (a crash, the program stopped) to
+           files of otherwise unchanged directories are found by reconcile(true) only
+        -> inotify sees the changes made through this kernel: on an NFS or SMB share the writes of
+           other clients produce no event. There the index runs on the file server, or
+           reconcile(false) replaces the full rescan: one statx per directory, not per file
+        -> one watch per directory, /proc/sys/fs/inotify/max_user_watches: above it watching()
+           is false and the index is kept by reconcile alone
+        -> hard links are counted once per link, symbolic links are not followed nor counted
+        -> the index file is in the byte order of the machine; not thread safe, one thread uses it
+
+***********/
+
+#ifndef SIZE_INDEX_HPP
+#define SIZE_INDEX_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sizeindex {
+
+struct totals {
+    std::int64_t bytes{0};
+    std::int64_t allocated{0};
+    std::int64_t files{0};
+    std::int64_t directories{0};
+
+    totals &operator+=(const totals &other) {
+        bytes += other.bytes;
+        allocated += other.allocated;
+        files += other.files;
+        directories += other.directories;
+        return *this;
+    }
+    totals operator-() const { return {-bytes, -allocated, -files, -directories}; }
+    bool operator==(const totals &) const = default;
+};
+
+struct file_record {
+    std::int64_t size;
+    std::int64_t allocated;
+    std::int64_t mtime_ns;
+};
+
+// what a reconcile or a batch of events did
+struct sync_stats {
+    std::size_t directories_checked{0};     // statx of a directory
+    std::size_t directories_read{0};        // getdents64 of a directory
+    std::size_t files_stated{0};
+    std::size_t events{0};                  // inotify events read
+
+    sync_stats &operator+=(const sync_stats &other) {
+        directories_checked += other.directories_checked;
+        directories_read += other.directories_read;
+        files_stated += other.files_stated;
+        events += other.events;
+        return *this;
+    }
+};
+
+namespace detail {
+
+    inline std::int64_t nanoseconds(const struct statx_timestamp &t) {
+        return static_cast<std::int64_t>(t.tv_sec) * 1'000'000'000 + t.tv_nsec;
+    }
+
+    inline file_record record_of(const struct statx &s) {
+        return {static_cast<std::int64_t>(s.stx_size), static_cast<std::int64_t>(s.stx_blocks) * 512, nanoseconds(s.stx_mtime)};
+    }
+
+    inline totals totals_of(const file_record &r) { return {r.size, r.allocated, 1, 0}; }
+
+    inline std::string child_path(const std::string &directory, const std::string_view name) {
+        std::string l_path;
+        l_path.reserve(directory.size() + 1 + name.size());
+        if (not directory.empty()) {
+            l_path.append(directory).push_back('/');
+        }
+        l_path.append(name);
+        return l_path;
+    }
+
+    class file_descriptor {
+        int m_fd;
+
+    public:
+        explicit file_descriptor(const int fd = -1) : m_fd{fd} {}
+        ~file_descriptor() {
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+        }
+        file_descriptor(const file_descriptor &) = delete;
+        file_descriptor &operator=(const file_descriptor &) = delete;
+        int get() const { return m_fd; }
+    };
+
+    // binary fields of the index file
+    template <typename T>
+    void write(std::ostream &os, const T value) {
+        os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    inline void write(std::ostream &os, const std::string_view s) {
+        write<std::uint32_t>(os, static_cast<std::uint32_t>(s.size()));
+        os.write(s.data(), static_cast<std::streamsize>(s.size()));
+    }
+    template <typename T>
+    T read(std::istream &is) {
+        T l_value{};
+        is.read(reinterpret_cast<char *>(&l_value), sizeof(l_value));
+        return l_value;
+    }
+    // a length above max_size (the size of the file) is a corrupt file: failbit, no allocation
+    inline std::string read_string(std::istream &is, const std::uint64_t max_size) {
+        const auto l_size = read<std::uint32_t>(is);
+        if (l_size > max_size) {
+            is.setstate(std::ios::failbit);
+            return {};
+        }
+        std::string l_s(l_size, '\0');
+        is.read(l_s.data(), static_cast<std::streamsize>(l_s.size()));
+        return l_s;
+    }
+
+    // the data of a file (or the entries of a directory) on the disk, not only in the page cache
+    inline void sync_to_disk(const std::filesystem::path &path, const int flags) {
+        const file_descriptor l_fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC | flags));
+        if (l_fd.get() < 0 or ::fsync(l_fd.get()) != 0) {
+            throw std::filesystem::filesystem_error("size_index: cannot fsync", path, std::error_code(errno, std::generic_category()));
+        }
+    }
+
+}  // namespace detail
+
+class size_index {
+    static constexpr std::uint32_t file_magic = 0x5849'5a53;    // "SZIX"
+    static constexpr std::uint32_t file_version = 1;
+    static constexpr std::uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                                IN_MODIFY | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+    // the mtime of a directory whose entries are not known
+    static constexpr std::int64_t unknown_mtime = 0;
+
+    struct directory_node {
+        std::string path;                   // relative to the root, empty for the root
+        directory_node *parent;
+        std::int64_t mtime_ns{unknown_mtime};
+        std::uint64_t inode{0};
+        int watch{-1};
+        totals own{};                       // the files directly inside
+        totals total{};                     // the subtree, this directory included
+        std::unordered_map<std::string, file_record> files;
+        std::map<std::string, directory_node *> children;
+    };
+
+    std::filesystem::path m_root;
+    std::filesystem::path m_index_file;
+    detail::file_descriptor m_root_fd;
+    detail::file_descriptor m_inotify;
+    bool m_watching{true};
+    std::unordered_map<std::string, std::unique_ptr<directory_node>> m_nodes;
+    std::unordered_map<int, directory_node *> m_watches;
+    std::vector<char> m_events;
+    sync_stats m_startup;
+
+    directory_node &root() { return *m_nodes.at(""); }
+
+    // the difference from node to the root
+    static void propagate(directory_node *node, const totals &delta) {
+        for (; node != nullptr; node = node->parent) {
+            node->total += delta;
+        }
+    }
+
+    directory_node *add_node(directory_node *parent, const std::string_view name) {
+        auto l_node = std::make_unique<directory_node>();
+        l_node->path = detail::child_path(parent->path, name);
+        l_node->parent = parent;
+        l_node->total.directories = 1;
+        directory_node *l_raw = l_node.get();
+        parent->children.emplace(std::string(name), l_raw);
+        propagate(parent, l_node->total);
+        m_nodes.emplace(l_raw->path, std::move(l_node));
+        return l_raw;
+    }
+
+    void remove_node(directory_node *node) {
+        propagate(node->parent, -node->total);
+        std::vector<directory_node *> l_stack{node};
+        while (not l_stack.empty()) {
+            directory_node *l_node = l_stack.back();
+            l_stack.pop_back();
+            for (const auto &[name, child] : l_node->children) {
+                l_stack.push_back(child);
+            }
+            if (l_node->watch >= 0) {
+                // gone with the directory already when it was deleted, the error does not matter
+                ::inotify_rm_watch(m_inotify.get(), l_node->watch);
+                m_watches.erase(l_node->watch);
+                l_node->watch = -1;
+            }
+            if (l_node != node) {
+                m_nodes.erase(l_node->path);
+            }
+        }
+        const std::string l_path = node->path;
+        node->parent->children.erase(std::filesystem::path(l_path).filename().string());
+        m_nodes.erase(l_path);
+    }
+
+    void set_file(directory_node *node, const std::string &name, const file_record &record) {
+        totals l_delta = detail::totals_of(record);
+        const auto [l_it, l_inserted] = node->files.try_emplace(name, record);
+        if (not l_inserted) {
+            l_delta += -detail::totals_of(l_it->second);
+            l_it->second = record;
+        }
+        node->own += l_delta;
+        propagate(node, l_delta);
+    }
+
+    void remove_file(directory_node *node, const std::string &name) {
+        const auto l_it = node->files.find(name);
+        if (l_it != node->files.end()) {
+            const totals l_delta = -detail::totals_of(l_it->second);
+            node->own += l_delta;
+            propagate(node, l_delta);
+            node->files.erase(l_it);
+        }
+    }
+
+    const char *relative(const std::string &path) const { return path.empty() ? "." : path.c_str(); }
+
+    void add_watch(directory_node *node) {
+        if (not m_watching or node->watch >= 0) {
+            return;
+        }
+        const int l_watch = ::inotify_add_watch(m_inotify.get(), (m_root / node->path).c_str(), watch_mask);
+        if (l_watch < 0) {
+            // ENOSPC: more directories than max_user_watches, the events are incomplete from now on;
+            // anything else: the directory is gone, the statx that follows removes the node
+            if (errno == ENOSPC) {
+                m_watching = false;
+            }
+            return;
+        }
+        // the same inode has the same watch: a directory moved to a name read before its old name
+        if (const auto l_old = m_watches.find(l_watch); l_old != m_watches.end()) {
+            l_old->second->watch = -1;
+        }
+        node->watch = l_watch;
+        m_watches[l_watch] = node;
+    }
+
+    // the entries of node read again: files stat'ed, new subdirectories created (unknown mtime),
+    // vanished entries removed
+    void read_directory(directory_node *node, sync_stats &stats) {
+        const detail::file_descriptor l_fd(::openat(m_root_fd.get(), relative(node->path), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if (l_fd.get() < 0) {
+            return;
+        }
+        ++stats.directories_read;
+        std::set<std::string> l_files_seen;
+        std::set<std::string> l_children_seen;
+        alignas(8) char l_buffer[64 * 1024];
+        struct statx l_stat;
+        for (;;) {
+            const ssize_t l_bytes = ::getdents64(l_fd.get(), l_buffer, sizeof(l_buffer));
+            if (l_bytes <= 0) {
+                break;
+            }
+            for (ssize_t l_offset = 0; l_offset < l_bytes;) {
+                const auto *l_record = reinterpret_cast<const struct dirent64 *>(l_buffer + l_offset);
+                l_offset += l_record->d_reclen;
+                const std::string_view l_name(l_record->d_name);
+                if (l_name == "." or l_name == "..") {
+                    continue;
+                }
+                unsigned char l_type = l_record->d_type;
+                if (l_type == DT_REG or l_type == DT_UNKNOWN) {
+                    ++stats.files_stated;
+                    if (::statx(l_fd.get(), l_record->d_name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                                STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_MTIME, &l_stat) != 0) {
+                        continue;
+                    }
+                    l_type = S_ISREG(l_stat.stx_mode) ? DT_REG : S_ISDIR(l_stat.stx_mode) ? DT_DIR : DT_UNKNOWN;
+                    if (l_type == DT_REG) {
+                        const std::string l_file(l_name);
+                        if (node->children.contains(l_file)) {
+                            remove_node(node->children.at(l_file));
+                        }
+                        set_file(node, l_file, detail::record_of(l_stat));
+                        l_files_seen.insert(l_file);
+                    }
+                }
+                if (l_type == DT_DIR) {
+                    const std::string l_child(l_name);
+                    remove_file(node, l_child);
+                    if (not node->children.contains(l_child)) {
+                        add_node(node, l_child);
+                    }
+                    l_children_seen.insert(l_child);
+                }
+            }
+        }
+
+        std::vector<std::string> l_gone;
+        for (const auto &[name, record] : node->files) {
+            if (not l_files_seen.contains(name)) {
+                l_gone.push_back(name);
+            }
+        }
+        for (const std::string &l_name : l_gone) {
+            remove_file(node, l_name);
+        }
+        l_gone.clear();
+        for (const auto &[name, child] : node->children) {
+            if (not l_children_seen.contains(name)) {
+                l_gone.push_back(name);
+            }
+        }
+        for (const std::string &l_name : l_gone) {
+            remove_node(node->children.at(l_name));
+        }
+    }
+
+    // the recorded files of node stat'ed again
+    void verify_files(directory_node *node, sync_stats &stats) {
+        const detail::file_descriptor l_fd(::openat(m_root_fd.get(), relative(node->path), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if (l_fd.get() < 0) {
+            return;
+        }
+        struct statx l_stat;
+        bool l_gone = false;
+        for (auto &[name, record] : node->files) {
+            ++stats.files_stated;
+            if (::statx(l_fd.get(), name.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                        STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_MTIME, &l_stat) != 0 or not S_ISREG(l_stat.stx_mode)) {
+                // the mtime of the directory said the entries did not change: a clock set back, read it
+                l_gone = true;
+                continue;
+            }
+            const file_record l_record = detail::record_of(l_stat);
+            const totals l_delta{l_record.size - record.size, l_record.allocated - record.allocated, 0, 0};
+            record = l_record;
+            node->own += l_delta;
+            propagate(node, l_delta);
+        }
+        if (l_gone) {
+            read_directory(node, stats);
+        }
+    }
+
+    // the subtree of node brought up to date with the filesystem
+    sync_stats sync(directory_node *start, const bool verify) {
+        sync_stats l_stats;
+        std::vector<directory_node *> l_stack{start};
+        struct statx l_stat;
+        while (not l_stack.empty()) {
+            directory_node *l_node = l_stack.back();
+            l_stack.pop_back();
+
+            add_watch(l_node);
+            ++l_stats.directories_checked;
+            if (::statx(m_root_fd.get(), relative(l_node->path), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                        STATX_TYPE | STATX_INO | STATX_MTIME, &l_stat) != 0 or not S_ISDIR(l_stat.stx_mode)) {
+                if (l_node->parent != nullptr) {
+                    remove_node(l_node);
+                }
+                continue;
+            }
+            if (l_node->inode != 0 and l_node->inode != l_stat.stx_ino) {
+                // another directory of the same name: everything below is read again
+                for (const auto &[name, child] : std::map(l_node->children)) {
+                    remove_node(child);
+                }
+                for (const auto &[name, record] : std::unordered_map(l_node->files)) {
+                    remove_file(l_node, name);
+                }
+                l_node->mtime_ns = unknown_mtime;
+            }
+            l_node->inode = l_stat.stx_ino;
+
+            // the mtime before the read: a change during the read leaves a newer mtime, read next time
+            const std::int64_t l_mtime = detail::nanoseconds(l_stat.stx_mtime);
+            if (l_mtime != l_node->mtime_ns) {
+                read_directory(l_node, l_stats);
+                l_node->mtime_ns = l_mtime;
+            } else if (verify) {
+                verify_files(l_node, l_stats);
+            }
+            for (const auto &[name, child] : l_node->children) {
+                l_stack.push_back(child);
+            }
+        }
+        return l_stats;
+    }
+
+    // one entry named by an event, stat'ed once whatever the number of events
+    void refresh(directory_node *node, const std::string &name, sync_stats &stats) {
+        struct statx l_stat;
+        ++stats.files_stated;
+        const std::string l_path = detail::child_path(node->path, name);
+        const bool l_exists = ::statx(m_root_fd.get(), l_path.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                                      STATX_TYPE | STATX_INO | STATX_SIZE | STATX_BLOCKS | STATX_MTIME, &l_stat) == 0;
+        const auto l_child = node->children.find(name);
+        if (l_exists and S_ISREG(l_stat.stx_mode)) {
+            if (l_child != node->children.end()) {
+                remove_node(l_child->second);
+            }
+            set_file(node, name, detail::record_of(l_stat));
+        } else if (l_exists and S_ISDIR(l_stat.stx_mode)) {
+            remove_file(node, name);
+            if (l_child != node->children.end() and l_child->second->inode != l_stat.stx_ino) {
+                remove_node(l_child->second);
+            }
+            if (not node->children.contains(name)) {
+                // created or moved in: read with its subtree, the watch added before the read
+                stats += sync(add_node(node, name), false);
+            }
+        } else {
+            remove_file(node, name);
+            if (l_child != node->children.end()) {
+                remove_node(l_child->second);
+            }
+        }
+    }
+
+    bool load() {
+        std::ifstream l_in(m_index_file, std::ios::binary);
+        std::error_code l_error;
+        const std::uint64_t l_file_size = std::filesystem::file_size(m_index_file, l_error);
+        if (not l_in or l_error or detail::read<std::uint32_t>(l_in) != file_magic or
+            detail::read<std::uint32_t>(l_in) != file_version or detail::read_string(l_in, l_file_size) != m_root.string()) {
+            return false;
+        }
+        const auto l_directories = detail::read<std::uint64_t>(l_in);
+        // parents before children, the totals added bottom up at the end
+        root().total = {};
+        std::vector<directory_node *> l_order;
+        bool l_root_read = false;
+        for (std::uint64_t d = 0; d < l_directories and l_in; ++d) {
+            const std::string l_path = detail::read_string(l_in, l_file_size);
+            directory_node *l_node = nullptr;
+            // a directory or a file twice is a corrupt file: false, the constructor resets the nodes
+            if (l_path.empty()) {
+                if (l_root_read) {
+                    return false;
+                }
+                l_root_read = true;
+                l_node = &root();
+            } else {
+                const auto l_parent = m_nodes.find(std::filesystem::path(l_path).parent_path().string());
+                if (l_parent == m_nodes.end()) {
+                    return false;
+                }
+                auto l_new = std::make_unique<directory_node>();
+                l_new->path = l_path;
+                l_new->parent = l_parent->second.get();
+                l_node = l_new.get();
+                if (not m_nodes.emplace(l_path, std::move(l_new)).second or
+                    not l_parent->second->children.emplace(std::filesystem::path(l_path).filename().string(), l_node).second) {
+                    return false;
+                }
+            }
+            l_node->mtime_ns = detail::read<std::int64_t>(l_in);
+            l_node->inode = detail::read<std::uint64_t>(l_in);
+            const auto l_files = detail::read<std::uint64_t>(l_in);
+            // a file record is at least 28 bytes: a corrupt count does not reserve more than the file holds
+            l_node->files.reserve(std::min<std::uint64_t>(l_files, l_file_size / 28));
+            for (std::uint64_t f = 0; f < l_files and l_in; ++f) {
+                std::string l_name = detail::read_string(l_in, l_file_size);
+                file_record l_record;
+                l_record.size = detail::read<std::int64_t>(l_in);
+                l_record.allocated = detail::read<std::int64_t>(l_in);
+                l_record.mtime_ns = detail::read<std::int64_t>(l_in);
+                if (not l_node->files.emplace(std::move(l_name), l_record).second) {
+                    return false;
+                }
+                l_node->own += detail::totals_of(l_record);
+            }
+            l_order.push_back(l_node);
+        }
+        if (not l_in) {
+            return false;
+        }
+        for (auto l_it = l_order.rbegin(); l_it != l_order.rend(); ++l_it) {
+            directory_node *l_node = *l_it;
+            l_node->total.directories += 1;
+            l_node->total += l_node->own;
+            if (l_node->parent != nullptr) {
+                l_node->parent->total += l_node->total;
+            }
+        }
+        return true;
+    }
+
+    void reset() {
+        for (const auto &[watch, node] : m_watches) {
+            ::inotify_rm_watch(m_inotify.get(), watch);
+        }
+        m_watches.clear();
+        m_nodes.clear();
+        auto l_root = std::make_unique<directory_node>();
+        l_root->parent = nullptr;
+        l_root->total.directories = 1;
+        m_nodes.emplace("", std::move(l_root));
+    }
+
+public:
+    // loads index_file (when it exists and was written for tree) and reconciles it, or reads the tree
+    size_index(std::filesystem::path tree, std::filesystem::path index_file, const bool verify = false)
+        : m_root{std::filesystem::absolute(std::move(tree)).lexically_normal()}, m_index_file{std::move(index_file)},
+          m_root_fd{::open(m_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)},
+          m_inotify{::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}, m_events(64 * 1024) {
+        if (m_root_fd.get() < 0) {
+            throw std::filesystem::filesystem_error("size_index: cannot open the root", m_root,
+                                                    std::error_code(errno, std::generic_category()));
+        }
+        m_watching = (m_inotify.get() >= 0);
+        reset();
+        if (not load()) {
+            reset();
+        }
+        m_startup = sync(&root(), verify);
+    }
+
+    // totals of the subtree at path (relative to the root, "" for the root), nullopt when not indexed
+    std::optional<totals> query(const std::string &path) const {
+        const auto l_it = m_nodes.find(path);
+        if (l_it == m_nodes.end()) {
+            return std::nullopt;
+        }
+        return l_it->second->total;
+    }
+
+    // the events that arrived, waiting up to timeout_ms for the first one
+    sync_stats process_events(const int timeout_ms) {
+        sync_stats l_stats;
+        if (m_inotify.get() < 0) {
+            return l_stats;
+        }
+        pollfd l_poll{m_inotify.get(), POLLIN, 0};
+        if (::poll(&l_poll, 1, timeout_ms) <= 0) {
+            return l_stats;
+        }
+
+        // merged per directory and name, in the order of their first event
+        std::vector<std::pair<int, std::string>> l_names;
+        std::set<std::pair<int, std::string>> l_seen;
+        bool l_overflow = false;
+        for (;;) {
+            const ssize_t l_bytes = ::read(m_inotify.get(), m_events.data(), m_events.size());
+            if (l_bytes <= 0) {
+                break;
+            }
+            for (ssize_t l_offset = 0; l_offset < l_bytes;) {
+                inotify_event l_event;
+                std::memcpy(&l_event, m_events.data() + l_offset, sizeof(l_event));
+                const char *l_name = m_events.data() + l_offset + sizeof(inotify_event);
+                l_offset += static_cast<ssize_t>(sizeof(inotify_event) + l_event.len);
+                ++l_stats.events;
+
+                if (l_event.mask & IN_Q_OVERFLOW) {
+                    l_overflow = true;
+                    continue;
+                }
+                if (l_event.mask & IN_IGNORED) {
+                    // the directory was removed, its node with it or soon by its parent's event
+                    if (const auto l_node = m_watches.find(l_event.wd); l_node != m_watches.end()) {
+                        l_node->second->watch = -1;
+                        m_watches.erase(l_node);
+                    }
+                    continue;
+                }
+                if (l_event.len == 0 or not m_watches.contains(l_event.wd)) {
+                    continue;
+                }
+                if (l_event.mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+                    // the entries changed: the saved index must not claim the listing of this mtime
+                    m_watches.at(l_event.wd)->mtime_ns = unknown_mtime;
+                }
+                if (l_seen.emplace(l_event.wd, l_name).second) {
+                    l_names.emplace_back(l_event.wd, l_name);
+                }
+            }
+        }
+
+        for (const auto &[watch, name] : l_names) {
+            // a directory of an earlier name of the batch may be gone with its watch
+            if (const auto l_node = m_watches.find(watch); l_node != m_watches.end()) {
+                refresh(l_node->second, name, l_stats);
+            }
+        }
+        if (l_overflow) {
+            l_stats += reconcile(true);
+        }
+        return l_stats;
+    }
+
+    sync_stats reconcile(const bool verify) { return sync(&root(), verify); }
+
+    // the index file replaced atomically: a crash or a power loss during save leaves the previous one;
+    // the temporary file is on the disk before the rename, the rename is on the disk when save returns
+    void save() const {
+        const std::filesystem::path l_temporary = m_index_file.string() + ".tmp";
+        {
+            std::ofstream l_out(l_temporary, std::ios::binary | std::ios::trunc);
+            detail::write(l_out, file_magic);
+            detail::write(l_out, file_version);
+            detail::write(l_out, std::string_view(m_root.string()));
+            detail::write<std::uint64_t>(l_out, m_nodes.size());
+            // parents first: the root, then depth first through the children
+            std::vector<const directory_node *> l_stack{m_nodes.at("").get()};
+            while (not l_stack.empty()) {
+                const directory_node *l_node = l_stack.back();
+                l_stack.pop_back();
+                detail::write(l_out, std::string_view(l_node->path));
+                detail::write(l_out, l_node->mtime_ns);
+                detail::write(l_out, l_node->inode);
+                detail::write<std::uint64_t>(l_out, l_node->files.size());
+                for (const auto &[name, record] : l_node->files) {
+                    detail::write(l_out, std::string_view(name));
+                    detail::write(l_out, record.size);
+                    detail::write(l_out, record.allocated);
+                    detail::write(l_out, record.mtime_ns);
+                }
+                for (const auto &[name, child] : l_node->children) {
+                    l_stack.push_back(child);
+                }
+            }
+            l_out.flush();
+            if (not l_out) {
+                throw std::filesystem::filesystem_error("size_index: cannot write the index", l_temporary,
+                                                        std::make_error_code(std::errc::io_error));
+            }
+        }
+        detail::sync_to_disk(l_temporary, 0);
+        std::filesystem::rename(l_temporary, m_index_file);
+        const std::filesystem::path l_directory = m_index_file.parent_path();
+        detail::sync_to_disk(l_directory.empty() ? std::filesystem::path(".") : l_directory, O_DIRECTORY);
+    }
+
+    // what the reconcile of the constructor did: a full read without an index file
+    const sync_stats &startup() const { return m_startup; }
+    bool watching() const { return m_watching; }
+    std::size_t directories() const { return m_nodes.size(); }
+    const std::filesystem::path &root_path() const { return m_root; }
+};
+
+}  // namespace sizeindex
+
+#endif
+
+/*****
+    END OF FILE
+*********/
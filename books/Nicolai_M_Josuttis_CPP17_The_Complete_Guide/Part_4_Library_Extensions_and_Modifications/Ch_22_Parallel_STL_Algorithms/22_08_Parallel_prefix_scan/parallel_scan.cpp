@@ -0,0 +1,421 @@
+/**********
+
+References
+
+    C++17 - The Complete Guide | Nicolai M. Josuttis
+    https://en.cppreference.com/w/cpp/algorithm/inclusive_scan
+    https://en.cppreference.com/w/cpp/algorithm/exclusive_scan
+    https://en.cppreference.com/w/cpp/experimental/simd
+
+Chapter 22 Parallel STL Algorithms
+
+22.8 Parallel prefix scan
+
+    inclusive_scan() and exclusive_scan() (22.5) may run in parallel with std::execution::par,
+    but libstdc++ needs TBB for that, without it the parallel versions run sequentially.
+
+    parallel_inclusive_scan() and parallel_exclusive_scan() below run a two-pass blocked scan
+    (reduce-then-scan) on the thread pool of executor.hpp:
+
+        pass 1      the range is split in one block per thread, every block but the last is reduced
+                    in order to its sum (in parallel)
+        offsets     the sums are scanned sequentially, the offset of block b combines the sums of the blocks before it
+        pass 2      every block is scanned starting from its offset (in parallel)
+
+    Every element is read twice and written once, so the parallel scan needs at least
+    two threads to beat the sequential scan, which reads and writes every element once.
+
+    The operation only has to be associative, not commutative: the blocks are reduced in order
+    and the sums combined left to right, a matrix product or a "keep the last valid value" operation works.
+    As for reduce() (22.6), floating-point sums may differ in the last bits from the sequential scan
+    because they are grouped differently.
+
+    With std::plus on arithmetic values the block sums of pass 1 use std::experimental::simd
+    (several vectors accumulated at once), the scan itself is a chain of dependent additions
+    and stays scalar, an in-register shift-and-add scan of a vector was slower than the scalar chain
+    with the simd of g++ 12.
+
+    Small ranges (less than min_block elements per thread) are scanned sequentially.
+
+    Prefix sums are the step turning counts into offsets:
+        histogram to offsets    exclusive scan of the counts of the buckets gives where every bucket starts
+        stream compaction       exclusive scan of the 0/1 flags gives the position of every kept element
+
+Usage
+    ./parallel_scan [max_elements] [threads]
+    sizes from 10M up to max_elements (default 100M) by factors of 10, 1B elements need 8GB for the input and output
+
+*************/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <array>
+#include <type_traits>
+#include <experimental/simd>
+#include <iomanip>
+#include <cstdint>
+
+#include <string>
+#include <chrono>
+
+#include "executor.hpp"
+
+namespace stdx = std::experimental;
+
+class Timer {
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_stop;
+
+    public:
+    void start()    { m_start = std::chrono::steady_clock::now();   }
+    void stop()     { m_stop = std::chrono::steady_clock::now();    }
+
+    double nanoseconds() const { return std::chrono::duration<double, std::nano>{m_stop - m_start}.count(); }
+};
+
+constexpr std::size_t min_block = 1 << 16;
+
+// the sum of [first, last) with several vectors in flight, the additions of one vector do not wait for the previous one
+template<typename T>
+T simdSum(const T * first, const T * last) {
+    using simd_t = stdx::native_simd<T>;
+    constexpr std::size_t width = simd_t::size();
+
+    simd_t sum0{}, sum1{}, sum2{}, sum3{};
+    for(; static_cast<std::size_t>(last - first) >= 4 * width; first += 4 * width) {
+        sum0 += simd_t(first, stdx::element_aligned);
+        sum1 += simd_t(first + width, stdx::element_aligned);
+        sum2 += simd_t(first + 2 * width, stdx::element_aligned);
+        sum3 += simd_t(first + 3 * width, stdx::element_aligned);
+    }
+    T sum = stdx::reduce((sum0 + sum1) + (sum2 + sum3));
+    for(; first != last; ++first) {
+        sum += *first;
+    }
+    return sum;
+}
+
+// only when the sum is kept in the element type, a wider accumulator (uint8_t flags summed into size_t) stays scalar
+template<typename Acc, typename InIt, typename BinaryOp>
+constexpr bool simd_reducible =
+    std::contiguous_iterator<InIt>
+    and std::is_same_v<Acc, std::iter_value_t<InIt>>
+    and std::is_arithmetic_v<std::iter_value_t<InIt>>
+    and not std::is_same_v<std::iter_value_t<InIt>, bool>
+    and (std::is_same_v<BinaryOp, std::plus<>> or std::is_same_v<BinaryOp, std::plus<std::iter_value_t<InIt>>>);
+
+// in order, the operation does not have to be commutative, the sum is accumulated in Acc
+template<typename Acc, typename InIt, typename BinaryOp>
+Acc reduceBlock(InIt first, InIt last, BinaryOp op) {
+    if constexpr (simd_reducible<Acc, InIt, BinaryOp>) {
+        return simdSum(std::to_address(first), std::to_address(last));
+    }
+    else {
+        Acc sum = *first;
+        while(++first != last) {
+            sum = op(std::move(sum), *first);
+        }
+        return sum;
+    }
+}
+
+// pass 1, offsets and pass 2, scan_block(first, last, out, offset) scans one block
+// from the offset combining all the elements before it (the init value of the exclusive scan included);
+// the sums and offsets are of type Acc, like the accumulator of the std scans:
+// the value type of the input for inclusive_scan without init, the type of init for exclusive_scan
+template<typename Acc, typename InIt, typename OutIt, typename BinaryOp, typename Executor, typename ScanBlock>
+void blockedScan(InIt first, std::size_t blocks_count, std::size_t block_size, std::size_t num_elems,
+                 OutIt d_first, BinaryOp op, Executor & executor, std::optional<Acc> init,
+                 ScanBlock scan_block) {
+    auto block_begin = [&](std::size_t b) { return std::min(b * block_size, num_elems); };
+
+    // pass 1, the last block is not needed for the offsets
+    std::vector<std::optional<Acc>> sums(blocks_count);
+    {
+        task_group<Executor> group(executor);
+        for(std::size_t b = 1; b + 1 < blocks_count; ++b) {
+            group.run([&, b] { sums[b] = reduceBlock<Acc>(first + block_begin(b), first + block_begin(b + 1), op); });
+        }
+        sums[0] = reduceBlock<Acc>(first, first + block_begin(1), op);
+        group.wait();
+    }
+
+    // sums[b] becomes the offset of block b + 1
+    std::optional<Acc> carry = std::move(init);
+    std::vector<std::optional<Acc>> offsets(blocks_count);
+    for(std::size_t b = 0; b < blocks_count; ++b) {
+        offsets[b] = carry;
+        if(b + 1 < blocks_count) {
+            carry = carry ? op(std::move(*carry), std::move(*sums[b])) : std::move(sums[b]);
+        }
+    }
+
+    // pass 2, in place works, every block only reads and writes its own elements
+    task_group<Executor> group(executor);
+    for(std::size_t b = 1; b < blocks_count; ++b) {
+        group.run([&, b] {
+            scan_block(first + block_begin(b), first + block_begin(b + 1), d_first + block_begin(b), offsets[b]);
+        });
+    }
+    scan_block(first, first + block_begin(1), d_first, offsets[0]);
+    group.wait();
+}
+
+template<typename Executor>
+std::size_t blocksCount(std::size_t num_elems, Executor & executor) {
+    return std::min<std::size_t>(executor.concurrency(), num_elems / min_block);
+}
+
+template<typename InIt, typename OutIt, typename BinaryOp = std::plus<>, typename Executor = thread_pool>
+OutIt parallel_inclusive_scan(InIt first, InIt last, OutIt d_first, BinaryOp op = {},
+                              Executor & executor = default_executor()) {
+    static_assert(std::random_access_iterator<InIt> and std::random_access_iterator<OutIt>);
+
+    const std::size_t num_elems = static_cast<std::size_t>(last - first);
+    const std::size_t blocks_count = blocksCount(num_elems, executor);
+    if(blocks_count < 2) {
+        return std::inclusive_scan(first, last, d_first, op);
+    }
+
+    const std::size_t block_size = (num_elems + blocks_count - 1) / blocks_count;
+    blockedScan<std::iter_value_t<InIt>>(first, blocks_count, block_size, num_elems, d_first, op, executor, std::nullopt,
+                [&op](InIt b_first, InIt b_last, OutIt b_out, const auto & offset) {
+                    if(offset) {
+                        std::inclusive_scan(b_first, b_last, b_out, op, *offset);
+                    }
+                    else {
+                        std::inclusive_scan(b_first, b_last, b_out, op);
+                    }
+                });
+    return d_first + num_elems;
+}
+
+template<typename InIt, typename OutIt, typename T, typename BinaryOp = std::plus<>, typename Executor = thread_pool>
+OutIt parallel_exclusive_scan(InIt first, InIt last, OutIt d_first, T init, BinaryOp op = {},
+                              Executor & executor = default_executor()) {
+    static_assert(std::random_access_iterator<InIt> and std::random_access_iterator<OutIt>);
+
+    const std::size_t num_elems = static_cast<std::size_t>(last - first);
+    const std::size_t blocks_count = blocksCount(num_elems, executor);
+    if(blocks_count < 2) {
+        return std::exclusive_scan(first, last, d_first, std::move(init), op);
+    }
+
+    const std::size_t block_size = (num_elems + blocks_count - 1) / blocks_count;
+    blockedScan<T>(first, blocks_count, block_size, num_elems, d_first, op, executor, std::optional<T>{std::move(init)},
+                [&op](InIt b_first, InIt b_last, OutIt b_out, const auto & offset) {
+                    std::exclusive_scan(b_first, b_last, b_out, *offset, op);
+                });
+    return d_first + num_elems;
+}
+
+// exclusive scan of the bucket counts, offsets[k] is where the elements of bucket k start
+std::vector<std::uint32_t> histogramToOffsets(const std::vector<std::uint32_t> & values, std::size_t buckets) {
+    std::vector<std::uint32_t> counts(buckets);
+    for(auto v : values) {
+        ++counts[v % buckets];
+    }
+    std::vector<std::uint32_t> offsets(buckets);
+    parallel_exclusive_scan(counts.begin(), counts.end(), offsets.begin(), std::uint32_t{0});
+    return offsets;
+}
+
+// keeps the elements satisfying pred, the exclusive scan of the flags gives the position of every kept element
+template<typename Pred>
+std::vector<std::uint32_t> compact(const std::vector<std::uint32_t> & values, Pred pred) {
+    std::vector<std::uint32_t> positions(values.size());
+    std::transform(values.begin(), values.end(), positions.begin(), [&](auto v) { return pred(v) ? 1u : 0u; });
+    const std::uint32_t last_flag = values.empty() ? 0 : positions.back();
+    parallel_exclusive_scan(positions.begin(), positions.end(), positions.begin(), std::uint32_t{0});
+
+    std::vector<std::uint32_t> kept(values.empty() ? 0 : positions.back() + last_flag);
+    for(std::size_t i = 0; i < values.size(); ++i) {
+        if(pred(values[i])) {
+            kept[positions[i]] = values[i];
+        }
+    }
+    return kept;
+}
+
+template<typename Func>
+double bestOf(int runs, Func func) {
+    Timer bt_time;
+    double best = 0;
+    for(int r = 0; r < runs; ++r) {
+        bt_time.start();
+        func();
+        bt_time.stop();
+        best = (r == 0) ? bt_time.nanoseconds() : std::min(best, bt_time.nanoseconds());
+    }
+    return best;
+}
+
+template<typename Executor>
+void printScanBenchmark(std::size_t num_elems, Executor & pool) {
+    std::vector<std::uint32_t> coll(num_elems);
+    for(std::size_t i = 0; i < num_elems; ++i) {
+        coll[i] = static_cast<std::uint32_t>(i * 2654435761u) >> 24;
+    }
+    std::vector<std::uint32_t> expected(num_elems);
+    std::vector<std::uint32_t> result(num_elems);
+
+    auto print = [num_elems](const std::string & name, double ns, bool ok) {
+        std::cout << std::setw(12) << num_elems << std::setw(28) << name << std::fixed << std::setprecision(2)
+                  << std::setw(10) << ns / 1e6 << std::setw(12) << ns / static_cast<double>(num_elems)
+                  << std::setw(10) << (2.0 * sizeof(std::uint32_t) * static_cast<double>(num_elems)) / ns << (ok ? "  ok" : "  WRONG") << '\n';
+    };
+
+    const int runs = 3;
+    const double seq_ns = bestOf(runs, [&] { std::inclusive_scan(coll.begin(), coll.end(), expected.begin()); });
+    print("std::inclusive_scan", seq_ns, true);
+
+    const double par_ns = bestOf(runs, [&] { parallel_inclusive_scan(coll.begin(), coll.end(), result.begin(), std::plus<>{}, pool); });
+    print("parallel_inclusive_scan", par_ns, result == expected);
+
+    std::exclusive_scan(coll.begin(), coll.end(), expected.begin(), std::uint32_t{7});
+    const double excl_ns = bestOf(runs, [&] { parallel_exclusive_scan(coll.begin(), coll.end(), result.begin(), std::uint32_t{7}, std::plus<>{}, pool); });
+    print("parallel_exclusive_scan", excl_ns, result == expected);
+
+    // a custom associative operation, the running maximum, pass 1 is not vectorized
+    auto max_op = [](std::uint32_t a, std::uint32_t b) { return std::max(a, b); };
+    std::inclusive_scan(coll.begin(), coll.end(), expected.begin(), max_op);
+    const double max_ns = bestOf(runs, [&] { parallel_inclusive_scan(coll.begin(), coll.end(), result.begin(), max_op, pool); });
+    print("parallel_inclusive_scan max", max_ns, result == expected);
+
+    // in place, the input is overwritten, so it is measured once
+    std::inclusive_scan(coll.begin(), coll.end(), expected.begin());
+    const double inplace_ns = bestOf(1, [&] { parallel_inclusive_scan(coll.begin(), coll.end(), coll.begin(), std::plus<>{}, pool); });
+    print("in place", inplace_ns, coll == expected);
+}
+
+void printNonCommutativeOperation() {
+    // 2x2 matrix product, associative but not commutative: the blocks have to be combined in order
+    using mat2 = std::array<std::uint64_t, 4>;
+    auto mul = [](const mat2 & a, const mat2 & b) {
+        return mat2{a[0] * b[0] + a[1] * b[2], a[0] * b[1] + a[1] * b[3],
+                    a[2] * b[0] + a[3] * b[2], a[2] * b[1] + a[3] * b[3]};
+    };
+    std::vector<mat2> coll(1 << 20);
+    for(std::size_t i = 0; i < coll.size(); ++i) {
+        coll[i] = (i % 3 == 0) ? mat2{1, 1, 1, 0} : mat2{1, 0, i & 7, 1};
+    }
+    std::vector<mat2> expected(coll.size()), result(coll.size());
+    std::inclusive_scan(coll.begin(), coll.end(), expected.begin(), mul);
+    parallel_inclusive_scan(coll.begin(), coll.end(), result.begin(), mul);
+    std::cout << "matrix product scan of " << coll.size() << " elements "
+              << ((result == expected) ? "same" : "different") << " as std::inclusive_scan\n";
+}
+
+template<typename Executor>
+void printWideAccumulator(Executor & pool) {
+    // uint8_t flags, size_t offsets: the sums have to be of the type of init, not of the elements
+    std::vector<std::uint8_t> flags(1 << 20);
+    for(std::size_t i = 0; i < flags.size(); ++i) {
+        flags[i] = (i % 3 != 0) ? 1 : 0;
+    }
+    std::vector<std::size_t> expected(flags.size()), result(flags.size());
+    std::exclusive_scan(flags.begin(), flags.end(), expected.begin(), std::size_t{0});
+    parallel_exclusive_scan(flags.begin(), flags.end(), result.begin(), std::size_t{0}, std::plus<>{}, pool);
+    std::cout << "exclusive scan of " << flags.size() << " uint8_t flags into size_t, last " << result.back() << ", "
+              << ((result == expected) ? "same" : "different") << " as std::exclusive_scan\n";
+}
+
+template<typename Executor>
+void printScanBenchmarks(const std::size_t max_elems, Executor & pool) {
+    std::cout << "=== Prefix sums of uint32_t, " << pool.concurrency() << " threads ===\n";
+    std::cout << std::setw(12) << "elements" << std::setw(28) << "" << std::setw(10) << "ms"
+              << std::setw(12) << "ns/element" << std::setw(10) << "GB/s" << '\n';
+    for(std::size_t num_elems = 10'000'000; num_elems <= max_elems; num_elems *= 10) {
+        printScanBenchmark(num_elems, pool);
+    }
+
+    std::cout << "\n=== Non-Commutative Operations ===\n";
+    printNonCommutativeOperation();
+
+    std::cout << "\n=== Narrow input, wide init ===\n";
+    printWideAccumulator(pool);
+}
+
+int main(int argc, char * argv[]) {
+    const std::size_t max_elems = (argc > 1) ? std::stoull(argv[1]) : 100'000'000;
+    const unsigned threads = (argc > 2) ? static_cast<unsigned>(std::stoul(argv[2])) : 4;
+
+    // the calling thread is one of them, a thread_pool has at least one worker
+    if(threads <= 1) {
+        inline_executor caller;
+        printScanBenchmarks(max_elems, caller);
+    } else {
+        thread_pool pool(threads - 1);
+        printScanBenchmarks(max_elems, pool);
+    }
+
+    std::cout << "\n=== Histogram to offsets ===\n";
+    std::vector<std::uint32_t> values(1'000'000);
+    std::iota(values.begin(), values.end(), 0);
+    const auto offsets = histogramToOffsets(values, 6);
+    for(auto o : offsets) {
+        std::cout << o << ' ';
+    }
+    std::cout << '\n';
+
+    std::cout << "\n=== Stream compaction ===\n";
+    const auto kept = compact(values, [](std::uint32_t v) { return v % 7 == 3; });
+    std::cout << "kept " << kept.size() << " elements, first " << kept.front() << ", last " << kept.back() << '\n';
+    return 0;
+}
+
+/**********
+
+Explanation
+
+On a single core the 4 blocks run one after the other, the parallel scan does the work of pass 1 on top
+of the sequential scan: at 100M about 1.4 ns per element against 1.0 to 1.2, pass 1 (simd) costs about a third
+of pass 2. At 10M the two are within the noise of each other, part of a block read by pass 1 is still
+in the cache for pass 2.
+With N cores pass 1 and pass 2 each take 1/N of the time, the scan is then limited by the memory bandwidth,
+reading the input twice (pass 1 and pass 2) is what remains of the extra work.
+
+The running maximum is slower, its pass 1 is a scalar loop calling the operation.
+
+In place the output is the input, pass 2 writes the lines it just read, a bit less memory traffic.
+
+The sums of the blocks and their offsets are of the type of init, like the accumulator of std::exclusive_scan:
+uint8_t flags scanned into size_t positions count to 699050, block sums of uint8_t would wrap at 256.
+
+Output (g++ -O2 -std=c++20 -pthread, ./parallel_scan on a single core machine)
+=== Prefix sums of uint32_t, 4 threads ===
+    elements                                    ms  ns/element      GB/s
+    10000000         std::inclusive_scan     10.55        1.06      7.58  ok
+    10000000     parallel_inclusive_scan     10.36        1.04      7.72  ok
+    10000000     parallel_exclusive_scan     10.70        1.07      7.48  ok
+    10000000 parallel_inclusive_scan max     15.84        1.58      5.05  ok
+    10000000                    in place      8.97        0.90      8.92  ok
+   100000000         std::inclusive_scan    100.62        1.01      7.95  ok
+   100000000     parallel_inclusive_scan    141.09        1.41      5.67  ok
+   100000000     parallel_exclusive_scan    136.47        1.36      5.86  ok
+   100000000 parallel_inclusive_scan max    192.59        1.93      4.15  ok
+   100000000                    in place    122.39        1.22      6.54  ok
+
+=== Non-Commutative Operations ===
+matrix product scan of 1048576 elements same as std::inclusive_scan
+
+=== Narrow input, wide init ===
+exclusive scan of 1048576 uint8_t flags into size_t, last 699050, same as std::exclusive_scan
+
+=== Histogram to offsets ===
+0 166667 333334 500001 666668 833334 
+
+=== Stream compaction ===
+kept 142857 elements, first 3, last 999995
+
+*************/
+
+/**********
+    END OF FILE
+*************/
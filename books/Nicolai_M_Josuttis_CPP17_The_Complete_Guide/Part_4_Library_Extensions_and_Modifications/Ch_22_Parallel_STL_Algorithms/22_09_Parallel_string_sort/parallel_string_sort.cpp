@@ -0,0 +1,412 @@
+/**********
+
+References
+
+    C++17 - The Complete Guide | Nicolai M. Josuttis
+    https://en.cppreference.com/w/cpp/algorithm/sort
+    Sinha, Zobel - Cache-conscious sorting of large sets of strings with dynamic tries
+    Bingmann, Sanders - Parallel String Sample Sort
+
+Chapter 22 Parallel STL Algorithms
+
+22.9 Parallel string sort
+
+    Sorting a std::vector<std::string> with std::sort (22.2, execution_policies.cpp)
+    compares whole strings: every comparison follows the pointers of two strings to their characters
+    (when they are longer than the small string buffer), cache misses all over the heap,
+    and compares again all the characters the two strings have in common.
+
+    parallel_string_sort() sorts small entries instead of the strings:
+        entry       the index of the string and 8 of its characters from the current depth,
+                    big endian in a uint64_t, so comparing the integers compares the characters
+        group       entries sorted by their key, the entries with equal keys make a run,
+                    the strings of a run have the same 8 characters at this depth
+        run         the strings ending in the key are done (shortest first),
+                    the others are sorted again as a group at depth + 8
+        -> a string is read once per 8 characters it shares with others, not once per comparison
+        -> the comparisons of the key sort are integer comparisons of entries next to each other
+
+    Parallel recursion on buckets
+        a large group is split in buckets by key (splitters from a sorted sample, as in samplesort),
+        the entries with equal keys are always in the same bucket, every bucket is a task
+        of the thread pool (executor.hpp) which sorts it and its runs, a large run is split again.
+        The keys equal to a splitter have a bucket of their own, it is one run already:
+        most URLs start with the same 8 characters, they are not sorted at this depth.
+        A task waiting for its buckets runs other tasks of the pool meanwhile (task_group).
+
+    At the end the strings are moved to their place following the sorted entries,
+    the strings themselves are never compared.
+
+Usage
+    g++ -O2 -std=c++20 -pthread parallel_string_sort.cpp -ltbb      (-ltbb for std::execution::par)
+    ./parallel_string_sort [strings] [threads]
+
+*************/
+
+#include <iostream>
+#include <vector>
+#include <execution>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <memory>
+#include <cstdio>
+#include <utility>
+
+#include <string>
+#include <chrono>
+
+#include "executor.hpp"
+
+class Timer {
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_stop;
+
+    public:
+    void start()    { m_start = std::chrono::steady_clock::now();   }
+    void stop()     { m_stop = std::chrono::steady_clock::now();    }
+
+    double milliseconds() const { return std::chrono::duration<double, std::milli>{m_stop - m_start}.count(); }
+};
+
+constexpr std::size_t parallel_threshold = 1 << 15;
+constexpr std::size_t small_group = 16;
+constexpr std::size_t oversampling = 32;
+
+// 16 bytes with a uint32_t index too (padding): size_t costs nothing and takes more than 4G strings
+struct Entry {
+    std::uint64_t key;
+    std::size_t index;
+};
+
+// the 8 characters from depth, big endian, 0 after the end of the string
+std::uint64_t keyAt(const std::string & str, std::size_t depth) {
+    unsigned char bytes[8] = {};
+    if(depth < str.size()) {
+        std::memcpy(bytes, str.data() + depth, std::min<std::size_t>(8, str.size() - depth));
+    }
+    std::uint64_t key;
+    std::memcpy(&key, bytes, 8);
+    return __builtin_bswap64(key);
+}
+
+template<typename Executor>
+std::size_t blocksCount(std::size_t length, Executor & executor) {
+    return std::max<std::size_t>(1, std::min(executor.concurrency(), length / parallel_threshold));
+}
+
+// func(b, begin, end) on one block per thread, the calling thread takes the first one
+template<typename Executor, typename Func>
+void forBlocks(std::size_t length, Executor & executor, Func func) {
+    const std::size_t blocks_count = blocksCount(length, executor);
+    const std::size_t block_size = (length + blocks_count - 1) / blocks_count;
+    task_group<Executor> group(executor);
+    for(std::size_t b = 1; b < blocks_count; ++b) {
+        group.run([&func, b, block_size, length] { func(b, std::min(b * block_size, length), std::min((b + 1) * block_size, length)); });
+    }
+    func(0, 0, std::min(block_size, length));
+    group.wait();
+}
+
+template<typename Executor>
+class StringSorter {
+    const std::string * m_strings;
+    Executor & m_executor;
+
+    bool endsInKey(const Entry & entry, std::size_t depth) const {
+        return m_strings[entry.index].size() <= depth + 8;
+    }
+
+    void loadKeys(Entry * first, Entry * last, std::size_t depth) const {
+        for(; first != last; ++first) {
+            first->key = keyAt(m_strings[first->index], depth);
+        }
+    }
+
+    // a few strings, compared from depth on
+    void sortSmall(Entry * first, Entry * last, std::size_t depth) const {
+        std::sort(first, last, [this, depth](const Entry & a, const Entry & b) {
+            if(a.key != b.key) {
+                return a.key < b.key;
+            }
+            return m_strings[a.index].compare(depth, std::string::npos, m_strings[b.index], depth, std::string::npos) < 0;
+        });
+    }
+
+    // the entries are sorted by key, every run of equal keys is sorted at the next depth
+    void sortRuns(Entry * first, Entry * last, std::size_t depth) {
+        while(first != last) {
+            Entry * run_end = std::find_if(first + 1, last, [key = first->key](const Entry & e) { return e.key != key; });
+            if(run_end - first > 1) {
+                // the strings ending here are equal but for trailing '\0' characters, the shortest first
+                Entry * done_end = std::partition(first, run_end, [&](const Entry & e) { return endsInKey(e, depth); });
+                std::sort(first, done_end, [this](const Entry & a, const Entry & b) {
+                    return m_strings[a.index].size() < m_strings[b.index].size();
+                });
+                if(run_end - done_end > 1) {
+                    sortGroup(done_end, run_end, depth + 8);
+                }
+            }
+            first = run_end;
+        }
+    }
+
+    void sortBucket(Entry * first, Entry * last, std::size_t depth) {
+        if(last - first <= static_cast<std::ptrdiff_t>(small_group)) {
+            sortSmall(first, last, depth);
+            return;
+        }
+        std::sort(first, last, [](const Entry & a, const Entry & b) { return a.key < b.key; });
+        sortRuns(first, last, depth);
+    }
+
+    // samplesort on the keys, the buckets are sorted by the tasks of the executor
+    void sortParallel(Entry * first, Entry * last, std::size_t depth) {
+        const std::size_t length = last - first;
+        // at most 2 * 127 + 1 buckets with the equal ones, the bucket of an entry fits in a byte
+        const std::size_t buckets_count = std::min<std::size_t>(4 * m_executor.concurrency(), 128);
+
+        std::vector<std::uint64_t> sample;
+        std::minstd_rand random(static_cast<std::minstd_rand::result_type>(length + depth));
+        std::uniform_int_distribution<std::size_t> position(0, length - 1);
+        for(std::size_t i = 0; i < buckets_count * oversampling; ++i) {
+            sample.push_back(first[position(random)].key);
+        }
+        std::sort(sample.begin(), sample.end());
+        std::vector<std::uint64_t> splitters;
+        for(std::size_t k = 1; k < buckets_count; ++k) {
+            splitters.push_back(sample[k * oversampling]);
+        }
+        splitters.erase(std::unique(splitters.begin(), splitters.end()), splitters.end());
+
+        // bucket 2k + 1 holds the keys equal to splitter k: they make one run, not sorted at this depth
+        // (the 8 first characters of most URLs, "https://")
+        const std::size_t buckets = 2 * splitters.size() + 1;
+        auto bucketOf = [&splitters](std::uint64_t key) {
+            const auto pos = std::lower_bound(splitters.begin(), splitters.end(), key);
+            const std::size_t k = pos - splitters.begin();
+            return (pos != splitters.end() and *pos == key) ? 2 * k + 1 : 2 * k;
+        };
+
+        // every block counts its entries per bucket, then moves them to its ranges of the buckets
+        std::vector<std::uint8_t> bucket_of(length);
+        std::vector<std::vector<std::size_t>> counts(blocksCount(length, m_executor), std::vector<std::size_t>(buckets));
+        forBlocks(length, m_executor, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            for(std::size_t i = begin; i < end; ++i) {
+                bucket_of[i] = static_cast<std::uint8_t>(bucketOf(first[i].key));
+                ++counts[b][bucket_of[i]];
+            }
+        });
+        std::vector<std::size_t> bucket_begin(buckets + 1);
+        std::size_t offset = 0;
+        for(std::size_t k = 0; k < buckets; ++k) {
+            bucket_begin[k] = offset;
+            for(auto & block_counts : counts) {
+                offset += std::exchange(block_counts[k], offset);
+            }
+        }
+        bucket_begin[buckets] = length;
+
+        std::vector<Entry> buffer(length);
+        forBlocks(length, m_executor, [&](std::size_t b, std::size_t begin, std::size_t end) {
+            for(std::size_t i = begin; i < end; ++i) {
+                buffer[counts[b][bucket_of[i]]++] = first[i];
+            }
+        });
+        forBlocks(length, m_executor, [&](std::size_t, std::size_t begin, std::size_t end) {
+            std::copy(buffer.begin() + begin, buffer.begin() + end, first + begin);
+        });
+
+        task_group<Executor> group(m_executor);
+        for(std::size_t k = 1; k < buckets; ++k) {
+            if(bucket_begin[k + 1] - bucket_begin[k] < 2) {
+                continue;
+            }
+            group.run([this, first, depth, k, b = bucket_begin[k], e = bucket_begin[k + 1]] {
+                if(k % 2) {
+                    sortRuns(first + b, first + e, depth);
+                }
+                else {
+                    sortBucket(first + b, first + e, depth);
+                }
+            });
+        }
+        sortBucket(first + bucket_begin[0], first + bucket_begin[1], depth);
+        group.wait();
+    }
+
+    public:
+    StringSorter(const std::string * strings, Executor & executor) : m_strings{strings}, m_executor{executor} {}
+
+    // the keys of the entries are the ones of depth, loaded by the caller for the first group
+    void sortGroup(Entry * first, Entry * last, std::size_t depth, bool keys_loaded = false) {
+        const std::size_t length = last - first;
+        if((length < parallel_threshold) or (m_executor.concurrency() == 1)) {
+            if(not keys_loaded) {
+                loadKeys(first, last, depth);
+            }
+            sortBucket(first, last, depth);
+            return;
+        }
+        if(not keys_loaded) {
+            forBlocks(length, m_executor, [&](std::size_t, std::size_t begin, std::size_t end) {
+                loadKeys(first + begin, first + end, depth);
+            });
+        }
+        sortParallel(first, last, depth);
+    }
+};
+
+template<typename Executor = thread_pool>
+void parallel_string_sort(std::vector<std::string> & strings, Executor & executor = default_executor()) {
+    const std::size_t length = strings.size();
+    std::vector<Entry> entries(length);
+    forBlocks(length, executor, [&](std::size_t, std::size_t begin, std::size_t end) {
+        for(std::size_t i = begin; i < end; ++i) {
+            entries[i] = Entry{keyAt(strings[i], 0), i};
+        }
+    });
+
+    StringSorter<Executor> sorter(strings.data(), executor);
+    sorter.sortGroup(entries.data(), entries.data() + length, 0, true);
+
+    std::vector<std::string> sorted(length);
+    forBlocks(length, executor, [&](std::size_t, std::size_t begin, std::size_t end) {
+        for(std::size_t i = begin; i < end; ++i) {
+            sorted[i] = std::move(strings[entries[i].index]);
+        }
+    });
+    strings.swap(sorted);
+}
+
+std::vector<std::string> makeUrls(std::size_t count) {
+    const std::string hosts[] = {"https://www.example.com", "https://shop.example.com", "https://api.example.org",
+                                 "http://cdn.static-content.net", "https://docs.example.com"};
+    const std::string paths[] = {"/products/", "/search?q=", "/v2/users/", "/assets/img/", "/articles/2024/"};
+    std::mt19937_64 random(1);
+    std::vector<std::string> coll;
+    coll.reserve(count);
+    for(std::size_t i = 0; i < count; ++i) {
+        const auto r = random();
+        coll.push_back(hosts[r % 5] + paths[(r >> 8) % 5] + std::to_string((r >> 16) % 1000000) + "/item-" + std::to_string(r >> 40));
+    }
+    return coll;
+}
+
+std::vector<std::string> makeLogLines(std::size_t count) {
+    const std::string levels[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+    const std::string services[] = {"auth", "billing", "gateway", "search", "storage", "users"};
+    std::mt19937_64 random(2);
+    std::vector<std::string> coll;
+    coll.reserve(count);
+    std::uint64_t millis = 0;
+    for(std::size_t i = 0; i < count; ++i) {
+        const auto r = random();
+        millis += r % 7;
+        const auto seconds = millis / 1000;
+        char time_stamp[32];
+        std::snprintf(time_stamp, sizeof(time_stamp), "2024-05-01T%02u:%02u:%02u.%03uZ ",
+                      unsigned(seconds / 3600 % 24), unsigned(seconds / 60 % 60), unsigned(seconds % 60), unsigned(millis % 1000));
+        coll.push_back(time_stamp + levels[r % 4] + " [" + services[(r >> 8) % 6] + "] request id="
+                       + std::to_string((r >> 16) % 100000000) + " took " + std::to_string((r >> 48) % 500) + " ms");
+    }
+    // the lines of several servers, merged in any order
+    std::shuffle(coll.begin(), coll.end(), random);
+    return coll;
+}
+
+// the result is compared with the one of the first sort, std::sort
+template<typename Sort>
+void printSort(const std::string & name, const std::vector<std::string> & input, std::vector<std::string> & expected, Sort sort) {
+    Timer bt_time;
+    std::vector<std::string> coll = input;
+    bt_time.start();
+    sort(coll);
+    bt_time.stop();
+    if(expected.empty()) {
+        expected = coll;
+    }
+    std::cout << std::setw(28) << name << std::fixed << std::setprecision(1) << std::setw(12) << bt_time.milliseconds()
+              << ((coll == expected) ? "  ok" : "  WRONG") << '\n';
+}
+
+template<typename Executor>
+void printBenchmark(const std::string & title, const std::vector<std::string> & input, Executor & pool) {
+    std::cout << input.size() << ' ' << title << ", e.g. " << input.front() << "\nmilliseconds\n";
+    std::vector<std::string> expected;
+    printSort("std::sort", input, expected, [](auto & coll) { std::sort(coll.begin(), coll.end()); });
+    printSort("std::sort(par)", input, expected, [](auto & coll) { std::sort(std::execution::par, coll.begin(), coll.end()); });
+    printSort("parallel_string_sort", input, expected, [&](auto & coll) { parallel_string_sort(coll, pool); });
+    inline_executor one_thread;
+    printSort("parallel_string_sort, inline", input, expected, [&](auto & coll) { parallel_string_sort(coll, one_thread); });
+    std::cout << '\n';
+}
+
+template<typename Executor>
+void printBenchmarks(const std::size_t num_elems, Executor & pool) {
+    std::cout << "=== Parallel string sort, " << pool.concurrency() << " threads ===\n";
+    printBenchmark("URLs", makeUrls(num_elems), pool);
+    printBenchmark("log lines", makeLogLines(num_elems), pool);
+}
+
+int main(int argc, char * argv[]) {
+    const std::size_t num_elems = (argc > 1) ? std::stoull(argv[1]) : 5'000'000;
+    const unsigned threads = (argc > 2) ? static_cast<unsigned>(std::stoul(argv[2])) : 4;
+
+    // the calling thread is one of them, a thread_pool has at least one worker
+    if(threads <= 1) {
+        inline_executor caller;
+        printBenchmarks(num_elems, caller);
+    } else {
+        thread_pool pool(threads - 1);
+        printBenchmarks(num_elems, pool);
+    }
+
+    // the same characters with '\0' at the end, shorter first
+    std::vector<std::string> zeros{std::string("ab\0\0", 4), "b", std::string("ab\0", 3), "ab", "", std::string("\0", 1)};
+    parallel_string_sort(zeros);
+    std::cout << "strings with '\\0' " << (std::is_sorted(zeros.begin(), zeros.end()) ? "sorted" : "NOT SORTED") << '\n';
+    return 0;
+}
+
+/**********
+
+Explanation
+
+On one core the pool runs the buckets one after the other, the gain is the one of the sort itself:
+1.5 times faster than std::sort on the URLs, 2 times on the log lines.
+std::sort compares the strings from their first character every time, a log line shares its first
+14 characters (the date and the hour) with most of the others, an URL its first 20 to 35.
+parallel_string_sort reads these characters once per 8 per string and sorts 16 bytes entries in between.
+
+The URLs go deeper (the host, then the path, then the number), a level has only a few distinct keys
+and the strings are read once per level, the log lines are split by the time stamp after two levels.
+
+With more cores the buckets and the blocks of the classification run at the same time,
+std::sort(par) of libstdc++ (TBB) parallelizes the std::sort on the left.
+
+Output (g++ -O2 -std=c++20 -pthread parallel_string_sort.cpp -ltbb, ./parallel_string_sort on a single core machine)
+=== Parallel string sort, 4 threads ===
+5000000 URLs, e.g. http://cdn.static-content.net/articles/2024/255528/item-2246077
+milliseconds
+                   std::sort      5477.6  ok
+              std::sort(par)      5253.2  ok
+        parallel_string_sort      3621.9  ok
+parallel_string_sort, inline      3903.5  ok
+
+5000000 log lines, e.g. 2024-05-01T02:49:20.917Z ERROR [users] request id=65332308 took 402 ms
+milliseconds
+                   std::sort      4826.6  ok
+              std::sort(par)      4598.2  ok
+        parallel_string_sort      2342.8  ok
+parallel_string_sort, inline      2363.2  ok
+
+strings with '\0' sorted
+
+*************/
+
+/**********
+    END OF FILE
+*************/
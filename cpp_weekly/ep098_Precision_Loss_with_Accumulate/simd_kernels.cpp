@@ -0,0 +1,313 @@
+/*****
+
+References
+    https://en.cppreference.com/w/cpp/algorithm/accumulate
+    https://en.cppreference.com/w/cpp/algorithm/inner_product
+
+std::accumulate and std::inner_product add one element after the other:
+    -> a single chain of dependent additions, one addition per 4 cycles for float or double,
+       GCC may not vectorize it without -ffast-math since the order of the additions changes the result
+    -> the error of a float sum grows with n, once the sum is large its ulp is larger than the elements
+
+simd_kernels.hpp computes sum, dot, minmax and axpy with vectors selected at run time (CPUID),
+float and double sums can be plain, pairwise or compensated (Kahan).
+
+This program
+    -> checks every kernel on every instruction set against the scalar loops, sizes 0 to 300 (the tails)
+    -> compares the accuracy of the summations on 10 million floats
+    -> measures the throughput in elements per nanosecond, 4096 elements (in the L1/L2 caches)
+       and 16M elements (in memory)
+
+Usage
+    g++ -O2 -std=c++20 simd_kernels.cpp
+    ./simd_kernels [large_size]
+
+**********/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "simd_kernels.hpp"
+
+namespace sk = simd_kernels;
+
+volatile double g_sink;
+
+std::vector<sk::isa> available_isas() {
+    std::vector<sk::isa> l_isas;
+    for (auto i : {sk::isa::scalar, sk::isa::sse4_2, sk::isa::avx2, sk::isa::avx512}) {
+        if (i <= sk::detected_isa()) {
+            l_isas.push_back(i);
+        }
+    }
+    return l_isas;
+}
+
+template <typename T>
+std::vector<T> random_values(const std::size_t n, std::mt19937 &gen) {
+    std::vector<T> l_values(n);
+    if constexpr (std::is_integral_v<T>) {
+        std::uniform_int_distribution<T> l_dist(-1000, 1000);
+        std::generate(l_values.begin(), l_values.end(), [&] { return l_dist(gen); });
+    } else {
+        std::uniform_real_distribution<T> l_dist(-1, 1);
+        std::generate(l_values.begin(), l_values.end(), [&] { return l_dist(gen); });
+    }
+    return l_values;
+}
+
+template <typename T>
+bool close(const T result, const T expected, const T magnitude) {
+    if constexpr (std::is_integral_v<T>) {
+        return result == expected;
+    } else {
+        return std::abs(result - expected) <= magnitude * 1e-4;
+    }
+}
+
+// every kernel, isa and summation against the scalar loops
+template <typename T>
+bool check(std::mt19937 &gen) {
+    bool l_ok = true;
+    for (std::size_t n = 0; n <= 300; ++n) {
+        const auto l_x = random_values<T>(n, gen);
+        const auto l_y = random_values<T>(n, gen);
+        T l_sum{}, l_dot{}, l_magnitude{1};
+        for (std::size_t k = 0; k < n; ++k) {
+            l_sum += l_x[k];
+            l_dot += l_x[k] * l_y[k];
+            l_magnitude += std::abs(l_x[k]);
+        }
+        for (auto i : available_isas()) {
+            for (auto s : {sk::summation::plain, sk::summation::pairwise, sk::summation::kahan}) {
+                l_ok &= close(sk::sum(l_x.data(), n, s, i), l_sum, l_magnitude);
+                l_ok &= close(sk::dot(l_x.data(), l_y.data(), n, s, i), l_dot, l_magnitude * 1000);
+            }
+            if (n > 0) {
+                const auto [l_min, l_max] = std::minmax_element(l_x.begin(), l_x.end());
+                l_ok &= (sk::minmax(l_x.data(), n, i) == std::pair(*l_min, *l_max));
+            }
+            auto l_axpy = l_y;
+            sk::axpy(T(3), l_x.data(), l_axpy.data(), n, i);
+            for (std::size_t k = 0; k < n; ++k) {
+                l_ok &= close<T>(l_axpy[k], l_y[k] + T(3) * l_x[k], 10);
+            }
+        }
+    }
+    return l_ok;
+}
+
+void accuracy(const std::size_t n) {
+    std::mt19937 l_gen(7);
+    std::uniform_real_distribution<float> l_dist(0, 1);
+    std::vector<float> l_x(n);
+    std::generate(l_x.begin(), l_x.end(), [&] { return l_dist(l_gen); });
+    const long double l_exact = std::accumulate(l_x.begin(), l_x.end(), 0.0L);
+
+    std::cout << "=== sum of " << n << " floats in [0, 1) ===\n"
+              << std::left << std::setw(32) << "method" << std::right << std::setw(16) << "sum" << std::setw(18)
+              << "relative error" << '\n';
+    auto print = [&](const std::string &method, const long double sum) {
+        std::cout << std::left << std::setw(32) << method << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(16) << static_cast<double>(sum) << std::scientific << std::setw(18)
+                  << static_cast<double>(std::abs(sum - l_exact) / l_exact) << std::defaultfloat << '\n';
+    };
+    print("long double accumulate (exact)", l_exact);
+    print("std::accumulate, float", std::accumulate(l_x.begin(), l_x.end(), 0.0f));
+    print("std::accumulate, double init", std::accumulate(l_x.begin(), l_x.end(), 0.0));
+    for (auto i : {sk::isa::scalar, sk::detected_isa()}) {
+        const std::string l_isa = std::string(", ") + sk::to_string(i);
+        print("plain" + l_isa, sk::sum(l_x.data(), n, sk::summation::plain, i));
+        print("pairwise" + l_isa, sk::sum(l_x.data(), n, sk::summation::pairwise, i));
+        print("kahan" + l_isa, sk::sum(l_x.data(), n, sk::summation::kahan, i));
+    }
+    std::cout << '\n';
+}
+
+// elements per nanosecond, the best of 3 runs of at least 2^26 elements
+double elements_per_ns(const std::size_t n, const std::function<void()> &func) {
+    const std::size_t l_reps = std::max<std::size_t>(1, (std::size_t{1} << 26) / n);
+    double l_best = 0;
+    for (int r = 0; r < 3; ++r) {
+        const auto l_start = std::chrono::steady_clock::now();
+        for (std::size_t k = 0; k < l_reps; ++k) {
+            func();
+        }
+        const std::chrono::duration<double, std::nano> l_elapsed = std::chrono::steady_clock::now() - l_start;
+        l_best = std::max(l_best, static_cast<double>(n * l_reps) / l_elapsed.count());
+    }
+    return l_best;
+}
+
+template <typename T>
+void benchmark(const std::string &type_name, const std::size_t n) {
+    std::mt19937 l_gen(11);
+    const auto l_x = random_values<T>(n, l_gen);
+    auto l_y = random_values<T>(n, l_gen);
+    const T *x = l_x.data();
+    T *y = l_y.data();
+    const auto l_isas = available_isas();
+
+    std::cout << type_name << ", " << n << " elements, elements/ns\n" << std::left << std::setw(14) << "" << std::right
+              << std::setw(9) << "std";
+    for (auto i : l_isas) {
+        std::cout << std::setw(9) << sk::to_string(i);
+    }
+    std::cout << '\n';
+
+    auto row = [&](const std::string &name, std::function<void()> standard, auto kernel) {
+        std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(2);
+        if (standard) {
+            std::cout << std::setw(9) << elements_per_ns(n, standard);
+        } else {
+            std::cout << std::setw(9) << "-";
+        }
+        for (auto i : l_isas) {
+            std::cout << std::setw(9) << elements_per_ns(n, [&] { kernel(i); });
+        }
+        std::cout << std::defaultfloat << '\n';
+    };
+
+    row("sum", [&] { g_sink = std::accumulate(x, x + n, T{}); },
+        [&](sk::isa i) { g_sink = sk::sum(x, n, sk::summation::plain, i); });
+    if constexpr (std::is_floating_point_v<T>) {
+        row("sum pairwise", {}, [&](sk::isa i) { g_sink = sk::sum(x, n, sk::summation::pairwise, i); });
+        row("sum kahan", {}, [&](sk::isa i) { g_sink = sk::sum(x, n, sk::summation::kahan, i); });
+    }
+    row("dot", [&] { g_sink = std::inner_product(x, x + n, y, T{}); },
+        [&](sk::isa i) { g_sink = sk::dot(x, y, n, sk::summation::plain, i); });
+    if constexpr (std::is_floating_point_v<T>) {
+        row("dot kahan", {}, [&](sk::isa i) { g_sink = sk::dot(x, y, n, sk::summation::kahan, i); });
+    }
+    row("minmax", [&] { g_sink = *std::minmax_element(x, x + n).first; },
+        [&](sk::isa i) { g_sink = sk::minmax(x, n, i).first; });
+    // y grows by 3 x at every call, far from overflow for the number of repetitions
+    row("axpy", [&] { std::transform(x, x + n, y, y, [](T a, T b) { return b + T(3) * a; }); },
+        [&](sk::isa i) { sk::axpy(T(3), x, y, n, i); });
+    std::cout << '\n';
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t large_size = (argc > 1) ? std::stoul(argv[1]) : (std::size_t{1} << 24);
+
+    std::cout << "detected instruction set: " << sk::to_string(sk::detected_isa()) << "\n\n";
+
+    std::mt19937 l_gen(3);
+    const bool l_ok = check<std::int32_t>(l_gen) and check<float>(l_gen) and check<double>(l_gen);
+    std::cout << "kernels agree with the scalar loops: " << (l_ok ? "yes" : "NO") << "\n\n";
+
+    accuracy(10'000'000);
+
+    for (const std::size_t n : {std::size_t{4096}, large_size}) {
+        benchmark<std::int32_t>("int32", n);
+        benchmark<float>("float", n);
+        benchmark<double>("double", n);
+    }
+
+    return 0;
+}
+
+/*****
+Explanation
+
+Accuracy: the float closest to the exact sum is 5001049.5, a relative error of 4.3e-08.
+std::accumulate in float is 400 times farther: after a few million elements the ulp of the sum is 0.5,
+every addition of a value in [0, 1) rounds by up to 0.25. The plain kernels are better only because
+they split the sum in 4 x lanes partial sums. Pairwise and Kahan reach the closest float on every isa.
+
+Throughput in the caches (4096 elements): std::accumulate adds one element per addition latency
+(about 1 per ns), the kernels add 4 x lanes independent partial sums:
+    -> float sum 24 to 27 per ns with avx2/avx512, more than 20 times std::accumulate
+    -> dot needs two loads per element, 11 to 12 per ns; double dot reads 64 KiB, more than L1
+    -> Kahan costs 4 operations per element, 8 to 9 per ns with avx512, still 8 times std::accumulate
+    -> avx512 is not faster than avx2 for sum, the loads (2 per cycle) are the limit, minmax gains from the masks
+
+Throughput in memory (16M elements): every kernel reads at the bandwidth of the machine, about 10 GB/s
+(2.7 floats or 1.35 doubles per ns), the instruction set matters less and Kahan is almost free.
+A big float dot product (the feature scoring) runs 2 times faster than std::inner_product from memory,
+12 times faster when the vectors stay in the caches.
+
+Output (g++ -O2 -std=c++20, ./simd_kernels on a single core machine)
+detected instruction set: avx512
+
+kernels agree with the scalar loops: yes
+
+=== sum of 10000000 floats in [0, 1) ===
+method                                       sum    relative error
+long double accumulate (exact)        5001049.72          0.00e+00
+std::accumulate, float                5001142.50          1.86e-05
+std::accumulate, double init          5001049.72          4.70e-15
+plain, scalar                         5001066.00          3.26e-06
+pairwise, scalar                      5001049.50          4.30e-08
+kahan, scalar                         5001049.50          4.30e-08
+plain, avx512                         5001045.00          9.43e-07
+pairwise, avx512                      5001049.50          4.30e-08
+kahan, avx512                         5001049.50          4.30e-08
+
+int32, 4096 elements, elements/ns
+                    std   scalar   sse4.2     avx2   avx512
+sum                1.02     3.00    10.56    28.22    25.13
+dot                1.22     1.95     5.24     9.98    10.93
+minmax             1.13     1.22     5.78    13.09    15.83
+axpy               1.07     1.25     6.17     7.31     9.08
+
+float, 4096 elements, elements/ns
+                    std   scalar   sse4.2     avx2   avx512
+sum                1.17     4.25     9.30    26.72    24.16
+sum pairwise          -     2.97     9.19    17.51    18.56
+sum kahan             -     0.84     3.18     6.48     8.90
+dot                0.84     3.91     5.81    12.07    11.31
+dot kahan             -     0.81     2.94     5.55     8.29
+minmax             1.01     0.94     3.55     7.31    16.60
+axpy               1.05     2.47     5.29     7.98    10.64
+
+double, 4096 elements, elements/ns
+                    std   scalar   sse4.2     avx2   avx512
+sum                1.08     4.25     6.45    14.09    12.70
+sum pairwise          -     2.77     5.08    10.33    11.33
+sum kahan             -     0.90     1.81     3.71     5.10
+dot                1.15     2.57     3.40     3.80     2.90
+dot kahan             -     0.82     1.32     3.08     3.13
+minmax             1.16     0.95     1.86     4.68     8.58
+axpy               1.03     1.40     2.15     2.75     2.88
+
+int32, 16777216 elements, elements/ns
+                    std   scalar   sse4.2     avx2   avx512
+sum                1.02     1.44     1.96     2.32     2.71
+dot                0.86     0.98     1.19     1.31     1.34
+minmax             0.92     0.95     1.63     1.86     2.26
+axpy               0.79     0.84     1.04     1.31     1.26
+
+float, 16777216 elements, elements/ns
+                    std   scalar   sse4.2     avx2   avx512
+sum                0.90     1.26     1.22     1.95     2.56
+sum pairwise          -     1.24     1.81     2.20     2.72
+sum kahan             -     0.81     1.34     1.70     2.00
+dot                0.76     1.12     1.19     1.35     1.47
+dot kahan             -     0.70     1.07     1.28     1.36
+minmax             0.22     0.83     1.64     2.18     2.20
+axpy               0.88     0.98     1.09     1.28     1.39
+
+double, 16777216 elements, elements/ns
+                    std   scalar   sse4.2     avx2   avx512
+sum                0.61     0.87     0.94     1.12     1.36
+sum pairwise          -     0.79     0.99     1.19     1.31
+sum kahan             -     0.57     0.69     0.89     1.03
+dot                0.54     0.62     0.61     0.69     0.75
+dot kahan             -     0.50     0.57     0.66     0.70
+minmax             0.22     0.60     0.73     1.00     1.03
+axpy               0.48     0.51     0.55     0.68     0.70
+**********/
+
+/*****
+    END OF FILE
+**********/
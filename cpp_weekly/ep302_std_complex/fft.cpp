@@ -0,0 +1,320 @@
+/**********
+
+    This example compares std::complex arrays with split complex buffers (fft.hpp) and a naive DFT
+    with the radix-4 FFT
+
+        check       the FFT against a DFT computed in long double, n from 2 to 4096 (odd and even log2 n),
+                    inverse(forward(x)) against x, multiply and add against std::complex
+        kernels     a * b and a + b on 4096 complex numbers: std::complex<float> arrays against split buffers
+        transforms  one signal of n points: naive DFT (n^2 complex multiply-adds, the twiddle factors from
+                    a table) against the FFT, in microseconds and GFLOP/s: 8 n^2 flops for the DFT
+                    (a complex multiply-add is 8), the usual 5 n log2(n) flops for the FFT
+        batch       signals of 4096 points, forward then inverse, sequential and std::execution::par
+
+    For more info visit:
+    https://en.cppreference.com/w/cpp/numeric/complex
+    https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm
+
+    Usage
+        g++ -O2 -std=c++20 fft.cpp -ltbb
+        ./fft [signals]         1000 signals by default
+
+**************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <execution>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fft.hpp"
+
+template <typename T>
+std::vector<std::complex<T>> random_signal(const std::size_t n, std::mt19937 & gen) {
+    std::uniform_real_distribution<T> dist(-1, 1);
+    std::vector<std::complex<T>> l_signal(n);
+    for(auto & value : l_signal) {
+        value = {dist(gen), dist(gen)};
+    }
+    return l_signal;
+}
+
+// X[k] = sum x[j] w^(j k mod n), the n twiddle factors from a table
+template <typename T>
+std::vector<std::complex<T>> naive_dft(const std::vector<std::complex<T>> & x) {
+    const std::size_t n = x.size();
+    std::vector<std::complex<T>> l_table(n);
+    for(std::size_t k = 0; k < n; ++k) {
+        l_table[k] = std::polar<T>(1, static_cast<T>(-2 * std::numbers::pi_v<long double> * k / n));
+    }
+    std::vector<std::complex<T>> l_result(n);
+    for(std::size_t k = 0; k < n; ++k) {
+        std::complex<T> l_sum{};
+        std::size_t l_index = 0;
+        for(std::size_t j = 0; j < n; ++j) {
+            l_sum += x[j] * l_table[l_index];
+            l_index = (l_index + k) & (n - 1);
+        }
+        l_result[k] = l_sum;
+    }
+    return l_result;
+}
+
+// the largest difference relative to the largest magnitude of expected
+template <typename T, typename U>
+double difference(const std::vector<std::complex<T>> & result, const std::vector<std::complex<U>> & expected) {
+    double l_diff = 0;
+    double l_max = 0;
+    for(std::size_t i = 0; i < expected.size(); ++i) {
+        const std::complex<double> l_expected(static_cast<double>(expected[i].real()), static_cast<double>(expected[i].imag()));
+        const std::complex<double> l_result(result[i].real(), result[i].imag());
+        l_diff = std::max(l_diff, std::abs(l_result - l_expected));
+        l_max = std::max(l_max, std::abs(l_expected));
+    }
+    return l_diff / l_max;
+}
+
+template <typename T>
+void check(const char * name) {
+    std::mt19937 gen(3);
+    double l_forward = 0;
+    double l_roundtrip = 0;
+    for(std::size_t n = 2; n <= 4096; n *= 2) {
+        const std::vector<std::complex<T>> l_x = random_signal<T>(n, gen);
+        std::vector<std::complex<long double>> l_wide(l_x.begin(), l_x.end());
+
+        fft::split_buffer<T> l_buffer(l_x);
+        fft::forward(l_buffer);
+        l_forward = std::max(l_forward, difference(l_buffer.to_complex(), naive_dft(l_wide)));
+        fft::inverse(l_buffer);
+        l_roundtrip = std::max(l_roundtrip, difference(l_buffer.to_complex(), l_x));
+    }
+
+    const std::vector<std::complex<T>> l_a = random_signal<T>(1001, gen);
+    const std::vector<std::complex<T>> l_b = random_signal<T>(1001, gen);
+    std::vector<std::complex<T>> l_product(l_a.size()), l_sum(l_a.size());
+    for(std::size_t i = 0; i < l_a.size(); ++i) {
+        l_product[i] = l_a[i] * l_b[i];
+        l_sum[i] = l_a[i] + l_b[i];
+    }
+    const fft::split_buffer<T> l_sa(l_a), l_sb(l_b);
+    fft::split_buffer<T> l_out(l_a.size());
+    fft::multiply(l_sa, l_sb, l_out);
+    const double l_multiply = difference(l_out.to_complex(), l_product);
+    fft::add(l_sa, l_sb, l_out);
+    const double l_add = difference(l_out.to_complex(), l_sum);
+
+    std::cout << std::setw(7) << name << ": forward against the DFT " << std::scientific << std::setprecision(1) << l_forward
+              << ", inverse(forward(x)) " << l_roundtrip << ", multiply " << l_multiply << ", add " << l_add
+              << std::defaultfloat << '\n';
+}
+
+volatile float g_sink;
+
+// seconds of one call, the best of 5 runs of at least about 0.05 s
+template <typename Func>
+double seconds(Func func) {
+    std::size_t l_reps = 1;
+    for(;;) {
+        const auto l_start = std::chrono::steady_clock::now();
+        for(std::size_t r = 0; r < l_reps; ++r) {
+            func();
+        }
+        const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+        if(l_elapsed.count() > 0.05) {
+            break;
+        }
+        l_reps *= 2;
+    }
+    double l_best = 0;
+    for(int run = 0; run < 5; ++run) {
+        const auto l_start = std::chrono::steady_clock::now();
+        for(std::size_t r = 0; r < l_reps; ++r) {
+            func();
+        }
+        const std::chrono::duration<double> l_elapsed = std::chrono::steady_clock::now() - l_start;
+        const double l_seconds = l_elapsed.count() / static_cast<double>(l_reps);
+        l_best = (run == 0) ? l_seconds : std::min(l_best, l_seconds);
+    }
+    return l_best;
+}
+
+void kernels() {
+    constexpr std::size_t n = 4096;
+    std::mt19937 gen(5);
+    const std::vector<std::complex<float>> l_a = random_signal<float>(n, gen);
+    const std::vector<std::complex<float>> l_b = random_signal<float>(n, gen);
+    std::vector<std::complex<float>> l_c(n);
+    const fft::split_buffer<float> l_sa(l_a), l_sb(l_b);
+    fft::split_buffer<float> l_sc(n);
+
+    auto row = [](const std::string & name, const double s, const double flops) {
+        std::cout << "    " << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(8) << s * 1e9 / n << " ns" << std::setprecision(2) << std::setw(8) << flops * n / s * 1e-9
+                  << " GFLOP/s" << std::defaultfloat << '\n';
+    };
+    std::cout << "\n4096 complex<float>, per element\n";
+    row("a * b, std::complex<float>[]", seconds([&] {
+        for(std::size_t i = 0; i < n; ++i) {
+            l_c[i] = l_a[i] * l_b[i];
+        }
+        g_sink = l_c[n / 2].real();
+    }), 6);
+    row("a * b, split_buffer", seconds([&] { fft::multiply(l_sa, l_sb, l_sc); g_sink = l_sc.re()[n / 2]; }), 6);
+    row("a + b, std::complex<float>[]", seconds([&] {
+        for(std::size_t i = 0; i < n; ++i) {
+            l_c[i] = l_a[i] + l_b[i];
+        }
+        g_sink = l_c[n / 2].real();
+    }), 2);
+    row("a + b, split_buffer", seconds([&] { fft::add(l_sa, l_sb, l_sc); g_sink = l_sc.re()[n / 2]; }), 2);
+}
+
+template <typename T>
+void transforms(const char * name) {
+    std::mt19937 gen(7);
+    std::cout << '\n' << name << ", one signal, microseconds (GFLOP/s)\n"
+              << std::setw(6) << "n" << std::setw(20) << "naive DFT" << std::setw(20) << "FFT" << std::setw(10) << "speedup\n";
+    for(std::size_t n = 64; n <= 4096; n *= 2) {
+        const std::vector<std::complex<T>> l_x = random_signal<T>(n, gen);
+        const double l_n = static_cast<double>(n);
+        const double l_dft_flops = 8.0 * l_n * l_n;
+        const double l_fft_flops = 5.0 * l_n * std::log2(l_n);
+        auto cell = [&](const double s, const double flops) {
+            std::ostringstream l_cell;
+            l_cell << std::fixed << std::setprecision(2) << s * 1e6 << " (" << flops / s * 1e-9 << ')';
+            return l_cell.str();
+        };
+
+        const double l_naive = seconds([&] { g_sink = static_cast<float>(naive_dft(l_x)[1].real()); });
+        fft::split_buffer<T> l_buffer(l_x);
+        // forward then inverse: the data stays the same from run to run (repeated forward transforms
+        // grow by up to n each time), half of it per transform, the inverse has the 1/n scaling more
+        const auto l_plan = fft::cached_plan<T>(n);
+        const double l_fft = seconds([&] {
+            l_plan->forward(l_buffer.re(), l_buffer.im());
+            l_plan->inverse(l_buffer.re(), l_buffer.im());
+            g_sink = static_cast<float>(l_buffer.re()[1]);
+        }) / 2;
+        std::cout << std::setw(6) << n << std::setw(20) << cell(l_naive, l_dft_flops) << std::setw(20) << cell(l_fft, l_fft_flops) << std::setw(9)
+                  << std::fixed << std::setprecision(0) << l_naive / l_fft << std::defaultfloat << '\n';
+    }
+}
+
+void batch(const std::size_t signals) {
+    constexpr std::size_t n = 4096;
+    std::mt19937 gen(9);
+    fft::split_buffer<float> l_signals(random_signal<float>(signals * n, gen));
+
+    const auto l_start = std::chrono::steady_clock::now();
+    const fft::plan<float> l_plan(n);
+    const std::chrono::duration<double, std::micro> l_create = std::chrono::steady_clock::now() - l_start;
+    std::cout << "\nplan<float>(4096): " << std::fixed << std::setprecision(1) << l_create.count()
+              << " us to create (twiddle factors and swaps), cached_plan<float>(4096) afterwards a lookup\n"
+              << signals << " signals of 4096 points, forward + inverse\n";
+
+    const double l_transforms = 2.0 * static_cast<double>(signals);
+    auto row = [&](const std::string & name, const double s) {
+        std::cout << "    " << std::left << std::setw(24) << name << std::right << std::setprecision(3) << std::setw(8) << s
+                  << " s" << std::setprecision(0) << std::setw(10) << l_transforms / s << " transforms/s" << std::setprecision(2)
+                  << std::setw(8) << l_transforms * 5.0 * n * 12 / s * 1e-9 << " GFLOP/s\n";
+    };
+    row("sequential", seconds([&] {
+        fft::forward(std::execution::seq, l_signals, n);
+        fft::inverse(std::execution::seq, l_signals, n);
+    }));
+    row("std::execution::par", seconds([&] {
+        fft::forward(std::execution::par, l_signals, n);
+        fft::inverse(std::execution::par, l_signals, n);
+    }));
+    std::cout << std::defaultfloat;
+}
+
+int main(int argc, char * argv[]) {
+    const std::size_t signals = (argc > 1) ? std::stoul(argv[1]) : 1000;
+
+    std::cout << "simd width " << fft::simd_t<float>::size() << " floats, " << fft::simd_t<double>::size() << " doubles\n";
+    check<float>("float");
+    check<double>("double");
+    kernels();
+    transforms<float>("float");
+    transforms<double>("double");
+    batch(signals);
+
+    return 0;
+}
+
+/*****
+    Explanation
+
+    check: the FFT is within 1.3e-7 (float) and 4.8e-16 (double) of the largest magnitude of a DFT
+    computed in long double, the round trip within 3.4e-7 and 7.1e-16, for every n from 2 to 4096:
+    the radix-4 stages, the radix-2 stage of odd log2(n) and the bit reversal agree.
+    multiply and add compute the same formulas as std::complex, the results are identical.
+
+    kernels: std::complex<float> a * b checks the result for NaN (C99 Annex G, GCC calls __mulsc3
+    when both parts are NaN) and the interleaved re, im layout is not vectorized at -O2: 2 times
+    slower than the split buffers, where 4 products are 4 lanes of 2 multiplies and an add/sub each.
+    a + b: 2 times, the split version loads 4 real parts at once.
+
+    transforms: the naive DFT costs n^2 complex multiply-adds, 8 n^2 flops, the FFT 5 n log2(n) flops,
+    the speedup grows like n / log2(n), 1170 at 4096. The DFT is a simple loop and runs at 3.5 to
+    4.8 GFLOP/s (float), 1.9 to 3.3 (double), the FFT at 5.5 to 7.7 GFLOP/s with 4 floats per SSE
+    register (no -march), double at 3.5 to 4.8: 2 lanes. The timings of the small sizes are noisy,
+    sizes with odd log2(n) pay for their scalar radix-2 stage and, for float, a span-8 stage with
+    2 lanes, too few for simd.
+    A 4096 point float transform takes 33 us: about 30000 transforms per second on one core.
+
+    batch: creating the plan of 4096 (twiddle factors computed in double, 2016 swaps) costs as much
+    as 6 transforms, the batch looks it up once. With one hardware thread std::execution::par runs
+    the signals one after the other, the same rate within the noise; each signal is independent,
+    the rate scales with the cores.
+
+    Output (g++ -O2 -std=c++20 fft.cpp -ltbb, ./fft on a single core machine)
+
+simd width 4 floats, 2 doubles
+  float: forward against the DFT 1.3e-07, inverse(forward(x)) 3.4e-07, multiply 0.0e+00, add 0.0e+00
+ double: forward against the DFT 4.8e-16, inverse(forward(x)) 7.1e-16, multiply 0.0e+00, add 0.0e+00
+
+4096 complex<float>, per element
+    a * b, std::complex<float>[]       1.358 ns    4.42 GFLOP/s
+    a * b, split_buffer                0.682 ns    8.80 GFLOP/s
+    a + b, std::complex<float>[]       0.657 ns    3.04 GFLOP/s
+    a + b, split_buffer                0.314 ns    6.36 GFLOP/s
+
+float, one signal, microseconds (GFLOP/s)
+     n           naive DFT                 FFT  speedup
+    64         9.82 (3.34)         0.41 (4.69)       24
+   128        29.42 (4.46)         0.78 (5.77)       38
+   256       129.70 (4.04)         1.83 (5.58)       71
+   512       468.45 (4.48)         4.10 (5.62)      114
+  1024      1732.06 (4.84)         6.61 (7.74)      262
+  2048      8995.50 (3.73)        20.65 (5.45)      436
+  4096     38954.92 (3.45)        33.28 (7.38)     1170
+
+double, one signal, microseconds (GFLOP/s)
+     n           naive DFT                 FFT  speedup
+    64        14.07 (2.33)         0.42 (4.60)       34
+   128        46.40 (2.83)         1.29 (3.47)       36
+   256       202.32 (2.59)         2.66 (3.85)       76
+   512       716.23 (2.93)         5.10 (4.52)      140
+  1024      2569.18 (3.27)        12.47 (4.11)      206
+  2048     18165.85 (1.85)        23.35 (4.82)      778
+  4096     46359.88 (2.90)        51.66 (4.76)      897
+
+plan<float>(4096): 201.5 us to create (twiddle factors and swaps), cached_plan<float>(4096) afterwards a lookup
+1000 signals of 4096 points, forward + inverse
+    sequential                 0.077 s     25904 transforms/s    6.37 GFLOP/s
+    std::execution::par        0.082 s     24361 transforms/s    5.99 GFLOP/s
+********/
+
+/*****
+    END OF FILE
+********/
@@ -0,0 +1,412 @@
+/**********
+
+    Split complex buffers and an in-place FFT
+
+        split_buffer<T>     n complex numbers as two 64-byte aligned arrays, the real parts and the
+                            imaginary parts (structure of arrays): a native_simd<T> loads the real parts
+                            of w neighbours in one instruction, std::complex<T> arrays (re, im, re, im, ...)
+                            need shuffles for every multiply
+        multiply, add       out = a * b, out = a + b element-wise, simd
+
+        plan<T>(n)          the twiddle factors of every stage of an n point FFT (n a power of 2) and the
+                            swaps of the bit reversal, computed once
+        cached_plan<T>(n)   the plan of n, created at the first call, shared afterwards (thread safe)
+        forward(x)          X[k] = sum x[j] e^(-2 pi i j k / n), in place, in natural order
+        inverse(x)          x[j] = 1/n sum X[k] e^(2 pi i j k / n), the forward transform on (im, re)
+        forward(policy, signals, n), inverse(policy, signals, n)
+                            signals.size() / n signals one after the other, one transform per signal
+                            on the execution policy (std::execution::par needs -ltbb)
+
+    The transform is a decimation in frequency: every stage of span L splits its blocks in 4 quarters
+    and computes a radix-4 butterfly, two radix-2 stages fused, 3 complex multiplies for 4 points
+    instead of 4:
+        z0 = (x0 + x2) + (x1 + x3)
+        z1 = ((x0 + x2) - (x1 + x3)) w^2j
+        z2 = ((x0 - x2) - i (x1 - x3)) w^j
+        z3 = ((x0 - x2) + i (x1 - x3)) w^3j             w = e^(-2 pi i / L), j < L / 4
+    stored as the two radix-2 stages would (z0, z1, z2, z3 in the quarters 0, 1, 2, 3), so the result
+    is in bit reversed order whatever the number of stages, a last radix-2 stage when log2(n) is odd.
+    The j loop of a stage runs on simd_t<T> while L / 4 is at least the simd width, the last stages
+    (L / 4 = 1 has no twiddle factor) one element at a time.
+
+    For more info visit:
+    https://en.cppreference.com/w/cpp/numeric/complex
+    https://en.cppreference.com/w/cpp/experimental/simd
+    https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm
+
+**************/
+
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <experimental/simd>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numbers>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fft {
+
+namespace stdx = std::experimental;
+
+template <typename T>
+using simd_t = stdx::native_simd<T>;
+
+template <typename T>
+concept real_type = std::same_as<T, float> or std::same_as<T, double>;
+
+template <typename T>
+struct aligned_allocator {
+    using value_type = T;
+    static constexpr std::align_val_t alignment{64};
+
+    aligned_allocator() = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U> &) {}
+
+    T *allocate(const std::size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), alignment)); }
+    void deallocate(T *p, const std::size_t) { ::operator delete(p, alignment); }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U> &) const { return true; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+template <real_type T>
+class split_buffer {
+    aligned_vector<T> m_re;
+    aligned_vector<T> m_im;
+
+public:
+    using value_type = std::complex<T>;
+
+    split_buffer() = default;
+    explicit split_buffer(const std::size_t size) : m_re(size), m_im(size) {}
+    explicit split_buffer(const std::vector<std::complex<T>> &values) : m_re(values.size()), m_im(values.size()) {
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            set(i, values[i]);
+        }
+    }
+
+    std::size_t size() const { return m_re.size(); }
+    T *re() { return m_re.data(); }
+    T *im() { return m_im.data(); }
+    const T *re() const { return m_re.data(); }
+    const T *im() const { return m_im.data(); }
+
+    std::complex<T> get(const std::size_t i) const { return {m_re[i], m_im[i]}; }
+    void set(const std::size_t i, const std::complex<T> value) {
+        m_re[i] = value.real();
+        m_im[i] = value.imag();
+    }
+
+    std::vector<std::complex<T>> to_complex() const {
+        std::vector<std::complex<T>> l_values(size());
+        for (std::size_t i = 0; i < size(); ++i) {
+            l_values[i] = get(i);
+        }
+        return l_values;
+    }
+};
+
+namespace detail {
+
+    template <typename V, typename T>
+    V load(const T *p) {
+        if constexpr (std::is_same_v<V, T>) {
+            return *p;
+        } else {
+            return V(p, stdx::element_aligned);
+        }
+    }
+
+    template <typename V, typename T>
+    void store(T *p, const V &v) {
+        if constexpr (std::is_same_v<V, T>) {
+            *p = v;
+        } else {
+            v.copy_to(p, stdx::element_aligned);
+        }
+    }
+
+    inline void check_sizes(const std::size_t a, const std::size_t b, const std::size_t out) {
+        if (a != b or a != out) {
+            throw std::invalid_argument("fft: buffers of different sizes");
+        }
+    }
+
+    // (re, im) *= (w_re, w_im)
+    template <typename V>
+    void twiddle(V &re, V &im, const V &w_re, const V &w_im) {
+        const V l_re = re * w_re - im * w_im;
+        im = re * w_im + im * w_re;
+        re = l_re;
+    }
+
+    // the radix-4 butterfly of the quarters r[0..3], i[0..3] at j, twiddle factors from w at j
+    template <typename V, bool Twiddle, typename T>
+    void butterfly4(T *const r[4], T *const i[4], const T *const w[6], const std::size_t j) {
+        const V x0r = load<V>(r[0] + j), x0i = load<V>(i[0] + j);
+        const V x1r = load<V>(r[1] + j), x1i = load<V>(i[1] + j);
+        const V x2r = load<V>(r[2] + j), x2i = load<V>(i[2] + j);
+        const V x3r = load<V>(r[3] + j), x3i = load<V>(i[3] + j);
+
+        const V s02r = x0r + x2r, s02i = x0i + x2i;
+        const V d02r = x0r - x2r, d02i = x0i - x2i;
+        const V s13r = x1r + x3r, s13i = x1i + x3i;
+        const V d13r = x1r - x3r, d13i = x1i - x3i;
+
+        V z1r = s02r - s13r, z1i = s02i - s13i;
+        // -i (x1 - x3) = (d13i, -d13r)
+        V z2r = d02r + d13i, z2i = d02i - d13r;
+        V z3r = d02r - d13i, z3i = d02i + d13r;
+        if constexpr (Twiddle) {
+            twiddle(z2r, z2i, load<V>(w[0] + j), load<V>(w[1] + j));
+            twiddle(z1r, z1i, load<V>(w[2] + j), load<V>(w[3] + j));
+            twiddle(z3r, z3i, load<V>(w[4] + j), load<V>(w[5] + j));
+        }
+
+        store(r[0] + j, s02r + s13r);
+        store(i[0] + j, s02i + s13i);
+        store(r[1] + j, z1r);
+        store(i[1] + j, z1i);
+        store(r[2] + j, z2r);
+        store(i[2] + j, z2i);
+        store(r[3] + j, z3r);
+        store(i[3] + j, z3i);
+    }
+
+}  // namespace detail
+
+// out = a * b, out may be a or b
+template <real_type T>
+void multiply(const split_buffer<T> &a, const split_buffer<T> &b, split_buffer<T> &out) {
+    detail::check_sizes(a.size(), b.size(), out.size());
+    constexpr std::size_t w = simd_t<T>::size();
+    const T *ar = a.re(), *ai = a.im(), *br = b.re(), *bi = b.im();
+    T *outr = out.re(), *outi = out.im();
+    const std::size_t n = a.size();
+    std::size_t i = 0;
+    for (; i + w <= n; i += w) {
+        simd_t<T> l_re = detail::load<simd_t<T>>(ar + i), l_im = detail::load<simd_t<T>>(ai + i);
+        detail::twiddle(l_re, l_im, detail::load<simd_t<T>>(br + i), detail::load<simd_t<T>>(bi + i));
+        detail::store(outr + i, l_re);
+        detail::store(outi + i, l_im);
+    }
+    for (; i < n; ++i) {
+        T l_re = ar[i], l_im = ai[i];
+        detail::twiddle(l_re, l_im, br[i], bi[i]);
+        outr[i] = l_re;
+        outi[i] = l_im;
+    }
+}
+
+namespace detail {
+
+    template <typename T>
+    void add_parts(const T *x, const T *y, T *out, const std::size_t n) {
+        constexpr std::size_t w = simd_t<T>::size();
+        std::size_t i = 0;
+        for (; i + w <= n; i += w) {
+            store(out + i, load<simd_t<T>>(x + i) + load<simd_t<T>>(y + i));
+        }
+        for (; i < n; ++i) {
+            out[i] = x[i] + y[i];
+        }
+    }
+
+}  // namespace detail
+
+// out = a + b, out may be a or b
+template <real_type T>
+void add(const split_buffer<T> &a, const split_buffer<T> &b, split_buffer<T> &out) {
+    detail::check_sizes(a.size(), b.size(), out.size());
+    detail::add_parts(a.re(), b.re(), out.re(), a.size());
+    detail::add_parts(a.im(), b.im(), out.im(), a.size());
+}
+
+template <real_type T>
+class plan {
+    // a radix-4 stage of span L: 6 tables of L / 4 values, w^j, w^2j and w^3j (re, im)
+    struct stage {
+        std::size_t span;
+        aligned_vector<T> twiddles;
+    };
+
+    std::size_t m_size;
+    std::vector<stage> m_stages;
+    bool m_radix2;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> m_swaps;
+
+    template <typename V, bool Twiddle>
+    void radix4(T *re, T *im, const stage &s, const std::size_t step) const {
+        const std::size_t q = s.span / 4;
+        const T *const w[6] = {s.twiddles.data(),         s.twiddles.data() + q,     s.twiddles.data() + 2 * q,
+                               s.twiddles.data() + 3 * q, s.twiddles.data() + 4 * q, s.twiddles.data() + 5 * q};
+        for (std::size_t g = 0; g < m_size; g += s.span) {
+            T *const r[4] = {re + g, re + g + q, re + g + 2 * q, re + g + 3 * q};
+            T *const i[4] = {im + g, im + g + q, im + g + 2 * q, im + g + 3 * q};
+            for (std::size_t j = 0; j < q; j += step) {
+                detail::butterfly4<V, Twiddle>(r, i, w, j);
+            }
+        }
+    }
+
+    void transform(T *re, T *im) const {
+        constexpr std::size_t w = simd_t<T>::size();
+        for (const stage &l_stage : m_stages) {
+            if (l_stage.span == 4) {
+                radix4<T, false>(re, im, l_stage, 1);
+            } else if (l_stage.span / 4 >= w) {
+                radix4<simd_t<T>, true>(re, im, l_stage, w);
+            } else {
+                radix4<T, true>(re, im, l_stage, 1);
+            }
+        }
+        if (m_radix2) {
+            for (std::size_t k = 0; k < m_size; k += 2) {
+                const T l_re = re[k], l_im = im[k];
+                re[k] = l_re + re[k + 1];
+                im[k] = l_im + im[k + 1];
+                re[k + 1] = l_re - re[k + 1];
+                im[k + 1] = l_im - im[k + 1];
+            }
+        }
+        for (const auto &[a, b] : m_swaps) {
+            std::swap(re[a], re[b]);
+            std::swap(im[a], im[b]);
+        }
+    }
+
+public:
+    explicit plan(const std::size_t size) : m_size{size}, m_radix2{false} {
+        if (not std::has_single_bit(size) or size > (std::size_t{1} << 31)) {
+            throw std::invalid_argument("fft: the size is not a power of 2");
+        }
+        std::size_t l_span = size;
+        for (; l_span >= 4; l_span /= 4) {
+            const std::size_t q = l_span / 4;
+            stage l_stage{l_span, aligned_vector<T>(6 * q)};
+            // w^mj in the tables 2 (m - 1) (re) and 2 (m - 1) + 1 (im), computed in double
+            for (std::size_t m = 1; m <= 3; ++m) {
+                for (std::size_t j = 0; j < q; ++j) {
+                    const double l_angle = -2 * std::numbers::pi * static_cast<double>(m * j) / static_cast<double>(l_span);
+                    l_stage.twiddles[(2 * m - 2) * q + j] = static_cast<T>(std::cos(l_angle));
+                    l_stage.twiddles[(2 * m - 1) * q + j] = static_cast<T>(std::sin(l_angle));
+                }
+            }
+            m_stages.push_back(std::move(l_stage));
+        }
+        m_radix2 = (l_span == 2);
+
+        const int l_bits = std::countr_zero(size);
+        for (std::uint32_t k = 0; k < size; ++k) {
+            std::uint32_t l_reversed = 0;
+            for (int b = 0; b < l_bits; ++b) {
+                l_reversed |= ((k >> b) & 1u) << (l_bits - 1 - b);
+            }
+            if (k < l_reversed) {
+                m_swaps.emplace_back(k, l_reversed);
+            }
+        }
+    }
+
+    std::size_t size() const { return m_size; }
+
+    // n values at re and im
+    void forward(T *re, T *im) const { transform(re, im); }
+
+    void inverse(T *re, T *im) const {
+        // the conjugate of the forward transform of the conjugate: swapping re and im conjugates twice
+        transform(im, re);
+        const T l_scale = T{1} / static_cast<T>(m_size);
+        constexpr std::size_t w = simd_t<T>::size();
+        for (T *l_part : {re, im}) {
+            std::size_t i = 0;
+            for (; i + w <= m_size; i += w) {
+                detail::store(l_part + i, detail::load<simd_t<T>>(l_part + i) * l_scale);
+            }
+            for (; i < m_size; ++i) {
+                l_part[i] *= l_scale;
+            }
+        }
+    }
+};
+
+template <real_type T>
+std::shared_ptr<const plan<T>> cached_plan(const std::size_t size) {
+    static std::mutex s_mutex;
+    static std::unordered_map<std::size_t, std::shared_ptr<const plan<T>>> s_plans;
+
+    std::lock_guard l_lock(s_mutex);
+    if (const auto l_found = s_plans.find(size); l_found != s_plans.end()) {
+        return l_found->second;
+    }
+    auto l_plan = std::make_shared<const plan<T>>(size);
+    s_plans.emplace(size, l_plan);
+    return l_plan;
+}
+
+template <real_type T>
+void forward(split_buffer<T> &x) {
+    cached_plan<T>(x.size())->forward(x.re(), x.im());
+}
+
+template <real_type T>
+void inverse(split_buffer<T> &x) {
+    cached_plan<T>(x.size())->inverse(x.re(), x.im());
+}
+
+namespace detail {
+
+    template <typename Policy, real_type T, typename Func>
+    void for_each_signal(Policy &&policy, split_buffer<T> &signals, const std::size_t n, Func func) {
+        if (n == 0 or signals.size() % n != 0) {
+            throw std::invalid_argument("fft: the buffer is not a whole number of signals");
+        }
+        const std::shared_ptr<const plan<T>> l_plan = cached_plan<T>(n);
+        std::vector<std::size_t> l_signals(signals.size() / n);
+        std::iota(l_signals.begin(), l_signals.end(), std::size_t{0});
+        std::for_each(std::forward<Policy>(policy), l_signals.begin(), l_signals.end(),
+                      [&](const std::size_t s) { func(*l_plan, signals.re() + s * n, signals.im() + s * n); });
+    }
+
+}  // namespace detail
+
+template <typename Policy, real_type T>
+    requires std::is_execution_policy_v<std::remove_cvref_t<Policy>>
+void forward(Policy &&policy, split_buffer<T> &signals, const std::size_t n) {
+    detail::for_each_signal(std::forward<Policy>(policy), signals, n,
+                            [](const plan<T> &p, T *re, T *im) { p.forward(re, im); });
+}
+
+template <typename Policy, real_type T>
+    requires std::is_execution_policy_v<std::remove_cvref_t<Policy>>
+void inverse(Policy &&policy, split_buffer<T> &signals, const std::size_t n) {
+    detail::for_each_signal(std::forward<Policy>(policy), signals, n,
+                            [](const plan<T> &p, T *re, T *im) { p.inverse(re, im); });
+}
+
+}  // namespace fft
+
+#endif
+
+/*****
+    END OF FILE
+********/
@@ -0,0 +1,299 @@
+/**********
+
+    This example compares std::valarray with expr::array (expr_array.hpp), an array whose operators
+    build expression templates evaluated in one simd loop
+
+    y = a * b + c * d - e computed
+        hand-written loop       one loop, scalar (GCC does not vectorize at -O2)
+        temporaries             one std::vector allocated and written per operator: a * b, c * d, the sum, the difference
+        std::valarray           the standard allows a temporary per operator, libstdc++ returns expression templates (_Expr)
+                                and evaluates them in one scalar loop
+        expr::array             one loop over native_simd<float>, aligned loads and stores
+        expr::array, par        assign(std::execution::par, ...), blocks of 16384 elements on the TBB pool
+
+    then a mask (y[y > 1] = 1, a clamp) and a slice (every second element, a decimation)
+
+    For more info visit:
+    C++ Weekly - Ep 367: https://www.youtube.com/watch?v=hxcrOwfPhkE&t=450s
+    https://en.cppreference.com/w/cpp/numeric/valarray
+
+    Usage
+        g++ -O2 -std=c++20 expr_array.cpp -ltbb
+        ./expr_array [max_size]
+
+**************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <valarray>
+#include <vector>
+
+#include "expr_array.hpp"
+
+template <typename Array>
+void display(const Array & arr) {
+    for(const auto & elem : arr) {
+        std::cout << elem << ' ';
+    }
+    std::cout << '\n';
+}
+
+void demo() {
+    expr::array<float> a{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    expr::array<float> b{10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+    expr::array<float> c = a * b + 3.0f;
+    std::cout << "a * b + 3              ";
+    display(c);
+
+    c = expr::sqrt(c) - a / 2.0f;
+    std::cout << "sqrt(c) - a / 2        ";
+    display(c);
+
+    c = expr::apply(a, [](const auto & x) { return x * x * x; });
+    std::cout << "apply(a, x * x * x)    ";
+    display(c);
+
+    std::cout << "sum " << c.sum() << ", min " << c.min() << ", max " << c.max()
+              << ", sum(a * b) " << expr::sum(a * b) << '\n';
+
+    c[expr::slice{0, 5, 2}] = b[expr::slice{5, 5, 1}] * 100.0f;
+    std::cout << "c[0, 2, 4, 6, 8] = b[5..9] * 100\n                       ";
+    display(c);
+
+    c[c > 500.0f && c < 800.0f] = -1.0f;
+    std::cout << "c[500 < c < 800] = -1  ";
+    display(c);
+
+    const expr::array<float> selected(c[c < 0.0f]);
+    std::cout << "c[c < 0]               ";
+    display(selected);
+    std::cout << '\n';
+}
+
+template <typename T>
+std::vector<T> operator*(const std::vector<T> & x, const std::vector<T> & y) {
+    std::vector<T> res(x.size());
+    for(std::size_t i = 0; i < x.size(); ++i) { res[i] = x[i] * y[i]; }
+    return res;
+}
+
+template <typename T>
+std::vector<T> operator+(const std::vector<T> & x, const std::vector<T> & y) {
+    std::vector<T> res(x.size());
+    for(std::size_t i = 0; i < x.size(); ++i) { res[i] = x[i] + y[i]; }
+    return res;
+}
+
+template <typename T>
+std::vector<T> operator-(const std::vector<T> & x, const std::vector<T> & y) {
+    std::vector<T> res(x.size());
+    for(std::size_t i = 0; i < x.size(); ++i) { res[i] = x[i] - y[i]; }
+    return res;
+}
+
+volatile float g_sink;
+
+// nanoseconds per element, the best of 5 runs of at least 2^24 elements
+template <typename Func>
+double ns_per_element(const std::size_t n, Func func) {
+    const std::size_t reps = std::max<std::size_t>(1, (std::size_t{1} << 24) / n);
+    double best = 0;
+    for(int r = 0; r < 5; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        for(std::size_t k = 0; k < reps; ++k) {
+            func();
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        const double ns = elapsed.count() / static_cast<double>(n * reps);
+        best = (r == 0) ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+void benchmark(const std::size_t n) {
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dist(-2, 2);
+    std::vector<std::vector<float>> in(5, std::vector<float>(n));
+    for(auto & v : in) {
+        std::generate(v.begin(), v.end(), [&] { return dist(gen); });
+    }
+
+    std::vector<float> va(in[0]), vb(in[1]), vc(in[2]), vd(in[3]), ve(in[4]), vy(n);
+    std::valarray<float> sa(in[0].data(), n), sb(in[1].data(), n), sc(in[2].data(), n), sd(in[3].data(), n),
+        se(in[4].data(), n), sy(n);
+    expr::array<float> xa(n), xb(n), xc(n), xd(n), xe(n), xy(n);
+    std::copy(in[0].begin(), in[0].end(), xa.begin());
+    std::copy(in[1].begin(), in[1].end(), xb.begin());
+    std::copy(in[2].begin(), in[2].end(), xc.begin());
+    std::copy(in[3].begin(), in[3].end(), xd.begin());
+    std::copy(in[4].begin(), in[4].end(), xe.begin());
+
+    std::cout << n << " floats, ns per element\n";
+    auto row = [&](const std::string & name, const double ns) {
+        std::cout << "    " << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(8) << ns << std::defaultfloat << '\n';
+    };
+
+    row("a*b + c*d - e, hand-written loop", ns_per_element(n, [&] {
+        for(std::size_t i = 0; i < n; ++i) {
+            vy[i] = va[i] * vb[i] + vc[i] * vd[i] - ve[i];
+        }
+        g_sink = vy[n / 2];
+    }));
+    row("a*b + c*d - e, temporaries", ns_per_element(n, [&] { vy = va * vb + vc * vd - ve; g_sink = vy[n / 2]; }));
+    row("a*b + c*d - e, std::valarray", ns_per_element(n, [&] { sy = sa * sb + sc * sd - se; g_sink = sy[n / 2]; }));
+    row("a*b + c*d - e, expr::array", ns_per_element(n, [&] { xy = xa * xb + xc * xd - xe; g_sink = xy[n / 2]; }));
+    if(n >= expr::parallel_min) {
+        row("a*b + c*d - e, expr::array par", ns_per_element(n, [&] {
+            expr::assign(std::execution::par, xy, xa * xb + xc * xd - xe);
+            g_sink = xy[n / 2];
+        }));
+    }
+
+    float diff = 0;
+    for(std::size_t i = 0; i < n; ++i) {
+        diff = std::max({diff, std::abs(xy[i] - vy[i]), std::abs(sy[i] - vy[i])});
+    }
+
+    // the clamp rewrites the arrays, they are reset from the inputs before every run
+    row("y[y > 1] = 1, hand-written loop", ns_per_element(n, [&] {
+        std::copy(in[0].begin(), in[0].end(), vy.begin());
+        for(std::size_t i = 0; i < n; ++i) {
+            if(vy[i] > 1.0f) { vy[i] = 1.0f; }
+        }
+        g_sink = vy[n / 2];
+    }));
+    row("y[y > 1] = 1, std::valarray", ns_per_element(n, [&] {
+        sy = sa;
+        sy[sy > 1.0f] = 1.0f;
+        g_sink = sy[n / 2];
+    }));
+    row("y[y > 1] = 1, expr::array", ns_per_element(n, [&] {
+        xy = xa;
+        xy[xy > 1.0f] = 1.0f;
+        g_sink = xy[n / 2];
+    }));
+
+    const std::size_t half = n / 2;
+    row("y[::2] = a[1::2] * 2, loop", ns_per_element(half, [&] {
+        for(std::size_t i = 0; i < half; ++i) {
+            vy[2 * i] = va[2 * i + 1] * 2.0f;
+        }
+        g_sink = vy[half];
+    }));
+    row("y[::2] = a[1::2] * 2, std::valarray", ns_per_element(half, [&] {
+        sy[std::slice(0, half, 2)] = std::valarray<float>(sa[std::slice(1, half, 2)]) * 2.0f;
+        g_sink = sy[half];
+    }));
+    row("y[::2] = a[1::2] * 2, expr::array", ns_per_element(half, [&] {
+        xy[expr::slice{0, half, 2}] = xa[expr::slice{1, half, 2}] * 2.0f;
+        g_sink = xy[half];
+    }));
+
+    std::cout << "    largest difference to the loop " << diff << "\n\n";
+}
+
+int main(int argc, char * argv[]) {
+    const std::size_t max_size = (argc > 1) ? std::stoul(argv[1]) : 10'000'000;
+
+    demo();
+
+    std::cout << "simd width " << expr::simd_t<float>::size() << " floats\n\n";
+    for(std::size_t n = 1000; n <= max_size; n *= 100) {
+        benchmark(n);
+    }
+
+    return 0;
+}
+
+/*****
+    Explanation
+
+    a*b + c*d - e
+        temporaries: 4 vectors allocated, written and read again per evaluation, 3x slower than one loop
+        in cache, 7x at 10M elements where each temporary is 40 MB of page faults and memory traffic.
+        std::valarray: libstdc++ returns _Expr nodes, one loop and no temporary like the hand-written one,
+        both are scalar at -O2 (the very cheap cost model of GCC 12 at -O2 does not vectorize them).
+        expr::array: the same tree evaluated 4 floats at a time (SSE, native_simd<float> without -march),
+        3.5x faster in L1 (1000), 1.7x in L2 (100000). At 10M all of them wait for memory, 24 bytes per
+        element, about 11 GB/s, and the simd loop is only 10% faster.
+        The nodes keep the pointers of the arrays by value and the loop works on a local copy of the tree:
+        with references, every simd store (may alias anything) made GCC load all the pointers again,
+        and expr::array was 1.0 ns per element instead of 0.3 at 1000.
+        expr::array par: one hardware thread, the blocks of 16384 run one after the other, the same time.
+
+    y[y > 1] = 1
+        the hand-written loop and valarray's mask_array branch on every element: random data, 1/4 above 1,
+        mispredicted branches (1.5 ns in cache when the predictor learns the 1000 elements, 5-6 ns above).
+        expr::array blends with stdx::where, no branch, 4 to 10 times faster.
+
+    y[::2] = a[1::2] * 2
+        a stride of 2 cannot be loaded as a vector: the lanes are gathered one by one and scattered back,
+        the simd multiply does not pay for it, expr::array is between the loop and std::valarray (which
+        needs the temporary valarray of the slice to multiply it).
+
+    Output (g++ -O2 -std=c++20 expr_array.cpp -ltbb, ./expr_array on a single core machine)
+
+a * b + 3              13 21 27 31 33 33 31 27 21 13 
+sqrt(c) - a / 2        3.10555 3.58258 3.69615 3.56776 3.24456 2.74456 2.06776 1.19615 0.0825758 -1.39445 
+apply(a, x * x * x)    1 8 27 64 125 216 343 512 729 1000 
+sum 3025, min 1, max 1000, sum(a * b) 220
+c[0, 2, 4, 6, 8] = b[5..9] * 100
+                       500 8 400 64 300 216 200 512 100 1000 
+c[500 < c < 800] = -1  500 8 400 64 300 216 200 -1 100 1000 
+c[c < 0]               -1 
+
+simd width 4 floats
+
+1000 floats, ns per element
+    a*b + c*d - e, hand-written loop       1.317
+    a*b + c*d - e, temporaries             3.667
+    a*b + c*d - e, std::valarray           1.333
+    a*b + c*d - e, expr::array             0.379
+    y[y > 1] = 1, hand-written loop        1.508
+    y[y > 1] = 1, std::valarray            2.936
+    y[y > 1] = 1, expr::array              0.284
+    y[::2] = a[1::2] * 2, loop             0.560
+    y[::2] = a[1::2] * 2, std::valarray    1.499
+    y[::2] = a[1::2] * 2, expr::array      1.297
+    largest difference to the loop 0
+
+100000 floats, ns per element
+    a*b + c*d - e, hand-written loop       1.457
+    a*b + c*d - e, temporaries             3.869
+    a*b + c*d - e, std::valarray           1.314
+    a*b + c*d - e, expr::array             0.787
+    a*b + c*d - e, expr::array par         0.792
+    y[y > 1] = 1, hand-written loop        5.255
+    y[y > 1] = 1, std::valarray            5.795
+    y[y > 1] = 1, expr::array              0.559
+    y[::2] = a[1::2] * 2, loop             0.767
+    y[::2] = a[1::2] * 2, std::valarray    1.573
+    y[::2] = a[1::2] * 2, expr::array      0.930
+    largest difference to the loop 0
+
+10000000 floats, ns per element
+    a*b + c*d - e, hand-written loop       2.400
+    a*b + c*d - e, temporaries            16.403
+    a*b + c*d - e, std::valarray           2.370
+    a*b + c*d - e, expr::array             2.181
+    a*b + c*d - e, expr::array par         2.156
+    y[y > 1] = 1, hand-written loop        6.021
+    y[y > 1] = 1, std::valarray            6.426
+    y[y > 1] = 1, expr::array              1.467
+    y[::2] = a[1::2] * 2, loop             1.822
+    y[::2] = a[1::2] * 2, std::valarray    3.073
+    y[::2] = a[1::2] * 2, expr::array      2.029
+    largest difference to the loop 0
+********/
+
+/*****
+    END OF FILE
+********/
@@ -0,0 +1,644 @@
+/**********
+
+    expr::array<T>, a valarray-like array whose operators build expression templates
+
+    a * b + c * d - e is a tree of nodes (binary_node<std::plus<>, ...>) holding pointers to the arrays,
+    nothing is computed until the tree is assigned to an array: one loop, no temporary array,
+    every step loads a native_simd<T> from every leaf, computes the tree in registers and stores it.
+
+        array<T>            64-byte aligned storage (aligned_allocator), the loads and stores of an
+                            assignment are aligned, the last size % width elements are computed one by one
+        scalars             a * 2.0f broadcasts the scalar, no array of 2.0f
+        sqrt, abs, apply    element-wise functions, apply(e, f) takes a generic lambda called with simd and T
+        a > b, a <= 1.0f    mask expressions, && || combine them
+        a[slice{start, size, stride}]   a slice_array, read (gather) and assigned (scatter) like std::slice_array
+        a[mask]             a mask_array: a[a > 1.0f] = 1.0f assigns where the mask is true (stdx::where),
+                            array<T>(a[mask]) copies the selected elements like std::mask_array
+        sum, min, max       reductions of an expression, also in one loop
+
+        assign(std::execution::par, y, expression)
+                            evaluates in blocks of parallel_block elements on the execution policy (-ltbb)
+                            from parallel_min elements on, sequentially below
+
+    The nodes keep pointers to the elements: an expression stored with auto must not outlive the arrays
+    or their resizing.
+    An expression may read the array it is assigned to at the same index (a = a * b), not at another
+    one (a[slice{0, n - 1, 1}] = a[slice{1, n - 1, 1}] reads elements already written, as with valarray).
+
+    For more info visit:
+    https://en.cppreference.com/w/cpp/numeric/valarray
+    https://en.cppreference.com/w/cpp/experimental/simd
+    Todd Veldhuizen - Expression Templates (C++ Report, 1995)
+
+**************/
+
+#ifndef EXPR_ARRAY_HPP
+#define EXPR_ARRAY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <execution>
+#include <experimental/simd>
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace expr {
+
+namespace stdx = std::experimental;
+
+template <typename T>
+using simd_t = stdx::native_simd<T>;
+
+template <typename T>
+using mask_t = typename simd_t<T>::mask_type;
+
+// from this size on assign(std::execution::par, ...) splits the work
+inline constexpr std::size_t parallel_min = std::size_t{1} << 16;
+inline constexpr std::size_t parallel_block = std::size_t{1} << 14;
+
+template <typename T>
+struct aligned_allocator {
+    using value_type = T;
+    static constexpr std::align_val_t alignment{64};
+
+    aligned_allocator() = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U> &) {}
+
+    T *allocate(const std::size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), alignment)); }
+    void deallocate(T *p, const std::size_t) { ::operator delete(p, alignment); }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U> &) const { return true; }
+};
+
+// the interface of every node: value_type, size(), e[i] one element, e.load(i) the simd_t from element i
+template <typename E>
+concept expression = requires(const E &e, std::size_t i) {
+    typename E::value_type;
+    requires std::is_arithmetic_v<typename E::value_type> and not std::same_as<typename E::value_type, bool>;
+    { e.size() } -> std::convertible_to<std::size_t>;
+    e[i];
+    e.load(i);
+};
+
+// value_type bool, load(i) is a mask_t<element_type>
+template <typename E>
+concept mask_expression = requires(const E &e, std::size_t i) {
+    typename E::element_type;
+    requires std::same_as<typename E::value_type, bool>;
+    { e.size() } -> std::convertible_to<std::size_t>;
+    { e[i] } -> std::convertible_to<bool>;
+    e.load(i);
+};
+
+template <typename T>
+class array;
+
+// an array in a node: its pointer and size, copied with the node
+template <typename T>
+class array_ref {
+    const T *m_data;
+    std::size_t m_size;
+
+public:
+    using value_type = T;
+    array_ref(const array<T> &a);
+    std::size_t size() const { return m_size; }
+    T operator[](const std::size_t i) const { return m_data[i]; }
+    simd_t<T> load(const std::size_t i) const { return simd_t<T>(m_data + i, stdx::vector_aligned); }
+};
+
+// the nodes hold everything by value, an expression is a handful of pointers
+template <typename E>
+struct stored {
+    using type = E;
+};
+
+template <typename T>
+struct stored<array<T>> {
+    using type = array_ref<T>;
+};
+
+template <typename E>
+using stored_t = typename stored<E>::type;
+
+template <typename T>
+class scalar_node {
+    T m_value;
+    std::size_t m_size;
+
+public:
+    using value_type = T;
+    scalar_node(const T value, const std::size_t size) : m_value{value}, m_size{size} {}
+    std::size_t size() const { return m_size; }
+    T operator[](std::size_t) const { return m_value; }
+    simd_t<T> load(std::size_t) const { return simd_t<T>(m_value); }
+};
+
+template <typename Op, typename E>
+class unary_node {
+    stored_t<E> m_e;
+    Op m_op;
+
+public:
+    using value_type = typename E::value_type;
+    unary_node(const E &e, Op op) : m_e{e}, m_op{op} {}
+    std::size_t size() const { return m_e.size(); }
+    value_type operator[](const std::size_t i) const { return m_op(m_e[i]); }
+    simd_t<value_type> load(const std::size_t i) const { return m_op(m_e.load(i)); }
+};
+
+template <typename Op, typename L, typename R>
+class binary_node {
+    stored_t<L> m_l;
+    stored_t<R> m_r;
+
+public:
+    using value_type = typename L::value_type;
+    static_assert(std::is_same_v<value_type, typename R::value_type>, "expr: operands of different types");
+
+    binary_node(const L &l, const R &r) : m_l{l}, m_r{r} {
+        if (m_l.size() != m_r.size()) {
+            throw std::invalid_argument("expr: operands of different sizes");
+        }
+    }
+    std::size_t size() const { return m_l.size(); }
+    value_type operator[](const std::size_t i) const { return Op{}(m_l[i], m_r[i]); }
+    simd_t<value_type> load(const std::size_t i) const { return Op{}(m_l.load(i), m_r.load(i)); }
+};
+
+// the type of the elements behind an expression or a mask
+template <typename E>
+struct element_of {
+    using type = typename E::value_type;
+};
+
+template <typename E>
+    requires requires { typename E::element_type; }
+struct element_of<E> {
+    using type = typename E::element_type;
+};
+
+// comparisons of two expressions, combinations of two masks
+template <typename Op, typename L, typename R>
+class mask_node {
+    stored_t<L> m_l;
+    stored_t<R> m_r;
+
+public:
+    using value_type = bool;
+    using element_type = typename element_of<L>::type;
+
+    mask_node(const L &l, const R &r) : m_l{l}, m_r{r} {
+        if (m_l.size() != m_r.size()) {
+            throw std::invalid_argument("expr: operands of different sizes");
+        }
+    }
+    std::size_t size() const { return m_l.size(); }
+    bool operator[](const std::size_t i) const { return Op{}(m_l[i], m_r[i]); }
+    mask_t<element_type> load(const std::size_t i) const { return Op{}(m_l.load(i), m_r.load(i)); }
+};
+
+struct slice {
+    std::size_t start;
+    std::size_t size;
+    std::size_t stride;
+};
+
+// size elements from data + start, stride apart, T may be const (a slice of a const array)
+template <typename T>
+class slice_array {
+    T *m_data;
+    slice m_slice;
+
+public:
+    using value_type = std::remove_const_t<T>;
+    slice_array(T *data, const slice s) : m_data{data + s.start}, m_slice{s} {}
+
+    std::size_t size() const { return m_slice.size; }
+    value_type operator[](const std::size_t i) const { return m_data[i * m_slice.stride]; }
+    simd_t<value_type> load(const std::size_t i) const {
+        if (m_slice.stride == 1) {
+            return simd_t<value_type>(m_data + i, stdx::element_aligned);
+        }
+        return simd_t<value_type>([&](const auto l) { return m_data[(i + l) * m_slice.stride]; });
+    }
+
+    // the destination interface of assign
+    void set(const std::size_t i, const value_type value) const { m_data[i * m_slice.stride] = value; }
+    void store(const std::size_t i, const simd_t<value_type> &v) const {
+        if (m_slice.stride == 1) {
+            v.copy_to(m_data + i, stdx::element_aligned);
+            return;
+        }
+        // through memory, the lanes of v one by one are extracted with shuffles
+        alignas(stdx::memory_alignment_v<simd_t<value_type>>) value_type l_lanes[simd_t<value_type>::size()];
+        v.copy_to(l_lanes, stdx::vector_aligned);
+        for (std::size_t l = 0; l < simd_t<value_type>::size(); ++l) {
+            m_data[(i + l) * m_slice.stride] = l_lanes[l];
+        }
+    }
+
+    template <expression E>
+    const slice_array &operator=(const E &e) const;
+    const slice_array &operator=(const value_type value) const {
+        return *this = scalar_node<value_type>(value, size());
+    }
+};
+
+// the elements of an array where the mask is true
+template <typename T, typename M>
+class mask_array {
+    T *m_data;
+    std::size_t m_size;
+    M m_mask;
+
+public:
+    mask_array(array<T> &a, const M &mask) : m_data{a.data()}, m_size{a.size()}, m_mask{mask} {
+        if (a.size() != mask.size()) {
+            throw std::invalid_argument("expr: mask of a different size");
+        }
+    }
+    std::size_t size() const { return m_size; }
+    const M &mask() const { return m_mask; }
+    const T *data() const { return m_data; }
+
+    // the destination interface of assign, the lanes outside of the mask keep their value
+    void set(const std::size_t i, const T value) const {
+        if (m_mask[i]) {
+            m_data[i] = value;
+        }
+    }
+    void store(const std::size_t i, const simd_t<T> &v) const {
+        simd_t<T> l_old(m_data + i, stdx::vector_aligned);
+        stdx::where(m_mask.load(i), l_old) = v;
+        l_old.copy_to(m_data + i, stdx::vector_aligned);
+    }
+
+    template <expression E>
+    const mask_array &operator=(const E &e) const;
+    const mask_array &operator=(const T value) const { return *this = scalar_node<T>(value, size()); }
+};
+
+namespace detail {
+
+    // the destination interface of an array: its pointer
+    template <typename T>
+    class array_out {
+        T *m_data;
+
+    public:
+        explicit array_out(T *data) : m_data{data} {}
+        void set(const std::size_t i, const T value) const { m_data[i] = value; }
+        void store(const std::size_t i, const simd_t<T> &v) const { v.copy_to(m_data + i, stdx::vector_aligned); }
+    };
+
+    template <typename T>
+    array_out<T> destination(array<T> &a) { return array_out<T>(a.data()); }
+
+    // slice_array and mask_array are views already
+    template <typename Dest>
+    Dest destination(const Dest &dest) { return dest; }
+
+    // dest[first, last) = e[first, last), first a multiple of the simd width
+    template <typename Dest, typename E>
+    void evaluate(Dest &dest, const E &e, const std::size_t first, const std::size_t last) {
+        using T = typename E::value_type;
+        constexpr std::size_t w = simd_t<T>::size();
+        // local copies: a simd store may alias any memory, the pointers of the nodes and of the
+        // destination would be loaded again after every store, the locals stay in registers
+        const stored_t<E> l_e = e;
+        const auto l_dest = destination(dest);
+        std::size_t i = first;
+        for (; i + w <= last; i += w) {
+            l_dest.store(i, l_e.load(i));
+        }
+        for (; i < last; ++i) {
+            l_dest.set(i, l_e[i]);
+        }
+    }
+
+    template <typename Policy, typename Dest, typename E>
+    void evaluate(Policy &&policy, Dest &dest, const E &e) {
+        const std::size_t n = e.size();
+        if (std::is_same_v<std::remove_cvref_t<Policy>, std::execution::sequenced_policy> or n < parallel_min) {
+            evaluate(dest, e, 0, n);
+            return;
+        }
+        std::vector<std::size_t> l_blocks((n + parallel_block - 1) / parallel_block);
+        std::iota(l_blocks.begin(), l_blocks.end(), std::size_t{0});
+        std::for_each(std::forward<Policy>(policy), l_blocks.begin(), l_blocks.end(), [&](const std::size_t b) {
+            evaluate(dest, e, b * parallel_block, std::min(n, (b + 1) * parallel_block));
+        });
+    }
+
+    // a scalar becomes a scalar_node, an expression is returned as it is (a reference)
+    template <typename T, typename E>
+    decltype(auto) wrap(const E &e, const std::size_t size) {
+        if constexpr (std::is_arithmetic_v<E>) {
+            return scalar_node<T>(static_cast<T>(e), size);
+        } else {
+            return e;
+        }
+    }
+
+    template <typename T, typename E>
+    using wrapped_t = std::remove_cvref_t<decltype(wrap<T>(std::declval<const E &>(), 0))>;
+
+    template <typename L, typename R>
+    struct operand_type {
+        using type = typename L::value_type;
+    };
+
+    template <typename L, typename R>
+        requires std::is_arithmetic_v<L>
+    struct operand_type<L, R> {
+        using type = typename R::value_type;
+    };
+
+    template <typename L, typename R>
+    std::size_t operand_size(const L &l, const R &r) {
+        if constexpr (std::is_arithmetic_v<L>) {
+            return r.size();
+        } else {
+            return l.size();
+        }
+    }
+
+    // one of l, r may be a scalar, it becomes a scalar_node of the size of the other one
+    template <typename Op, typename L, typename R>
+    auto make_binary(const L &l, const R &r) {
+        using T = typename operand_type<L, R>::type;
+        const std::size_t l_size = operand_size(l, r);
+        return binary_node<Op, wrapped_t<T, L>, wrapped_t<T, R>>(wrap<T>(l, l_size), wrap<T>(r, l_size));
+    }
+
+    template <typename Op, typename L, typename R>
+    auto make_compare(const L &l, const R &r) {
+        using T = typename operand_type<L, R>::type;
+        const std::size_t l_size = operand_size(l, r);
+        return mask_node<Op, wrapped_t<T, L>, wrapped_t<T, R>>(wrap<T>(l, l_size), wrap<T>(r, l_size));
+    }
+
+    struct sqrt_op {
+        template <typename V>
+        V operator()(const V &v) const {
+            using std::sqrt;
+            using stdx::sqrt;
+            return sqrt(v);
+        }
+    };
+
+    struct abs_op {
+        template <typename V>
+        V operator()(const V &v) const {
+            using std::abs;
+            using stdx::abs;
+            return abs(v);
+        }
+    };
+
+}  // namespace detail
+
+// an expression and an expression or a scalar, in any order
+template <typename L, typename R>
+concept operands = (expression<L> and expression<R>) or (expression<L> and std::is_arithmetic_v<R>) or
+                   (std::is_arithmetic_v<L> and expression<R>);
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator+(const L &l, const R &r) { return detail::make_binary<std::plus<>>(l, r); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator-(const L &l, const R &r) { return detail::make_binary<std::minus<>>(l, r); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator*(const L &l, const R &r) { return detail::make_binary<std::multiplies<>>(l, r); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator/(const L &l, const R &r) { return detail::make_binary<std::divides<>>(l, r); }
+
+template <expression E>
+auto operator-(const E &e) { return unary_node<std::negate<>, E>(e, std::negate<>{}); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator<(const L &l, const R &r) { return detail::make_compare<std::less<>>(l, r); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator<=(const L &l, const R &r) { return detail::make_compare<std::less_equal<>>(l, r); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator>(const L &l, const R &r) { return detail::make_compare<std::greater<>>(l, r); }
+
+template <typename L, typename R>
+    requires operands<L, R>
+auto operator>=(const L &l, const R &r) { return detail::make_compare<std::greater_equal<>>(l, r); }
+
+template <mask_expression L, mask_expression R>
+auto operator&&(const L &l, const R &r) { return mask_node<std::logical_and<>, L, R>(l, r); }
+
+template <mask_expression L, mask_expression R>
+auto operator||(const L &l, const R &r) { return mask_node<std::logical_or<>, L, R>(l, r); }
+
+template <expression E>
+auto sqrt(const E &e) { return unary_node<detail::sqrt_op, E>(e, {}); }
+
+template <expression E>
+auto abs(const E &e) { return unary_node<detail::abs_op, E>(e, {}); }
+
+// f is called with simd_t<value_type> and with value_type, a generic lambda
+template <expression E, typename F>
+auto apply(const E &e, F f) { return unary_node<F, E>(e, f); }
+
+template <expression E>
+typename E::value_type sum(const E &e) {
+    using T = typename E::value_type;
+    constexpr std::size_t w = simd_t<T>::size();
+    simd_t<T> l_acc0(T{}), l_acc1(T{});
+    std::size_t i = 0;
+    for (; i + 2 * w <= e.size(); i += 2 * w) {
+        l_acc0 += e.load(i);
+        l_acc1 += e.load(i + w);
+    }
+    T l_sum = stdx::reduce(l_acc0 + l_acc1);
+    for (; i < e.size(); ++i) {
+        l_sum += e[i];
+    }
+    return l_sum;
+}
+
+// min and max of a non empty expression
+template <expression E>
+typename E::value_type min(const E &e) {
+    using T = typename E::value_type;
+    constexpr std::size_t w = simd_t<T>::size();
+    T l_min = e[0];
+    std::size_t i = 0;
+    if (e.size() >= w) {
+        simd_t<T> l_acc = e.load(0);
+        for (i = w; i + w <= e.size(); i += w) {
+            l_acc = stdx::min(l_acc, e.load(i));
+        }
+        l_min = stdx::hmin(l_acc);
+    }
+    for (; i < e.size(); ++i) {
+        l_min = std::min(l_min, e[i]);
+    }
+    return l_min;
+}
+
+template <expression E>
+typename E::value_type max(const E &e) {
+    using T = typename E::value_type;
+    constexpr std::size_t w = simd_t<T>::size();
+    T l_max = e[0];
+    std::size_t i = 0;
+    if (e.size() >= w) {
+        simd_t<T> l_acc = e.load(0);
+        for (i = w; i + w <= e.size(); i += w) {
+            l_acc = stdx::max(l_acc, e.load(i));
+        }
+        l_max = stdx::hmax(l_acc);
+    }
+    for (; i < e.size(); ++i) {
+        l_max = std::max(l_max, e[i]);
+    }
+    return l_max;
+}
+
+template <typename T>
+class array {
+    std::vector<T, aligned_allocator<T>> m_data;
+
+public:
+    using value_type = T;
+
+    array() = default;
+    explicit array(const std::size_t size, const T value = T{}) : m_data(size, value) {}
+    array(std::initializer_list<T> values) : m_data(values) {}
+
+    // an expression is evaluated in one loop, like valarray's constructor from its _Expr
+    template <expression E>
+    array(const E &e) : m_data(e.size()) {
+        detail::evaluate(*this, e, 0, size());
+    }
+
+    // the selected elements, in order
+    template <typename M>
+    array(const mask_array<T, M> &m) {
+        for (std::size_t i = 0; i < m.size(); ++i) {
+            if (m.mask()[i]) {
+                m_data.push_back(m.data()[i]);
+            }
+        }
+    }
+
+    template <expression E>
+    array &operator=(const E &e) {
+        if (e.size() != size()) {
+            // a different size cannot be the same array, the new one is evaluated apart
+            *this = array(e);
+            return *this;
+        }
+        detail::evaluate(*this, e, 0, size());
+        return *this;
+    }
+
+    array &operator=(const T value) {
+        std::fill(m_data.begin(), m_data.end(), value);
+        return *this;
+    }
+
+    template <typename R>
+        requires operands<array, R>
+    array &operator+=(const R &r) { return *this = *this + r; }
+    template <typename R>
+        requires operands<array, R>
+    array &operator-=(const R &r) { return *this = *this - r; }
+    template <typename R>
+        requires operands<array, R>
+    array &operator*=(const R &r) { return *this = *this * r; }
+    template <typename R>
+        requires operands<array, R>
+    array &operator/=(const R &r) { return *this = *this / r; }
+
+    std::size_t size() const { return m_data.size(); }
+    T *data() { return m_data.data(); }
+    const T *data() const { return m_data.data(); }
+    auto begin() { return m_data.begin(); }
+    auto end() { return m_data.end(); }
+    auto begin() const { return m_data.begin(); }
+    auto end() const { return m_data.end(); }
+
+    T &operator[](const std::size_t i) { return m_data[i]; }
+    const T &operator[](const std::size_t i) const { return m_data[i]; }
+
+    slice_array<T> operator[](const slice s) { return slice_array<T>(data(), s); }
+    slice_array<const T> operator[](const slice s) const { return slice_array<const T>(data(), s); }
+
+    template <mask_expression M>
+    mask_array<T, M> operator[](const M &mask) { return mask_array<T, M>(*this, mask); }
+
+    T sum() const { return expr::sum(*this); }
+    T min() const { return expr::min(*this); }
+    T max() const { return expr::max(*this); }
+
+    // the expression interface: the loads of an assignment start at multiples of the width, aligned
+    simd_t<T> load(const std::size_t i) const { return simd_t<T>(data() + i, stdx::vector_aligned); }
+};
+
+template <typename T>
+array_ref<T>::array_ref(const array<T> &a) : m_data{a.data()}, m_size{a.size()} {}
+
+template <typename T>
+template <expression E>
+const slice_array<T> &slice_array<T>::operator=(const E &e) const {
+    if (e.size() != size()) {
+        throw std::invalid_argument("expr: assignment to a slice of a different size");
+    }
+    detail::evaluate(*this, e, 0, size());
+    return *this;
+}
+
+template <typename T, typename M>
+template <expression E>
+const mask_array<T, M> &mask_array<T, M>::operator=(const E &e) const {
+    if (e.size() != size()) {
+        throw std::invalid_argument("expr: assignment to a mask_array of a different size");
+    }
+    detail::evaluate(*this, e, 0, size());
+    return *this;
+}
+
+// y = e on the execution policy, y takes the size of e
+template <typename Policy, typename T, expression E>
+    requires std::is_execution_policy_v<std::remove_cvref_t<Policy>>
+void assign(Policy &&policy, array<T> &y, const E &e) {
+    if (y.size() != e.size()) {
+        y = array<T>(e.size());
+    }
+    detail::evaluate(std::forward<Policy>(policy), y, e);
+}
+
+}  // namespace expr
+
+#endif
+
+/*****
+    END OF FILE
+********/
@@ -5,12 +5,13 @@
 
 #include <iostream>
 #include <filesystem>
-#include <fstream>
-#include <sstream>
+#include <string_view>
 
 #include <thread>
 #include <chrono>
 
+#include "mapped_file.hpp"
+
 bool readFile(const std::filesystem::path filepath) {
 
     if(filepath.empty()) {
@@ -18,13 +19,14 @@ bool readFile(const std::filesystem::path filepath) {
         return false;
     }
 
-    std::ifstream ifs(filepath);
-    auto fsize =  std::filesystem::file_size(filepath);
-    std::string buffer(fsize, 0);
-    //std::clog << "file size is " << fsize << '\n';
-
-    while(ifs.read(buffer.data(), buffer.size())) {
-        std::clog << buffer;
+    // the file mapped, not copied into a string: see mapped_file.hpp
+    try {
+        const mapped_file file(filepath);
+        const std::string_view contents = file.view();
+        std::clog.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    } catch(const std::filesystem::filesystem_error & fexp) {
+        std::clog << "cannot read " << filepath << ": " << fexp.code().message() << '\n';
+        return false;
     }
     std::clog << '\n';
 
@@ -0,0 +1,284 @@
+/***************
+    file_follower: a growing file copied to a descriptor as it grows, like tail -F (Linux)
+
+        file_follower follower(path);
+        follower.follow(STDOUT_FILENO, stop);   -> until stop is set by a SIGINT or SIGTERM handler
+
+    -> one buffer of buffer_size bytes (1 MiB by default) for the whole run: every read() fills it,
+       one write() ships it, nothing is copied in between and nothing else grows with the file;
+       a log of many GB is shipped in the memory of a small one
+    -> no polling: an inotify watch on the file (IN_MODIFY) and one on its directory (IN_CREATE,
+       IN_MOVED_TO of its name); between two changes the process sleeps in ppoll(), with a timeout
+       only while rotated files are kept open
+    -> rotation: when the name points to another file (mv app.log app.log.1, a new app.log), the
+       rest of the old file is shipped, then the new one from its start; a missing file is waited for
+    -> a rotated file stays open and watched: what its writer appends until it reopens the name
+       (logrotate create, then a HUP) is shipped as well, until it was idle for grace (5 s by default),
+       every rotated file on its own; while several files are written their chunks may alternate
+       in the output
+    -> truncation: a file shorter than what was read (truncate, > app.log) is shipped again from
+       its start; like tail, a copytruncate rotation may lose the lines written between the copy
+       and the truncation
+    -> the file is read from its start: a sidecar ships the whole log, not its last lines
+    -> SIGINT and SIGTERM are blocked between the test of stop and ppoll(), which unblocks them
+       atomically: a stop request never waits for the next change of the file
+
+ ****************/
+
+#ifndef FILE_FOLLOWER_HPP
+#define FILE_FOLLOWER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class file_follower {
+public:
+    struct statistics {
+        std::uint64_t bytes{0};
+        std::uint64_t reads{0};
+        std::uint64_t wakeups{0};
+        std::uint64_t rotations{0};
+        std::uint64_t truncations{0};
+        std::uint64_t rotated_bytes{0};     // read from a rotated file after the switch to the new one
+    };
+
+    explicit file_follower(const std::filesystem::path & path, const std::size_t buffer_size = 1 << 20,
+                           const std::chrono::milliseconds grace = std::chrono::seconds(5))
+        : m_path{std::filesystem::absolute(path)}, m_name{m_path.filename().string()},
+          m_buffer{new char[buffer_size]}, m_buffer_size{buffer_size}, m_grace{grace},
+          m_inotify{::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)} {
+        if(m_inotify < 0) {
+            throw std::system_error(errno, std::generic_category(), "file_follower: inotify_init1");
+        }
+        if(::inotify_add_watch(m_inotify, m_path.parent_path().c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+            const int error = errno;
+            ::close(m_inotify);
+            throw std::system_error(error, std::generic_category(), "file_follower: cannot watch " + m_path.parent_path().string());
+        }
+        open_file();
+    }
+
+    ~file_follower() {
+        if(m_fd >= 0) {
+            ::close(m_fd);
+        }
+        for(const rotated_file & rotated : m_rotated) {
+            ::close(rotated.fd);
+        }
+        ::close(m_inotify);
+    }
+
+    file_follower(const file_follower &) = delete;
+    file_follower & operator=(const file_follower &) = delete;
+
+    // ships the file to out_fd and waits for more, until stop
+    void follow(const int out_fd, const volatile std::sig_atomic_t & stop) {
+        while(!stop) {
+            drain(out_fd, stop);
+            if(!wait(stop)) {
+                break;
+            }
+        }
+    }
+
+    const statistics & stats() const { return m_stats; }
+
+private:
+    // everything readable now to out_fd, then the checks for truncation and rotation
+    void drain(const int out_fd, const volatile std::sig_atomic_t & stop) {
+        drain_rotated(out_fd, stop);
+        if(m_fd < 0 && !open_file()) {
+            return;
+        }
+        m_offset += copy(m_fd, out_fd, stop);
+
+        struct stat opened{};
+        if(::fstat(m_fd, &opened) == 0 && opened.st_size < m_offset) {
+            ++m_stats.truncations;
+            ::lseek(m_fd, 0, SEEK_SET);
+            m_offset = copy(m_fd, out_fd, stop);
+        }
+
+        struct stat named;
+        if(::stat(m_path.c_str(), &named) == 0 && (named.st_ino != opened.st_ino || named.st_dev != opened.st_dev)) {
+            ++m_stats.rotations;
+            rotate(out_fd, stop);
+            if(open_file()) {
+                m_offset += copy(m_fd, out_fd, stop);
+            }
+        }
+    }
+
+    // the old file becomes a rotated one: read once more for what was written since the copy
+    // before the check, then kept open for its writer
+    void rotate(const int out_fd, const volatile std::sig_atomic_t & stop) {
+        m_rotated.push_back({m_fd, m_watch, std::chrono::steady_clock::now() + m_grace});
+        m_fd = -1;
+        m_watch = -1;
+        m_stats.rotated_bytes += static_cast<std::uint64_t>(copy(m_rotated.back().fd, out_fd, stop));
+    }
+
+    // what the writers of the rotated files appended; each is closed after grace without new data
+    void drain_rotated(const int out_fd, const volatile std::sig_atomic_t & stop) {
+        const auto now = std::chrono::steady_clock::now();
+        for(auto rotated = m_rotated.begin(); rotated != m_rotated.end();) {
+            const off_t bytes = copy(rotated->fd, out_fd, stop);
+            m_stats.rotated_bytes += static_cast<std::uint64_t>(bytes);
+            if(bytes > 0) {
+                rotated->until = now + m_grace;
+            } else if(now >= rotated->until) {
+                ::inotify_rm_watch(m_inotify, rotated->watch);
+                ::close(rotated->fd);
+                rotated = m_rotated.erase(rotated);
+                continue;
+            }
+            ++rotated;
+        }
+    }
+
+    // the bytes copied from in_fd until its end
+    off_t copy(const int in_fd, const int out_fd, const volatile std::sig_atomic_t & stop) {
+        off_t copied = 0;
+        while(!stop) {
+            const ssize_t bytes = ::read(in_fd, m_buffer.get(), m_buffer_size);
+            if(bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if(bytes < 0) {
+                throw std::system_error(errno, std::generic_category(), "file_follower: read " + m_path.string());
+            }
+            if(bytes == 0) {
+                break;
+            }
+            ++m_stats.reads;
+            copied += bytes;
+            write_all(out_fd, static_cast<std::size_t>(bytes));
+        }
+        return copied;
+    }
+
+    // one write() of the whole chunk, more only when the output takes it in parts (a pipe)
+    void write_all(const int out_fd, const std::size_t size) {
+        for(std::size_t written = 0; written < size;) {
+            const ssize_t bytes = ::write(out_fd, m_buffer.get() + written, size - written);
+            if(bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if(bytes < 0) {
+                throw std::system_error(errno, std::generic_category(), "file_follower: write");
+            }
+            written += static_cast<std::size_t>(bytes);
+            m_stats.bytes += static_cast<std::uint64_t>(bytes);
+        }
+    }
+
+    // sleeps until the file, a rotated file or the name changes, or the grace of a rotated file
+    // ends; false when a stop signal arrived
+    bool wait(const volatile std::sig_atomic_t & stop) {
+        sigset_t stop_signals, unblocked;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        ::sigprocmask(SIG_BLOCK, &stop_signals, &unblocked);
+
+        bool changed = false;
+        while(!stop && !changed) {
+            pollfd descriptor{m_inotify, POLLIN, 0};
+            timespec timeout{};
+            if(!m_rotated.empty()) {
+                auto until = m_rotated.front().until;
+                for(const rotated_file & rotated : m_rotated) {
+                    until = std::min(until, rotated.until);
+                }
+                const auto left = std::max(std::chrono::nanoseconds::zero(), until - std::chrono::steady_clock::now());
+                timeout.tv_sec = static_cast<time_t>(left.count() / 1'000'000'000);
+                timeout.tv_nsec = static_cast<long>(left.count() % 1'000'000'000);
+            }
+            const int ready = ::ppoll(&descriptor, 1, m_rotated.empty() ? nullptr : &timeout, &unblocked);
+            if(ready < 0 && errno == EINTR) {
+                continue;       // the loop tests stop
+            }
+            if(ready < 0) {
+                const int error = errno;
+                ::sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+                throw std::system_error(error, std::generic_category(), "file_follower: ppoll");
+            }
+            if(ready == 0) {
+                changed = true;     // a grace ended: drain() closes the rotated file
+                break;
+            }
+            // the events only wake up: drain() looks at the file itself; those of other names are ignored
+            alignas(inotify_event) char events[4096];
+            ssize_t bytes;
+            while((bytes = ::read(m_inotify, events, sizeof(events))) > 0) {
+                for(ssize_t offset = 0; offset < bytes;) {
+                    const auto * event = reinterpret_cast<const inotify_event *>(events + offset);
+                    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                    changed = changed || event->wd == m_watch || (event->len > 0 && m_name == event->name) ||
+                              (event->mask & IN_Q_OVERFLOW) || is_rotated_watch(event->wd);
+                }
+            }
+        }
+        ::sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+        if(changed) {
+            ++m_stats.wakeups;
+        }
+        return changed;
+    }
+
+    bool open_file() {
+        m_fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(m_fd < 0) {
+            return false;
+        }
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        m_offset = 0;
+        // through the descriptor: the file opened, even when the name was replaced meanwhile
+        const std::string opened = "/proc/self/fd/" + std::to_string(m_fd);
+        m_watch = ::inotify_add_watch(m_inotify, opened.c_str(), IN_MODIFY);
+        return true;
+    }
+
+    bool is_rotated_watch(const int watch) const {
+        return std::any_of(m_rotated.begin(), m_rotated.end(), [watch](const rotated_file & rotated) { return rotated.watch == watch; });
+    }
+
+    std::filesystem::path m_path;
+    std::string m_name;
+    std::unique_ptr<char[]> m_buffer;
+    std::size_t m_buffer_size;
+    std::chrono::milliseconds m_grace;
+    int m_inotify;
+    int m_fd{-1};
+    int m_watch{-1};
+    off_t m_offset{0};
+    struct rotated_file {
+        int fd;
+        int watch;
+        std::chrono::steady_clock::time_point until;    // closed when idle until then
+    };
+    std::vector<rotated_file> m_rotated;
+    statistics m_stats;
+};
+
+#endif
+
+/*******
+    END OF FILE
+ *****/
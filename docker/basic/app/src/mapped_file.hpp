@@ -0,0 +1,171 @@
+/***************
+    mapped_file: the contents of a file as read-only memory, without copying them (Linux)
+
+    std::ifstream into a std::string sized by file_size: the string is allocated and zero-filled,
+    then the kernel copies the file from the page cache into it (through the stream buffer for
+    small reads); the process holds a second copy of the whole file.
+    mmap: the pages of the page cache are mapped into the process, nothing is copied and nothing
+    is allocated; the memory is given back by the kernel when it needs it, the file is its backing.
+
+        const mapped_file file(path);
+        file.view()         -> std::string_view of the contents
+        file.bytes()        -> std::span<const std::byte> of the contents
+        file.mapped()       -> false when the contents were read into a buffer (see below)
+
+    options
+        sequential      madvise(MADV_SEQUENTIAL): a larger read-ahead, pages read are dropped first
+        willneed        madvise(MADV_WILLNEED): the read-ahead of the whole file starts at once
+        populate        MAP_POPULATE: the whole file read and the page tables filled by mmap itself,
+                        no page fault while reading; mmap returns when the file is in memory
+        huge_pages      madvise(MADV_HUGEPAGE): 2 MiB mappings where the kernel can make them
+                        (file systems with large folios, CONFIG_READ_ONLY_THP_FOR_FS), a hint only
+
+    Pipes, terminals, character devices, files of /proc and /sys (their size is 0) and files the
+    file system cannot map are read with read() into a buffer the object owns: the same interface.
+
+    A mapping sees the file as it is: a file truncated by another process while mapped raises
+    SIGBUS on access past its new end. For files rewritten in place while they are read, copy.
+
+ ****************/
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class mapped_file {
+public:
+    struct options {
+        bool sequential{true};
+        bool willneed{true};
+        bool populate{false};
+        bool huge_pages{false};
+    };
+
+    explicit mapped_file(const std::filesystem::path & path) : mapped_file(path, options{}) {}
+
+    mapped_file(const std::filesystem::path & path, const options opts) {
+        const descriptor fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+        if(fd.value < 0) {
+            throw std::filesystem::filesystem_error("mapped_file: cannot open", path, std::error_code(errno, std::generic_category()));
+        }
+
+        struct stat st{};
+        if(::fstat(fd.value, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            m_size = static_cast<std::size_t>(st.st_size);
+            const int flags = MAP_PRIVATE | (opts.populate ? MAP_POPULATE : 0);
+            void * const data = ::mmap(nullptr, m_size, PROT_READ, flags, fd.value, 0);
+            if(data != MAP_FAILED) {
+                m_data = static_cast<const char *>(data);
+                m_mapped = true;
+                // hints: a kernel that does not know one ignores it, the mapping works the same
+                if(opts.huge_pages) {
+                    ::madvise(data, m_size, MADV_HUGEPAGE);
+                }
+                if(opts.sequential) {
+                    ::madvise(data, m_size, MADV_SEQUENTIAL);
+                }
+                if(opts.willneed && !opts.populate) {
+                    ::madvise(data, m_size, MADV_WILLNEED);
+                }
+                return;
+            }
+        }
+        read_all(fd.value, path, S_ISREG(st.st_mode) ? static_cast<std::size_t>(st.st_size) : 0);
+    }
+
+    ~mapped_file() { release(); }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    mapped_file(mapped_file && other) noexcept
+        : m_data{std::exchange(other.m_data, nullptr)}, m_size{std::exchange(other.m_size, 0)},
+          m_mapped{std::exchange(other.m_mapped, false)}, m_buffer{std::move(other.m_buffer)} {}
+
+    mapped_file & operator=(mapped_file && other) noexcept {
+        if(this != &other) {
+            release();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_mapped = std::exchange(other.m_mapped, false);
+            m_buffer = std::move(other.m_buffer);
+        }
+        return *this;
+    }
+
+    std::string_view view() const noexcept { return {m_data, m_size}; }
+    std::span<const std::byte> bytes() const noexcept { return {reinterpret_cast<const std::byte *>(m_data), m_size}; }
+    std::size_t size() const noexcept { return m_size; }
+    bool empty() const noexcept { return m_size == 0; }
+    bool mapped() const noexcept { return m_mapped; }
+
+private:
+    struct descriptor {
+        int value;
+        ~descriptor() {
+            if(value >= 0) {
+                ::close(value);
+            }
+        }
+    };
+
+    // the fallback: read() until the end, size_hint bytes at first when the size is known
+    void read_all(const int fd, const std::filesystem::path & path, const std::size_t size_hint) {
+        m_buffer.resize(size_hint > 0 ? size_hint : 64 * 1024);
+        std::size_t used = 0;
+        for(;;) {
+            // a known size takes one more read() that returns 0, a pipe doubles the buffer
+            if(used == m_buffer.size()) {
+                m_buffer.resize(used == size_hint ? used + 4096 : used * 2);
+            }
+            const ssize_t bytes = ::read(fd, m_buffer.data() + used, m_buffer.size() - used);
+            if(bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if(bytes < 0) {
+                throw std::filesystem::filesystem_error("mapped_file: cannot read", path, std::error_code(errno, std::generic_category()));
+            }
+            if(bytes == 0) {
+                break;
+            }
+            used += static_cast<std::size_t>(bytes);
+        }
+        m_buffer.resize(used);
+        m_data = m_buffer.data();
+        m_size = used;
+    }
+
+    void release() noexcept {
+        if(m_mapped) {
+            ::munmap(const_cast<char *>(m_data), m_size);
+        }
+        m_mapped = false;
+        m_data = nullptr;
+        m_size = 0;
+        m_buffer.clear();
+    }
+
+    const char * m_data{nullptr};
+    std::size_t m_size{0};
+    bool m_mapped{false};
+    std::vector<char> m_buffer;
+};
+
+#endif
+
+/*******
+    END OF FILE
+ *****/
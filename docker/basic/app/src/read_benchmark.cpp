@@ -0,0 +1,198 @@
+/***************
+    This source code measures the ways to read a whole file into memory, see mapped_file.hpp.
+
+    Every way reads the file and counts its lines (memchr), so every byte is touched once:
+        ifstream + string       readFile before mapped_file: a string of file_size bytes, one read
+        istreambuf_iterator     parseJsonFile of libraries/rapidjson before mapped_file: a string
+                                grown character by character
+        read() into vector      one copy from the page cache, no stream
+        mapped_file             the default options: sequential, willneed
+        mapped_file populate    MAP_POPULATE: no page faults
+        mapped_file huge pages  madvise(MADV_HUGEPAGE) besides the default options
+
+    Usage:
+        make -f Makefile_read_benchmark
+        ./bin/read_benchmark <file> [size_mb] [cold]
+            creates <file> of size_mb (2048 by default) lines of json when it does not exist;
+            cold: drops the page cache before every way (root only), else the file is cached
+
+ ****************/
+
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+// the lines of the contents, the work of a parser that looks at every byte
+std::size_t countLines(const std::string_view contents) {
+    std::size_t lines = 0;
+    const char * pos = contents.data();
+    const char * const end = contents.data() + contents.size();
+    while((pos = static_cast<const char *>(std::memchr(pos, '\n', static_cast<std::size_t>(end - pos)))) != nullptr) {
+        ++lines;
+        ++pos;
+    }
+    return lines;
+}
+
+std::size_t viaIfstream(const std::filesystem::path & filepath) {
+    std::ifstream ifs(filepath, std::ios::binary);
+    std::string buffer(std::filesystem::file_size(filepath), 0);
+    ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    return countLines(buffer);
+}
+
+std::size_t viaStreambufIterator(const std::filesystem::path & filepath) {
+    std::ifstream ifs(filepath, std::ios::binary);
+    std::istreambuf_iterator<char> begin(ifs), end;
+    const std::string buffer(begin, end);
+    return countLines(buffer);
+}
+
+std::size_t viaRead(const std::filesystem::path & filepath) {
+    std::vector<char> buffer(std::filesystem::file_size(filepath));
+    const int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    std::size_t used = 0;
+    while(used < buffer.size()) {
+        const ssize_t bytes = ::read(fd, buffer.data() + used, buffer.size() - used);
+        if(bytes <= 0) {
+            break;
+        }
+        used += static_cast<std::size_t>(bytes);
+    }
+    ::close(fd);
+    return countLines({buffer.data(), used});
+}
+
+std::size_t viaMappedFile(const std::filesystem::path & filepath, const mapped_file::options opts) {
+    const mapped_file file(filepath, opts);
+    return countLines(file.view());
+}
+
+void createFile(const std::filesystem::path & filepath, const std::size_t size_mb) {
+    std::ofstream ofs(filepath, std::ios::binary);
+    const std::size_t size = size_mb << 20;
+    std::string line;
+    for(std::size_t written = 0, id = 0; written < size; written += line.size(), ++id) {
+        line = "{\"id\":" + std::to_string(id) + ",\"name\":\"item" + std::to_string(id) + "\",\"value\":" +
+               std::to_string(static_cast<double>(id % 1000) / 8) + ",\"tags\":[\"a\",\"b\"]}\n";
+        ofs << line;
+    }
+}
+
+bool dropCaches() {
+    ::sync();
+    std::ofstream ofs("/proc/sys/vm/drop_caches");
+    ofs << "1\n";
+    return static_cast<bool>(ofs.flush());
+}
+
+template <typename Read>
+void measure(const char * name, const std::filesystem::path & filepath, const bool cold, Read read) {
+    if(cold && !dropCaches()) {
+        std::clog << "cannot drop the page cache (root only)\n";
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const std::size_t lines = read(filepath);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double gb = static_cast<double>(std::filesystem::file_size(filepath)) / 1e9;
+    std::clog << std::setw(24) << std::left << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(8) << seconds << " s " << std::setw(7) << std::setprecision(2) << gb / seconds
+              << " GB/s  " << lines << " lines\n";
+}
+
+int main(const int argc, const char * const argv[]) {
+
+    if(2 > argc || 4 < argc) {
+        std::clog << "Usage: bin <file> [size_mb] [cold]\n";
+        return 1;
+    }
+
+    const std::filesystem::path filepath(argv[1]);
+    const std::size_t size_mb = (3 <= argc) ? std::stoul(argv[2]) : 2048;
+    const bool cold = (4 == argc) && std::string_view(argv[3]) == "cold";
+
+    if(!std::filesystem::exists(filepath)) {
+        createFile(filepath, size_mb);
+    }
+    std::clog << filepath.string() << ": " << std::filesystem::file_size(filepath) << " bytes, "
+              << (cold ? "page cache dropped before every way\n" : "in the page cache\n");
+    // the first read brings a warm file into the page cache
+    if(!cold) {
+        viaRead(filepath);
+    }
+
+    measure("ifstream + string", filepath, cold, viaIfstream);
+    measure("istreambuf_iterator", filepath, cold, viaStreambufIterator);
+    measure("read() into vector", filepath, cold, viaRead);
+    measure("mapped_file", filepath, cold, [](const std::filesystem::path & p) { return viaMappedFile(p, {}); });
+    measure("mapped_file populate", filepath, cold, [](const std::filesystem::path & p) {
+        mapped_file::options opts;
+        opts.populate = true;
+        return viaMappedFile(p, opts);
+    });
+    measure("mapped_file huge pages", filepath, cold, [](const std::filesystem::path & p) {
+        mapped_file::options opts;
+        opts.huge_pages = true;
+        return viaMappedFile(p, opts);
+    });
+
+    return 0;
+}
+
+
+/*******
+    Explanation
+
+    A file of 2 GiB, 29.7 million lines of json, on a machine of 5 GB and one core.
+
+    In the page cache the copies are the cost, not the disk:
+        ifstream + string and read() copy 2 GiB into fresh memory: 2.6 to 3.1 s, 0.7 to 0.8 GB/s;
+        the string (vector) is zero-filled first and every new page is a page fault
+        istreambuf_iterator grows the string a character at a time: 13.5 s, 0.16 GB/s
+        mapped_file maps the pages of the cache: 0.57 s, 3.8 GB/s, the time of the line count
+        itself; no memory is allocated, the process does not hold a second copy of 2 GiB
+    populate and huge pages change nothing here: the kernel maps the cached pages in large steps
+    (fault-around) either way.
+
+    From the disk (page cache dropped before every way):
+        the copies 3.6 s, mapped_file 2.7 s, populate 2.0 to 2.5 s, huge pages 1.5 to 1.9 s:
+        with MADV_HUGEPAGE the read-ahead fills the page cache with 2 MiB folios (FileHugePages
+        rose to 2 GB in /proc/meminfo), fewer and larger reads of the disk.
+    The istreambuf_iterator of parseJsonFile is the slowest way on both: a dump of 2 GiB spent
+    13 s before rapidjson saw its first byte.
+
+    Output (make -f Makefile_read_benchmark, ./bin/read_benchmark /tmp/rfb/d.json 2048 [cold] on a single core machine)
+
+/tmp/rfb/d.json: 2147483666 bytes, in the page cache
+ifstream + string          2.647 s    0.81 GB/s  29673222 lines
+istreambuf_iterator       13.538 s    0.16 GB/s  29673222 lines
+read() into vector         3.124 s    0.69 GB/s  29673222 lines
+mapped_file                0.570 s    3.77 GB/s  29673222 lines
+mapped_file populate       0.565 s    3.80 GB/s  29673222 lines
+mapped_file huge pages     0.584 s    3.68 GB/s  29673222 lines
+
+/tmp/rfb/d.json: 2147483666 bytes, page cache dropped before every way
+ifstream + string          3.669 s    0.59 GB/s  29673222 lines
+istreambuf_iterator       14.350 s    0.15 GB/s  29673222 lines
+read() into vector         3.614 s    0.59 GB/s  29673222 lines
+mapped_file                2.733 s    0.79 GB/s  29673222 lines
+mapped_file populate       2.031 s    1.06 GB/s  29673222 lines
+mapped_file huge pages     1.461 s    1.47 GB/s  29673222 lines
+ *****/
+
+
+/*******
+    END OF FILE
+ *****/
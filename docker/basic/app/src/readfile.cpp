@@ -1,15 +1,25 @@
 /***************
     This source code is to read a file which path is paased as an argument.
+
+    --follow: the file is shipped to stdout as it grows, rotations and truncations included, through
+    a buffer of 1 MiB whatever its size (file_follower.hpp); the statistics go to clog at the end.
  
  ****************/
 
 #include <iostream>
 #include <filesystem>
-#include <fstream>
-#include <sstream>
+#include <string_view>
 
 #include <thread>
 #include <chrono>
+#include <csignal>
+#include <system_error>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+#include "file_follower.hpp"
 
 bool readFile(const std::filesystem::path filepath) {
 
@@ -18,23 +28,65 @@ bool readFile(const std::filesystem::path filepath) {
         return false;
     }
 
-    std::ifstream ifs(filepath);
-    auto fsize =  std::filesystem::file_size(filepath);
-    std::string buffer(fsize, 0);
-    //std::clog << "file size is " << fsize << '\n';
-
-    while(ifs.read(buffer.data(), buffer.size())) {
-        std::clog << buffer;
+    // the file mapped, not copied into a string: see mapped_file.hpp
+    try {
+        const mapped_file file(filepath);
+        const std::string_view contents = file.view();
+        std::clog.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    } catch(const std::filesystem::filesystem_error & fexp) {
+        std::clog << "cannot read " << filepath << ": " << fexp.code().message() << '\n';
+        return false;
     }
     std::clog << '\n';
 
     return true;
 }
 
+volatile std::sig_atomic_t stop_requested = 0;
+
+extern "C" void requestStop(int) {
+    stop_requested = 1;
+}
+
+// ships the file to stdout as it grows, through one buffer of 1 MiB, until SIGINT or SIGTERM
+bool followFile(const std::filesystem::path filepath) {
+
+    struct sigaction action{};
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        file_follower follower(filepath);
+        follower.follow(STDOUT_FILENO, stop_requested);
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const file_follower::statistics & stats = follower.stats();
+        struct rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        std::clog << "shipped " << stats.bytes << " bytes in " << seconds << " s, "
+                  << static_cast<double>(stats.bytes) / 1e6 / seconds << " MB/s, " << stats.reads << " reads, "
+                  << stats.wakeups << " wakeups, " << stats.rotations << " rotations (" << stats.rotated_bytes
+                  << " bytes after the switch), " << stats.truncations << " truncations, max RSS " << usage.ru_maxrss << " KiB\n";
+    } catch(const std::system_error & exp) {
+        std::clog << exp.what() << '\n';
+        return false;
+    }
+
+    return true;
+}
+
 int main(const int argc, const char * const argv[]) {
 
+    if(3 == argc && std::string_view(argv[1]) == "--follow") {
+        return followFile(argv[2]) ? 0 : 1;
+    }
+
     if(2 != argc) {
-        std::clog << "Usage: bin <filepath_to_read>\n";
+        std::clog << "Usage: bin <filepath_to_read>\n"
+                  << "       bin --follow <filepath_to_follow>    (to stdout, like tail -F, until SIGINT or SIGTERM)\n";
         return 1;
     }
 
@@ -49,6 +101,34 @@ int main(const int argc, const char * const argv[]) {
 }
 
 
+/*******
+    Explanation
+
+    bin/readfile --follow, built with g++ -O2 -std=c++20 (the Makefile adds -fsanitize=address,
+    whose shadow memory would hide the footprint), on a single core machine:
+
+    catch-up    a log of 4 GiB already on disk (page cache dropped), shipped to /dev/null:
+                1.46 GB/s, 4096 reads of 1 MiB
+    live        4 GiB appended by yes | head -c 1G four times, mv app.log app.log.N after each GiB,
+                shipped to a file on the same disk while it was written: 312 MB/s with the writer
+                on the same core, one wakeup per write of the writer, the 3 rotations followed and
+                cat app.log.1 app.log.2 app.log.3 app.log | cmp - out equal
+    rotation    a writer keeps app.log open (exec 3>>app.log), mv app.log app.log.1, a new app.log,
+                then x and, a second later, y written to the old file through fd 3, the way an
+                application writes until logrotate's HUP makes it reopen the name: both are shipped
+                (4 bytes after the switch), a z written after the grace of 5 s is not; then
+                : > app.log, a truncation, and the new line shipped from the start
+    memory      max RSS 4.6 MiB for 4 GiB, 3.1 MiB for a log of a few lines: the buffer of 1 MiB and
+                the C++ runtime, nothing that grows with the file. readFile before mapped_file held a
+                string of the whole file.
+
+    Output (the statistics of bin/readfile --follow on clog at SIGINT / SIGTERM)
+
+shipped 4294967296 bytes in 2.93728 s, 1462.23 MB/s, 4096 reads, 0 wakeups, 0 rotations (0 bytes after the switch), 0 truncations, max RSS 4656 KiB
+shipped 4294967296 bytes in 13.7571 s, 312.199 MB/s, 204893 reads, 204345 wakeups, 3 rotations (0 bytes after the switch), 0 truncations, max RSS 4628 KiB
+shipped 21 bytes in 9.30541 s, 2.25675e-06 MB/s, 6 reads, 8 wakeups, 1 rotations (4 bytes after the switch), 1 truncations, max RSS 3196 KiB
+ *****/
+
 /*******
     END OF FILE
  *****/
@@ -5,12 +5,13 @@
 
 #include <iostream>
 #include <filesystem>
-#include <string>
-#include <fstream>
+#include <string_view>
 
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
 
+#include "mapped_file.hpp"
+
 bool printJsonObject(const rapidjson::Value & obj);
 
 bool printJsonArray(const rapidjson::Value & arr) {
@@ -100,10 +101,11 @@ bool printJsonObject(const rapidjson::Value & obj) {
     return true;
 }
 
-bool parseJsonString(const std::string & str_data) {
+bool parseJsonString(const std::string_view str_data) {
     rapidjson::Document json_doc;
 
-    if(json_doc.Parse(str_data.c_str()).HasParseError()) {
+    // the length given: the data need not end with '\0', a mapped file is parsed in place
+    if(json_doc.Parse(str_data.data(), str_data.size()).HasParseError()) {
         std::clog << "Json parsing error\n";
         return false;
     } 
@@ -117,11 +119,14 @@ bool parseJsonString(const std::string & str_data) {
 
 bool parseJsonFile(const std::filesystem::path filepath) {
 
-    std::ifstream ifs(filepath);
-    std::istreambuf_iterator<char> begin(ifs), end;
-
-    const std::string json_str(begin, end);
-    if(!parseJsonString(json_str)) {
+    // mapped, not copied into a string character by character: see mapped_file.hpp
+    try {
+        const mapped_file json_file(filepath);
+        if(!parseJsonString(json_file.view())) {
+            return false;
+        }
+    } catch(const std::filesystem::filesystem_error & fexp) {
+        std::clog << "cannot read " << filepath << ": " << fexp.code().message() << '\n';
         return false;
     }
 